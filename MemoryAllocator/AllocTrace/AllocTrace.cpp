@@ -0,0 +1,107 @@
+#include "AllocTrace.h"
+#include "../VirtualMemory/VirtualMemory.h"
+#include <string.h>
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+
+/* Stop() moves the record count here, far beyond any capacity, so late threads drop their records */
+static const size_t TRACE_STOPPED_RECORD_NUM = SIZE_MAX / 2;
+
+
+bool AllocTrace::Start(const char* path, size_t maxRecordNum)
+{
+	if (path == nullptr || strlen(path) >= TRACE_MAX_PATH_LENGTH || maxRecordNum == 0 ||
+		maxRecordNum > (SIZE_MAX - sizeof(TraceHeader)) / sizeof(TraceRecord))
+		return false;
+
+	this->lock.Lock();
+	if (this->enabled)
+	{
+		this->lock.Unlock();
+		return false;
+	}
+
+	size_t mappedSize = sizeof(TraceHeader) + maxRecordNum * sizeof(TraceRecord);
+	void* addr = MapFile(path, mappedSize);
+	if (addr == nullptr)
+	{
+		this->lock.Unlock();
+		return false;
+	}
+
+	memcpy(this->path, path, strlen(path) + 1);
+	this->header = static_cast<TraceHeader*>(addr);
+	this->header->magic = TRACE_FILE_MAGIC;
+	this->header->version = TRACE_FILE_VERSION;
+	this->header->recordSize = sizeof(TraceRecord);
+	this->records = static_cast<TraceRecord*>(PointerAdd(addr, sizeof(TraceHeader)));
+	this->mappedSize = mappedSize;
+	this->beginTime = GetTraceTime();
+	AtomicStore(&this->maxRecordNum, maxRecordNum);
+
+	/* Threads only write a record once they reserve an index below the capacity, which is after this */
+	AtomicStore(&this->recordNum, static_cast<size_t>(0));
+	AtomicStore(&this->enabled, true);
+	this->lock.Unlock();
+	return true;
+}
+
+
+bool AllocTrace::Stop()
+{
+	this->lock.Lock();
+	if (!this->enabled)
+	{
+		this->lock.Unlock();
+		return false;
+	}
+
+	AtomicStore(&this->enabled, false);
+	size_t recordNum = AtomicExchange(&this->recordNum, TRACE_STOPPED_RECORD_NUM);
+	size_t droppedRecordNum = 0;
+	if (recordNum > this->maxRecordNum)
+	{
+		droppedRecordNum = recordNum - this->maxRecordNum;
+		recordNum = this->maxRecordNum;
+	}
+
+	/* Threads that reserved a record before may still be writing it */
+	for (size_t i = 0; i < recordNum; i++)
+	{
+		uint32_t spinCount = 0;
+		while (AtomicLoad(&this->records[i].op) == TRACE_OP_NONE)
+			SpinWait(spinCount);
+	}
+
+	this->header->recordNum = recordNum;
+	this->header->droppedRecordNum = droppedRecordNum;
+	bool success = UnmapFile(this->header, this->mappedSize, this->path, sizeof(TraceHeader) + recordNum * sizeof(TraceRecord));
+	this->header = nullptr;
+	this->records = nullptr;
+	this->lock.Unlock();
+	return success;
+}
+
+
+uint64_t GetTraceTime()
+{
+#if defined(_WIN32)
+	static LARGE_INTEGER frequency;
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	uint64_t seconds = static_cast<uint64_t>(counter.QuadPart / frequency.QuadPart);
+	uint64_t rest = static_cast<uint64_t>(counter.QuadPart % frequency.QuadPart);
+	return seconds * 1000000000ull + rest * 1000000000ull / static_cast<uint64_t>(frequency.QuadPart);
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+#endif
+}
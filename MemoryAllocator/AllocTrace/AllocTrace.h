@@ -0,0 +1,127 @@
+#pragma once
+#include <stdint.h>
+#include "../Utility/Atomic.h"
+#include "../Utility/Utility.h"
+
+
+using namespace Utility;
+
+
+/* The operations of trace records. A record of TRACE_OP_NONE is empty */
+const uint32_t TRACE_OP_NONE = 0;
+const uint32_t TRACE_OP_ALLOC = 1;
+const uint32_t TRACE_OP_FREE = 2;
+const uint32_t TRACE_OP_RESIZE = 3;
+const uint32_t TRACE_OP_COLLECT = 4;
+
+/* "MATRACE1" in a little endian file, and the version of the record layout */
+const uint64_t TRACE_FILE_MAGIC = 0x3145434152544D41ull;
+const uint32_t TRACE_FILE_VERSION = 1;
+
+/* The longest path of a trace file, including the terminating zero */
+const size_t TRACE_MAX_PATH_LENGTH = 260;
+
+
+/**
+* @brief A record of an allocation trace. Records are 32 bytes, so they never cross a page and two
+*		 of them share a cache line.
+*
+* @param time -- The time of the operation in nanoseconds since the trace started;
+* @param id -- The memory address of the memory block, which identifies it until it is freed. 0 for
+*		 TRACE_OP_COLLECT;
+* @param size -- The requested size of TRACE_OP_ALLOC, and the new size of TRACE_OP_RESIZE;
+* @param alignment -- The requested alignment of TRACE_OP_ALLOC, 0 if none was requested;
+* @param op -- TRACE_OP_ALLOC etc. It is written last, so a record that is not TRACE_OP_NONE is
+*		 complete;
+*/
+struct TraceRecord
+{
+	uint64_t time;
+	uint64_t id;
+	uint64_t size;
+	uint32_t alignment;
+	uint32_t op;
+};
+
+
+/**
+* @brief The header at the start of a trace file, followed by "recordNum" records in the order that
+*		 the operations were made. The header is as large as a record.
+*
+* @param magic, version -- TRACE_FILE_MAGIC and TRACE_FILE_VERSION;
+* @param recordSize -- sizeof(TraceRecord);
+* @param recordNum -- The number of records in the file;
+* @param droppedRecordNum -- The number of operations that were not recorded because the file was
+*		 full;
+*/
+struct TraceHeader
+{
+	uint64_t magic;
+	uint32_t version;
+	uint32_t recordSize;
+	uint64_t recordNum;
+	uint64_t droppedRecordNum;
+};
+
+
+/**
+* @brief AllocTrace appends a record of every allocation, free, resize and collection to a trace file
+*		 that is mapped into memory, so recording is a store into memory and the OS writes the
+*		 pages back. A thread reserves the index of its record with one atomic addition, so the
+*		 records keep the order of the operations across threads: an allocation is recorded after
+*		 it returns, and a free before the memory block is released. The file has a fixed capacity,
+*		 and operations beyond it are dropped and counted. A trace that is filled with zero is
+*		 stopped, so it can be a global variable.
+*
+* @param lock -- Serializes Start() and Stop();
+* @param enabled -- Set while the trace records;
+* @param recordNum -- The number of records reserved so far. Stop() sets it beyond "maxRecordNum",
+*		 so threads that are late do not write any more;
+* @param maxRecordNum -- The capacity of the file;
+* @param header, records -- The header and the records in the mapped file;
+* @param mappedSize -- The size of the mapped file;
+* @param beginTime -- The time when the trace started, see GetTraceTime();
+* @param path -- The path of the file;
+*/
+class AllocTrace
+{
+public:
+	SpinLock lock;
+	volatile bool enabled;
+	size_t recordNum;
+	size_t maxRecordNum;
+	TraceHeader* header;
+	TraceRecord* records;
+	size_t mappedSize;
+	uint64_t beginTime;
+	char path[TRACE_MAX_PATH_LENGTH];
+
+
+	/**
+	* @brief Create the trace file with room for "maxRecordNum" records and start recording. Return
+	*		 false if a trace is already recording, or the file can not be created.
+	*/
+	bool Start(const char* path, size_t maxRecordNum);
+
+	/**
+	* @brief Stop recording, wait for the records that are being written, and cut the file to the
+	*		 records it holds. Return false if no trace is recording.
+	*/
+	bool Stop();
+
+	/**
+	* @brief Append a record. It should only be called while "enabled" is set, but a call that races
+	*		 with Stop() is dropped safely.
+	*/
+	inline void Record(uint32_t op, const void* ptr, size_t size, size_t alignment);
+};
+
+
+/**
+* @brief A monotonic clock in nanoseconds. It is QueryPerformanceCounter() on Windows and
+*		 clock_gettime(CLOCK_MONOTONIC) on Linux.
+*/
+uint64_t GetTraceTime();
+
+
+#include "AllocTrace.inl"
@@ -0,0 +1,16 @@
+#pragma once
+
+
+inline void AllocTrace::Record(uint32_t op, const void* ptr, size_t size, size_t alignment)
+{
+	size_t idx = AtomicFetchAdd(&this->recordNum, static_cast<size_t>(1));
+	if (idx >= AtomicLoad(&this->maxRecordNum))
+		return;
+
+	TraceRecord& record = this->records[idx];
+	record.time = GetTraceTime() - this->beginTime;
+	record.id = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(ptr));
+	record.size = static_cast<uint64_t>(size);
+	record.alignment = static_cast<uint32_t>(alignment);
+	AtomicStore(&record.op, op);
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <stddef.h>
+#include "../Arena/Arena.h"
+
+
+/**
+* @brief Statistics of a size class, summed over all arenas.
+*
+* @param blockSize -- The block size of the size class;
+* @param allocCount, freeCount -- The number of memory blocks allocated and freed so far. Each
+*		 thread adds its counts in batches, so the counts of other threads may lag behind by a
+*		 few dozens;
+* @param liveBlockNum -- The number of memory blocks in use, "allocCount" minus "freeCount";
+* @param maxLiveBlockNum -- The highest "liveBlockNum" so far. Each thread keeps the peak of its
+*		 own batch, so it is exact with one thread, and an estimate when several threads allocate
+*		 from the size class at the same time;
+* @param blockNum -- The number of memory blocks that the fix size allocators have committed;
+* @param freeBlockNum -- The number of memory blocks that are free in the fix size allocators.
+*		 Memory blocks held in thread caches are not included;
+*/
+struct SizeClassStats
+{
+	size_t blockSize;
+	size_t allocCount;
+	size_t freeCount;
+	size_t liveBlockNum;
+	size_t maxLiveBlockNum;
+	size_t blockNum;
+	size_t freeBlockNum;
+};
+
+
+/**
+* @brief A snapshot of the statistics of the memory system, filled by GetAllocatorStats(). All
+*		 counters are kept up to date by the allocations and frees themselves, so taking a
+*		 snapshot does not walk any free list. The largest free block is not one of them, see
+*		 GetLargestFreeBlock(). Sizes are in bytes.
+*
+* @param sizeClasses, sizeClassNum -- The statistics of each size class;
+* @param fallThroughCount -- The number of requests that a size class fits but the dynamic
+*		 allocator served, because the size classes were full or not aligned enough;
+* @param dynamicAllocCount, dynamicFreeCount -- The number of memory blocks allocated and freed by
+*		 the dynamic allocators;
+* @param dynamicLiveSize -- The user memory of the memory blocks in use in the dynamic allocators;
+* @param dynamicMaxLiveSize -- The highest "dynamicLiveSize" so far. With several arenas it is the
+*		 sum of the highest value of each arena, which may be above the real peak;
+* @param dynamicFreeSize -- The free memory of the dynamic allocators, including the headers of
+*		 free blocks;
+* @param largeAllocCount, largeFreeCount -- The number of memory blocks mapped and unmapped by the
+*		 large allocator;
+* @param largeLiveSize, largeMaxLiveSize -- The size of the mappings of the large allocator, and its
+*		 highest value so far;
+* @param liveSize -- The memory in use in the whole memory system, the sum of the memory blocks in
+*		 use of the size classes, the dynamic allocators and the large allocator;
+*/
+struct AllocatorStats
+{
+	SizeClassStats sizeClasses[ARENA_MAX_FIX_SIZE_ALLOCATOR_NUM];
+	size_t sizeClassNum;
+	size_t fallThroughCount;
+
+	size_t dynamicAllocCount;
+	size_t dynamicFreeCount;
+	size_t dynamicLiveSize;
+	size_t dynamicMaxLiveSize;
+	size_t dynamicFreeSize;
+
+	size_t largeAllocCount;
+	size_t largeFreeCount;
+	size_t largeLiveSize;
+	size_t largeMaxLiveSize;
+
+	size_t liveSize;
+};
@@ -0,0 +1,404 @@
+#include "Arena.h"
+#include "../VirtualMemory/VirtualMemory.h"
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(__linux__)
+#include <sched.h>
+#endif
+
+
+/**
+* @brief Commit the pages that cover the memory from "beginAddr" to "endAddr", but not beyond the
+*		 memory space of the arena from "arenaBaseAddr" to "arenaEndAddr". Pages shared with 
+*		 memory that is already committed are committed again, which does nothing. See 
+*		 ARENA_PAGE_HUGE etc for "pagePolicy".
+*/
+static bool CommitArenaPages(void* beginAddr, void* endAddr, void* arenaBaseAddr, void* arenaEndAddr, unsigned int pagePolicy)
+{
+	/* A transparent huge page is only used when all of it is committed at once */
+	size_t pageSize = (pagePolicy & ARENA_PAGE_HUGE) ? GetHugePageSize() : GetVirtualPageSize();
+	uintptr_t pageBeginAddr = reinterpret_cast<uintptr_t>(beginAddr) / pageSize * pageSize;
+	uintptr_t pageEndAddr = (reinterpret_cast<uintptr_t>(endAddr) + pageSize - 1) / pageSize * pageSize;
+	if (pageBeginAddr < reinterpret_cast<uintptr_t>(arenaBaseAddr))
+		pageBeginAddr = reinterpret_cast<uintptr_t>(arenaBaseAddr);
+	if (pageEndAddr > reinterpret_cast<uintptr_t>(arenaEndAddr))
+		pageEndAddr = reinterpret_cast<uintptr_t>(arenaEndAddr);
+	if (pageEndAddr <= pageBeginAddr)
+		return true;
+	if (!(pagePolicy & ARENA_PAGE_HUGETLB) && !CommitVirtualMemory(reinterpret_cast<void*>(pageBeginAddr), pageEndAddr - pageBeginAddr))
+		return false;
+
+	/* Locking faults in the pages as well, and does not change their contents, so the whole range 
+	 * can be locked. Only the pages inside the requested memory are prefaulted, since the pages
+	 * around it may be in use by other threads */
+	if (pagePolicy & ARENA_PAGE_LOCK)
+		LockVirtualMemory(reinterpret_cast<void*>(pageBeginAddr), pageEndAddr - pageBeginAddr);
+	else if (pagePolicy & ARENA_PAGE_PREFAULT)
+	{
+		size_t virtualPageSize = GetVirtualPageSize();
+		uintptr_t prefaultBeginAddr = (reinterpret_cast<uintptr_t>(beginAddr) + virtualPageSize - 1) / virtualPageSize * virtualPageSize;
+		uintptr_t prefaultEndAddr = reinterpret_cast<uintptr_t>(endAddr) / virtualPageSize * virtualPageSize;
+		if (prefaultEndAddr > prefaultBeginAddr)
+			PrefaultVirtualMemory(reinterpret_cast<void*>(prefaultBeginAddr), prefaultEndAddr - prefaultBeginAddr);
+	}
+	return true;
+}
+
+
+/**
+* @brief Round the given address up to a boundary of FIX_SIZE_ISOLATION_ALIGNMENT, where a fix size
+*		 allocator of FIX_SIZE_POLICY_ISOLATE_HEADER starts.
+*/
+static inline void* AlignIsolatedAddress(void* addr)
+{
+	return reinterpret_cast<void*>((reinterpret_cast<uintptr_t>(addr) + FIX_SIZE_ISOLATION_ALIGNMENT - 1) / FIX_SIZE_ISOLATION_ALIGNMENT * FIX_SIZE_ISOLATION_ALIGNMENT);
+}
+
+
+/**
+* @brief Lay out an arena in the designated memory space. If "growable" is set, the memory space is
+*		 only reserved, and the parts in use are committed as they are laid out. See CreateArena()
+*		 and CreateGrowableArena() for the parameters.
+*/
+static Arena* LayoutArena(void* baseAddr, size_t size, size_t commitSize, const FixSizeAllocatorArg* fixSizeAllocatorArgs, int fixSizeAllocatorNum, unsigned int policy, bool growable, unsigned int pagePolicy)
+{
+	size_t arenaSize = sizeof(Arena) + (sizeof(void*) - sizeof(Arena) % sizeof(void*)) % sizeof(void*);
+	if (arenaSize > size || fixSizeAllocatorNum > ARENA_MAX_FIX_SIZE_ALLOCATOR_NUM)
+		return nullptr;
+	if (growable && !CommitArenaPages(baseAddr, PointerAdd(baseAddr, arenaSize), baseAddr, PointerAdd(baseAddr, size), pagePolicy))
+		return nullptr;
+
+	Arena* arena = static_cast<Arena*>(baseAddr);
+	arena->baseAddr = baseAddr;
+	arena->endAddr = PointerAdd(baseAddr, size);
+	arena->fixSizeAllocatorNum = fixSizeAllocatorNum;
+	arena->dynamicAllocator = nullptr;
+	arena->pageMap = nullptr;
+	arena->dynamicAllocatorLock.locked = 0;
+	arena->growLock.locked = 0;
+	arena->pagePolicy = growable ? pagePolicy : ARENA_PAGE_DEFAULT;
+	arena->remoteFreeList = 0;
+
+	size_t slabNum = growable ? ARENA_MAX_SLAB_NUM : 1;
+	void* fixBeginAddr = PointerAdd(baseAddr, arenaSize);
+	void* addr = fixBeginAddr;
+	for (int i = 0; i < fixSizeAllocatorNum; i++)
+	{
+		FixSizeAllocatorArg arg = fixSizeAllocatorArgs[i];
+		unsigned int allocatorPolicy = FIX_SIZE_POLICY_BIT_ARRAY | (arg.policy & FIX_SIZE_POLICY_ISOLATE_HEADER);
+		if (allocatorPolicy & FIX_SIZE_POLICY_ISOLATE_HEADER)
+			addr = AlignIsolatedAddress(addr);
+
+		size_t blockOffset = GetFixSizeBlockOffset(arg.blockNum * slabNum, allocatorPolicy);
+		if (arena->pagePolicy & ARENA_PAGE_HUGE)
+		{
+			/* Move the blocks to the next huge page if the first slab would cross one, so that the
+			 * blocks in use at first are covered by a single TLB entry */
+			size_t hugePageSize = GetHugePageSize();
+			uintptr_t slabBeginAddr = reinterpret_cast<uintptr_t>(addr) + blockOffset;
+			uintptr_t slabEndAddr = slabBeginAddr + arg.blockSize * arg.blockNum;
+			if (slabEndAddr - slabBeginAddr <= hugePageSize && slabBeginAddr / hugePageSize != (slabEndAddr - 1) / hugePageSize)
+				addr = PointerAdd(addr, hugePageSize - slabBeginAddr % hugePageSize);
+		}
+
+		/* Check the size before creating the fix size allocator, since it writes its bit array first */
+		size_t restSize = addr < arena->endAddr ? reinterpret_cast<uintptr_t>(PointerSub(arena->endAddr, addr)) : 0;
+		size_t allocatorSize = blockOffset + arg.blockSize * arg.blockNum * slabNum;
+		FixSizeAllocator* allocator = nullptr;
+		if (allocatorSize <= restSize && (!growable || arena->CommitPages(addr, PointerAdd(addr, blockOffset + arg.blockSize * arg.blockNum))))
+			allocator = CreateFixSizeAllocator(addr, arg.blockNum, arg.blockSize, restSize, allocatorPolicy, arg.blockNum * slabNum);
+		arena->fixSizeAllocatorPtrs[i] = allocator;
+		if (allocator != nullptr)
+			addr = PointerAdd(allocator->blockBaseAddr, allocator->blockSize * allocator->maxBlockNum);
+
+		/* What comes after an isolated fix size allocator does not share the cache lines of its last block either */
+		if (allocator != nullptr && (allocatorPolicy & FIX_SIZE_POLICY_ISOLATE_HEADER))
+			addr = AlignIsolatedAddress(addr);
+	}
+
+	/* Build the page map that covers all fix size allocators, so that Free() can find the owner of
+	 * a memory address in constant time. The page size should not be larger than the smallest fix
+	 * size allocator, otherwise a page may be shared by more than two fix size allocators. */
+	size_t pageSize = PAGE_MAP_MAX_PAGE_SIZE;
+	for (int i = 0; i < fixSizeAllocatorNum; i++)
+	{
+		FixSizeAllocator* allocator = arena->fixSizeAllocatorPtrs[i];
+		if (allocator == nullptr)
+			continue;
+
+		size_t allocatorSize = reinterpret_cast<uintptr_t>(PointerSub(PointerAdd(allocator->blockBaseAddr, allocator->blockSize * allocator->maxBlockNum), allocator));
+		while (pageSize > allocatorSize)
+			pageSize >>= 1;
+	}
+
+	size_t restSize = reinterpret_cast<uintptr_t>(PointerSub(arena->endAddr, addr));
+	size_t pageMapSize = GetPageMapSize(fixBeginAddr, addr, pageSize);
+	if (!growable || (pageMapSize <= restSize && arena->CommitPages(addr, PointerAdd(addr, pageMapSize))))
+		arena->pageMap = CreatePageMap(addr, fixBeginAddr, addr, pageSize, restSize);
+	if (arena->pageMap != nullptr)
+	{
+		for (int i = 0; i < fixSizeAllocatorNum; i++)
+		{
+			FixSizeAllocator* allocator = arena->fixSizeAllocatorPtrs[i];
+			if (allocator != nullptr)
+				arena->pageMap->SetOwner(allocator, PointerAdd(allocator->blockBaseAddr, allocator->blockSize * allocator->maxBlockNum), static_cast<uint8_t>(i));
+		}
+
+		/* Keep the dynamic allocator aligned to the pointer size */
+		pageMapSize += (sizeof(void*) - reinterpret_cast<uintptr_t>(PointerAdd(addr, pageMapSize)) % sizeof(void*)) % sizeof(void*);
+		addr = PointerAdd(addr, pageMapSize);
+	}
+
+	/* A growable dynamic allocator ends at a page boundary, so it grows by whole pages */
+	restSize = reinterpret_cast<uintptr_t>(PointerSub(arena->endAddr, addr));
+	if (growable)
+	{
+		size_t usedSize = reinterpret_cast<uintptr_t>(PointerSub(addr, baseAddr));
+		size_t dynamicSize = commitSize > usedSize + MANAGER_SIZE + BLOCK_SIZE + TAG_SIZE ? commitSize - usedSize : MANAGER_SIZE + BLOCK_SIZE + TAG_SIZE + BLOCK_ALIGNMENT;
+		size_t virtualPageSize = GetVirtualPageSize();
+		uintptr_t dynamicEndAddr = (reinterpret_cast<uintptr_t>(addr) + dynamicSize + virtualPageSize - 1) / virtualPageSize * virtualPageSize;
+		dynamicSize = dynamicEndAddr - reinterpret_cast<uintptr_t>(addr);
+		if (dynamicSize > restSize)
+			dynamicSize = restSize;
+		if (!arena->CommitPages(addr, PointerAdd(addr, dynamicSize)))
+			dynamicSize = 0;
+		restSize = dynamicSize;
+	}
+	if (restSize > MANAGER_SIZE + BLOCK_SIZE + TAG_SIZE)
+		arena->dynamicAllocator = CreateDynamicAllocator(addr, restSize, policy);
+
+	if (arena->dynamicAllocator != nullptr)
+		return arena;
+	for (int i = 0; i < fixSizeAllocatorNum; i++)
+	{
+		if (arena->fixSizeAllocatorPtrs[i] != nullptr)
+			return arena;
+	}
+	return nullptr;
+}
+
+
+Arena* CreateArena(void* baseAddr, size_t size, const FixSizeAllocatorArg* fixSizeAllocatorArgs, int fixSizeAllocatorNum, unsigned int policy)
+{
+	return LayoutArena(baseAddr, size, size, fixSizeAllocatorArgs, fixSizeAllocatorNum, policy, false, ARENA_PAGE_DEFAULT);
+}
+
+
+Arena* CreateGrowableArena(void* baseAddr, size_t size, size_t commitSize, const FixSizeAllocatorArg* fixSizeAllocatorArgs, int fixSizeAllocatorNum, unsigned int policy, unsigned int pagePolicy)
+{
+	/* Giving back pages would undo locking, and explicit huge pages can not be given back by parts */
+	policy |= POLICY_ZEROED_MEMORY;
+	if (!(pagePolicy & (ARENA_PAGE_LOCK | ARENA_PAGE_HUGETLB)))
+		policy |= POLICY_TRIMMABLE;
+	return LayoutArena(baseAddr, size, commitSize, fixSizeAllocatorArgs, fixSizeAllocatorNum, policy, true, pagePolicy);
+}
+
+
+unsigned int GetCurrentProcessorIdx()
+{
+#if defined(_WIN32)
+	return static_cast<unsigned int>(GetCurrentProcessorNumber());
+#elif defined(__linux__)
+	int cpu = sched_getcpu();
+	return cpu < 0 ? 0 : static_cast<unsigned int>(cpu);
+#else
+	return 0;
+#endif
+}
+
+
+int Arena::FindFixSizeAllocator(const void* ptr) const
+{
+	/* Fall back to probing each fix size allocator if there is no space for the page map */
+	if (this->pageMap == nullptr)
+	{
+		for (int i = 0; i < this->fixSizeAllocatorNum; i++)
+		{
+			if (this->fixSizeAllocatorPtrs[i] != nullptr && this->fixSizeAllocatorPtrs[i]->Contains(ptr))
+				return i;
+		}
+		return -1;
+	}
+
+	if (!this->pageMap->Contains(ptr))
+		return -1;
+
+	size_t pageIdx = this->pageMap->FindPageIdx(ptr);
+	uint8_t owner = this->pageMap->GetOwner(pageIdx);
+	if (owner != PAGE_OWNER_NONE)
+	{
+		FixSizeAllocator* allocator = this->fixSizeAllocatorPtrs[owner];
+		if (ptr < PointerAdd(allocator->blockBaseAddr, allocator->blockSize * allocator->maxBlockNum))
+			return owner;
+	}
+
+	owner = this->pageMap->GetOwner(pageIdx + 1);
+	return owner != PAGE_OWNER_NONE ? owner : -1;
+}
+
+
+bool Arena::GrowFixSizeAllocator(int fixSizeAllocatorIdx)
+{
+	FixSizeAllocator* allocator = this->fixSizeAllocatorPtrs[fixSizeAllocatorIdx];
+	if (allocator == nullptr || AtomicLoad(&allocator->blockNum) >= allocator->maxBlockNum)
+		return false;
+
+	this->growLock.Lock();
+	bool success = AtomicLoad(&allocator->freeBlockNum) > 0;
+	if (!success && allocator->blockNum < allocator->maxBlockNum)
+	{
+		size_t slabBlockNum = allocator->maxBlockNum / ARENA_MAX_SLAB_NUM;
+		size_t newBlockNum = allocator->blockNum + slabBlockNum < allocator->maxBlockNum ? allocator->blockNum + slabBlockNum : allocator->maxBlockNum;
+		success = this->CommitPages(PointerAdd(allocator->blockBaseAddr, allocator->blockSize * allocator->blockNum), PointerAdd(allocator->blockBaseAddr, allocator->blockSize * newBlockNum)) && 
+			allocator->Grow(newBlockNum - allocator->blockNum) > 0;
+	}
+	this->growLock.Unlock();
+	return success;
+}
+
+
+bool Arena::GrowDynamicAllocator(size_t size)
+{
+	void* dynamicEndAddr = PointerAdd(this->dynamicAllocator->baseAddr, this->dynamicAllocator->heapSize);
+	size_t restSize = reinterpret_cast<uintptr_t>(PointerSub(this->endAddr, dynamicEndAddr));
+	if (restSize == 0)
+		return false;
+
+	/* Grow by whole pages, and by enough at a time that a run of large requests does not commit 
+	 * pages one by one. The last free block may already hold a part of the request, but it is not
+	 * counted, so the request always fits after the heap grows. The segregated fit only takes a
+	 * block from a list above the request, so the new block has room for that rounding too */
+	size_t pageSize = GetVirtualPageSize();
+	size_t growSize = size + (size >> SL_INDEX_COUNT_LOG2) + BLOCK_SIZE + TAG_SIZE + BLOCK_ALIGNMENT;
+	if (growSize < size)
+		return false;
+	if (growSize < ARENA_MIN_GROW_SIZE)
+		growSize = ARENA_MIN_GROW_SIZE;
+	growSize = (growSize + pageSize - 1) / pageSize * pageSize;
+	if (growSize > restSize)
+	{
+		if (size + BLOCK_SIZE + TAG_SIZE + BLOCK_ALIGNMENT > restSize)
+			return false;
+		growSize = restSize;
+	}
+
+	return this->CommitPages(dynamicEndAddr, PointerAdd(dynamicEndAddr, growSize)) && this->dynamicAllocator->Grow(growSize);
+}
+
+
+bool Arena::CommitPages(void* beginAddr, void* endAddr)
+{
+	return CommitArenaPages(beginAddr, endAddr, this->baseAddr, this->endAddr, this->pagePolicy);
+}
+
+
+void* Arena::AllocFromDynamicAllocator(size_t size, size_t alignment)
+{
+	if (this->dynamicAllocator == nullptr)
+		return nullptr;
+
+	this->dynamicAllocatorLock.Lock();
+	void* ptr = this->dynamicAllocator->Alloc(size, alignment);
+	if (ptr == nullptr && size + alignment >= size && this->GrowDynamicAllocator(size + alignment))
+		ptr = this->dynamicAllocator->Alloc(size, alignment);
+	this->dynamicAllocatorLock.Unlock();
+	return ptr;
+}
+
+
+void* Arena::CallocFromDynamicAllocator(size_t size)
+{
+	if (this->dynamicAllocator == nullptr)
+		return nullptr;
+
+	this->dynamicAllocatorLock.Lock();
+	void* ptr = this->dynamicAllocator->Calloc(1, size);
+	if (ptr == nullptr && this->GrowDynamicAllocator(size))
+		ptr = this->dynamicAllocator->Calloc(1, size);
+	this->dynamicAllocatorLock.Unlock();
+	return ptr;
+}
+
+
+bool Arena::ExpandInDynamicAllocator(void* ptr, size_t newSize, size_t& outOldSize)
+{
+	outOldSize = 0;
+	if (this->dynamicAllocator == nullptr)
+		return false;
+
+	this->dynamicAllocatorLock.Lock();
+	outOldSize = this->dynamicAllocator->GetAllocationSize(ptr);
+	bool success = outOldSize != 0 && this->dynamicAllocator->Expand(ptr, newSize);
+	this->dynamicAllocatorLock.Unlock();
+	return success;
+}
+
+
+bool Arena::FreeToDynamicAllocator(void* ptr)
+{
+	if (this->dynamicAllocator == nullptr)
+		return false;
+
+	this->dynamicAllocatorLock.Lock();
+	bool success = this->dynamicAllocator->Free(ptr);
+	this->dynamicAllocatorLock.Unlock();
+	return success;
+}
+
+
+size_t Arena::GetDynamicAllocationSize(const void* ptr)
+{
+	if (this->dynamicAllocator == nullptr)
+		return 0;
+
+	this->dynamicAllocatorLock.Lock();
+	size_t size = this->dynamicAllocator->GetAllocationSize(ptr);
+	this->dynamicAllocatorLock.Unlock();
+	return size;
+}
+
+
+void Arena::Collect()
+{
+	if (this->dynamicAllocator == nullptr)
+		return;
+
+	this->dynamicAllocatorLock.Lock();
+	this->dynamicAllocator->Collect();
+	this->dynamicAllocatorLock.Unlock();
+}
+
+
+size_t Arena::Trim()
+{
+	if (this->dynamicAllocator == nullptr)
+		return 0;
+
+	this->dynamicAllocatorLock.Lock();
+	size_t trimmedSize = this->dynamicAllocator->Trim();
+	this->dynamicAllocatorLock.Unlock();
+	return trimmedSize;
+}
+
+
+void Arena::SetTrimThreshold(size_t threshold)
+{
+	if (this->dynamicAllocator == nullptr)
+		return;
+
+	this->dynamicAllocatorLock.Lock();
+	this->dynamicAllocator->trimThreshold = threshold;
+	this->dynamicAllocatorLock.Unlock();
+}
+
+
+void Arena::Destroy()
+{
+	for (int i = 0; i < this->fixSizeAllocatorNum; i++)
+	{
+		if (this->fixSizeAllocatorPtrs[i] != nullptr)
+			this->fixSizeAllocatorPtrs[i]->Destroy();
+	}
+	if (this->dynamicAllocator != nullptr)
+		this->dynamicAllocator->Destroy();
+}
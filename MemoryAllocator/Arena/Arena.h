@@ -0,0 +1,230 @@
+#pragma once
+#include "../DynamicAllocator/DynamicAllocator.h"
+#include "../FixSizeAllocator/FixSizeAllocator.h"
+#include "../PageMap/PageMap.h"
+#include "../Utility/Atomic.h"
+#include "../Utility/Utility.h"
+
+
+using namespace Utility;
+
+
+/* The maximum number of fix size allocators in an arena */
+const int ARENA_MAX_FIX_SIZE_ALLOCATOR_NUM = 8;
+
+/* The maximum number of arenas that a heap can be split into */
+const unsigned int ARENA_MAX_NUM = 64;
+
+/* Arenas are aligned to cache lines, so that two arenas never share a cache line */
+const size_t ARENA_ALIGNMENT = 64;
+
+/* The number of memory blocks a thread collects for another arena before it hands them over */
+const size_t ARENA_REMOTE_FREE_BATCH = 16;
+
+/* A growable arena lays out room for this many slabs in each fix size allocator, where a slab is
+ * the block number given by the size class */
+const size_t ARENA_MAX_SLAB_NUM = 64;
+
+/* The least amount of memory that a growable arena adds to its dynamic allocator at a time */
+const size_t ARENA_MIN_GROW_SIZE = 256 * 1024;
+
+/* How a growable arena backs its memory with pages. They can be combined:
+ * ARENA_PAGE_HUGE -- Back the arena with transparent huge pages. Memory is committed by whole 
+ * huge pages, and the first slab of a fix size allocator never crosses a huge page;
+ * ARENA_PAGE_HUGETLB -- The arena is in a range of explicit huge pages, which is accessible as a
+ * whole, so nothing is committed. Combine it with ARENA_PAGE_HUGE for the slab layout;
+ * ARENA_PAGE_PREFAULT -- Fault in memory when it is committed, instead of on the first access;
+ * ARENA_PAGE_LOCK -- Lock memory into physical memory when it is committed. It is best effort, 
+ * since the OS limits how much memory a process can lock. 
+ * Locked memory and explicit huge pages are not trimmed. */
+const unsigned int ARENA_PAGE_DEFAULT = 0x0;
+const unsigned int ARENA_PAGE_HUGE = 0x1;
+const unsigned int ARENA_PAGE_HUGETLB = 0x2;
+const unsigned int ARENA_PAGE_PREFAULT = 0x4;
+const unsigned int ARENA_PAGE_LOCK = 0x8;
+
+/* How threads are assigned to arenas */
+const unsigned int ARENA_ASSIGN_ROUND_ROBIN = 0x0;
+const unsigned int ARENA_ASSIGN_BY_CPU = 0x1;
+
+
+/**
+* @brief Arena is an independent memory system carved out of a part of the heap. It has its own fix 
+*		 size allocators, page map and dynamic allocator, so threads that use different arenas do
+*		 not touch the same metadata. Fix size allocators are lock-free, and the dynamic allocator
+*		 is protected by a lock of its own arena. 
+*		 Memory blocks freed by threads of other arenas are not returned to the sub-allocators
+*		 directly. They are pushed onto the remote free list of the arena, a lock-free stack that 
+*		 many threads push onto, and the threads of the arena take the whole list at once and 
+*		 free the blocks in a batch. Each block in the list stores the next block in its first 
+*		 bytes. The structure of arena be like:
+*		 |  member variables  |  fix size allocators...  |  page map  |  dynamic allocator  |
+*		 A growable arena is laid out the same way in a range of reserved address space, but only
+*		 commits what is in use. Each fix size allocator has room for ARENA_MAX_SLAB_NUM slabs and
+*		 starts with one of them, and another slab is committed whenever it runs out of blocks. The
+*		 dynamic allocator starts with the rest of the initial memory, and commits the pages after 
+*		 its end when no free block fits, up to the end of the arena.
+*
+* @param baseAddr -- The starting address of the memory space of arena, where the arena itself is;
+* @param endAddr -- The address next to the last byte of the memory space of arena. It is the end
+*		 of the reserved range for a growable arena;
+* @param fixSizeAllocatorNum -- The number of fix size allocators in arena;
+* @param fixSizeAllocatorPtrs -- The fix size allocators, from the smallest block size to the 
+*		 largest. An entry is nullptr if there is no space for the fix size allocator;
+* @param dynamicAllocator -- The dynamic allocator that serves the rest memory requests;
+* @param pageMap -- The page map from memory address to the fix size allocator that owns it. It is
+*		 nullptr if there is no space for it;
+* @param dynamicAllocatorLock -- The lock of the dynamic allocator, also held while it grows;
+* @param growLock -- The lock that is held while a fix size allocator grows;
+* @param pagePolicy -- How a growable arena commits its memory, see ARENA_PAGE_HUGE etc;
+* @param remoteFreeList -- The address of the first memory block in the remote free list, 0 if the
+*		 list is empty;
+*/
+class Arena
+{
+public:
+	void* baseAddr;
+	void* endAddr;
+	int fixSizeAllocatorNum;
+	FixSizeAllocator* fixSizeAllocatorPtrs[ARENA_MAX_FIX_SIZE_ALLOCATOR_NUM];
+	DynamicAllocator* dynamicAllocator;
+	PageMap* pageMap;
+	SpinLock dynamicAllocatorLock;
+	SpinLock growLock;
+	unsigned int pagePolicy;
+	uintptr_t remoteFreeList;
+
+
+	inline bool Contains(const void* ptr) const;
+
+	/**
+	* @brief Push a chain of memory blocks onto the remote free list. The blocks must be linked 
+	*		 through their first bytes, from "head" to "tail". Safe to call from any thread.
+	*/
+	inline void PushRemoteFree(void* head, void* tail);
+
+	/**
+	* @brief Take all memory blocks in the remote free list at once. 
+	* 
+	* @return The first memory block of the chain, or nullptr if the list is empty.
+	*/
+	inline void* TakeRemoteFree();
+
+	inline bool HasRemoteFree() const;
+
+	/**
+	* @brief Find the fix size allocator that owns the given memory address. The owner is looked up
+	*		 from the page map, so the cost does not grow with the number of fix size allocators.
+	*		 Since a page is shared by at most two fix size allocators, if the address is beyond the
+	*		 owner of its page, it must belong to the owner of the next page.
+	*
+	* @return The index of the owner of the memory address. Return -1 if the memory address does not 
+	*		  belong to any fix size allocator.
+	*/
+	int FindFixSizeAllocator(const void* ptr) const;
+
+	/**
+	* @brief Commit another slab of the given fix size allocator and put it into use. Nothing is
+	*		 done if other threads have freed blocks to it or grown it in the meantime.
+	* 
+	* @return Return false if the fix size allocator has no free block and can not grow any more,
+	*		  which is always the case in an arena that is not growable.
+	*/
+	bool GrowFixSizeAllocator(int fixSizeAllocatorIdx);
+
+	/**
+	* @brief Commit the memory after the end of the dynamic allocator and add it to the dynamic 
+	*		 allocator, so that a request of "size" bytes fits. The lock of the dynamic allocator
+	*		 must be held.
+	* 
+	* @return Return false if the rest of the arena is too small.
+	*/
+	bool GrowDynamicAllocator(size_t size);
+
+	/**
+	* @brief Commit the pages that cover the memory from "beginAddr" to "endAddr" by the page policy
+	*		 of the arena, without going beyond the arena.
+	*/
+	bool CommitPages(void* beginAddr, void* endAddr);
+
+	/**
+	* @brief Allocate from (or free to) the dynamic allocator while holding the lock of the arena.
+	*		 The dynamic allocator of a growable arena grows if the request does not fit.
+	*/
+	void* AllocFromDynamicAllocator(size_t size, size_t alignment = 0);
+	void* CallocFromDynamicAllocator(size_t size);
+	bool FreeToDynamicAllocator(void* ptr);
+
+	/**
+	* @brief Resize an allocation of the dynamic allocator in place while holding the lock of the
+	*		 arena. "outOldSize" is set to the size of the allocation before it is resized, or 0 if
+	*		 the memory address is not allocated by the dynamic allocator.
+	*/
+	bool ExpandInDynamicAllocator(void* ptr, size_t newSize, size_t& outOldSize);
+
+	/**
+	* @brief The usable size of an allocation of the dynamic allocator, read while holding the lock
+	*		 of the arena. Return 0 if the memory address is not allocated by the dynamic allocator.
+	*/
+	size_t GetDynamicAllocationSize(const void* ptr);
+
+	void Collect();
+
+	/**
+	* @brief Give the pages of the free blocks of the dynamic allocator back to the OS while holding
+	*		 the lock of the arena, and return the number of bytes. Only growable arenas trim.
+	*/
+	size_t Trim();
+
+	/**
+	* @brief Set the size of a free block from which the dynamic allocator trims it as soon as it
+	*		 is freed. 0 disables automatic trimming.
+	*/
+	void SetTrimThreshold(size_t threshold);
+
+	void Destroy();
+};
+
+
+/**
+* @brief Instantiate an Arena instance in the designated memory space, and lay out its fix size
+*		 allocators, page map and dynamic allocator right after it.
+* 
+* @param baseAddr -- The starting address of the memory space of arena.
+* @param size -- The size of the memory space of arena.
+* @param fixSizeAllocatorArgs -- The block size and block number of each fix size allocator.
+* @param fixSizeAllocatorNum -- The number of fix size allocators, no more than 
+*		 ARENA_MAX_FIX_SIZE_ALLOCATOR_NUM.
+* @param policy -- The policy of the dynamic allocator.
+* 
+* @return The address of Arena instance. Return nullptr if the memory space can not hold the Arena
+*		  instance, or none of the sub-allocators fits in it.
+*/
+Arena* CreateArena(void* baseAddr, size_t size, const FixSizeAllocatorArg* fixSizeAllocatorArgs, int fixSizeAllocatorNum, unsigned int policy);
+
+/**
+* @brief Instantiate a growable Arena instance in a range of reserved address space. Only the arena,
+*		 the first slab of each fix size allocator, the page map and the dynamic allocator are 
+*		 committed, and the dynamic allocator takes the rest of "commitSize". Committed memory is
+*		 known to be zero, so POLICY_ZEROED_MEMORY is added to the policy. POLICY_TRIMMABLE is
+*		 added as well unless the memory is locked or in explicit huge pages.
+* 
+* @param baseAddr -- The starting address of the reserved range, aligned to the page size, or to
+*		 the huge page size under ARENA_PAGE_HUGE and ARENA_PAGE_HUGETLB.
+* @param size -- The size of the reserved range, a multiple of the same page size.
+* @param commitSize -- The memory that is committed at the beginning.
+* @param pagePolicy -- How the memory is committed, see ARENA_PAGE_HUGE etc.
+* 
+* @return The address of Arena instance. Return nullptr if the reserved range can not hold the 
+*		  arena, or the memory can not be committed.
+*/
+Arena* CreateGrowableArena(void* baseAddr, size_t size, size_t commitSize, const FixSizeAllocatorArg* fixSizeAllocatorArgs, int fixSizeAllocatorNum, unsigned int policy, unsigned int pagePolicy = ARENA_PAGE_DEFAULT);
+
+/**
+* @brief Return the index of the processor that the calling thread is running on. It is used to
+*		 assign threads to arenas by CPU.
+*/
+unsigned int GetCurrentProcessorIdx();
+
+
+#include "Arena.inl"
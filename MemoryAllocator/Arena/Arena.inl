@@ -0,0 +1,31 @@
+#pragma once
+
+
+inline bool Arena::Contains(const void* ptr) const
+{
+	return ptr >= this->baseAddr && ptr < this->endAddr;
+}
+
+
+inline void Arena::PushRemoteFree(void* head, void* tail)
+{
+	uintptr_t first = AtomicLoad(&this->remoteFreeList);
+	do
+	{
+		*static_cast<uintptr_t*>(tail) = first;
+	} while (!AtomicCompareExchange(&this->remoteFreeList, first, reinterpret_cast<uintptr_t>(head)));
+}
+
+
+inline void* Arena::TakeRemoteFree()
+{
+	if (AtomicLoad(&this->remoteFreeList) == 0)
+		return nullptr;
+	return reinterpret_cast<void*>(AtomicExchange(&this->remoteFreeList, static_cast<uintptr_t>(0)));
+}
+
+
+inline bool Arena::HasRemoteFree() const
+{
+	return AtomicLoad(&this->remoteFreeList) != 0;
+}
\ No newline at end of file
@@ -0,0 +1,352 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+
+/* The number of memory blocks that a thread of the churn workloads keeps */
+const size_t CHURN_SLOT_NUM = 1024;
+const size_t LARSON_SLOT_NUM = 1000;
+const size_t LARSON_ROUND_NUM = 10;
+
+/* The most memory blocks that a round of the random size workload allocates */
+const size_t RANDOM_SIZE_MAX_BLOCK_NUM = 10240;
+
+/* The capacity of the ring buffer between a producer and a consumer, a power of 2 */
+const size_t RING_SIZE = 1024;
+
+
+/**
+* @brief Times a sample of the alloc and free calls of a thread. The buffer of latencies is
+*		 reserved before the workload starts, so that recording does not allocate.
+*/
+class LatencyRecorder
+{
+public:
+	std::vector<uint32_t> latencies;
+	size_t callNum;
+
+	inline LatencyRecorder(size_t opNum) : callNum(0)
+	{
+		this->latencies.reserve(opNum / LATENCY_SAMPLE_INTERVAL + 1);
+	}
+
+	inline void* Alloc(const BenchmarkAllocator& allocator, size_t size)
+	{
+		if ((++this->callNum & (LATENCY_SAMPLE_INTERVAL - 1)) != 0 || this->latencies.size() == this->latencies.capacity())
+			return allocator.alloc(size);
+
+		auto begin = std::chrono::steady_clock::now();
+		void* ptr = allocator.alloc(size);
+		auto end = std::chrono::steady_clock::now();
+		this->Record(end - begin);
+		return ptr;
+	}
+
+	inline void Free(const BenchmarkAllocator& allocator, void* ptr)
+	{
+		if ((++this->callNum & (LATENCY_SAMPLE_INTERVAL - 1)) != 0 || this->latencies.size() == this->latencies.capacity())
+		{
+			allocator.free(ptr);
+			return;
+		}
+
+		auto begin = std::chrono::steady_clock::now();
+		allocator.free(ptr);
+		auto end = std::chrono::steady_clock::now();
+		this->Record(end - begin);
+	}
+
+	inline void Record(std::chrono::steady_clock::duration duration)
+	{
+		long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+		this->latencies.push_back(static_cast<uint32_t>(ns < UINT32_MAX ? ns : UINT32_MAX));
+	}
+};
+
+
+/* Create a latency recorder for each thread in place, since a copy would not keep the reserved buffer */
+static std::vector<LatencyRecorder> CreateLatencyRecorders(size_t threadNum, size_t threadOpNum)
+{
+	std::vector<LatencyRecorder> recorders;
+	recorders.reserve(threadNum);
+	for (size_t i = 0; i < threadNum; i++)
+		recorders.emplace_back(threadOpNum);
+	return recorders;
+}
+
+
+/* Touch the first and the last byte of a memory block, as a user would */
+static inline void TouchBlock(void* ptr, size_t size)
+{
+	if (ptr == nullptr)
+		return;
+	static_cast<volatile char*>(ptr)[0] = 1;
+	static_cast<volatile char*>(ptr)[size - 1] = 1;
+}
+
+
+/* Merge the latencies of all threads, and fill in the percentiles of the result */
+static WorkloadResult FinishWorkload(std::vector<LatencyRecorder>& recorders, size_t opNum, std::chrono::steady_clock::time_point begin)
+{
+	WorkloadResult result;
+	result.opNum = opNum;
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	result.p50Ns = 0;
+	result.p99Ns = 0;
+
+	std::vector<uint32_t> latencies;
+	for (const LatencyRecorder& recorder : recorders)
+		latencies.insert(latencies.end(), recorder.latencies.begin(), recorder.latencies.end());
+	if (latencies.empty())
+		return result;
+
+	std::sort(latencies.begin(), latencies.end());
+	result.p50Ns = latencies[latencies.size() / 2];
+	result.p99Ns = latencies[latencies.size() * 99 / 100];
+	return result;
+}
+
+
+WorkloadResult SameSizeChurn_Workload(const BenchmarkAllocator& allocator, unsigned int threadNum, size_t opNum)
+{
+	const size_t blockSize = 64;
+	size_t threadOpNum = opNum / threadNum;
+
+	std::vector<LatencyRecorder> recorders = CreateLatencyRecorders(threadNum, threadOpNum);
+	std::vector<std::thread> threads;
+	auto begin = std::chrono::steady_clock::now();
+	for (unsigned int t = 0; t < threadNum; t++)
+	{
+		threads.emplace_back([&allocator, &recorders, t, threadOpNum, blockSize]()
+		{
+			LatencyRecorder& recorder = recorders[t];
+			void* slots[CHURN_SLOT_NUM];
+			for (size_t i = 0; i < CHURN_SLOT_NUM; i++)
+			{
+				slots[i] = recorder.Alloc(allocator, blockSize);
+				TouchBlock(slots[i], blockSize);
+			}
+
+			BenchmarkRandom random(42 + t);
+			for (size_t i = 2 * CHURN_SLOT_NUM; i < threadOpNum; i += 2)
+			{
+				size_t slot = random.Next() % CHURN_SLOT_NUM;
+				recorder.Free(allocator, slots[slot]);
+				slots[slot] = recorder.Alloc(allocator, blockSize);
+				TouchBlock(slots[slot], blockSize);
+			}
+
+			for (size_t i = 0; i < CHURN_SLOT_NUM; i++)
+				recorder.Free(allocator, slots[i]);
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+
+	return FinishWorkload(recorders, threadOpNum * threadNum, begin);
+}
+
+
+WorkloadResult RandomSize_Workload(const BenchmarkAllocator& allocator, unsigned int threadNum, size_t opNum)
+{
+	size_t threadOpNum = opNum / threadNum;
+
+	std::vector<LatencyRecorder> recorders = CreateLatencyRecorders(threadNum, threadOpNum);
+	std::vector<std::vector<void*>> blockLists(threadNum);
+	for (std::vector<void*>& blocks : blockLists)
+		blocks.reserve(RANDOM_SIZE_MAX_BLOCK_NUM);
+
+	std::vector<size_t> doneOpNums(threadNum, 0);
+	std::vector<std::thread> threads;
+	auto begin = std::chrono::steady_clock::now();
+	for (unsigned int t = 0; t < threadNum; t++)
+	{
+		threads.emplace_back([&allocator, &recorders, &blockLists, &doneOpNums, t, threadOpNum]()
+		{
+			LatencyRecorder& recorder = recorders[t];
+			std::vector<void*>& blocks = blockLists[t];
+			BenchmarkRandom random(42 + t);
+			size_t doneOpNum = 0;
+			while (doneOpNum < threadOpNum)
+			{
+				for (size_t i = 0; i < RANDOM_SIZE_MAX_BLOCK_NUM; i++)
+				{
+					size_t size = 1 + (random.Next() & 1023);
+					void* ptr = recorder.Alloc(allocator, size);
+					doneOpNum++;
+					if (ptr == nullptr)
+						break;
+					TouchBlock(ptr, size);
+					blocks.push_back(ptr);
+
+					if (random.Next() % 7 == 0)
+					{
+						recorder.Free(allocator, blocks.back());
+						blocks.pop_back();
+						doneOpNum++;
+					}
+				}
+
+				/* Free the rest in random order */
+				for (size_t i = blocks.size(); i > 1; i--)
+					std::swap(blocks[i - 1], blocks[random.Next() % i]);
+				for (void* ptr : blocks)
+					recorder.Free(allocator, ptr);
+				doneOpNum += blocks.size();
+				blocks.clear();
+			}
+			doneOpNums[t] = doneOpNum;
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+
+	size_t doneOpNum = 0;
+	for (size_t num : doneOpNums)
+		doneOpNum += num;
+	return FinishWorkload(recorders, doneOpNum, begin);
+}
+
+
+/**
+* @brief A ring buffer of memory blocks with a single producer and a single consumer.
+*/
+class BlockRing
+{
+public:
+	alignas(64) std::atomic<size_t> head;
+	alignas(64) std::atomic<size_t> tail;
+	alignas(64) void* blocks[RING_SIZE];
+
+	inline BlockRing() : head(0), tail(0) {}
+
+	inline bool Push(void* ptr)
+	{
+		size_t tail = this->tail.load(std::memory_order_relaxed);
+		if (tail - this->head.load(std::memory_order_acquire) == RING_SIZE)
+			return false;
+		this->blocks[tail & (RING_SIZE - 1)] = ptr;
+		this->tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	inline void* Pop()
+	{
+		size_t head = this->head.load(std::memory_order_relaxed);
+		if (head == this->tail.load(std::memory_order_acquire))
+			return nullptr;
+		void* ptr = this->blocks[head & (RING_SIZE - 1)];
+		this->head.store(head + 1, std::memory_order_release);
+		return ptr;
+	}
+};
+
+
+WorkloadResult ProducerConsumer_Workload(const BenchmarkAllocator& allocator, unsigned int threadNum, size_t opNum)
+{
+	unsigned int pairNum = threadNum / 2 > 0 ? threadNum / 2 : 1;
+	size_t pairBlockNum = opNum / 2 / pairNum;
+
+	std::vector<LatencyRecorder> recorders = CreateLatencyRecorders(pairNum * 2, pairBlockNum);
+	std::vector<BlockRing> rings(pairNum);
+	std::vector<std::thread> threads;
+	auto begin = std::chrono::steady_clock::now();
+	for (unsigned int p = 0; p < pairNum; p++)
+	{
+		threads.emplace_back([&allocator, &recorders, &rings, p, pairBlockNum]()
+		{
+			LatencyRecorder& recorder = recorders[p * 2];
+			BenchmarkRandom random(42 + p);
+			for (size_t i = 0; i < pairBlockNum; i++)
+			{
+				size_t size = 16 + random.Next() % 497;
+				void* ptr = recorder.Alloc(allocator, size);
+				if (ptr == nullptr)
+				{
+					/* The consumer counts on every block, so a failed one is passed on as a dummy */
+					ptr = &rings[p];
+				}
+				else
+				{
+					TouchBlock(ptr, size);
+				}
+				while (!rings[p].Push(ptr))
+					std::this_thread::yield();
+			}
+		});
+
+		threads.emplace_back([&allocator, &recorders, &rings, p, pairBlockNum]()
+		{
+			LatencyRecorder& recorder = recorders[p * 2 + 1];
+			for (size_t i = 0; i < pairBlockNum; i++)
+			{
+				void* ptr;
+				while ((ptr = rings[p].Pop()) == nullptr)
+					std::this_thread::yield();
+				if (ptr != &rings[p])
+					recorder.Free(allocator, ptr);
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+
+	return FinishWorkload(recorders, pairBlockNum * pairNum * 2, begin);
+}
+
+
+WorkloadResult Larson_Workload(const BenchmarkAllocator& allocator, unsigned int threadNum, size_t opNum)
+{
+	size_t roundOpNum = opNum / threadNum / LARSON_ROUND_NUM;
+
+	/* The blocks of each array are allocated by the main thread, and freed by the workers */
+	std::vector<std::vector<void*>> slotLists(threadNum, std::vector<void*>(LARSON_SLOT_NUM));
+	BenchmarkRandom setupRandom(7);
+	for (std::vector<void*>& slots : slotLists)
+	{
+		for (void*& ptr : slots)
+		{
+			size_t size = 16 + setupRandom.Next() % 1009;
+			ptr = allocator.alloc(size);
+			TouchBlock(ptr, size);
+		}
+	}
+
+	std::vector<LatencyRecorder> recorders = CreateLatencyRecorders(threadNum, roundOpNum * LARSON_ROUND_NUM);
+	auto begin = std::chrono::steady_clock::now();
+	for (size_t round = 0; round < LARSON_ROUND_NUM; round++)
+	{
+		std::vector<std::thread> threads;
+		for (unsigned int t = 0; t < threadNum; t++)
+		{
+			threads.emplace_back([&allocator, &recorders, &slotLists, t, round, threadNum, roundOpNum]()
+			{
+				LatencyRecorder& recorder = recorders[t];
+				std::vector<void*>& slots = slotLists[(t + round) % threadNum];
+				BenchmarkRandom random(42 + t + round * threadNum);
+				for (size_t i = 0; i < roundOpNum; i += 2)
+				{
+					size_t slot = random.Next() % LARSON_SLOT_NUM;
+					size_t size = 16 + random.Next() % 1009;
+					recorder.Free(allocator, slots[slot]);
+					slots[slot] = recorder.Alloc(allocator, size);
+					TouchBlock(slots[slot], size);
+				}
+			});
+		}
+		for (std::thread& thread : threads)
+			thread.join();
+	}
+	WorkloadResult result = FinishWorkload(recorders, (roundOpNum + 1) / 2 * 2 * threadNum * LARSON_ROUND_NUM, begin);
+
+	for (std::vector<void*>& slots : slotLists)
+	{
+		for (void* ptr : slots)
+			allocator.free(ptr);
+	}
+	return result;
+}
@@ -0,0 +1,278 @@
+#include "Benchmark.h"
+#include "../DynamicAllocator/DynamicAllocator.h"
+#include "../FixSizeAllocator/BirArray.h"
+#include "../FixSizeAllocator/FixSizeAllocator.h"
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+static void RunDynamicAllocatorChurn(const char* name, unsigned int policy)
+{
+	const size_t sizeHeap = 8 * 1024 * 1024;
+	const size_t slotNum = 4096;
+	const size_t opNum = 100000;
+
+	void* pHeapMemory = malloc(sizeHeap);
+	void** slots = static_cast<void**>(calloc(slotNum, sizeof(void*)));
+	DynamicAllocator* allocator = CreateDynamicAllocator(pHeapMemory, sizeHeap, policy);
+
+	BenchmarkRandom random(42);
+	size_t failNum = 0;
+	auto begin = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < opNum; i++)
+	{
+		size_t slot = random.Next() % slotNum;
+		if (slots[slot] != nullptr)
+		{
+			allocator->Free(slots[slot]);
+			slots[slot] = nullptr;
+		}
+		else
+		{
+			size_t size = 16 + random.Next() % 2033;
+			slots[slot] = allocator->Alloc(size);
+			if (slots[slot] == nullptr)
+				failNum++;
+		}
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	size_t totalFree = allocator->GetTotalFreeMemory();
+	size_t largestFree = allocator->GetLargestFreeBlock();
+	double nsPerOp = std::chrono::duration<double, std::nano>(end - begin).count() / opNum;
+	printf("%-34s %10.1f ns/op, failed allocations: %zu, free memory: %zu, largest free block: %zu (%.1f%%) \n",
+		name, nsPerOp, failNum, totalFree, largestFree, totalFree == 0 ? 0.0 : 100.0 * largestFree / totalFree);
+
+	free(slots);
+	free(pHeapMemory);
+}
+
+
+void DynamicAllocator_Benchmark()
+{
+	printf("Dynamic allocator benchmark: random alloc/free churn \n");
+	RunDynamicAllocatorChurn("First fit", POLICY_FIRST_FIT);
+	RunDynamicAllocatorChurn("Segregated fit", POLICY_SEGREGATED_FIT);
+	RunDynamicAllocatorChurn("First fit + coalesce on free", POLICY_FIRST_FIT | POLICY_COALESCE_ON_FREE);
+	RunDynamicAllocatorChurn("Segregated fit + coalesce on free", POLICY_SEGREGATED_FIT | POLICY_COALESCE_ON_FREE);
+}
+
+
+/* Reference implementation that scans the elements from the beginning, as BitArray used to do */
+static bool LinearFindFirstFreeBit(const BitArray* bitArray, size_t& outIdx)
+{
+	for (size_t idx = 0; idx < bitArray->length; idx++)
+	{
+		BitElement element = *bitArray->FindElementPtr(idx);
+		if (element != 0)
+		{
+			outIdx = idx * BIT_ELEMENT_SIZE + static_cast<size_t>(FindFirstSetBit(element));
+			return true;
+		}
+	}
+	return false;
+}
+
+
+void BitArray_Benchmark()
+{
+	const size_t blockNums[] = { 1024, 64 * 1024, 1024 * 1024 };
+	const size_t occupancies[] = { 50, 90, 99 };
+	const size_t opNum = 5000;
+
+	printf("Bit array benchmark: find, claim and release the first free bit \n");
+	for (size_t blockNum : blockNums)
+	{
+		void* pMemory = malloc(GetBitArraySize(blockNum));
+		BitArray* bitArray = CreateBitArray(pMemory, blockNum, true);
+
+		for (size_t occupancy : occupancies)
+		{
+			/* Blocks are claimed from the lowest index, the same as FixSizeAllocator does */
+			bitArray->SetAllBits();
+			for (size_t i = 0; i < blockNum * occupancy / 100; i++)
+				bitArray->ClearBit(i);
+
+			size_t bitIdx = 0;
+			auto begin = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < opNum; i++)
+			{
+				bitArray->FindFirstFreeBit(bitIdx);
+				bitArray->ClearBit(bitIdx);
+				bitArray->SetBit(bitIdx);
+			}
+			auto middle = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < opNum; i++)
+			{
+				LinearFindFirstFreeBit(bitArray, bitIdx);
+				bitArray->ClearBit(bitIdx);
+				bitArray->SetBit(bitIdx);
+			}
+			auto end = std::chrono::steady_clock::now();
+
+			double summaryNs = std::chrono::duration<double, std::nano>(middle - begin).count() / opNum;
+			double linearNs = std::chrono::duration<double, std::nano>(end - middle).count() / opNum;
+			printf("blocks: %8zu, occupancy: %3zu%%, summary: %10.1f ns/op, linear scan: %10.1f ns/op \n",
+				blockNum, occupancy, summaryNs, linearNs);
+		}
+
+		free(pMemory);
+	}
+}
+
+
+static void RunFixSizeAllocatorChurn(const char* name, unsigned int policy)
+{
+	const size_t blockNum = 64 * 1024;
+	const size_t blockSize = 16;
+	const size_t liveNum = blockNum * 90 / 100;
+	const size_t opNum = 1000000;
+	const size_t sizeHeap = GetBitArraySize(blockNum) + sizeof(FixSizeAllocator) + blockNum * blockSize;
+
+	void* pHeapMemory = malloc(sizeHeap);
+	void** slots = static_cast<void**>(malloc(liveNum * sizeof(void*)));
+	FixSizeAllocator* allocator = CreateFixSizeAllocator(pHeapMemory, blockNum, blockSize, sizeHeap, policy);
+	for (size_t i = 0; i < liveNum; i++)
+		slots[i] = allocator->Alloc();
+
+	/* Every step frees a random live block and allocates a new one in its place */
+	BenchmarkRandom random(42);
+	auto begin = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < opNum; i++)
+	{
+		size_t slot = random.Next() % liveNum;
+		allocator->Free(slots[slot]);
+		slots[slot] = allocator->Alloc();
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	double nsPerOp = std::chrono::duration<double, std::nano>(end - begin).count() / opNum;
+	printf("%-34s %10.1f ns/op (free + alloc) \n", name, nsPerOp);
+
+	free(slots);
+	free(pHeapMemory);
+}
+
+
+void FixSizeAllocator_Benchmark()
+{
+	printf("Fix size allocator benchmark: random free/alloc churn at 90%% occupancy \n");
+	RunFixSizeAllocatorChurn("Bit array", FIX_SIZE_POLICY_BIT_ARRAY);
+	RunFixSizeAllocatorChurn("Free list", FIX_SIZE_POLICY_FREE_LIST);
+	RunFixSizeAllocatorChurn("Free list + double free check", FIX_SIZE_POLICY_FREE_LIST | FIX_SIZE_POLICY_CHECK_DOUBLE_FREE);
+}
+
+
+void FixSizeAllocator_BatchBenchmark()
+{
+	const size_t blockNum = 64 * 1024;
+	const size_t blockSize = 16;
+	const size_t batchNum = 256;
+	const size_t roundNum = 2000;
+	const size_t sizeHeap = GetBitArraySize(blockNum) + sizeof(FixSizeAllocator) + blockNum * blockSize;
+
+	void* pHeapMemory = malloc(sizeHeap);
+	void* ptrs[batchNum];
+	printf("Fix size allocator benchmark: allocate and free %zu blocks at a time \n", batchNum);
+	for (int atomic = 0; atomic < 2; atomic++)
+	{
+		/* Keep half of the allocator allocated, so that the batches do not start at block 0 */
+		FixSizeAllocator* allocator = CreateFixSizeAllocator(pHeapMemory, blockNum, blockSize, sizeHeap);
+		for (size_t i = 0; i < blockNum / 2; i++)
+			allocator->Alloc();
+
+		auto begin = std::chrono::steady_clock::now();
+		for (size_t round = 0; round < roundNum; round++)
+		{
+			for (size_t i = 0; i < batchNum; i++)
+				ptrs[i] = atomic ? allocator->AtomicAlloc() : allocator->Alloc();
+			for (size_t i = 0; i < batchNum; i++)
+				atomic ? allocator->AtomicFree(ptrs[i]) : allocator->Free(ptrs[i]);
+		}
+		auto middle = std::chrono::steady_clock::now();
+		for (size_t round = 0; round < roundNum; round++)
+		{
+			atomic ? allocator->AtomicAllocBatch(batchNum, ptrs) : allocator->AllocBatch(batchNum, ptrs);
+			atomic ? allocator->AtomicFreeBatch(ptrs, batchNum) : allocator->FreeBatch(ptrs, batchNum);
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		double loopNs = std::chrono::duration<double, std::nano>(middle - begin).count() / (roundNum * batchNum);
+		double batchNs = std::chrono::duration<double, std::nano>(end - middle).count() / (roundNum * batchNum);
+		printf("%-8s one by one: %8.1f ns/block, batch: %8.1f ns/block \n", atomic ? "Atomic" : "Plain", loopNs, batchNs);
+	}
+	free(pHeapMemory);
+}
+
+
+static double RunFixSizeAllocatorThreads(FixSizeAllocator* allocator, unsigned int threadNum, bool atomic)
+{
+	const size_t slotNum = 64;
+	const size_t opNum = 200000;
+
+	std::mutex mutex;
+	std::vector<std::thread> threads;
+	threads.reserve(threadNum);
+	auto begin = std::chrono::steady_clock::now();
+	for (unsigned int t = 0; t < threadNum; t++)
+	{
+		threads.emplace_back([allocator, atomic, t, &mutex]()
+			{
+				void* slots[slotNum] = { nullptr };
+				BenchmarkRandom random(42 + t);
+				for (size_t i = 0; i < opNum; i++)
+				{
+					size_t slot = random.Next() % slotNum;
+					if (atomic)
+					{
+						if (slots[slot] != nullptr)
+							allocator->AtomicFree(slots[slot]);
+						slots[slot] = slots[slot] != nullptr ? nullptr : allocator->AtomicAlloc();
+					}
+					else
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						if (slots[slot] != nullptr)
+							allocator->Free(slots[slot]);
+						slots[slot] = slots[slot] != nullptr ? nullptr : allocator->Alloc();
+					}
+				}
+			});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+	auto end = std::chrono::steady_clock::now();
+
+	return threadNum * opNum / std::chrono::duration<double, std::micro>(end - begin).count();
+}
+
+
+void FixSizeAllocator_ConcurrentBenchmark()
+{
+	const size_t blockNum = 64 * 1024;
+	const size_t blockSize = 16;
+	const size_t sizeHeap = GetBitArraySize(blockNum) + sizeof(FixSizeAllocator) + blockNum * blockSize;
+
+	unsigned int maxThreadNum = std::thread::hardware_concurrency();
+	if (maxThreadNum == 0)
+		maxThreadNum = 1;
+
+	printf("Fix size allocator benchmark: alloc/free churn of threads sharing one allocator \n");
+	for (unsigned int threadNum = 1; ; threadNum = threadNum * 2 < maxThreadNum ? threadNum * 2 : maxThreadNum)
+	{
+		void* pHeapMemory = malloc(sizeHeap);
+		FixSizeAllocator* allocator = CreateFixSizeAllocator(pHeapMemory, blockNum, blockSize, sizeHeap);
+		double mutexOps = RunFixSizeAllocatorThreads(allocator, threadNum, false);
+
+		allocator = CreateFixSizeAllocator(pHeapMemory, blockNum, blockSize, sizeHeap);
+		double atomicOps = RunFixSizeAllocatorThreads(allocator, threadNum, true);
+		printf("threads: %3u, mutex: %8.2f Mops/s, atomic: %8.2f Mops/s \n", threadNum, mutexOps, atomicOps);
+
+		free(pHeapMemory);
+		if (threadNum == maxThreadNum)
+			break;
+	}
+}
\ No newline at end of file
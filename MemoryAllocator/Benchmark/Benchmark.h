@@ -0,0 +1,130 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/**
+* @brief Benchmarks of the memory allocator. Each benchmark runs the same workload on different
+*		 configurations of an allocator and prints the results, so that the configurations can be
+*		 compared with each other. Workloads use a fixed random seed, so that every configuration
+*		 sees exactly the same sequence of requests.
+*/
+
+
+/**
+* @brief A small deterministic random number generator for benchmark workloads.
+*/
+class BenchmarkRandom
+{
+public:
+	uint64_t state;
+
+	inline BenchmarkRandom(uint64_t seed) : state(seed) {}
+
+	inline uint32_t Next()
+	{
+		this->state = this->state * 6364136223846793005ULL + 1442695040888963407ULL;
+		return static_cast<uint32_t>(this->state >> 33);
+	}
+};
+
+
+/**
+* @brief Compare the policies of DynamicAllocator on a random alloc/free churn with sizes from 
+*		 16B to 2KB.
+*/
+void DynamicAllocator_Benchmark();
+
+
+/**
+* @brief Measure how long it takes BitArray to find and claim the first free bit, sweeping the
+*		 number of blocks and the occupancy of the bit array. The summary search is compared with
+*		 a linear scan over the elements.
+*/
+void BitArray_Benchmark();
+
+
+/**
+* @brief Compare the policies of FixSizeAllocator on a random free/alloc churn, with the allocator
+*		 kept at a fixed occupancy.
+*/
+void FixSizeAllocator_Benchmark();
+
+
+/**
+* @brief Compare allocating and freeing a batch of memory blocks one by one with AllocBatch() and 
+*		 FreeBatch(), with and without atomic operations.
+*/
+void FixSizeAllocator_BatchBenchmark();
+
+
+/**
+* @brief Measure the throughput of threads that allocate and free from one FixSizeAllocator, from 1
+*		 thread up to the number of hardware threads. Alloc()/Free() behind a mutex is compared with
+*		 AtomicAlloc()/AtomicFree().
+*/
+void FixSizeAllocator_ConcurrentBenchmark();
+
+/* One of this many alloc and free calls of a workload is timed, a power of 2. Reading the clock at
+ * every call would take longer than the calls themselves */
+const size_t LATENCY_SAMPLE_INTERVAL = 16;
+
+
+/**
+* @brief The allocation functions that a workload runs on, so that the same workload can be timed
+*		 on MemoryAllocator and on the allocator of the C runtime.
+*/
+struct BenchmarkAllocator
+{
+	const char* name;
+	void* (*alloc)(size_t size);
+	void (*free)(void* ptr);
+};
+
+
+/**
+* @brief The result of a workload.
+*
+* @param opNum -- The number of alloc and free calls of all threads;
+* @param seconds -- The wall time of the workload;
+* @param p50Ns, p99Ns -- The median and the 99th percentile latency of a single alloc or free call,
+*		 from a sample of the calls;
+*/
+struct WorkloadResult
+{
+	size_t opNum;
+	double seconds;
+	double p50Ns;
+	double p99Ns;
+};
+
+
+/**
+* @brief Each thread keeps 1024 blocks of 64B, and replaces a random one with a new block at every
+*		 step. It is the fast path of a single size class.
+*/
+WorkloadResult SameSizeChurn_Workload(const BenchmarkAllocator& allocator, unsigned int threadNum, size_t opNum);
+
+
+/**
+* @brief Each thread allocates blocks of random sizes from 1B to 1KB, freeing the last one about
+*		 every 7 allocations, and then frees the rest in random order, as MemorySystem_UnitTest()
+*		 does.
+*/
+WorkloadResult RandomSize_Workload(const BenchmarkAllocator& allocator, unsigned int threadNum, size_t opNum);
+
+
+/**
+* @brief Pairs of threads, one allocating blocks of 16B to 512B and handing them over through a
+*		 ring buffer, the other freeing them. Every free is a free of another thread's memory.
+*/
+WorkloadResult ProducerConsumer_Workload(const BenchmarkAllocator& allocator, unsigned int threadNum, size_t opNum);
+
+
+/**
+* @brief Larson-style server churn: each thread replaces random blocks of 16B to 1KB in an array of
+*		 1000 blocks. The threads are replaced every round, and each new thread takes over the array
+*		 of another one, so blocks are freed by a different thread than the one that allocated them.
+*/
+WorkloadResult Larson_Workload(const BenchmarkAllocator& allocator, unsigned int threadNum, size_t opNum);
@@ -0,0 +1,129 @@
+/* The benchmark program that compares the memory allocator with the malloc of the C runtime on
+ * Linux. It is not part of the Visual Studio project, since it runs each workload in a child
+ * process to measure its peak memory. Build it from the MemoryAllocator folder with
+ *
+ *	g++ -std=c++17 -O2 -pthread -o benchmark $(find . -name '*.cpp' ! -name UnitTest.cpp ! -name Replay.cpp ! -name Preload.cpp ! -name PreloadTest.cpp)
+ *
+ * and run it as "./benchmark [threadNum] [opNum in millions]" */
+#include "../MemoryAllocator.h"
+#include "Benchmark.h"
+
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <thread>
+
+
+/* The address space reserved for the memory allocator, and the memory committed at start */
+const size_t BENCHMARK_RESERVE_SIZE = 16ull * 1024 * 1024 * 1024;
+const size_t BENCHMARK_INITIAL_SIZE = 4 * 1024 * 1024;
+
+
+typedef WorkloadResult (*Workload)(const BenchmarkAllocator& allocator, unsigned int threadNum, size_t opNum);
+
+struct BenchmarkWorkload
+{
+	const char* name;
+	Workload run;
+};
+
+
+static const BenchmarkWorkload workloads[] =
+{
+	{ "same-size churn", SameSizeChurn_Workload },
+	{ "random 1B-1KB", RandomSize_Workload },
+	{ "producer/consumer", ProducerConsumer_Workload },
+	{ "larson", Larson_Workload },
+};
+
+static const BenchmarkAllocator allocators[] =
+{
+	{ "MemoryAllocator", static_cast<void* (*)(size_t)>(Alloc), static_cast<void (*)(void*)>(Free) },
+	{ "glibc malloc", malloc, free },
+};
+
+
+/**
+* @brief Run a workload in a child process and print a line of its results. The peak resident
+*		 memory of the child is its footprint. The memory allocator is initialized in both
+*		 cases, since operator new of the benchmark itself goes to it, so the difference of the
+*		 footprints is the difference of the allocators.
+*/
+static bool RunInChild(const BenchmarkWorkload& workload, const BenchmarkAllocator& allocator, unsigned int threadNum, size_t opNum)
+{
+	int fds[2];
+	if (pipe(fds) != 0)
+		return false;
+
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+
+	if (pid == 0)
+	{
+		close(fds[0]);
+		if (!InitializeGrowableMemoryAllocator(BENCHMARK_RESERVE_SIZE, BENCHMARK_INITIAL_SIZE, threadNum))
+			_exit(1);
+
+		WorkloadResult result = workload.run(allocator, threadNum, opNum);
+		bool success = write(fds[1], &result, sizeof(result)) == static_cast<ssize_t>(sizeof(result));
+		_exit(success ? 0 : 1);
+	}
+
+	close(fds[1]);
+	WorkloadResult result;
+	bool success = read(fds[0], &result, sizeof(result)) == static_cast<ssize_t>(sizeof(result));
+	close(fds[0]);
+
+	int status = 0;
+	struct rusage usage;
+	memset(&usage, 0, sizeof(usage));
+	if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		success = false;
+
+	if (!success)
+	{
+		printf("%-18s %-16s %7u   failed \n", workload.name, allocator.name, threadNum);
+		return false;
+	}
+
+	printf("%-18s %-16s %7u %10.2f %8.0f %8.0f %10.1f \n", workload.name, allocator.name, threadNum,
+		static_cast<double>(result.opNum) / result.seconds / 1e6, result.p50Ns, result.p99Ns,
+		static_cast<double>(usage.ru_maxrss) / 1024.0);
+	return true;
+}
+
+
+int main(int argc, char** argv)
+{
+	unsigned int threadNum = std::thread::hardware_concurrency();
+	if (argc > 1)
+		threadNum = static_cast<unsigned int>(atoi(argv[1]));
+	if (threadNum == 0)
+		threadNum = 1;
+
+	size_t opNum = 20 * 1000 * 1000;
+	if (argc > 2 && atoi(argv[2]) > 0)
+		opNum = static_cast<size_t>(atoi(argv[2])) * 1000 * 1000;
+
+	printf("Allocator benchmark: %zu alloc and free calls, 1 of %zu timed \n", opNum, LATENCY_SAMPLE_INTERVAL);
+	printf("%-18s %-16s %7s %10s %8s %8s %10s \n", "workload", "allocator", "threads", "Mops/s", "p50 ns", "p99 ns", "peak MB");
+
+	bool success = true;
+	for (const BenchmarkWorkload& workload : workloads)
+	{
+		for (unsigned int t = 1; ; t = t * 2 < threadNum ? t * 2 : threadNum)
+		{
+			for (const BenchmarkAllocator& allocator : allocators)
+				success = RunInChild(workload, allocator, t, opNum) && success;
+			if (t == threadNum)
+				break;
+		}
+	}
+	return success ? 0 : 1;
+}
@@ -1,364 +1,1032 @@
-#include "DynamicAllocator.h"
-
-
-
-DynamicAllocator* CreateDynamicAllocator(void* baseAddr, size_t size)
-{
-	DynamicAllocator* allocator = static_cast<DynamicAllocator*>(baseAddr);
-	allocator->baseAddr = baseAddr;
-	allocator->heapSize = size;
-	allocator->freeList = nullptr;
-	allocator->allocList = nullptr;
-
-	/* The size of the heap memory block should be larger than the size
-		of heap allocator plus the size of the first freeBlock node. The rest
-		memory space the actual free memory*/
-	if (size - MANAGER_SIZE - BLOCK_SIZE < 0)
-		return nullptr;
-
-	void* firstBlockAddr = PointerAdd(baseAddr, MANAGER_SIZE);
-	MemoryBlock* freeBlock = CreateMemoryBlock(firstBlockAddr, size - MANAGER_SIZE - BLOCK_SIZE);
-	allocator->freeList = freeBlock;
-
-	return allocator;
-}
-
-
-MemoryBlock* CreateMemoryBlock(void* ptr, size_t size)
-{
-	MemoryBlock* block = static_cast<MemoryBlock*>(ptr);
-	void* baseAddr = PointerAdd(ptr, BLOCK_SIZE);;
-	block->baseAddr = baseAddr;
-	block->blockSize = size;
-	block->nextBlock = nullptr;
-	block->prevBlock = nullptr;
-
-	return block;
-}
-
-
-MemoryBlock* DynamicAllocator::ShrinkMemoryBlock(MemoryBlock* block, size_t shrinkSize)
-{
-	MemoryBlock* newBlock;
-	newBlock = static_cast<MemoryBlock*>(PointerAdd(block, shrinkSize));
-	newBlock->baseAddr = PointerAdd(block->baseAddr, shrinkSize);
-	newBlock->blockSize = block->blockSize - shrinkSize;
-	newBlock->nextBlock = block->nextBlock;
-	newBlock->prevBlock = block->prevBlock;
-
-	if (block->prevBlock != nullptr)
-		block->prevBlock->nextBlock = newBlock;
-	else
-	{
-		if (this->freeList == block)
-			this->freeList = newBlock;
-		else
-			this->allocList = newBlock;
-	}
-
-	if (block->nextBlock != nullptr)
-		block->nextBlock->prevBlock = newBlock;
-
-	return newBlock;
-}
-
-
-void* DynamicAllocator::Alloc(size_t size, const unsigned int alignment)
-{
-	/* Align the size */
-	if (alignment != 0 && size % alignment != 0)
-		size = alignment * ((size + alignment) / alignment);
-
-	/* Try to find free block that has sufficient size */
-	MemoryBlock* freeBlock = this->freeList;
-	while (freeBlock != nullptr)
-	{
-		if (freeBlock->blockSize >= size + BLOCK_SIZE)
-		{
-			/* If free block is not starting with an aligned address, create buffer block to make it align  */
-			if (alignment != 0 && reinterpret_cast<uintptr_t>(PointerSub(freeBlock->baseAddr, this->baseAddr)) % alignment != 0)
-			{
-				/* (base address) + (node size of buffer) + (size of buffer) should satisfy the alignment requirement */
-				size_t bufferSize = alignment - ((reinterpret_cast<uintptr_t>(freeBlock->baseAddr) + BLOCK_SIZE) % alignment);
-
-				if (bufferSize == 0)
-					bufferSize += alignment;
-
-				if (freeBlock->blockSize >= size + (BLOCK_SIZE + bufferSize) + BLOCK_SIZE)
-				{
-					MemoryBlock* newAddr = this->ShrinkMemoryBlock(freeBlock, bufferSize + BLOCK_SIZE);
-					MemoryBlock* bufferBlock = CreateMemoryBlock(freeBlock, bufferSize);
-					this->AddFreeBlockToList(bufferBlock);
-					freeBlock = newAddr;
-
-					break;
-				}
-			}
-			else
-				break;
-		}
-
-		freeBlock = freeBlock->nextBlock;
-	}
-
-	/* Return NULL pointer if there is no free memory to allocate */
-	if (freeBlock == nullptr)
-		return nullptr;
-
-
-	/* Allocate the memory to the block */
-	this->ShrinkMemoryBlock(freeBlock, size + BLOCK_SIZE);
-	MemoryBlock* allocBlock = CreateMemoryBlock(freeBlock, size);
-	this->AddAllocBlockToList(allocBlock);
-
-	return allocBlock->baseAddr;
-}
-
-
-bool DynamicAllocator::Free(void* ptr)
-{
-	MemoryBlock* block = this->allocList;
-	while (block != nullptr)
-	{
-		if (block->baseAddr == ptr)
-		{
-			MemoryBlock* prev = block->prevBlock;
-			MemoryBlock* next = block->nextBlock;
-
-			if (prev == nullptr)
-				this->allocList = next;
-			else
-				prev->nextBlock = next;
-
-			if (next != nullptr)
-				next->prevBlock = prev;
-
-			this->AddFreeBlockToList(block);
-			return true;
-		}
-		else
-			block = block->nextBlock;
-	}
-
-	return false;
-}
-
-
-void DynamicAllocator::Collect()
-{
-	MemoryBlock* block = this->freeList;
-
-	while (block != nullptr && block->nextBlock != nullptr)
-	{
-		if (reinterpret_cast<uintptr_t>(block->baseAddr) + block->blockSize == reinterpret_cast<uintptr_t>(block->nextBlock))
-		{
-			block->blockSize += BLOCK_SIZE + block->nextBlock->blockSize;
-
-			MemoryBlock* nextNextBlock = block->nextBlock->nextBlock;
-			if (nextNextBlock != nullptr)
-				nextNextBlock->prevBlock = block;
-
-			block->nextBlock = nextNextBlock;
-		}
-		else
-			block = block->nextBlock;
-	}
-}
-
-
-void DynamicAllocator::Destroy()
-{
-	MemoryBlock* block = this->freeList;
-	while (block != nullptr)
-	{
-		MemoryBlock* tempBlock = block;
-		block = block->nextBlock;
-		tempBlock->nextBlock = nullptr;
-		tempBlock->prevBlock = nullptr;
-		tempBlock = nullptr;
-		delete tempBlock;
-	}
-
-	block = this->allocList;
-	while (block != nullptr)
-	{
-		MemoryBlock* tempBlock = block;
-		block = block->nextBlock;
-		tempBlock->nextBlock = nullptr;
-		tempBlock->prevBlock = nullptr;
-		tempBlock = nullptr;
-		delete tempBlock;
-	}
-
-	//allocator = nullptr;
-}
-
-
-void DynamicAllocator::AddAllocBlockToList(MemoryBlock* allocBlock)
-{
-	if (this->allocList == nullptr)
-	{
-		allocBlock->prevBlock = nullptr;
-		allocBlock->nextBlock = nullptr;
-	}
-	else
-	{
-		allocBlock->prevBlock = nullptr;
-		allocBlock->nextBlock = this->allocList;
-		this->allocList->prevBlock = allocBlock;
-	}
-
-	this->allocList = allocBlock;
-}
-
-
-void DynamicAllocator::AddFreeBlockToList(MemoryBlock* freeBlock)
-{
-	MemoryBlock* prevBlock = this->freeList;
-	MemoryBlock* currBlock = this->freeList;
-
-	/* If the free list is empty */
-	if (currBlock == nullptr)
-	{
-		freeBlock->nextBlock = nullptr;
-		freeBlock->prevBlock = nullptr;
-		this->freeList = freeBlock;
-		return;
-	}
-
-	/* If the new free block have the most forward address */
-	if (freeBlock->baseAddr < currBlock->baseAddr)
-	{
-		freeBlock->nextBlock = currBlock;
-		freeBlock->prevBlock = nullptr;
-		currBlock->prevBlock = freeBlock;
-		this->freeList = freeBlock;
-		return;
-	}
-
-	/* If the new free block have a middle address */
-	currBlock = currBlock->nextBlock;
-	while (currBlock != nullptr)
-	{
-		if (freeBlock->baseAddr < currBlock->baseAddr)
-		{
-			freeBlock->prevBlock = prevBlock;
-			freeBlock->nextBlock = currBlock;
-			prevBlock->nextBlock = freeBlock;
-			currBlock->prevBlock = freeBlock;
-			return;
-		}
-		else
-		{
-			currBlock = currBlock->nextBlock;
-			prevBlock = prevBlock->nextBlock;
-		}
-	}
-
-	/* If the new free block have the last address */
-	freeBlock->prevBlock = prevBlock;
-	freeBlock->nextBlock = nullptr;
-	prevBlock->nextBlock = freeBlock;
-
-	return;
-}
-
-
-bool DynamicAllocator::Contains(const void* ptr) const
-{
-	MemoryBlock* block = this->allocList;
-	while (block != nullptr)
-	{
-		if (block->baseAddr == ptr)
-			return true;
-		else
-			block = block->nextBlock;
-	}
-
-	block = this->freeList;
-	while (block != nullptr)
-	{
-		if (block->baseAddr == ptr)
-			return true;
-		else
-			block = block->nextBlock;
-	}
-
-	return false;
-}
-
-
-bool DynamicAllocator::IsAllocated(const void* ptr) const
-{
-	MemoryBlock* block = this->allocList;
-	while (block != nullptr)
-	{
-		if (block->baseAddr == ptr)
-			return true;
-		else
-			block = block->nextBlock;
-	}
-	return false;
-}
-
-
-size_t DynamicAllocator::GetLargestFreeBlock() const
-{
-	size_t result = 0;
-	MemoryBlock* freeBlock = this->freeList;
-
-	while (freeBlock != nullptr)
-	{
-		if (freeBlock->blockSize > result)
-			result = freeBlock->blockSize;
-
-		freeBlock = freeBlock->nextBlock;
-	}
-
-	return result;
-}
-
-
-size_t DynamicAllocator::GetTotalFreeMemory() const
-{
-	size_t result = 0;
-	MemoryBlock* freeBlock = this->freeList;
-
-	while (freeBlock != nullptr)
-	{
-		result += freeBlock->blockSize;
-		freeBlock = freeBlock->nextBlock;
-	}
-
-	return result;
-}
-
-
-void DynamicAllocator::ShowFreeBlocks() const
-{
-	printf("\n\n!!!###########################!!! \n Start showing free blocks: ");
-
-	MemoryBlock* block = this->freeList;
-	while (block != nullptr)
-	{
-		printf("\n--------------------------------------------------------------\n");
-		printf("Free Block Node Address: %p, Free Block Address: %p, Free Block Size: %zu",
-			block, block->baseAddr, block->blockSize);
-		block = block->nextBlock;
-	}
-}
-
-
-void DynamicAllocator::ShowOutstandingAllocations() const
-{
-	printf("\n\n!!!###########################!!! \n Start showing allocated blocks: ");
-
-	MemoryBlock* block = this->allocList;
-	while (block != nullptr)
-	{
-		printf("\n--------------------------------------------------------------\n");
-		printf("Alloc Block Node Address: %p, Alloc Block Address: %p, Alloc Block Size: %zu",
-			block, block->baseAddr, block->blockSize);
-		block = block->nextBlock;
-	}
-}
+#include "DynamicAllocator.h"
+#include <string.h>
+#include "../VirtualMemory/VirtualMemory.h"
+
+
+
+DynamicAllocator* CreateDynamicAllocator(void* baseAddr, size_t size, unsigned int policy)
+{
+	DynamicAllocator* allocator = static_cast<DynamicAllocator*>(baseAddr);
+	allocator->baseAddr = baseAddr;
+	allocator->heapSize = size;
+	allocator->policy = policy;
+	allocator->freeList = nullptr;
+	allocator->allocList = nullptr;
+	allocator->flBitmap = 0;
+	allocator->trimThreshold = TRIM_DEFAULT_THRESHOLD;
+	allocator->allocCount = 0;
+	allocator->freeCount = 0;
+	allocator->allocBlockNum = 0;
+	allocator->allocSize = 0;
+	allocator->maxAllocSize = 0;
+	for (size_t i = 0; i < FL_INDEX_COUNT; i++)
+	{
+		allocator->slBitmap[i] = 0;
+		for (size_t j = 0; j < SL_INDEX_COUNT; j++)
+			allocator->freeBins[i][j] = nullptr;
+	}
+
+	/* The size of the heap memory block should be larger than the size
+		of heap allocator plus the size of the first freeBlock node and its
+		boundary tag. The rest memory space the actual free memory. Every
+		block starts at an address aligned to BLOCK_ALIGNMENT */
+	uintptr_t beginAddr = reinterpret_cast<uintptr_t>(PointerAdd(baseAddr, MANAGER_SIZE));
+	uintptr_t endAddr = reinterpret_cast<uintptr_t>(PointerAdd(baseAddr, size));
+	beginAddr = (beginAddr + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+	endAddr = endAddr / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+	if (size < MANAGER_SIZE || endAddr < beginAddr + BLOCK_SIZE + TAG_SIZE)
+		return nullptr;
+
+	allocator->blockBeginAddr = reinterpret_cast<void*>(beginAddr);
+	allocator->blockEndAddr = reinterpret_cast<void*>(endAddr);
+	MemoryBlock* freeBlock = CreateMemoryBlock(allocator->blockBeginAddr, endAddr - beginAddr - BLOCK_SIZE - TAG_SIZE);
+	allocator->InsertFreeBlock(freeBlock);
+	allocator->zeroBeginAddr = (policy & POLICY_ZEROED_MEMORY) ? freeBlock->baseAddr : allocator->blockEndAddr;
+
+	return allocator;
+}
+
+
+MemoryBlock* CreateMemoryBlock(void* ptr, size_t size, size_t blockTag)
+{
+	MemoryBlock* block = static_cast<MemoryBlock*>(ptr);
+	void* baseAddr = PointerAdd(ptr, BLOCK_SIZE);
+	block->baseAddr = baseAddr;
+	block->blockSize = size;
+	block->nextBlock = nullptr;
+	block->prevBlock = nullptr;
+
+	MemoryBlockTag* tag = static_cast<MemoryBlockTag*>(PointerAdd(baseAddr, size));
+	tag->block = block;
+	tag->blockTag = blockTag;
+
+	return block;
+}
+
+
+MemoryBlock* DynamicAllocator::ShrinkMemoryBlock(MemoryBlock* block, size_t shrinkSize)
+{
+	/* The header moves into the user memory of the block, so read the trim record first */
+	void* trimBeginAddr = nullptr;
+	void* trimEndAddr = nullptr;
+	if (this->policy & POLICY_TRIMMABLE)
+		this->ReadTrimRecord(block, trimBeginAddr, trimEndAddr);
+
+	MemoryBlock* newBlock;
+	newBlock = static_cast<MemoryBlock*>(PointerAdd(block, shrinkSize));
+	newBlock->baseAddr = PointerAdd(block->baseAddr, shrinkSize);
+	newBlock->blockSize = block->blockSize - shrinkSize;
+	newBlock->nextBlock = block->nextBlock;
+	newBlock->prevBlock = block->prevBlock;
+	this->GetBlockTag(newBlock)->block = newBlock;
+
+	if (block->prevBlock != nullptr)
+		block->prevBlock->nextBlock = newBlock;
+	else
+	{
+		if (this->freeList == block)
+			this->freeList = newBlock;
+		else
+			this->allocList = newBlock;
+	}
+
+	if (block->nextBlock != nullptr)
+		block->nextBlock->prevBlock = newBlock;
+
+	if (this->policy & POLICY_TRIMMABLE)
+		this->WriteTrimRecord(newBlock, trimBeginAddr, trimEndAddr);
+	return newBlock;
+}
+
+
+MemoryBlock* DynamicAllocator::SplitMemoryBlock(MemoryBlock* block, size_t size)
+{
+	if (block->blockSize < size + BLOCK_SIZE + TAG_SIZE)
+		return nullptr;
+
+	/* The rest block of a free block keeps the trimmed pages that are still in it */
+	size_t blockTag = this->GetBlockTag(block)->blockTag;
+	void* trimBeginAddr = nullptr;
+	void* trimEndAddr = nullptr;
+	if ((this->policy & POLICY_TRIMMABLE) && blockTag == BLOCK_TAG_FREE)
+		this->ReadTrimRecord(block, trimBeginAddr, trimEndAddr);
+
+	void* restAddr = PointerAdd(block->baseAddr, size + TAG_SIZE);
+	MemoryBlock* restBlock = CreateMemoryBlock(restAddr, block->blockSize - size - TAG_SIZE - BLOCK_SIZE);
+	if (this->policy & POLICY_TRIMMABLE)
+		this->WriteTrimRecord(restBlock, trimBeginAddr, trimEndAddr);
+
+	block->blockSize = size;
+	MemoryBlockTag* tag = this->GetBlockTag(block);
+	tag->block = block;
+	tag->blockTag = blockTag;
+
+	return restBlock;
+}
+
+
+void* DynamicAllocator::Alloc(size_t size, size_t alignment)
+{
+	/* Align the size, so that the boundary tag and the next header are aligned as well. A size that
+	 * overflows when it is aligned can never fit */
+	if (size > SIZE_MAX - (BLOCK_ALIGNMENT - 1))
+		return nullptr;
+	size = (size + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+
+	if (this->policy & POLICY_SEGREGATED_FIT)
+		return this->AllocSegregatedFit(size, alignment);
+	else
+		return this->AllocFirstFit(size, alignment);
+}
+
+
+void* DynamicAllocator::AllocFirstFit(size_t size, size_t alignment)
+{
+	/* Try to find free block that has sufficient size */
+	MemoryBlock* freeBlock = this->freeList;
+	while (freeBlock != nullptr)
+	{
+		/* If free block is not starting with an aligned address, create buffer block to make it align  */
+		if (alignment > BLOCK_ALIGNMENT && reinterpret_cast<uintptr_t>(freeBlock->baseAddr) % alignment != 0)
+		{
+			/* (block address) + (size of buffer block) + (node size of new block) should satisfy the alignment 
+			 * requirement, and buffer block should be large enough to hold its own node and boundary tag */
+			size_t bufferSize = alignment - (reinterpret_cast<uintptr_t>(freeBlock->baseAddr) % alignment);
+			while (bufferSize < BLOCK_SIZE + TAG_SIZE)
+				bufferSize += alignment;
+
+			if (freeBlock->blockSize >= bufferSize && freeBlock->blockSize - bufferSize >= size)
+			{
+				MemoryBlock* newAddr = this->ShrinkMemoryBlock(freeBlock, bufferSize);
+				MemoryBlock* bufferBlock = CreateMemoryBlock(freeBlock, bufferSize - BLOCK_SIZE - TAG_SIZE);
+
+				/* Buffer block is right before the shrunk block, so it takes the place of the shrunk 
+				 * block in the address-ordered free list */
+				bufferBlock->prevBlock = newAddr->prevBlock;
+				bufferBlock->nextBlock = newAddr;
+				if (newAddr->prevBlock != nullptr)
+					newAddr->prevBlock->nextBlock = bufferBlock;
+				else
+					this->freeList = bufferBlock;
+				newAddr->prevBlock = bufferBlock;
+
+				freeBlock = newAddr;
+				break;
+			}
+		}
+		else if (freeBlock->blockSize >= size)
+			break;
+
+		freeBlock = freeBlock->nextBlock;
+	}
+
+	/* Return NULL pointer if there is no free memory to allocate */
+	if (freeBlock == nullptr)
+		return nullptr;
+
+
+	/* Allocate the memory to the block. If the rest of the free block is too small to hold a node and 
+	 * a boundary tag, the whole free block is allocated */
+	if (freeBlock->blockSize >= size + BLOCK_SIZE + TAG_SIZE)
+		this->ShrinkMemoryBlock(freeBlock, BLOCK_SIZE + size + TAG_SIZE);
+	else
+	{
+		size = freeBlock->blockSize;
+		if (freeBlock->prevBlock != nullptr)
+			freeBlock->prevBlock->nextBlock = freeBlock->nextBlock;
+		else
+			this->freeList = freeBlock->nextBlock;
+
+		if (freeBlock->nextBlock != nullptr)
+			freeBlock->nextBlock->prevBlock = freeBlock->prevBlock;
+	}
+
+	MemoryBlock* allocBlock = CreateMemoryBlock(freeBlock, size, BLOCK_TAG_ALLOCATED);
+	this->AddAllocBlockToList(allocBlock);
+	this->MarkBlockUsed(allocBlock);
+
+	return allocBlock->baseAddr;
+}
+
+
+void* DynamicAllocator::AllocSegregatedFit(size_t size, size_t alignment)
+{
+	/* Reserve room for a buffer block in front of the user memory if it needs to be aligned */
+	size_t searchSize = size;
+	if (alignment > BLOCK_ALIGNMENT)
+	{
+		if (size > SIZE_MAX - alignment - BLOCK_SIZE - TAG_SIZE)
+			return nullptr;
+		searchSize += alignment + BLOCK_SIZE + TAG_SIZE;
+	}
+
+	MemoryBlock* freeBlock = this->FindFreeBlockInBins(searchSize);
+	if (freeBlock == nullptr)
+		return nullptr;
+	this->RemoveFreeBlockFromBin(freeBlock);
+
+	/* If free block is not starting with an aligned address, split a buffer block from its front */
+	if (alignment > BLOCK_ALIGNMENT && reinterpret_cast<uintptr_t>(freeBlock->baseAddr) % alignment != 0)
+	{
+		size_t bufferSize = alignment - (reinterpret_cast<uintptr_t>(freeBlock->baseAddr) % alignment);
+		while (bufferSize < BLOCK_SIZE + TAG_SIZE)
+			bufferSize += alignment;
+
+		MemoryBlock* alignedBlock = this->SplitMemoryBlock(freeBlock, bufferSize - BLOCK_SIZE - TAG_SIZE);
+		this->AddFreeBlockToBin(freeBlock);
+		freeBlock = alignedBlock;
+	}
+
+	/* Give the rest of the free block back to the segregated lists */
+	MemoryBlock* restBlock = this->SplitMemoryBlock(freeBlock, size);
+	if (restBlock != nullptr)
+		this->AddFreeBlockToBin(restBlock);
+
+	this->GetBlockTag(freeBlock)->blockTag = BLOCK_TAG_ALLOCATED;
+	this->AddAllocBlockToList(freeBlock);
+	this->MarkBlockUsed(freeBlock);
+
+	return freeBlock->baseAddr;
+}
+
+
+bool DynamicAllocator::Free(void* ptr)
+{
+	MemoryBlock* block = this->FindMemoryBlock(ptr);
+	if (block == nullptr || this->GetBlockTag(block)->blockTag != BLOCK_TAG_ALLOCATED)
+		return false;
+
+	this->RemoveAllocBlockFromList(block);
+	this->GetBlockTag(block)->blockTag = BLOCK_TAG_FREE;
+	if (this->policy & POLICY_TRIMMABLE)
+		this->WriteTrimRecord(block, nullptr, nullptr);
+
+	/* Merge with free physical neighbours right away, found by the boundary tags */
+	if (this->policy & POLICY_COALESCE_ON_FREE)
+	{
+		MemoryBlock* prevBlock = this->GetPrevPhysicalBlock(block);
+		if (prevBlock != nullptr && this->GetBlockTag(prevBlock)->blockTag == BLOCK_TAG_FREE)
+		{
+			this->RemoveFreeBlock(prevBlock);
+			this->MergeMemoryBlock(prevBlock, block);
+			block = prevBlock;
+		}
+
+		MemoryBlock* nextBlock = this->GetNextPhysicalBlock(block);
+		if (nextBlock != nullptr && this->GetBlockTag(nextBlock)->blockTag == BLOCK_TAG_FREE)
+		{
+			this->RemoveFreeBlock(nextBlock);
+			this->MergeMemoryBlock(block, nextBlock);
+		}
+	}
+
+	this->InsertFreeBlock(block);
+	if ((this->policy & POLICY_TRIMMABLE) && this->trimThreshold != 0 && block->blockSize >= this->trimThreshold)
+		this->TrimBlock(block);
+	return true;
+}
+
+
+bool DynamicAllocator::Expand(void* ptr, size_t newSize)
+{
+	MemoryBlock* block = this->FindMemoryBlock(ptr);
+	if (block == nullptr || this->GetBlockTag(block)->blockTag != BLOCK_TAG_ALLOCATED)
+		return false;
+
+	/* A size that overflows when it is aligned can not be grown to */
+	if (newSize > SIZE_MAX - (BLOCK_ALIGNMENT - 1))
+		return false;
+
+	size_t oldSize = block->blockSize;
+	newSize = (newSize + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+	if (newSize > block->blockSize)
+	{
+		MemoryBlock* nextBlock = this->GetNextPhysicalBlock(block);
+		if (nextBlock == nullptr || this->GetBlockTag(nextBlock)->blockTag != BLOCK_TAG_FREE || 
+			block->blockSize + TAG_SIZE + BLOCK_SIZE + nextBlock->blockSize < newSize)
+			return false;
+
+		/* The merged block takes the boundary tag of the free block, mark it as allocated again */
+		this->RemoveFreeBlock(nextBlock);
+		this->MergeMemoryBlock(block, nextBlock);
+		this->GetBlockTag(block)->blockTag = BLOCK_TAG_ALLOCATED;
+	}
+
+	/* Give the tail back. It is merged with the next physical block if that block is free, so 
+	 * shrinking a block does not leave a small fragment next to a free block */
+	MemoryBlock* restBlock = this->SplitMemoryBlock(block, newSize);
+	if (restBlock != nullptr)
+	{
+		MemoryBlock* nextBlock = this->GetNextPhysicalBlock(restBlock);
+		if (nextBlock != nullptr && this->GetBlockTag(nextBlock)->blockTag == BLOCK_TAG_FREE)
+		{
+			this->RemoveFreeBlock(nextBlock);
+			this->MergeMemoryBlock(restBlock, nextBlock);
+		}
+		this->InsertFreeBlock(restBlock);
+	}
+	this->allocSize = this->allocSize - oldSize + block->blockSize;
+	if (this->allocSize > this->maxAllocSize)
+		this->maxAllocSize = this->allocSize;
+	this->MarkBlockUsed(block);
+	return true;
+}
+
+
+void* DynamicAllocator::Realloc(void* ptr, size_t newSize)
+{
+	if (this->Expand(ptr, newSize))
+		return ptr;
+
+	size_t oldSize = this->GetAllocationSize(ptr);
+	if (oldSize == 0)
+		return nullptr;
+
+	void* newPtr = this->Alloc(newSize);
+	if (newPtr == nullptr)
+		return nullptr;
+
+	memcpy(newPtr, ptr, oldSize < newSize ? oldSize : newSize);
+	this->Free(ptr);
+	return newPtr;
+}
+
+
+void* DynamicAllocator::Calloc(size_t num, size_t size)
+{
+	if (size != 0 && num > SIZE_MAX / size)
+		return nullptr;
+
+	size_t totalSize = num * size;
+	void* zeroBeginAddr = this->zeroBeginAddr;
+	void* ptr = this->Alloc(totalSize);
+	if (ptr == nullptr || ptr >= zeroBeginAddr)
+		return ptr;
+
+	/* Memory above the old "zeroBeginAddr" has never been written */
+	size_t dirtySize = reinterpret_cast<uintptr_t>(PointerSub(zeroBeginAddr, ptr));
+	memset(ptr, 0, dirtySize < totalSize ? dirtySize : totalSize);
+	return ptr;
+}
+
+
+size_t DynamicAllocator::GetAllocationSize(const void* ptr) const
+{
+	MemoryBlock* block = this->FindMemoryBlock(ptr);
+	if (block == nullptr || this->GetBlockTag(block)->blockTag != BLOCK_TAG_ALLOCATED)
+		return 0;
+	return block->blockSize;
+}
+
+
+MemoryBlock* DynamicAllocator::FindMemoryBlock(const void* ptr) const
+{
+	/* The address should be inside the memory space and properly aligned, otherwise reading its 
+	 * header may access memory that does not belong to dynamic allocator */
+	if (ptr < PointerAdd(this->blockBeginAddr, BLOCK_SIZE) || ptr >= this->blockEndAddr)
+		return nullptr;
+	if (reinterpret_cast<uintptr_t>(ptr) % BLOCK_ALIGNMENT != 0)
+		return nullptr;
+
+	MemoryBlock* block = static_cast<MemoryBlock*>(PointerSub(ptr, BLOCK_SIZE));
+	if (block->baseAddr != ptr)
+		return nullptr;
+	if (block->blockSize > reinterpret_cast<uintptr_t>(PointerSub(this->blockEndAddr, ptr)) - TAG_SIZE)
+		return nullptr;
+
+	MemoryBlockTag* tag = this->GetBlockTag(block);
+	if (tag->block != block || (tag->blockTag != BLOCK_TAG_FREE && tag->blockTag != BLOCK_TAG_ALLOCATED))
+		return nullptr;
+
+	return block;
+}
+
+
+void DynamicAllocator::MergeMemoryBlock(MemoryBlock* block, MemoryBlock* nextBlock)
+{
+	/* A free block that has not been trimmed takes over the trimmed pages of the next block */
+	void* trimBeginAddr = nullptr;
+	void* trimEndAddr = nullptr;
+	bool takeTrimRecord = (this->policy & POLICY_TRIMMABLE) && this->GetBlockTag(block)->blockTag == BLOCK_TAG_FREE &&
+		!this->ReadTrimRecord(block, trimBeginAddr, trimEndAddr) && this->ReadTrimRecord(nextBlock, trimBeginAddr, trimEndAddr);
+
+	block->blockSize += TAG_SIZE + BLOCK_SIZE + nextBlock->blockSize;
+	this->GetBlockTag(block)->block = block;
+	if (takeTrimRecord)
+		this->WriteTrimRecord(block, trimBeginAddr, trimEndAddr);
+}
+
+
+/**
+* @brief Give the pages from "beginAddr" to "endAddr" back to the OS, and add the number of bytes to
+*		 "trimmedSize". Return false if the OS refuses.
+*/
+static bool ResetPages(void* beginAddr, void* endAddr, size_t& trimmedSize)
+{
+	if (endAddr <= beginAddr)
+		return true;
+
+	size_t size = reinterpret_cast<uintptr_t>(PointerSub(endAddr, beginAddr));
+	if (!ResetVirtualMemory(beginAddr, size))
+		return false;
+	trimmedSize += size;
+	return true;
+}
+
+
+size_t DynamicAllocator::Trim()
+{
+	if (!(this->policy & POLICY_TRIMMABLE))
+		return 0;
+
+	size_t trimmedSize = 0;
+	for (MemoryBlock* block = this->GetFirstFreeBlock(); block != nullptr; block = this->GetNextFreeBlock(block))
+		trimmedSize += this->TrimBlock(block);
+	return trimmedSize;
+}
+
+
+size_t DynamicAllocator::TrimBlock(MemoryBlock* block)
+{
+	void* beginAddr;
+	void* endAddr;
+	if (!(this->policy & POLICY_TRIMMABLE) || !this->FindTrimRange(block, beginAddr, endAddr))
+		return 0;
+
+	/* The pages of the last block above "zeroBeginAddr" have not been touched since they were 
+	 * committed or trimmed. Other blocks rely on their trim records */
+	bool isLastBlock = (this->policy & POLICY_ZEROED_MEMORY) && this->GetNextPhysicalBlock(block) == nullptr;
+	void* trimmedBeginAddr = endAddr;
+	void* trimmedEndAddr = endAddr;
+	if (isLastBlock)
+	{
+		size_t pageSize = GetVirtualPageSize();
+		void* untouchedAddr = reinterpret_cast<void*>((reinterpret_cast<uintptr_t>(this->zeroBeginAddr) + pageSize - 1) / pageSize * pageSize);
+		if (untouchedAddr < endAddr)
+			trimmedBeginAddr = untouchedAddr > beginAddr ? untouchedAddr : beginAddr;
+	}
+	else
+		this->ReadTrimRecord(block, trimmedBeginAddr, trimmedEndAddr);
+
+	/* Pages that are not given back keep their contents, so nothing is recorded for them */
+	size_t trimmedSize = 0;
+	if (!ResetPages(beginAddr, trimmedBeginAddr, trimmedSize) || !ResetPages(trimmedEndAddr, endAddr, trimmedSize))
+		return trimmedSize;
+	this->WriteTrimRecord(block, beginAddr, endAddr);
+
+	/* Everything from the trimmed pages to the boundary tag is zero now, once the bytes after the 
+	 * last page are cleared. The trim record is below the trimmed pages */
+	if (isLastBlock)
+	{
+		void* tagAddr = this->GetBlockTag(block);
+		if (this->zeroBeginAddr > endAddr)
+			memset(endAddr, 0, reinterpret_cast<uintptr_t>(PointerSub(this->zeroBeginAddr < tagAddr ? this->zeroBeginAddr : tagAddr, endAddr)));
+		if (this->zeroBeginAddr > beginAddr)
+			this->zeroBeginAddr = beginAddr;
+	}
+	return trimmedSize;
+}
+
+
+bool DynamicAllocator::FindTrimRange(const MemoryBlock* block, void*& outBeginAddr, void*& outEndAddr) const
+{
+	size_t pageSize = GetVirtualPageSize();
+	uintptr_t beginAddr = reinterpret_cast<uintptr_t>(PointerAdd(block->baseAddr, sizeof(TrimRecord)));
+	uintptr_t endAddr = reinterpret_cast<uintptr_t>(this->GetBlockTag(block));
+	beginAddr = (beginAddr + pageSize - 1) / pageSize * pageSize;
+	endAddr = endAddr / pageSize * pageSize;
+	if (endAddr <= beginAddr)
+		return false;
+
+	outBeginAddr = reinterpret_cast<void*>(beginAddr);
+	outEndAddr = reinterpret_cast<void*>(endAddr);
+	return true;
+}
+
+
+bool DynamicAllocator::ReadTrimRecord(const MemoryBlock* block, void*& outBeginAddr, void*& outEndAddr) const
+{
+	void* rangeBeginAddr;
+	void* rangeEndAddr;
+	if (!this->FindTrimRange(block, rangeBeginAddr, rangeEndAddr))
+		return false;
+
+	const TrimRecord* record = static_cast<const TrimRecord*>(block->baseAddr);
+	uintptr_t check = reinterpret_cast<uintptr_t>(record->beginAddr) ^ reinterpret_cast<uintptr_t>(record->endAddr) ^ TRIM_RECORD_MAGIC;
+	if (record->check != check || record->beginAddr < rangeBeginAddr || record->endAddr > rangeEndAddr || record->beginAddr >= record->endAddr)
+		return false;
+
+	outBeginAddr = record->beginAddr;
+	outEndAddr = record->endAddr;
+	return true;
+}
+
+
+void DynamicAllocator::WriteTrimRecord(MemoryBlock* block, void* beginAddr, void* endAddr)
+{
+	if (block->blockSize < sizeof(TrimRecord))
+		return;
+
+	void* rangeBeginAddr;
+	void* rangeEndAddr;
+	if (!this->FindTrimRange(block, rangeBeginAddr, rangeEndAddr))
+		beginAddr = endAddr = nullptr;
+	else
+	{
+		if (beginAddr < rangeBeginAddr)
+			beginAddr = rangeBeginAddr;
+		if (endAddr > rangeEndAddr)
+			endAddr = rangeEndAddr;
+		if (beginAddr >= endAddr)
+			beginAddr = endAddr = nullptr;
+	}
+
+	/* A cleared record is all zero, so it does not disturb memory that is known to be zero */
+	TrimRecord* record = static_cast<TrimRecord*>(block->baseAddr);
+	record->beginAddr = beginAddr;
+	record->endAddr = endAddr;
+	record->check = beginAddr != nullptr ? reinterpret_cast<uintptr_t>(beginAddr) ^ reinterpret_cast<uintptr_t>(endAddr) ^ TRIM_RECORD_MAGIC : 0;
+}
+
+
+bool DynamicAllocator::Grow(size_t size)
+{
+	void* oldEndAddr = this->blockEndAddr;
+	uintptr_t endAddr = reinterpret_cast<uintptr_t>(PointerAdd(this->baseAddr, this->heapSize + size)) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+	if (endAddr < reinterpret_cast<uintptr_t>(oldEndAddr) + BLOCK_SIZE + TAG_SIZE)
+		return false;
+
+	MemoryBlockTag* lastTag = static_cast<MemoryBlockTag*>(PointerSub(oldEndAddr, TAG_SIZE));
+	MemoryBlock* lastBlock = lastTag->block;
+	this->heapSize += size;
+	this->blockEndAddr = reinterpret_cast<void*>(endAddr);
+	MemoryBlock* block = CreateMemoryBlock(oldEndAddr, endAddr - reinterpret_cast<uintptr_t>(oldEndAddr) - BLOCK_SIZE - TAG_SIZE);
+
+	if (lastTag->blockTag == BLOCK_TAG_FREE)
+	{
+		this->RemoveFreeBlock(lastBlock);
+		this->MergeMemoryBlock(lastBlock, block);
+		block = lastBlock;
+
+		/* The old boundary tag and the new header are in the middle of the merged block now. Clear
+		 * them, so the memory known to be zero still runs up to the last boundary tag */
+		if (this->policy & POLICY_ZEROED_MEMORY)
+			memset(lastTag, 0, TAG_SIZE + BLOCK_SIZE);
+	}
+	else if ((this->policy & POLICY_ZEROED_MEMORY) && this->zeroBeginAddr >= oldEndAddr)
+		this->zeroBeginAddr = block->baseAddr;
+
+	if (!(this->policy & POLICY_ZEROED_MEMORY))
+		this->zeroBeginAddr = this->blockEndAddr;
+
+	this->InsertFreeBlock(block);
+	return true;
+}
+
+
+void DynamicAllocator::Collect()
+{
+	/* Free blocks are already merged when they are released */
+	if (this->policy & POLICY_COALESCE_ON_FREE)
+		return;
+
+	/* Segregated lists are not sorted by address, so walk through all memory blocks by their physical
+	 * order and merge each run of free blocks into one block */
+	if (this->policy & POLICY_SEGREGATED_FIT)
+	{
+		MemoryBlock* block = static_cast<MemoryBlock*>(this->blockBeginAddr);
+		while (block != nullptr)
+		{
+			MemoryBlock* nextBlock = this->GetNextPhysicalBlock(block);
+			if (nextBlock == nullptr || this->GetBlockTag(block)->blockTag != BLOCK_TAG_FREE || 
+				this->GetBlockTag(nextBlock)->blockTag != BLOCK_TAG_FREE)
+			{
+				block = nextBlock;
+				continue;
+			}
+
+			this->RemoveFreeBlockFromBin(block);
+			while (nextBlock != nullptr && this->GetBlockTag(nextBlock)->blockTag == BLOCK_TAG_FREE)
+			{
+				this->RemoveFreeBlockFromBin(nextBlock);
+				this->MergeMemoryBlock(block, nextBlock);
+				nextBlock = this->GetNextPhysicalBlock(block);
+			}
+			this->AddFreeBlockToBin(block);
+			block = nextBlock;
+		}
+		return;
+	}
+
+	MemoryBlock* block = this->freeList;
+
+	while (block != nullptr && block->nextBlock != nullptr)
+	{
+		if (this->GetNextPhysicalBlock(block) == block->nextBlock)
+		{
+			block->blockSize += TAG_SIZE + BLOCK_SIZE + block->nextBlock->blockSize;
+			this->GetBlockTag(block)->block = block;
+
+			MemoryBlock* nextNextBlock = block->nextBlock->nextBlock;
+			if (nextNextBlock != nullptr)
+				nextNextBlock->prevBlock = block;
+
+			block->nextBlock = nextNextBlock;
+		}
+		else
+			block = block->nextBlock;
+	}
+}
+
+
+void DynamicAllocator::Destroy()
+{
+	MemoryBlock* block = this->freeList;
+	while (block != nullptr)
+	{
+		MemoryBlock* tempBlock = block;
+		block = block->nextBlock;
+		tempBlock->nextBlock = nullptr;
+		tempBlock->prevBlock = nullptr;
+		tempBlock = nullptr;
+		delete tempBlock;
+	}
+
+	block = this->allocList;
+	while (block != nullptr)
+	{
+		MemoryBlock* tempBlock = block;
+		block = block->nextBlock;
+		tempBlock->nextBlock = nullptr;
+		tempBlock->prevBlock = nullptr;
+		tempBlock = nullptr;
+		delete tempBlock;
+	}
+
+	//allocator = nullptr;
+}
+
+
+void DynamicAllocator::AddAllocBlockToList(MemoryBlock* allocBlock)
+{
+#if DYNAMIC_ALLOCATOR_TRACK_ALLOCATIONS
+	if (this->allocList == nullptr)
+	{
+		allocBlock->prevBlock = nullptr;
+		allocBlock->nextBlock = nullptr;
+	}
+	else
+	{
+		allocBlock->prevBlock = nullptr;
+		allocBlock->nextBlock = this->allocList;
+		this->allocList->prevBlock = allocBlock;
+	}
+
+	this->allocList = allocBlock;
+#else
+	allocBlock->prevBlock = nullptr;
+	allocBlock->nextBlock = nullptr;
+#endif
+
+	this->allocCount++;
+	this->allocBlockNum++;
+	this->allocSize += allocBlock->blockSize;
+	if (this->allocSize > this->maxAllocSize)
+		this->maxAllocSize = this->allocSize;
+}
+
+
+void DynamicAllocator::RemoveAllocBlockFromList(MemoryBlock* allocBlock)
+{
+#if DYNAMIC_ALLOCATOR_TRACK_ALLOCATIONS
+	MemoryBlock* prev = allocBlock->prevBlock;
+	MemoryBlock* next = allocBlock->nextBlock;
+
+	if (prev == nullptr)
+		this->allocList = next;
+	else
+		prev->nextBlock = next;
+
+	if (next != nullptr)
+		next->prevBlock = prev;
+#endif
+
+	this->freeCount++;
+	this->allocBlockNum--;
+	this->allocSize -= allocBlock->blockSize;
+}
+
+
+void DynamicAllocator::AddFreeBlockToList(MemoryBlock* freeBlock)
+{
+	MemoryBlock* prevBlock = this->freeList;
+	MemoryBlock* currBlock = this->freeList;
+
+	/* If the free list is empty */
+	if (currBlock == nullptr)
+	{
+		freeBlock->nextBlock = nullptr;
+		freeBlock->prevBlock = nullptr;
+		this->freeList = freeBlock;
+		return;
+	}
+
+	/* If the new free block have the most forward address */
+	if (freeBlock->baseAddr < currBlock->baseAddr)
+	{
+		freeBlock->nextBlock = currBlock;
+		freeBlock->prevBlock = nullptr;
+		currBlock->prevBlock = freeBlock;
+		this->freeList = freeBlock;
+		return;
+	}
+
+	/* If the new free block have a middle address */
+	currBlock = currBlock->nextBlock;
+	while (currBlock != nullptr)
+	{
+		if (freeBlock->baseAddr < currBlock->baseAddr)
+		{
+			freeBlock->prevBlock = prevBlock;
+			freeBlock->nextBlock = currBlock;
+			prevBlock->nextBlock = freeBlock;
+			currBlock->prevBlock = freeBlock;
+			return;
+		}
+		else
+		{
+			currBlock = currBlock->nextBlock;
+			prevBlock = prevBlock->nextBlock;
+		}
+	}
+
+	/* If the new free block have the last address */
+	freeBlock->prevBlock = prevBlock;
+	freeBlock->nextBlock = nullptr;
+	prevBlock->nextBlock = freeBlock;
+
+	return;
+}
+
+
+void DynamicAllocator::InsertFreeBlock(MemoryBlock* freeBlock)
+{
+	if (this->policy & POLICY_SEGREGATED_FIT)
+		this->AddFreeBlockToBin(freeBlock);
+	else if (this->policy & POLICY_COALESCE_ON_FREE)
+	{
+		/* Nothing relies on the address order once blocks are merged on free, so skip sorting */
+		freeBlock->prevBlock = nullptr;
+		freeBlock->nextBlock = this->freeList;
+		if (this->freeList != nullptr)
+			this->freeList->prevBlock = freeBlock;
+		this->freeList = freeBlock;
+	}
+	else
+		this->AddFreeBlockToList(freeBlock);
+}
+
+
+void DynamicAllocator::RemoveFreeBlock(MemoryBlock* freeBlock)
+{
+	if (this->policy & POLICY_SEGREGATED_FIT)
+	{
+		this->RemoveFreeBlockFromBin(freeBlock);
+		return;
+	}
+
+	if (freeBlock->prevBlock != nullptr)
+		freeBlock->prevBlock->nextBlock = freeBlock->nextBlock;
+	else
+		this->freeList = freeBlock->nextBlock;
+
+	if (freeBlock->nextBlock != nullptr)
+		freeBlock->nextBlock->prevBlock = freeBlock->prevBlock;
+}
+
+
+void DynamicAllocator::AddFreeBlockToBin(MemoryBlock* freeBlock)
+{
+	size_t flIdx, slIdx;
+	FindBinIndex(freeBlock->blockSize, flIdx, slIdx);
+
+	MemoryBlock* head = this->freeBins[flIdx][slIdx];
+	freeBlock->prevBlock = nullptr;
+	freeBlock->nextBlock = head;
+	if (head != nullptr)
+		head->prevBlock = freeBlock;
+
+	this->freeBins[flIdx][slIdx] = freeBlock;
+	this->flBitmap |= static_cast<size_t>(1) << flIdx;
+	this->slBitmap[flIdx] |= static_cast<size_t>(1) << slIdx;
+}
+
+
+void DynamicAllocator::RemoveFreeBlockFromBin(MemoryBlock* freeBlock)
+{
+	size_t flIdx, slIdx;
+	FindBinIndex(freeBlock->blockSize, flIdx, slIdx);
+
+	MemoryBlock* prev = freeBlock->prevBlock;
+	MemoryBlock* next = freeBlock->nextBlock;
+	if (prev != nullptr)
+		prev->nextBlock = next;
+	else
+		this->freeBins[flIdx][slIdx] = next;
+
+	if (next != nullptr)
+		next->prevBlock = prev;
+
+	freeBlock->prevBlock = nullptr;
+	freeBlock->nextBlock = nullptr;
+
+	/* Clear the bits of the list if it becomes empty */
+	if (this->freeBins[flIdx][slIdx] == nullptr)
+	{
+		this->slBitmap[flIdx] &= ~(static_cast<size_t>(1) << slIdx);
+		if (this->slBitmap[flIdx] == 0)
+			this->flBitmap &= ~(static_cast<size_t>(1) << flIdx);
+	}
+}
+
+
+MemoryBlock* DynamicAllocator::FindFreeBlockInBins(size_t size) const
+{
+	/* Round the size up to the next list, so that any block in the list found is large enough */
+	size_t searchSize = size;
+	if (size >= SMALL_BLOCK_SIZE)
+	{
+		size_t round = (static_cast<size_t>(1) << (FindLastSetBit(size) - SL_INDEX_COUNT_LOG2)) - 1;
+		if (searchSize + round > searchSize)
+			searchSize += round;
+	}
+
+	size_t flIdx, slIdx;
+	FindBinIndex(searchSize, flIdx, slIdx);
+
+	/* The last list holds blocks of all sizes beyond 2^FL_INDEX_MAX, search it linearly */
+	if (flIdx == FL_INDEX_COUNT - 1 && slIdx == SL_INDEX_COUNT - 1)
+	{
+		MemoryBlock* block = this->freeBins[flIdx][slIdx];
+		while (block != nullptr && block->blockSize < size)
+			block = block->nextBlock;
+		return block;
+	}
+
+	/* Find a non-empty list in the same first level, otherwise in the next non-empty first level */
+	size_t slMap = this->slBitmap[flIdx] & (~static_cast<size_t>(0) << slIdx);
+	if (slMap == 0)
+	{
+		size_t flMap = this->flBitmap & (~static_cast<size_t>(0) << (flIdx + 1));
+		if (flMap == 0)
+			return nullptr;
+
+		flIdx = static_cast<size_t>(FindFirstSetBit(flMap));
+		slMap = this->slBitmap[flIdx];
+	}
+
+	slIdx = static_cast<size_t>(FindFirstSetBit(slMap));
+	return this->freeBins[flIdx][slIdx];
+}
+
+
+MemoryBlock* DynamicAllocator::GetFirstFreeBlock() const
+{
+	if (!(this->policy & POLICY_SEGREGATED_FIT))
+		return this->freeList;
+
+	if (this->flBitmap == 0)
+		return nullptr;
+
+	size_t flIdx = static_cast<size_t>(FindFirstSetBit(this->flBitmap));
+	size_t slIdx = static_cast<size_t>(FindFirstSetBit(this->slBitmap[flIdx]));
+	return this->freeBins[flIdx][slIdx];
+}
+
+
+MemoryBlock* DynamicAllocator::GetNextFreeBlock(const MemoryBlock* freeBlock) const
+{
+	if (!(this->policy & POLICY_SEGREGATED_FIT) || freeBlock->nextBlock != nullptr)
+		return freeBlock->nextBlock;
+
+	/* Move on to the next non-empty list */
+	size_t flIdx, slIdx;
+	FindBinIndex(freeBlock->blockSize, flIdx, slIdx);
+
+	size_t slMap = this->slBitmap[flIdx] & (~static_cast<size_t>(0) << (slIdx + 1));
+	if (slMap == 0)
+	{
+		size_t flMap = this->flBitmap & (~static_cast<size_t>(0) << (flIdx + 1));
+		if (flMap == 0)
+			return nullptr;
+
+		flIdx = static_cast<size_t>(FindFirstSetBit(flMap));
+		slMap = this->slBitmap[flIdx];
+	}
+
+	slIdx = static_cast<size_t>(FindFirstSetBit(slMap));
+	return this->freeBins[flIdx][slIdx];
+}
+
+
+bool DynamicAllocator::Contains(const void* ptr) const
+{
+	return this->FindMemoryBlock(ptr) != nullptr;
+}
+
+
+bool DynamicAllocator::IsAllocated(const void* ptr) const
+{
+	MemoryBlock* block = this->FindMemoryBlock(ptr);
+	return block != nullptr && this->GetBlockTag(block)->blockTag == BLOCK_TAG_ALLOCATED;
+}
+
+
+size_t DynamicAllocator::GetLargestFreeBlock() const
+{
+	size_t result = 0;
+	MemoryBlock* freeBlock = this->GetFirstFreeBlock();
+	if ((this->policy & POLICY_SEGREGATED_FIT) && this->flBitmap != 0)
+	{
+		size_t flIdx = static_cast<size_t>(FindLastSetBit(this->flBitmap));
+		size_t slIdx = static_cast<size_t>(FindLastSetBit(this->slBitmap[flIdx]));
+		freeBlock = this->freeBins[flIdx][slIdx];
+		while (freeBlock != nullptr)
+		{
+			if (freeBlock->blockSize > result)
+				result = freeBlock->blockSize;
+			freeBlock = freeBlock->nextBlock;
+		}
+		return result;
+	}
+
+	while (freeBlock != nullptr)
+	{
+		if (freeBlock->blockSize > result)
+			result = freeBlock->blockSize;
+
+		freeBlock = this->GetNextFreeBlock(freeBlock);
+	}
+
+	return result;
+}
+
+
+size_t DynamicAllocator::GetTotalFreeMemory() const
+{
+	size_t result = 0;
+	MemoryBlock* freeBlock = this->GetFirstFreeBlock();
+
+	while (freeBlock != nullptr)
+	{
+		result += freeBlock->blockSize;
+		freeBlock = this->GetNextFreeBlock(freeBlock);
+	}
+
+	return result;
+}
+
+
+void DynamicAllocator::ShowFreeBlocks() const
+{
+	printf("\n\n!!!###########################!!! \n Start showing free blocks: ");
+
+	MemoryBlock* block = this->GetFirstFreeBlock();
+	while (block != nullptr)
+	{
+		printf("\n--------------------------------------------------------------\n");
+		printf("Free Block Node Address: %p, Free Block Address: %p, Free Block Size: %zu",
+			block, block->baseAddr, block->blockSize);
+		block = this->GetNextFreeBlock(block);
+	}
+}
+
+
+void DynamicAllocator::ShowOutstandingAllocations() const
+{
+	printf("\n\n!!!###########################!!! \n Start showing allocated blocks: ");
+
+#if DYNAMIC_ALLOCATOR_TRACK_ALLOCATIONS
+	MemoryBlock* block = this->allocList;
+	while (block != nullptr)
+	{
+		printf("\n--------------------------------------------------------------\n");
+		printf("Alloc Block Node Address: %p, Alloc Block Address: %p, Alloc Block Size: %zu",
+			block, block->baseAddr, block->blockSize);
+		block = block->nextBlock;
+	}
+#else
+	/* Without the list of allocated blocks, walk through all memory blocks by their physical order */
+	MemoryBlock* block = static_cast<MemoryBlock*>(this->blockBeginAddr);
+	while (block != nullptr)
+	{
+		if (this->GetBlockTag(block)->blockTag == BLOCK_TAG_ALLOCATED)
+		{
+			printf("\n--------------------------------------------------------------\n");
+			printf("Alloc Block Node Address: %p, Alloc Block Address: %p, Alloc Block Size: %zu",
+				block, block->baseAddr, block->blockSize);
+		}
+		block = this->GetNextPhysicalBlock(block);
+	}
+#endif
+}
@@ -1,101 +1,417 @@
-#pragma once
-#include <stdint.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include "../Utility/Utility.h"
-
-
-using namespace Utility;
-
-
-/**
-* @brief MemoryBlock is a linked list node that act as the minimum memory management unit of 
-*		 dynamic allocator. A MemoryBlock node is make up of two parts. The first part is the 
-*		 memory space that containing the data of memory block and the second part is the 
-*		 memory space that dynamic allocator allocates to user. Assuming user request 10 byte 
-*		 of memory on address 0x0000. Dyanimc allocator first needs to assign 32B of memory to 
-*		 construct a "MemoryBlock" and then assign 10B of memory to the "MemoryBlock" for user.
-*		 Therefore, we need 32B + 10B in total and the structure looks like:
-*			|     memory block data: 32B     |      user memory: 10B         |
-*		 0x0000								0x0020						  0x002A
-*
-* @param baseAddr -- The starting address of the memory space that assigned to user;
-* @param blockSize -- The size of the memory space that assigned to user;
-* @param nextBlock -- Address of the next "MemoryBlock" node;
-* @param prevBlock -- Address of the previous "MemoryBlock" node;
-*/
-class MemoryBlock
-{
-public:
-	void* baseAddr;
-	size_t blockSize;
-	MemoryBlock* nextBlock;
-	MemoryBlock* prevBlock;
-
-	inline MemoryBlock(void* addr, size_t size, MemoryBlock* next, MemoryBlock* prev);
-	inline ~MemoryBlock();
-};
-
-
-/**
-* @brief DyanmicAllocator is a memory allocator that designed for general memory allocation.
-*		 DynamicAllocator use two linked lists to manage its memory. One linked list for 
-*		 managing free menory blocks in allocator and the other for managing allocated menory
-*		 blocks. (See the description of "MemoryBlock" class for more detail)
-*
-* @param baseAddr -- The starting address of the dynamic allocator, which is also the starting
-*					 address of the whole memory space;
-* @param heapSize -- The size of the whole memory space, including the memory space for storing
-*					 dynamic allocator data and memory space for allocation;
-* @param freeList -- The address of the linked list that manage free memory blocks;
-* @param allocList -- The address of the linked list that manage allocated memory blocks;
-*/
-class DynamicAllocator
-{
-public:
-	/* Member Field */
-	void* baseAddr;
-	size_t heapSize;
-	MemoryBlock* freeList;
-	MemoryBlock* allocList;
-
-	/* Method Field */
-	inline DynamicAllocator(void* addr, size_t size);
-	inline ~DynamicAllocator();
-
-	MemoryBlock* ShrinkMemoryBlock(MemoryBlock* block, size_t shrinkSize);
-
-	inline void* Alloc(size_t size);
-
-	void* Alloc(size_t size, const unsigned int alignment);
-
-	bool Free(void* ptr);
-
-	void Collect();
-
-	void Destroy();
-
-	void AddAllocBlockToList(MemoryBlock* allocBlock);
-	void AddFreeBlockToList(MemoryBlock* freeBlock);
-
-	bool Contains(const void* ptr) const;
-	bool IsAllocated(const void* ptr) const;
-
-	size_t GetLargestFreeBlock() const;
-	size_t GetTotalFreeMemory() const;
-
-	void ShowFreeBlocks() const;
-	void ShowOutstandingAllocations()const;
-};
-
-
-const size_t MANAGER_SIZE = sizeof(DynamicAllocator);
-const size_t BLOCK_SIZE = sizeof(MemoryBlock);
-
-
-/* Function Space */
-DynamicAllocator* CreateDynamicAllocator(void* baseAddr, size_t size);
-
-MemoryBlock* CreateMemoryBlock(void* ptr, size_t size);
-
-#include "DynamicAllocator.inl"
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../Utility/Utility.h"
+
+
+using namespace Utility;
+
+
+/* Keep allocated blocks in "allocList" for debugging. Allocated blocks are always found by pointer
+ * arithmetic, so the list is only used to show outstanding allocations in the order they are made */
+#ifndef DYNAMIC_ALLOCATOR_TRACK_ALLOCATIONS
+#ifdef _DEBUG
+#define DYNAMIC_ALLOCATOR_TRACK_ALLOCATIONS 1
+#else
+#define DYNAMIC_ALLOCATOR_TRACK_ALLOCATIONS 0
+#endif // _DEBUG
+#endif // DYNAMIC_ALLOCATOR_TRACK_ALLOCATIONS
+
+
+/* Policies of dynamic allocator that decide how free blocks are managed. See "CreateDynamicAllocator" */
+const unsigned int POLICY_FIRST_FIT = 0x0;
+const unsigned int POLICY_SEGREGATED_FIT = 0x1;
+const unsigned int POLICY_COALESCE_ON_FREE = 0x2;
+const unsigned int POLICY_ZEROED_MEMORY = 0x4;
+const unsigned int POLICY_TRIMMABLE = 0x8;
+
+/* Free blocks of a trimmable dynamic allocator that are at least this large are trimmed as soon as
+ * they are freed, see "DynamicAllocator::trimThreshold" */
+const size_t TRIM_DEFAULT_THRESHOLD = 1024 * 1024;
+
+
+/* Parameters of segregated fit. The first level divides block sizes by powers of 2 and the second
+ * level divides each first level range linearly into SL_INDEX_COUNT lists. Sizes smaller than 
+ * SMALL_BLOCK_SIZE all go to the first first level list, and sizes not smaller than 2^FL_INDEX_MAX
+ * all go to the last list */
+const size_t SL_INDEX_COUNT_LOG2 = 4;
+const size_t SL_INDEX_COUNT = static_cast<size_t>(1) << SL_INDEX_COUNT_LOG2;
+const size_t FL_INDEX_SHIFT = SL_INDEX_COUNT_LOG2 + (sizeof(void*) == 8 ? 4 : 3);		// log2(BLOCK_ALIGNMENT)
+const size_t FL_INDEX_MAX = sizeof(void*) == 8 ? 32 : 30;
+const size_t FL_INDEX_COUNT = FL_INDEX_MAX - FL_INDEX_SHIFT + 1;
+const size_t SMALL_BLOCK_SIZE = static_cast<size_t>(1) << FL_INDEX_SHIFT;
+
+
+/* Magic numbers stored in the boundary tag of each memory block to tell its status */
+const size_t BLOCK_TAG_FREE = 0xF4EEB10C;
+const size_t BLOCK_TAG_ALLOCATED = 0xA110CA7E;
+
+
+/**
+* @brief MemoryBlock is a linked list node that act as the minimum memory management unit of 
+*		 dynamic allocator. A MemoryBlock node is make up of three parts. The first part is the 
+*		 memory space that containing the data of memory block (header), the second part is the 
+*		 memory space that dynamic allocator allocates to user and the third part is the boundary
+*		 tag of the memory block (see "MemoryBlockTag"). Assuming user request 10 byte of memory 
+*		 on address 0x0000 on a 64-bit system. Dyanimc allocator first needs to assign 32B of 
+*		 memory to construct a "MemoryBlock", then round the user memory up to 16B, and finally
+*		 assign 16B of memory to the boundary tag. Therefore, we need 32B + 16B + 16B in total 
+*		 and the structure looks like:
+*			|   memory block data: 32B   |   user memory: 16B   |   boundary tag: 16B   |
+*		 0x0000						  0x0020				 0x0030				   0x0040
+*		 Memory blocks tile the memory space of dynamic allocator without gaps, so the header of 
+*		 a block is always at a fixed negative offset from the address assigned to user, and the
+*		 physical neighbours of a block are found by the size of the block (next neighbour) and 
+*		 the boundary tag right before the header (previous neighbour).
+*
+* @param baseAddr -- The starting address of the memory space that assigned to user;
+* @param blockSize -- The size of the memory space that assigned to user;
+* @param nextBlock -- Address of the next "MemoryBlock" node;
+* @param prevBlock -- Address of the previous "MemoryBlock" node;
+*/
+class MemoryBlock
+{
+public:
+	void* baseAddr;
+	size_t blockSize;
+	MemoryBlock* nextBlock;
+	MemoryBlock* prevBlock;
+
+	inline MemoryBlock(void* addr, size_t size, MemoryBlock* next, MemoryBlock* prev);
+	inline ~MemoryBlock();
+};
+
+
+/**
+* @brief MemoryBlockTag is the boundary tag at the end of each memory block. It points back to the
+*		 header of the block and records whether the block is free or allocated. 
+*
+* @param block -- Address of the "MemoryBlock" node that the tag belongs to;
+* @param blockTag -- Either BLOCK_TAG_FREE or BLOCK_TAG_ALLOCATED;
+*/
+class MemoryBlockTag
+{
+public:
+	MemoryBlock* block;
+	size_t blockTag;
+};
+
+
+/**
+* @brief TrimRecord is kept in the first bytes of the user memory of a free block that has been 
+*		 trimmed. It records the pages of the block that have been given back to the OS, so they
+*		 are not given back again. "check" tells a record from leftover user data. A record is
+*		 only a hint for Trim(): memory is never assumed to be zero because of it.
+*
+* @param beginAddr -- The first trimmed page;
+* @param endAddr -- The address next to the last trimmed page;
+* @param check -- The addresses above mixed with TRIM_RECORD_MAGIC;
+*/
+class TrimRecord
+{
+public:
+	void* beginAddr;
+	void* endAddr;
+	uintptr_t check;
+};
+
+const uintptr_t TRIM_RECORD_MAGIC = static_cast<uintptr_t>(0x7B1A3C5E9D2F4861ull);
+
+
+/**
+* @brief DyanmicAllocator is a memory allocator that designed for general memory allocation.
+*		 DynamicAllocator use two linked lists to manage its memory. One linked list for 
+*		 managing free menory blocks in allocator and the other for managing allocated menory
+*		 blocks. Note that the linked list of allocated blocks is only maintained when
+*		 DYNAMIC_ALLOCATOR_TRACK_ALLOCATIONS is enabled. (See the description of "MemoryBlock" 
+*		 class for more detail)
+*		 Free blocks are managed by one of the following policies:
+*		 POLICY_FIRST_FIT -- Free blocks are kept in one linked list sorted by address. Allocation
+*							 takes the first free block that is large enough;
+*		 POLICY_SEGREGATED_FIT -- Free blocks are kept in two-level segregated lists (TLSF). The
+*							 first level splits sizes by powers of 2 and the second level splits
+*							 each range linearly. Two levels of bitmaps record which lists are not 
+*							 empty, so a list that is guaranteed to fit the request is found with
+*							 two bit scans, regardless of the number of free blocks;
+*		 POLICY_COALESCE_ON_FREE -- Can be combined with either policy above. A block is merged with
+*							 its free physical neighbours as soon as it is released, so there are 
+*							 never two adjacent free blocks and "Collect()" has nothing to do. Under
+*							 first fit, the free list is no longer sorted by address and free blocks
+*							 are put at the front of the list;
+*		 POLICY_ZEROED_MEMORY -- Can be combined with any policy above. It tells that the memory
+*							 space is filled with zero when the allocator is created (e.g. fresh
+*							 pages from the OS), so Calloc() does not clear memory that has never 
+*							 been handed out;
+*		 POLICY_TRIMMABLE -- Can be combined with any policy above. It tells that the memory space
+*							 is committed virtual memory (see "VirtualMemory.h"), so Trim() can give 
+*							 the whole pages in the middle of free blocks back to the OS. The headers
+*							 and boundary tags are kept, and the trimmed pages are recorded in the 
+*							 block (see "TrimRecord"). Under POLICY_ZEROED_MEMORY, trimming the last
+*							 block moves "zeroBeginAddr" down to its trimmed pages, since they read as
+*							 zero afterwards;
+*
+* @param baseAddr -- The starting address of the dynamic allocator, which is also the starting
+*					 address of the whole memory space;
+* @param heapSize -- The size of the whole memory space, including the memory space for storing
+*					 dynamic allocator data and memory space for allocation;
+* @param blockBeginAddr -- The address of the first memory block;
+* @param blockEndAddr -- The address next to the last byte of the last memory block;
+* @param policy -- The policy of managing free blocks;
+* @param freeList -- The address of the linked list that manage free memory blocks (first fit);
+* @param allocList -- The address of the linked list that manage allocated memory blocks;
+* @param flBitmap -- Bit i is set if any second level list of first level i is not empty;
+* @param slBitmap -- Bit j of slBitmap[i] is set if the list freeBins[i][j] is not empty;
+* @param freeBins -- The segregated linked lists that manage free memory blocks (segregated fit);
+* @param zeroBeginAddr -- Memory from this address to the last boundary tag has never been handed 
+*		 out or used by headers, so it is known to be zero under POLICY_ZEROED_MEMORY. It only moves
+*		 up, except when Trim() gives the pages of the last block back to the OS. It is 
+*		 "blockEndAddr" if nothing is known to be zero;
+* @param trimThreshold -- Under POLICY_TRIMMABLE, a block is trimmed when it is freed if it is at 
+*		 least this large (after merging with its neighbours). 0 means blocks are only trimmed by 
+*		 Trim();
+*/
+class DynamicAllocator
+{
+public:
+	/* Member Field */
+	void* baseAddr;
+	size_t heapSize;
+	void* blockBeginAddr;
+	void* blockEndAddr;
+	unsigned int policy;
+	MemoryBlock* freeList;
+	MemoryBlock* allocList;
+	size_t flBitmap;
+	size_t slBitmap[FL_INDEX_COUNT];
+	MemoryBlock* freeBins[FL_INDEX_COUNT][SL_INDEX_COUNT];
+	void* zeroBeginAddr;
+	size_t trimThreshold;
+
+	/* Counters of allocated blocks, kept up to date by every allocation, free and resize. The
+	 * sizes are the sizes of user memory, not including headers and boundary tags */
+	size_t allocCount;
+	size_t freeCount;
+	size_t allocBlockNum;
+	size_t allocSize;
+	size_t maxAllocSize;
+
+	/* Method Field */
+	inline DynamicAllocator(void* addr, size_t size);
+	inline ~DynamicAllocator();
+
+	MemoryBlock* ShrinkMemoryBlock(MemoryBlock* block, size_t shrinkSize);
+
+	/**
+	* @brief Find the memory block whose user memory starts at the given address by pointer
+	*		 arithmetic. The header and boundary tag of the block are verified before return.
+	* 
+	* @return The memory block. Return nullptr if the given address is not the starting address 
+	*		  of a memory block in dynamic allocator.
+	*/
+	MemoryBlock* FindMemoryBlock(const void* ptr) const;
+
+	inline MemoryBlockTag* GetBlockTag(const MemoryBlock* block) const;
+
+	/**
+	* @brief Find the physical neighbours of the given memory block. Return nullptr if the block
+	*		 is the first or the last block of dynamic allocator.
+	*/
+	inline MemoryBlock* GetNextPhysicalBlock(const MemoryBlock* block) const;
+	inline MemoryBlock* GetPrevPhysicalBlock(const MemoryBlock* block) const;
+
+	inline void* Alloc(size_t size);
+
+	void* Alloc(size_t size, size_t alignment);
+
+	/**
+	* @brief Allocate memory for an array of "num" elements of "size" bytes and fill it with zero. 
+	*		 Only the part of the memory block below "zeroBeginAddr" is cleared.
+	* 
+	* @return Return nullptr if the total size overflows or there is no memory.
+	*/
+	void* Calloc(size_t num, size_t size);
+
+	/**
+	* @brief Move "zeroBeginAddr" past an allocated memory block, and past the header (and the trim
+	*		 record) of the next block that may be written when the block is split or freed.
+	*/
+	inline void MarkBlockUsed(const MemoryBlock* block);
+
+	void* AllocFirstFit(size_t size, size_t alignment);
+	void* AllocSegregatedFit(size_t size, size_t alignment);
+
+	/**
+	* @brief Split a memory block that is not in any list into two blocks. The first block keeps
+	*		 "size" bytes of user memory and the second block takes the rest memory space. 
+	* 
+	* @return The second block, which is marked as free. Return nullptr if the rest memory space 
+	*		  is too small to hold a node and a boundary tag, in which case the block is not split.
+	*/
+	MemoryBlock* SplitMemoryBlock(MemoryBlock* block, size_t size);
+
+	/**
+	* @brief Merge a memory block with the next physical block. Both blocks should not be in any
+	*		 list. The merged block keeps the header of the first block.
+	*/
+	void MergeMemoryBlock(MemoryBlock* block, MemoryBlock* nextBlock);
+
+	bool Free(void* ptr);
+
+	/**
+	* @brief Resize an allocated memory block without moving it. The block grows into the next
+	*		 physical block if that block is free and large enough, and gives its tail back as a
+	*		 free block when it shrinks (or when the grown block has more than it needs).
+	* 
+	* @return Return false if the given address is not allocated by dynamic allocator, or the block
+	*		  can not grow in place. The block is not changed in that case.
+	*/
+	bool Expand(void* ptr, size_t newSize);
+
+	/**
+	* @brief Resize an allocated memory block. It is resized in place if possible, otherwise the
+	*		 data is copied to a new block and the old block is freed.
+	* 
+	* @return The address of the resized block. Return nullptr if there is no memory for the new
+	*		  block, in which case the old block is not freed.
+	*/
+	void* Realloc(void* ptr, size_t newSize);
+
+	/**
+	* @brief The size of user memory of an allocated memory block, which may be larger than the
+	*		 requested size. Return 0 if the given address is not allocated by dynamic allocator.
+	*/
+	size_t GetAllocationSize(const void* ptr) const;
+
+	/**
+	* @brief Add the memory space right after the end of dynamic allocator to it, so that the heap
+	*		 grows by "size" bytes. The new memory becomes a free block, which is merged with the
+	*		 last block if that block is free. The memory space must be writable, and it is assumed
+	*		 to be zero under POLICY_ZEROED_MEMORY.
+	* 
+	* @return Return false if the memory space is too small to hold a memory block.
+	*/
+	bool Grow(size_t size);
+
+	/**
+	* @brief Give the whole pages in the middle of all free blocks back to the OS. Pages that are 
+	*		 already given back are skipped. It does nothing without POLICY_TRIMMABLE.
+	* 
+	* @return The number of bytes that are given back.
+	*/
+	size_t Trim();
+
+	/**
+	* @brief Give the whole pages in the middle of a free block back to the OS, and record them in 
+	*		 the block. See Trim().
+	*/
+	size_t TrimBlock(MemoryBlock* block);
+
+	/**
+	* @brief Find the whole pages of a free block that can be trimmed. They are after its trim 
+	*		 record and before its boundary tag.
+	* 
+	* @return Return false if there is no whole page.
+	*/
+	bool FindTrimRange(const MemoryBlock* block, void*& outBeginAddr, void*& outEndAddr) const;
+
+	/**
+	* @brief Read the trim record of a free block. Return false if the block has no valid record.
+	*/
+	bool ReadTrimRecord(const MemoryBlock* block, void*& outBeginAddr, void*& outEndAddr) const;
+
+	/**
+	* @brief Record the trimmed pages of a free block. The pages are clipped to the trim range of
+	*		 the block, and the record is cleared if nothing is left.
+	*/
+	void WriteTrimRecord(MemoryBlock* block, void* beginAddr, void* endAddr);
+
+	void Collect();
+
+	void Destroy();
+
+	/**
+	* @brief Keep track of an allocated block that is handed out or freed, and update the counters
+	*		 of allocated blocks.
+	*/
+	void AddAllocBlockToList(MemoryBlock* allocBlock);
+	void AddFreeBlockToList(MemoryBlock* freeBlock);
+	void RemoveAllocBlockFromList(MemoryBlock* allocBlock);
+
+	/**
+	* @brief Put a free block into (or take a free block out of) the free block structure of
+	*		 current policy. 
+	*/
+	void InsertFreeBlock(MemoryBlock* freeBlock);
+	void RemoveFreeBlock(MemoryBlock* freeBlock);
+
+	void AddFreeBlockToBin(MemoryBlock* freeBlock);
+	void RemoveFreeBlockFromBin(MemoryBlock* freeBlock);
+
+	/**
+	* @brief Find a free block that has at least "size" bytes of user memory in segregated lists.
+	*		 Noted that the block is not removed from its list.
+	*/
+	MemoryBlock* FindFreeBlockInBins(size_t size) const;
+
+	/**
+	* @brief Iterate through all free blocks regardless of the policy. The order of free blocks is
+	*		 the address order under first fit, and the order of size under segregated fit.
+	*/
+	MemoryBlock* GetFirstFreeBlock() const;
+	MemoryBlock* GetNextFreeBlock(const MemoryBlock* freeBlock) const;
+
+	bool Contains(const void* ptr) const;
+	bool IsAllocated(const void* ptr) const;
+
+	/**
+	* @brief The size of user memory of the largest free block. It walks the free blocks, under
+	*		 segregated fit only those of the highest non-empty list, since every block in lower
+	*		 lists is smaller.
+	*/
+	size_t GetLargestFreeBlock() const;
+	size_t GetTotalFreeMemory() const;
+
+	/**
+	* @brief The free memory of dynamic allocator computed from its counters in constant time. 
+	*		 Unlike GetTotalFreeMemory(), it includes the headers and boundary tags of free blocks,
+	*		 which are given to an allocation when a free block is used as a whole.
+	*/
+	inline size_t GetFreeSize() const;
+
+	void ShowFreeBlocks() const;
+	void ShowOutstandingAllocations()const;
+};
+
+
+const size_t MANAGER_SIZE = sizeof(DynamicAllocator);
+const size_t BLOCK_SIZE = sizeof(MemoryBlock);
+const size_t TAG_SIZE = sizeof(MemoryBlockTag);
+
+/* The size of user memory is rounded up to this value, so that every header stays aligned */
+const size_t BLOCK_ALIGNMENT = sizeof(void*) * 2;
+
+
+/* Function Space */
+
+/**
+* @brief Instantiate a DynamicAllocator instance in the designated memory space. The rest of the 
+*		 memory space after the DynamicAllocator instance becomes its first free block.
+* 
+* @param policy -- The policy of managing free blocks, POLICY_FIRST_FIT or POLICY_SEGREGATED_FIT, 
+*		 optionally combined with POLICY_COALESCE_ON_FREE.
+*/
+DynamicAllocator* CreateDynamicAllocator(void* baseAddr, size_t size, unsigned int policy = POLICY_FIRST_FIT);
+
+/**
+* @brief Instantiate a MemoryBlock and its boundary tag in the designated memory space. The 
+*		 memory space should be at least "BLOCK_SIZE + size + TAG_SIZE" bytes.
+*/
+MemoryBlock* CreateMemoryBlock(void* ptr, size_t size, size_t blockTag = BLOCK_TAG_FREE);
+
+/**
+* @brief Find the segregated list that a free block of the given size belongs to.
+*/
+inline void FindBinIndex(size_t size, size_t& outFlIdx, size_t& outSlIdx);
+
+#include "DynamicAllocator.inl"
@@ -1,32 +1,108 @@
-#pragma once
-
-
-inline MemoryBlock::MemoryBlock(void* addr, size_t size, MemoryBlock* next, MemoryBlock* prev)
-{
-	this->baseAddr = addr;
-	this->blockSize = size;
-	this->nextBlock = next;
-	this->prevBlock = prev;
-}
-
-
-inline MemoryBlock::~MemoryBlock() {}
-
-
-inline DynamicAllocator::DynamicAllocator(void* addr, size_t size)
-{
-	this->baseAddr = addr;
-	this->heapSize = size;
-	this->allocList = nullptr;
-	this->freeList = nullptr;
-}
-
-
-inline DynamicAllocator::~DynamicAllocator() {}
-
-
-inline void* DynamicAllocator::Alloc(size_t size)
-{
-	return this->Alloc(size, 0);
-}
-
+#pragma once
+
+
+inline MemoryBlock::MemoryBlock(void* addr, size_t size, MemoryBlock* next, MemoryBlock* prev)
+{
+	this->baseAddr = addr;
+	this->blockSize = size;
+	this->nextBlock = next;
+	this->prevBlock = prev;
+}
+
+
+inline MemoryBlock::~MemoryBlock() {}
+
+
+inline DynamicAllocator::DynamicAllocator(void* addr, size_t size)
+{
+	this->baseAddr = addr;
+	this->heapSize = size;
+	this->blockBeginAddr = nullptr;
+	this->blockEndAddr = nullptr;
+	this->policy = POLICY_FIRST_FIT;
+	this->allocList = nullptr;
+	this->freeList = nullptr;
+	this->flBitmap = 0;
+	this->zeroBeginAddr = nullptr;
+	this->trimThreshold = 0;
+	this->allocCount = 0;
+	this->freeCount = 0;
+	this->allocBlockNum = 0;
+	this->allocSize = 0;
+	this->maxAllocSize = 0;
+	for (size_t i = 0; i < FL_INDEX_COUNT; i++)
+	{
+		this->slBitmap[i] = 0;
+		for (size_t j = 0; j < SL_INDEX_COUNT; j++)
+			this->freeBins[i][j] = nullptr;
+	}
+}
+
+
+inline DynamicAllocator::~DynamicAllocator() {}
+
+
+inline void* DynamicAllocator::Alloc(size_t size)
+{
+	return this->Alloc(size, 0);
+}
+
+
+inline void DynamicAllocator::MarkBlockUsed(const MemoryBlock* block)
+{
+	void* usedEndAddr = PointerAdd(this->GetBlockTag(block), TAG_SIZE + BLOCK_SIZE + ((this->policy & POLICY_TRIMMABLE) ? sizeof(TrimRecord) : 0));
+	if (usedEndAddr > this->zeroBeginAddr)
+		this->zeroBeginAddr = usedEndAddr < this->blockEndAddr ? usedEndAddr : this->blockEndAddr;
+}
+
+
+inline size_t DynamicAllocator::GetFreeSize() const
+{
+	size_t totalSize = reinterpret_cast<uintptr_t>(this->blockEndAddr) - reinterpret_cast<uintptr_t>(this->blockBeginAddr);
+	return totalSize - this->allocSize - this->allocBlockNum * (BLOCK_SIZE + TAG_SIZE);
+}
+
+
+inline MemoryBlockTag* DynamicAllocator::GetBlockTag(const MemoryBlock* block) const
+{
+	return static_cast<MemoryBlockTag*>(PointerAdd(block->baseAddr, block->blockSize));
+}
+
+
+inline MemoryBlock* DynamicAllocator::GetNextPhysicalBlock(const MemoryBlock* block) const
+{
+	void* nextAddr = PointerAdd(this->GetBlockTag(block), TAG_SIZE);
+	return nextAddr < this->blockEndAddr ? static_cast<MemoryBlock*>(nextAddr) : nullptr;
+}
+
+
+inline MemoryBlock* DynamicAllocator::GetPrevPhysicalBlock(const MemoryBlock* block) const
+{
+	if (block <= this->blockBeginAddr)
+		return nullptr;
+
+	MemoryBlockTag* prevTag = static_cast<MemoryBlockTag*>(PointerSub(block, TAG_SIZE));
+	return prevTag->block;
+}
+
+
+inline void FindBinIndex(size_t size, size_t& outFlIdx, size_t& outSlIdx)
+{
+	if (size < SMALL_BLOCK_SIZE)
+	{
+		outFlIdx = 0;
+		outSlIdx = size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT);
+		return;
+	}
+
+	size_t fl = static_cast<size_t>(FindLastSetBit(size));
+	if (fl >= FL_INDEX_MAX)
+	{
+		outFlIdx = FL_INDEX_COUNT - 1;
+		outSlIdx = SL_INDEX_COUNT - 1;
+		return;
+	}
+
+	outSlIdx = (size >> (fl - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+	outFlIdx = fl - FL_INDEX_SHIFT + 1;
+}
\ No newline at end of file
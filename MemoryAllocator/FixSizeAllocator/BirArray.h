@@ -1,89 +1,196 @@
-#pragma once
-#include <inttypes.h>
-#include <intrin.h>
-#include "../Utility/Utility.h"
-
-
-using namespace Utility;
-
-
-#if _WIN32
-typedef uint32_t BitElement;
-#else
-typedef uint64_t BitElement;
-#endif // WIN32
-
-
-/**
-* @brief BitArray is an array that monitor the status of each memory block in fix size
-*		 allocator. Elements of the bit array is 32-bit or 64-bit unsigned integers -- based
-*		 on the architecture of current system (32-bit or 64-bit system). Each bit in each 
-*		 element monitors a memory block in fix size allocator. A clear bit (0) represent an 
-*		 allocated block, a set bit (1) represent a free block. Note that BitArray use a single 
-*		 integer to represent an array, compiler still treats "bit array" as an single 
-*		 integer. Therefore, "array" will not has range protection as regular array does. User 
-*		 needs to manually implement array range protection. 
-*
-* @param length -- The number of elements in bit array;
-* @param blockPerElement -- How many blocks does each element monitoring;
-* @param arr -- Entry of the bit array. arr is the first element of the bit array. The address 
-*				of arr is count as the starting address of the bit array;
-*/
-class BitArray
-{
-public:
-	size_t length;
-	size_t blockPerElement;
-	BitElement arr;
-
-
-	inline BitArray(size_t length = 0, size_t blockPerElement = 0, BitElement arr = 0);
-	inline ~BitArray();
-
-	inline BitElement* FindElementPtr(size_t idx) const;
-
-	/**
-	* @brief Go through all elements in the bit array, and scan from the least significant
-	*		 bit to the most significant bit of each element to find the first allocated 
-	*		 bit (clear bit) in the bit array.
-	* 
-	* @param &outIdx -- Result of the function: index of the first allocated bit in 
-	*		 bit array;
-	*
-	* @return If a allocated bit is found, return true and result is assigned to parameter
-	*		  "outIdx". Otherwise, return false;
-	*/
-	bool FindFirstAllocateBit(size_t& outIdx) const;
-	bool FindFirstFreeBit(size_t& outIdx) const;
-
-	void SetBit(size_t blockIdx);
-	void ClearBit(size_t blockIdx);
-
-	void SetAllBits();
-	void ClearAllBits();
-
-	inline bool IsBitSet(size_t blockIdx) const;
-	inline bool IsBitClear(size_t blockIdx) const;
-
-	bool AreAllBitsSet() const;
-	bool AreAllBitsClear() const;
-};
-
-
-/**
-* @brief Instantiate a BitArray instance in the designated memory space. It is done by
-*		 manually assigning a block of unoccupied memory space to store the BitArray
-*		 instance and telling the compiler to treat that memory space as a BitArray.
-* 
-* @param baseAddr -- The starting address of the free memory space that is going to 
-*		 store the BitArray instance.
-* @param blockNum -- The number of memory blocks that bit array is going to monitor.
-* @param initToOne -- A trigger to determine whether the bit array should be initialized
-*		 to all set.
-* 
-* @return The address of BitArray instance. It is equals to the parameter "baseAddr"
-*/
-BitArray* CreateBitArray(void* baseAddr, size_t blockNum, bool initToOne);
-
-
-#include "BitArray.inl"
+#pragma once
+#include <inttypes.h>
+#include <stddef.h>
+#include "../Utility/Utility.h"
+
+
+using namespace Utility;
+
+
+#if _WIN32
+typedef uint32_t BitElement;
+#else
+typedef uint64_t BitElement;
+#endif // WIN32
+
+/* The number of bits in each element of bit array */
+const size_t BIT_ELEMENT_SIZE = sizeof(BitElement) * 8;
+
+/* The maximum levels of summary, enough for BIT_ELEMENT_SIZE^8 elements */
+const size_t BIT_ARRAY_MAX_SUMMARY_LEVEL = 8;
+
+
+/**
+* @brief BitArray is an array that monitor the status of each memory block in fix size
+*		 allocator. Elements of the bit array is 32-bit or 64-bit unsigned integers -- based
+*		 on the architecture of current system (32-bit or 64-bit system). Each bit in each 
+*		 element monitors a memory block in fix size allocator. A clear bit (0) represent an 
+*		 allocated block, a set bit (1) represent a free block. Note that BitArray use a single 
+*		 integer to represent an array, compiler still treats "bit array" as an single 
+*		 integer. Therefore, "array" will not has range protection as regular array does. User 
+*		 needs to manually implement array range protection. 
+*		 To avoid scanning all elements for a free (or allocated) bit, bit array keeps two summaries
+*		 right after its elements. In the free summary, bit i of level 0 is set if element i has any
+*		 set bit, and bit i of level k is set if element i of level k-1 is not zero. The allocated 
+*		 summary does the same for clear bits. The top level of each summary is a single element, so
+*		 finding the first free (or allocated) bit only reads one element per level. Summaries are 
+*		 kept up to date by the methods that modify bits. If elements are modified directly, call
+*		 "UpdateSummary()" to rebuild the summaries. 
+*		 Bit array can also be modified by several threads at the same time through its "Atomic"
+*		 methods, which update elements and summaries with atomic operations instead of a lock.
+*		 The structure of bit array be like:
+*		 |  member variables  |  elements...  |  free summary levels...  |  allocated summary levels...  |
+*
+* @param length -- The number of elements in bit array;
+* @param blockNum -- The number of memory blocks monitored by bit array. The rest bits of the last
+*		 element are padding;
+* @param blockPerElement -- How many blocks does each element monitoring;
+* @param summaryLevelNum -- The number of levels of each summary;
+* @param freeSummaryIdx -- The index of the first element of each level of the free summary;
+* @param allocSummaryIdx -- The index of the first element of each level of the allocated summary;
+* @param arr -- Entry of the bit array. arr is the first element of the bit array. The address 
+*				of arr is count as the starting address of the bit array;
+*/
+class BitArray
+{
+public:
+	size_t length;
+	size_t blockNum;
+	size_t blockPerElement;
+	size_t summaryLevelNum;
+	size_t freeSummaryIdx[BIT_ARRAY_MAX_SUMMARY_LEVEL];
+	size_t allocSummaryIdx[BIT_ARRAY_MAX_SUMMARY_LEVEL];
+	BitElement arr;
+
+
+	inline BitArray(size_t length = 0, size_t blockPerElement = 0, BitElement arr = 0);
+	inline ~BitArray();
+
+	inline BitElement* FindElementPtr(size_t idx) const;
+
+	/**
+	* @brief Go through all elements in the bit array, and scan from the least significant
+	*		 bit to the most significant bit of each element to find the first allocated 
+	*		 bit (clear bit) in the bit array.
+	* 
+	* @param &outIdx -- Result of the function: index of the first allocated bit in 
+	*		 bit array;
+	*
+	* @return If a allocated bit is found, return true and result is assigned to parameter
+	*		  "outIdx". Otherwise, return false;
+	*/
+	bool FindFirstAllocateBit(size_t& outIdx) const;
+	bool FindFirstFreeBit(size_t& outIdx) const;
+
+	void SetBit(size_t blockIdx);
+	void ClearBit(size_t blockIdx);
+
+	void SetAllBits();
+	void ClearAllBits();
+
+	/**
+	* @brief Rebuild both summaries from the elements of the bit array.
+	*/
+	void UpdateSummary();
+
+	/**
+	* @brief Find the first element that is marked in the given summary by walking down from the
+	*		 top level of the summary.
+	*/
+	bool FindFirstSummaryElement(const size_t* summaryIdx, size_t& outIdx) const;
+
+	/**
+	* @brief Mark (or unmark) an element in the given summary. Upper levels are only updated when
+	*		 the lower level element changes between zero and non-zero.
+	*/
+	void SetSummaryBit(const size_t* summaryIdx, size_t idx);
+	void ClearSummaryBit(const size_t* summaryIdx, size_t idx);
+
+	inline bool IsBitSet(size_t blockIdx) const;
+	inline bool IsBitClear(size_t blockIdx) const;
+
+	bool AreAllBitsSet() const;
+	bool AreAllBitsClear() const;
+
+	/**
+	* @brief Return the bits of the given element that monitor memory blocks, padding excluded.
+	*/
+	inline BitElement GetValidMask(size_t idx) const;
+
+	/**
+	* @brief Thread-safe version of FindFirstFreeBit() followed by ClearBit(). The bit is claimed by 
+	*		 a CAS on its element, so two threads never claim the same bit. Padding bits are never
+	*		 claimed.
+	* 
+	* @return If a free bit is claimed, return true and its index is assigned to parameter 
+	*		  "outIdx". Otherwise, return false;
+	*/
+	bool AtomicClaimFreeBit(size_t& outIdx);
+
+	/**
+	* @brief Thread-safe version of SetBit().
+	* 
+	* @return If the bit is already set, return false.
+	*/
+	bool AtomicReleaseBit(size_t blockIdx);
+
+	/**
+	* @brief Claim up to "maxNum" free bits (no more than BIT_ELEMENT_SIZE) of the first element that
+	*		 has any, with one update of the element. The lowest free bits are claimed first.
+	* 
+	* @param outIdxs -- Indices of the claimed bits, it should have room for "maxNum" indices;
+	* 
+	* @return The number of claimed bits. Return 0 if there is no free bit.
+	*/
+	size_t ClaimFreeBits(size_t maxNum, size_t* outIdxs);
+	size_t AtomicClaimFreeBits(size_t maxNum, size_t* outIdxs);
+
+	/**
+	* @brief Set the given bits of element "idx" with one update of the element.
+	* 
+	* @return The bits that were clear before, i.e. the bits that are actually released.
+	*/
+	BitElement ReleaseBits(size_t idx, BitElement bits);
+	BitElement AtomicReleaseBits(size_t idx, BitElement bits);
+
+	/**
+	* @brief Thread-safe versions of the summary methods. Under concurrent modification a summary bit
+	*		 may be set while the element below it is empty, but never the opposite: whoever clears a
+	*		 summary bit checks the element below it again afterwards, and marks it again if another
+	*		 thread has refilled it in the meantime. A search that runs into an empty element clears
+	*		 its stale summary bit and starts over.
+	*/
+	bool AtomicFindFirstSummaryElement(const size_t* summaryIdx, size_t& outIdx);
+	void AtomicSetSummaryBit(const size_t* summaryIdx, size_t idx, size_t level);
+	void AtomicClearSummaryBit(const size_t* summaryIdx, size_t idx, size_t level);
+
+	/**
+	* @brief Whether the element that bit "idx" of the given summary level stands for is not empty.
+	*/
+	bool IsSummaryElementMarked(const size_t* summaryIdx, size_t idx, size_t level) const;
+};
+
+
+/**
+* @brief Instantiate a BitArray instance in the designated memory space. It is done by
+*		 manually assigning a block of unoccupied memory space to store the BitArray
+*		 instance and telling the compiler to treat that memory space as a BitArray.
+* 
+* @param baseAddr -- The starting address of the free memory space that is going to 
+*		 store the BitArray instance.
+* @param blockNum -- The number of memory blocks that bit array is going to monitor.
+* @param initToOne -- A trigger to determine whether the bit array should be initialized
+*		 to all set.
+* 
+* @return The address of BitArray instance. It is equals to the parameter "baseAddr"
+*/
+BitArray* CreateBitArray(void* baseAddr, size_t blockNum, bool initToOne);
+
+/**
+* @brief Return the size of the BitArray instance that monitors the given number of memory blocks, 
+*		 including its elements and summaries. It can be evaluated at compile time.
+*/
+constexpr size_t GetBitArraySize(size_t blockNum);
+
+
+#include "BitArray.inl"
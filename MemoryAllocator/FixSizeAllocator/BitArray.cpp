@@ -1,134 +1,452 @@
-#include "BirArray.h"
-
-
-BitArray* CreateBitArray(void* baseAddr, size_t blockNum, bool initToOne)
-{
-	BitArray* bitArray = static_cast<BitArray*>(baseAddr);
-	bitArray->blockPerElement = sizeof(BitElement) * 8;
-	bitArray->length = blockNum / bitArray->blockPerElement + (blockNum % bitArray->blockPerElement == 0 ? 0 : 1);
-	bitArray->SetAllBits();
-
-	return bitArray;
-}
-
-
-bool BitArray::FindFirstAllocateBit(size_t& outIdx) const
-{
-	unsigned long idx, bitIdx;
-	BitElement marker = _WIN32 ? ~0UL : ~0ULL;			// Create an element that has 1 in all its bits
-	BitElement element = 0;;
-	for (idx = 0; idx < this->length; idx++)			// Skip scanning the element if all its bits are 1
-	{
-		element = *this->FindElementPtr(idx);
-		if (element != marker)
-			break;
-	}
-
-#if _WIN32
-	_BitScanForward(&bitIdx, ~element);
-#else
-	_BitScanForward64(&bitIdx, ~element);
-#endif
-
-	if (idx >= this->length)
-		return false;
-	else
-	{
-		outIdx = idx * this->blockPerElement + bitIdx;
-		return true;
-	}
-}
-
-
-bool BitArray::FindFirstFreeBit(size_t& outIdx) const
-{
-	unsigned long idx, bitIdx;
-	BitElement marker = _WIN32 ? 0UL : 0ULL;			// Create an element that has 0 in all its bits
-	BitElement element = 0;
-	for (idx = 0; idx < this->length; idx++)			// Skip scanning the element if all its bits are 0
-	{
-		element = *this->FindElementPtr(idx);
-		if (element != marker)
-			break;
-	}
-
-#if _WIN32
-	_BitScanForward(&bitIdx, element);
-#else
-	_BitScanForward64(&bitIdx, element);
-#endif
-
-	if (idx >= this->length)
-		return false;
-	else
-	{
-		outIdx = idx * this->blockPerElement + bitIdx;
-		return true;
-	}
-}
-
-
-void BitArray::SetBit(size_t blockIdx)
-{
-	size_t idx = blockIdx / this->blockPerElement;
-	size_t bitIdx = blockIdx % this->blockPerElement;
-
-	if (_WIN32)
-		*this->FindElementPtr(idx) |= 1UL << bitIdx;
-	else
-		*this->FindElementPtr(idx) |= 1ULL << bitIdx;
-}
-
-
-void BitArray::ClearBit(size_t blockIdx)
-{
-	size_t idx = blockIdx / this->blockPerElement;
-	size_t bitIdx = blockIdx % this->blockPerElement;
-
-	if (_WIN32)
-		*this->FindElementPtr(idx) &= ~(1UL << bitIdx);
-	else
-		*this->FindElementPtr(idx) &= ~(1ULL << bitIdx);
-}
-
-
-void BitArray::SetAllBits()
-{
-	for (size_t i = 0; i < this->length; i++)
-	{
-		*this->FindElementPtr(i) = _WIN32 ? ~0UL : ~0ULL;
-	}
-}
-
-
-void BitArray::ClearAllBits()
-{
-	for (size_t i = 0; i < this->length; i++)
-	{
-		*this->FindElementPtr(i) = _WIN32 ? 0UL : 0ULL;
-	}
-}
-
-
-bool BitArray::AreAllBitsSet() const
-{
-	BitElement marker = _WIN32 ? ~0UL : ~0ULL;
-	for (size_t i = 0; i < this->length; i++)
-	{
-		if (*this->FindElementPtr(i) != marker)
-			return false;
-	}
-	return true;
-}
-
-
-bool BitArray::AreAllBitsClear() const
-{
-	BitElement marker = _WIN32 ? 0UL : 0ULL;
-	for (size_t i = 0; i < this->length; i++)
-	{
-		if (*this->FindElementPtr(i) != marker)
-			return false;
-	}
-	return true;
-}
+#include "BirArray.h"
+#include "../Utility/Atomic.h"
+
+
+/* Create an element that has 1 in all its bits */
+static const BitElement ALL_BITS_SET = ~static_cast<BitElement>(0);
+
+
+BitArray* CreateBitArray(void* baseAddr, size_t blockNum, bool initToOne)
+{
+	BitArray* bitArray = static_cast<BitArray*>(baseAddr);
+	bitArray->blockPerElement = BIT_ELEMENT_SIZE;
+	bitArray->length = blockNum / bitArray->blockPerElement + (blockNum % bitArray->blockPerElement == 0 ? 0 : 1);
+	bitArray->blockNum = blockNum;
+
+	/* Lay out the levels of both summaries after the elements, until a level fits in one element */
+	size_t levelLength = bitArray->length;
+	size_t freeSummaryIdx = bitArray->length;
+	size_t summaryLength = 0;
+	bitArray->summaryLevelNum = 0;
+	do
+	{
+		levelLength = levelLength / BIT_ELEMENT_SIZE + (levelLength % BIT_ELEMENT_SIZE == 0 ? 0 : 1);
+		bitArray->freeSummaryIdx[bitArray->summaryLevelNum] = freeSummaryIdx + summaryLength;
+		summaryLength += levelLength;
+		bitArray->summaryLevelNum++;
+	} while (levelLength > 1 && bitArray->summaryLevelNum < BIT_ARRAY_MAX_SUMMARY_LEVEL);
+
+	for (size_t level = 0; level < bitArray->summaryLevelNum; level++)
+		bitArray->allocSummaryIdx[level] = bitArray->freeSummaryIdx[level] + summaryLength;
+
+	if (initToOne)
+		bitArray->SetAllBits();
+	else
+		bitArray->ClearAllBits();
+
+	return bitArray;
+}
+
+
+bool BitArray::FindFirstSummaryElement(const size_t* summaryIdx, size_t& outIdx) const
+{
+	if (this->length == 0)
+		return false;
+
+	size_t idx = 0;
+	for (size_t level = this->summaryLevelNum; level > 0; level--)
+	{
+		BitElement element = *this->FindElementPtr(summaryIdx[level - 1] + idx);
+		if (element == 0)
+			return false;
+
+		idx = idx * BIT_ELEMENT_SIZE + static_cast<size_t>(FindFirstSetBit(element));
+	}
+
+	outIdx = idx;
+	return idx < this->length;
+}
+
+
+void BitArray::SetSummaryBit(const size_t* summaryIdx, size_t idx)
+{
+	for (size_t level = 0; level < this->summaryLevelNum; level++)
+	{
+		BitElement* element = this->FindElementPtr(summaryIdx[level] + idx / BIT_ELEMENT_SIZE);
+		BitElement prevElement = *element;
+		*element |= static_cast<BitElement>(1) << (idx % BIT_ELEMENT_SIZE);
+
+		if (prevElement != 0)
+			break;
+		idx /= BIT_ELEMENT_SIZE;
+	}
+}
+
+
+void BitArray::ClearSummaryBit(const size_t* summaryIdx, size_t idx)
+{
+	for (size_t level = 0; level < this->summaryLevelNum; level++)
+	{
+		BitElement* element = this->FindElementPtr(summaryIdx[level] + idx / BIT_ELEMENT_SIZE);
+		*element &= ~(static_cast<BitElement>(1) << (idx % BIT_ELEMENT_SIZE));
+
+		if (*element != 0)
+			break;
+		idx /= BIT_ELEMENT_SIZE;
+	}
+}
+
+
+void BitArray::UpdateSummary()
+{
+	size_t levelLength = this->length;
+	for (size_t level = 0; level < this->summaryLevelNum; level++)
+	{
+		size_t nextLevelLength = levelLength / BIT_ELEMENT_SIZE + (levelLength % BIT_ELEMENT_SIZE == 0 ? 0 : 1);
+		for (size_t i = 0; i < nextLevelLength; i++)
+		{
+			*this->FindElementPtr(this->freeSummaryIdx[level] + i) = 0;
+			*this->FindElementPtr(this->allocSummaryIdx[level] + i) = 0;
+		}
+
+		/* Level 0 summarizes the elements, and the other levels summarize the level below them */
+		for (size_t i = 0; i < levelLength; i++)
+		{
+			BitElement freeElement, allocElement;
+			if (level == 0)
+			{
+				freeElement = *this->FindElementPtr(i);
+				allocElement = ~freeElement;
+			}
+			else
+			{
+				freeElement = *this->FindElementPtr(this->freeSummaryIdx[level - 1] + i);
+				allocElement = *this->FindElementPtr(this->allocSummaryIdx[level - 1] + i);
+			}
+
+			BitElement bit = static_cast<BitElement>(1) << (i % BIT_ELEMENT_SIZE);
+			if (freeElement != 0)
+				*this->FindElementPtr(this->freeSummaryIdx[level] + i / BIT_ELEMENT_SIZE) |= bit;
+			if (allocElement != 0)
+				*this->FindElementPtr(this->allocSummaryIdx[level] + i / BIT_ELEMENT_SIZE) |= bit;
+		}
+
+		levelLength = nextLevelLength;
+	}
+}
+
+
+bool BitArray::FindFirstAllocateBit(size_t& outIdx) const
+{
+	size_t idx;
+	if (!this->FindFirstSummaryElement(this->allocSummaryIdx, idx))
+		return false;
+
+	BitElement element = *this->FindElementPtr(idx);
+	outIdx = idx * BIT_ELEMENT_SIZE + static_cast<size_t>(FindFirstSetBit(static_cast<BitElement>(~element)));
+	return true;
+}
+
+
+bool BitArray::FindFirstFreeBit(size_t& outIdx) const
+{
+	size_t idx;
+	if (!this->FindFirstSummaryElement(this->freeSummaryIdx, idx))
+		return false;
+
+	BitElement element = *this->FindElementPtr(idx);
+	outIdx = idx * BIT_ELEMENT_SIZE + static_cast<size_t>(FindFirstSetBit(element));
+	return true;
+}
+
+
+void BitArray::SetBit(size_t blockIdx)
+{
+	size_t idx = blockIdx / BIT_ELEMENT_SIZE;
+	size_t bitIdx = blockIdx % BIT_ELEMENT_SIZE;
+
+	BitElement* element = this->FindElementPtr(idx);
+	BitElement prevElement = *element;
+	*element |= static_cast<BitElement>(1) << bitIdx;
+
+	if (prevElement == 0)
+		this->SetSummaryBit(this->freeSummaryIdx, idx);
+	if (*element == ALL_BITS_SET && prevElement != ALL_BITS_SET)
+		this->ClearSummaryBit(this->allocSummaryIdx, idx);
+}
+
+
+void BitArray::ClearBit(size_t blockIdx)
+{
+	size_t idx = blockIdx / BIT_ELEMENT_SIZE;
+	size_t bitIdx = blockIdx % BIT_ELEMENT_SIZE;
+
+	BitElement* element = this->FindElementPtr(idx);
+	BitElement prevElement = *element;
+	*element &= ~(static_cast<BitElement>(1) << bitIdx);
+
+	if (prevElement == ALL_BITS_SET)
+		this->SetSummaryBit(this->allocSummaryIdx, idx);
+	if (*element == 0 && prevElement != 0)
+		this->ClearSummaryBit(this->freeSummaryIdx, idx);
+}
+
+
+void BitArray::SetAllBits()
+{
+	for (size_t i = 0; i < this->length; i++)
+	{
+		*this->FindElementPtr(i) = ALL_BITS_SET;
+	}
+	this->UpdateSummary();
+}
+
+
+void BitArray::ClearAllBits()
+{
+	for (size_t i = 0; i < this->length; i++)
+	{
+		*this->FindElementPtr(i) = 0;
+	}
+	this->UpdateSummary();
+}
+
+
+bool BitArray::AreAllBitsSet() const
+{
+	size_t idx;
+	return !this->FindFirstSummaryElement(this->allocSummaryIdx, idx);
+}
+
+
+bool BitArray::AreAllBitsClear() const
+{
+	size_t idx;
+	return !this->FindFirstSummaryElement(this->freeSummaryIdx, idx);
+}
+
+
+bool BitArray::IsSummaryElementMarked(const size_t* summaryIdx, size_t idx, size_t level) const
+{
+	if (level > 0)
+		return AtomicLoad(this->FindElementPtr(summaryIdx[level - 1] + idx)) != 0;
+
+	BitElement element = AtomicLoad(this->FindElementPtr(idx));
+	if (summaryIdx == this->freeSummaryIdx)
+		return (element & this->GetValidMask(idx)) != 0;
+	else
+		return element != ALL_BITS_SET;
+}
+
+
+void BitArray::AtomicSetSummaryBit(const size_t* summaryIdx, size_t idx, size_t level)
+{
+	for (; level < this->summaryLevelNum; level++)
+	{
+		BitElement* element = this->FindElementPtr(summaryIdx[level] + idx / BIT_ELEMENT_SIZE);
+		BitElement prevElement = AtomicFetchOr(element, static_cast<BitElement>(1) << (idx % BIT_ELEMENT_SIZE));
+
+		if (prevElement != 0)
+			break;
+		idx /= BIT_ELEMENT_SIZE;
+	}
+}
+
+
+void BitArray::AtomicClearSummaryBit(const size_t* summaryIdx, size_t idx, size_t level)
+{
+	for (; level < this->summaryLevelNum; level++)
+	{
+		BitElement bit = static_cast<BitElement>(1) << (idx % BIT_ELEMENT_SIZE);
+		BitElement* element = this->FindElementPtr(summaryIdx[level] + idx / BIT_ELEMENT_SIZE);
+		BitElement prevElement = AtomicFetchAnd(element, static_cast<BitElement>(~bit));
+
+		/* Another thread may refill the element below after it is found empty. Since that thread
+		 * only marks the summary when the element changes from empty, mark it again here */
+		if (this->IsSummaryElementMarked(summaryIdx, idx, level))
+		{
+			this->AtomicSetSummaryBit(summaryIdx, idx, level);
+			return;
+		}
+
+		if ((prevElement & ~bit) != 0)
+			break;
+		idx /= BIT_ELEMENT_SIZE;
+	}
+}
+
+
+bool BitArray::AtomicFindFirstSummaryElement(const size_t* summaryIdx, size_t& outIdx)
+{
+	if (this->length == 0)
+		return false;
+
+	size_t level = this->summaryLevelNum;
+	size_t idx = 0;
+	while (level > 0)
+	{
+		BitElement element = AtomicLoad(this->FindElementPtr(summaryIdx[level - 1] + idx));
+		if (element != 0)
+		{
+			idx = idx * BIT_ELEMENT_SIZE + static_cast<size_t>(FindFirstSetBit(element));
+			level--;
+			continue;
+		}
+
+		if (level == this->summaryLevelNum)
+			return false;
+
+		/* The upper level is stale, clear its bit and search again from the top level */
+		this->AtomicClearSummaryBit(summaryIdx, idx, level);
+		level = this->summaryLevelNum;
+		idx = 0;
+	}
+
+	outIdx = idx;
+	return idx < this->length;
+}
+
+
+bool BitArray::AtomicClaimFreeBit(size_t& outIdx)
+{
+	size_t idx;
+	while (this->AtomicFindFirstSummaryElement(this->freeSummaryIdx, idx))
+	{
+		BitElement* element = this->FindElementPtr(idx);
+		BitElement validMask = this->GetValidMask(idx);
+		BitElement prevElement = AtomicLoad(element);
+		while ((prevElement & validMask) != 0)
+		{
+			BitElement freeBits = prevElement & validMask;
+			BitElement bit = freeBits & (~freeBits + 1);
+			if (AtomicCompareExchange(element, prevElement, static_cast<BitElement>(prevElement & ~bit)))
+			{
+				if (prevElement == ALL_BITS_SET)
+					this->AtomicSetSummaryBit(this->allocSummaryIdx, idx, 0);
+				if ((prevElement & ~bit & validMask) == 0)
+					this->AtomicClearSummaryBit(this->freeSummaryIdx, idx, 0);
+
+				outIdx = idx * BIT_ELEMENT_SIZE + static_cast<size_t>(FindFirstSetBit(bit));
+				return true;
+			}
+		}
+
+		/* Other threads have claimed the rest bits of the element */
+		this->AtomicClearSummaryBit(this->freeSummaryIdx, idx, 0);
+	}
+	return false;
+}
+
+
+/**
+* @brief Keep the lowest "maxNum" set bits of the given value.
+*/
+static inline BitElement SelectLowestBits(BitElement bits, size_t maxNum)
+{
+	if (static_cast<size_t>(CountSetBits(bits)) <= maxNum)
+		return bits;
+
+	BitElement selectedBits = 0;
+	for (size_t i = 0; i < maxNum; i++)
+	{
+		BitElement bit = bits & (~bits + 1);
+		selectedBits |= bit;
+		bits &= ~bit;
+	}
+	return selectedBits;
+}
+
+
+/**
+* @brief Write the indices of the set bits of element "idx" into "outIdxs", and return their number.
+*/
+static inline size_t WriteBitIndices(size_t idx, BitElement bits, size_t* outIdxs)
+{
+	size_t num = 0;
+	for (; bits != 0; bits &= bits - 1)
+		outIdxs[num++] = idx * BIT_ELEMENT_SIZE + static_cast<size_t>(FindFirstSetBit(bits));
+	return num;
+}
+
+
+size_t BitArray::ClaimFreeBits(size_t maxNum, size_t* outIdxs)
+{
+	size_t idx;
+	if (maxNum == 0 || !this->FindFirstSummaryElement(this->freeSummaryIdx, idx))
+		return 0;
+
+	BitElement* element = this->FindElementPtr(idx);
+	BitElement prevElement = *element;
+	BitElement bits = SelectLowestBits(prevElement & this->GetValidMask(idx), maxNum);
+	*element &= ~bits;
+
+	if (bits != 0 && prevElement == ALL_BITS_SET)
+		this->SetSummaryBit(this->allocSummaryIdx, idx);
+	if (*element == 0 && prevElement != 0)
+		this->ClearSummaryBit(this->freeSummaryIdx, idx);
+	return WriteBitIndices(idx, bits, outIdxs);
+}
+
+
+size_t BitArray::AtomicClaimFreeBits(size_t maxNum, size_t* outIdxs)
+{
+	size_t idx;
+	while (maxNum > 0 && this->AtomicFindFirstSummaryElement(this->freeSummaryIdx, idx))
+	{
+		BitElement* element = this->FindElementPtr(idx);
+		BitElement validMask = this->GetValidMask(idx);
+		BitElement prevElement = AtomicLoad(element);
+		while ((prevElement & validMask) != 0)
+		{
+			BitElement bits = SelectLowestBits(prevElement & validMask, maxNum);
+			if (AtomicCompareExchange(element, prevElement, static_cast<BitElement>(prevElement & ~bits)))
+			{
+				if (prevElement == ALL_BITS_SET)
+					this->AtomicSetSummaryBit(this->allocSummaryIdx, idx, 0);
+				if ((prevElement & ~bits & validMask) == 0)
+					this->AtomicClearSummaryBit(this->freeSummaryIdx, idx, 0);
+				return WriteBitIndices(idx, bits, outIdxs);
+			}
+		}
+
+		/* Other threads have claimed the rest bits of the element */
+		this->AtomicClearSummaryBit(this->freeSummaryIdx, idx, 0);
+	}
+	return 0;
+}
+
+
+BitElement BitArray::ReleaseBits(size_t idx, BitElement bits)
+{
+	BitElement* element = this->FindElementPtr(idx);
+	BitElement prevElement = *element;
+	*element |= bits;
+
+	if (prevElement == 0 && bits != 0)
+		this->SetSummaryBit(this->freeSummaryIdx, idx);
+	if (*element == ALL_BITS_SET && prevElement != ALL_BITS_SET)
+		this->ClearSummaryBit(this->allocSummaryIdx, idx);
+	return bits & ~prevElement;
+}
+
+
+BitElement BitArray::AtomicReleaseBits(size_t idx, BitElement bits)
+{
+	BitElement prevElement = AtomicFetchOr(this->FindElementPtr(idx), bits);
+	BitElement releasedBits = bits & ~prevElement;
+	if (releasedBits == 0)
+		return 0;
+
+	if ((prevElement & this->GetValidMask(idx)) == 0)
+		this->AtomicSetSummaryBit(this->freeSummaryIdx, idx, 0);
+	if ((prevElement | bits) == ALL_BITS_SET)
+		this->AtomicClearSummaryBit(this->allocSummaryIdx, idx, 0);
+	return releasedBits;
+}
+
+
+bool BitArray::AtomicReleaseBit(size_t blockIdx)
+{
+	size_t idx = blockIdx / BIT_ELEMENT_SIZE;
+	BitElement bit = static_cast<BitElement>(1) << (blockIdx % BIT_ELEMENT_SIZE);
+
+	BitElement prevElement = AtomicFetchOr(this->FindElementPtr(idx), bit);
+	if ((prevElement & bit) != 0)
+		return false;
+
+	if ((prevElement & this->GetValidMask(idx)) == 0)
+		this->AtomicSetSummaryBit(this->freeSummaryIdx, idx, 0);
+	if ((prevElement | bit) == ALL_BITS_SET)
+		this->AtomicClearSummaryBit(this->allocSummaryIdx, idx, 0);
+	return true;
+}
\ No newline at end of file
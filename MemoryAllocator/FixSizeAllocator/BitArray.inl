@@ -1,32 +1,60 @@
-#pragma once
-
-
-inline BitArray::BitArray(size_t length, size_t blockPerElement, BitElement arr)
-{
-	this->length = length;
-	this->blockPerElement = blockPerElement;
-	this->arr = arr;
-}
-
-
-inline BitArray::~BitArray() {}
-
-
-inline BitElement* BitArray::FindElementPtr(size_t idx) const
-{
-	return reinterpret_cast<BitElement*>(PointerAdd(&this->arr, sizeof(BitElement) * idx));
-}
-
-
-inline bool BitArray::IsBitSet(size_t blockIdx) const
-{
-	size_t idx = blockIdx / this->blockPerElement;
-	size_t bitIdx = blockIdx % this->blockPerElement;
-	return *this->FindElementPtr(idx) & (1 << bitIdx);
-}
-
-
-inline bool BitArray::IsBitClear(size_t blockIdx) const
-{
-	return !this->IsBitSet(blockIdx);
+#pragma once
+
+
+inline BitArray::BitArray(size_t length, size_t blockPerElement, BitElement arr)
+{
+	this->length = length;
+	this->blockNum = length * BIT_ELEMENT_SIZE;
+	this->blockPerElement = blockPerElement;
+	this->summaryLevelNum = 0;
+	this->arr = arr;
+}
+
+
+inline BitArray::~BitArray() {}
+
+
+inline BitElement* BitArray::FindElementPtr(size_t idx) const
+{
+	return reinterpret_cast<BitElement*>(PointerAdd(&this->arr, sizeof(BitElement) * idx));
+}
+
+
+inline bool BitArray::IsBitSet(size_t blockIdx) const
+{
+	size_t idx = blockIdx / BIT_ELEMENT_SIZE;
+	size_t bitIdx = blockIdx % BIT_ELEMENT_SIZE;
+	return (*this->FindElementPtr(idx) & (static_cast<BitElement>(1) << bitIdx)) != 0;
+}
+
+
+inline bool BitArray::IsBitClear(size_t blockIdx) const
+{
+	return !this->IsBitSet(blockIdx);
+}
+
+
+inline BitElement BitArray::GetValidMask(size_t idx) const
+{
+	size_t bitNum = this->blockNum - idx * BIT_ELEMENT_SIZE;
+	if (bitNum >= BIT_ELEMENT_SIZE)
+		return ~static_cast<BitElement>(0);
+	return (static_cast<BitElement>(1) << bitNum) - 1;
+}
+
+
+constexpr size_t GetBitArraySize(size_t blockNum)
+{
+	size_t length = blockNum / BIT_ELEMENT_SIZE + (blockNum % BIT_ELEMENT_SIZE == 0 ? 0 : 1);
+	size_t totalLength = length;
+	size_t levelLength = length;
+	size_t levelNum = 0;
+	do
+	{
+		levelLength = levelLength / BIT_ELEMENT_SIZE + (levelLength % BIT_ELEMENT_SIZE == 0 ? 0 : 1);
+		totalLength += levelLength * 2;
+		levelNum++;
+	} while (levelLength > 1 && levelNum < BIT_ARRAY_MAX_SUMMARY_LEVEL);
+
+	return offsetof(BitArray, arr) + totalLength * sizeof(BitElement);
 }
\ No newline at end of file
@@ -1,118 +1,370 @@
-#include "FixSizeAllocator.h"
-
-
-FixSizeAllocator* CreateFixSizeAllocator(void* baseAddr, size_t blockNum, size_t blockSize, size_t heapSize)
-{
-	FixSizeAllocator* allocator = static_cast<FixSizeAllocator*>(baseAddr);
-	allocator->blockNum = blockNum;
-	allocator->freeBlockNum = blockNum;
-	allocator->blockSize = blockSize;
-	allocator->bitArray = *CreateBitArray(&allocator->bitArray, blockNum, true);
-	BitArray bitArray = allocator->bitArray;
-	allocator->bitArraySize = reinterpret_cast<uintptr_t>(PointerSub(PointerAdd(&bitArray.arr, bitArray.length * sizeof(BitElement)), &bitArray));
-	allocator->blockBaseAddr = PointerAdd(&allocator->bitArray, allocator->bitArraySize);
-
-	/* Debug */
-	//size_t temp1 = sizeof(size_t) * 2 + sizeof(BitElement) * fixAllocator->bitArray.length;
-	//size_t temp2 = reinterpret_cast<uintptr_t>(PointerSub(PointerAdd(&bitArray.arr, bitArray.length * sizeof(BitElement)), &bitArray));
-	//size_t temp3 = sizeof(size_t);
-	//printf("BlockNum address %p \n", &fixAllocator->blockNum);
-	//printf("BlockSize address %p \n", &fixAllocator->blockSize);
-	//printf("Size address: %p \n", &fixAllocator->bitArraySize);
-	//printf("Memory address: %p \n", &fixAllocator->blockBaseAddr);
-	//printf("BitArray address %p \n", &fixAllocator->bitArray);
-	/**/
-
-	size_t allocatorSize = reinterpret_cast<uintptr_t>(PointerSub(PointerAdd(allocator->blockBaseAddr, blockSize * blockNum), baseAddr));
-	if (allocatorSize > heapSize)
-		return nullptr;
-
-	return allocator;
-}
-
-
-bool FixSizeAllocator::Contains(const void* ptr) const
-{
-	uintptr_t offset = reinterpret_cast<uintptr_t>(PointerSub(ptr, this->blockBaseAddr));
-	size_t blockIdx = offset / this->blockSize;
-
-	if (offset % this->blockSize != 0)
-		return false;
-	else if (blockIdx > this->blockNum)
-		return false;
-	else
-		return true;
-}
-
-
-bool FixSizeAllocator::IsAllocated(const void* ptr) const
-{
-	uintptr_t offset = reinterpret_cast<uintptr_t>(PointerSub(ptr, this->blockBaseAddr));
-	size_t blockIdx = offset / this->blockSize;
-
-	if (this->Contains(ptr))
-		return this->bitArray.IsBitClear(blockIdx);
-	else
-		return false;
-}
-
-
-bool FixSizeAllocator::Free(void* ptr)
-{
-	uintptr_t offset = reinterpret_cast<uintptr_t>(PointerSub(ptr, this->blockBaseAddr));
-	size_t blockIdx = offset / this->blockSize;
-
-	if (this->freeBlockNum == this->blockNum)
-		return false;
-	else if (!this->Contains(ptr))
-	{
-		/* Debug */
-		//printf("WARNING: FixAllocator.Free(): Given memory address is invalid! %p \n", ptr);
-		/**/
-		return false;
-	}
-	else if (!this->IsAllocated(ptr))
-	{
-		/* Debug */
-		//printf("WARNING: FixAllocator.Free(): Trying to double free the given memory address! %p \n", ptr);
-		/**/
-		return false;
-	}
-	else
-	{
-		this->freeBlockNum++;
-		this->bitArray.SetBit(blockIdx);
-		return true;
-	}
-}
-
-
-void* FixSizeAllocator::Alloc()
-{
-	if (this->freeBlockNum == 0)
-		return nullptr;
-
-	size_t bitIdx;
-	bool success = this->bitArray.FindFirstFreeBit(bitIdx);
-
-	if (!success)
-		return nullptr;
-	else
-	{
-		this->freeBlockNum--;
-		this->bitArray.ClearBit(bitIdx);
-		return PointerAdd(this->blockBaseAddr, blockSize * bitIdx);
-	}
-}
-
-
-void FixSizeAllocator::Destroy()
-{
-	if (!this->bitArray.AreAllBitsSet())
-	{
-		size_t bitIdx;
-		this->bitArray.FindFirstFreeBit(bitIdx);
-		void* ptr = PointerAdd(this->blockBaseAddr, sizeof(BitElement) * bitIdx);
-		printf("WARNING: FixAllocator.~FixAllocator(): Detect memory leak at %p \n", ptr);
-	}
-}
+#include "FixSizeAllocator.h"
+#include <assert.h>
+#include "../Utility/Atomic.h"
+
+
+/**
+* @brief Set the bits of the memory blocks from "beginIdx" to "endIdx" (exclusive), a whole element
+*		 at a time.
+*/
+static void ReleaseBlockRange(BitArray& bitArray, size_t beginIdx, size_t endIdx)
+{
+	size_t blockIdx = beginIdx;
+	while (blockIdx < endIdx)
+	{
+		size_t offset = blockIdx % BIT_ELEMENT_SIZE;
+		size_t bitNum = endIdx - blockIdx < BIT_ELEMENT_SIZE - offset ? endIdx - blockIdx : BIT_ELEMENT_SIZE - offset;
+		BitElement bits = bitNum == BIT_ELEMENT_SIZE ? ~static_cast<BitElement>(0) : ((static_cast<BitElement>(1) << bitNum) - 1) << offset;
+		bitArray.AtomicReleaseBits(blockIdx / BIT_ELEMENT_SIZE, bits);
+		blockIdx += bitNum;
+	}
+}
+
+
+FixSizeAllocator* CreateFixSizeAllocator(void* baseAddr, size_t blockNum, size_t blockSize, size_t heapSize, unsigned int policy, size_t maxBlockNum)
+{
+	if ((policy & FIX_SIZE_POLICY_FREE_LIST) && blockSize < sizeof(void*))
+		return nullptr;
+	if (maxBlockNum < blockNum)
+		maxBlockNum = blockNum;
+
+	/* Blocks that are not in use yet are marked as allocated, so they are never handed out */
+	FixSizeAllocator* allocator = static_cast<FixSizeAllocator*>(baseAddr);
+	allocator->blockNum = blockNum;
+	allocator->maxBlockNum = maxBlockNum;
+	allocator->freeBlockNum = blockNum;
+	allocator->blockSize = blockSize;
+	CreateBitArray(&allocator->bitArray, maxBlockNum, maxBlockNum == blockNum);
+	if (maxBlockNum != blockNum)
+		ReleaseBlockRange(allocator->bitArray, 0, blockNum);
+	allocator->bitArraySize = GetBitArraySize(maxBlockNum);
+	allocator->blockBaseAddr = PointerAdd(baseAddr, GetFixSizeBlockOffset(maxBlockNum, policy));
+	/* Isolation only decides the layout, the rest of the policy decides how free blocks are managed */
+	allocator->policy = policy & ~FIX_SIZE_POLICY_ISOLATE_HEADER;
+	allocator->freeList = nullptr;
+	allocator->untouchedBlockIdx = 0;
+
+	/* Debug */
+	//size_t temp1 = sizeof(size_t) * 2 + sizeof(BitElement) * fixAllocator->bitArray.length;
+	//size_t temp2 = reinterpret_cast<uintptr_t>(PointerSub(PointerAdd(&bitArray.arr, bitArray.length * sizeof(BitElement)), &bitArray));
+	//size_t temp3 = sizeof(size_t);
+	//printf("BlockNum address %p \n", &fixAllocator->blockNum);
+	//printf("BlockSize address %p \n", &fixAllocator->blockSize);
+	//printf("Size address: %p \n", &fixAllocator->bitArraySize);
+	//printf("Memory address: %p \n", &fixAllocator->blockBaseAddr);
+	//printf("BitArray address %p \n", &fixAllocator->bitArray);
+	/**/
+
+	size_t allocatorSize = reinterpret_cast<uintptr_t>(PointerSub(PointerAdd(allocator->blockBaseAddr, blockSize * maxBlockNum), baseAddr));
+	if (allocatorSize > heapSize)
+		return nullptr;
+
+	return allocator;
+}
+
+
+bool FixSizeAllocator::Contains(const void* ptr) const
+{
+	uintptr_t offset = reinterpret_cast<uintptr_t>(PointerSub(ptr, this->blockBaseAddr));
+	size_t blockIdx = offset / this->blockSize;
+
+	if (offset % this->blockSize != 0)
+		return false;
+	else if (blockIdx >= AtomicLoad(&this->blockNum))
+		return false;
+	else
+		return true;
+}
+
+
+bool FixSizeAllocator::IsAllocated(const void* ptr) const
+{
+	uintptr_t offset = reinterpret_cast<uintptr_t>(PointerSub(ptr, this->blockBaseAddr));
+	size_t blockIdx = offset / this->blockSize;
+
+	if (this->Contains(ptr))
+		return this->bitArray.IsBitClear(blockIdx);
+	else
+		return false;
+}
+
+
+bool FixSizeAllocator::Free(void* ptr)
+{
+	if (this->policy == FIX_SIZE_POLICY_FREE_LIST)
+		return this->FreeToFreeList(ptr);
+
+	uintptr_t offset = reinterpret_cast<uintptr_t>(PointerSub(ptr, this->blockBaseAddr));
+	size_t blockIdx = offset / this->blockSize;
+
+	if (this->freeBlockNum == this->blockNum)
+		return false;
+	else if (!this->Contains(ptr))
+	{
+		/* Debug */
+		//printf("WARNING: FixAllocator.Free(): Given memory address is invalid! %p \n", ptr);
+		/**/
+		return false;
+	}
+	else if (!this->IsAllocated(ptr))
+	{
+		/* Debug */
+		//printf("WARNING: FixAllocator.Free(): Trying to double free the given memory address! %p \n", ptr);
+		/**/
+		return false;
+	}
+	else if (this->policy & FIX_SIZE_POLICY_FREE_LIST)
+	{
+		this->bitArray.SetBit(blockIdx);
+		return this->FreeToFreeList(ptr);
+	}
+	else
+	{
+		this->freeBlockNum++;
+		this->bitArray.SetBit(blockIdx);
+		return true;
+	}
+}
+
+
+void* FixSizeAllocator::Alloc()
+{
+	if (this->policy & FIX_SIZE_POLICY_FREE_LIST)
+	{
+		void* ptr = this->AllocFromFreeList();
+		if (ptr != nullptr && (this->policy & FIX_SIZE_POLICY_CHECK_DOUBLE_FREE))
+			this->bitArray.ClearBit(reinterpret_cast<uintptr_t>(PointerSub(ptr, this->blockBaseAddr)) / this->blockSize);
+		return ptr;
+	}
+
+	if (this->freeBlockNum == 0)
+		return nullptr;
+
+	size_t bitIdx;
+	bool success = this->bitArray.FindFirstFreeBit(bitIdx);
+
+	if (!success)
+		return nullptr;
+	else
+	{
+		this->freeBlockNum--;
+		this->bitArray.ClearBit(bitIdx);
+		return PointerAdd(this->blockBaseAddr, blockSize * bitIdx);
+	}
+}
+
+
+void* FixSizeAllocator::AtomicAlloc()
+{
+	size_t blockIdx;
+	if (!this->AtomicAllocBlock(blockIdx))
+		return nullptr;
+	return PointerAdd(this->blockBaseAddr, this->blockSize * blockIdx);
+}
+
+
+bool FixSizeAllocator::AtomicFree(void* ptr)
+{
+	if (!this->Contains(ptr))
+		return false;
+
+	size_t blockIdx = reinterpret_cast<uintptr_t>(PointerSub(ptr, this->blockBaseAddr)) / this->blockSize;
+	return this->AtomicFreeBlock(blockIdx);
+}
+
+
+bool FixSizeAllocator::AtomicAllocBlock(size_t& outBlockIdx)
+{
+	assert(this->policy == FIX_SIZE_POLICY_BIT_ARRAY);
+	size_t freeBlockNum = AtomicLoad(&this->freeBlockNum);
+	do
+	{
+		if (freeBlockNum == 0)
+			return false;
+	} while (!AtomicCompareExchange(&this->freeBlockNum, freeBlockNum, freeBlockNum - 1));
+
+	/* A free block is reserved for this thread. The search only fails while other threads are 
+	 * updating the summaries, so try again until the block is found */
+	uint32_t spinCount = 0;
+	while (!this->bitArray.AtomicClaimFreeBit(outBlockIdx))
+		SpinWait(spinCount);
+	return true;
+}
+
+
+bool FixSizeAllocator::AtomicFreeBlock(size_t blockIdx)
+{
+	assert(this->policy == FIX_SIZE_POLICY_BIT_ARRAY);
+	if (!this->bitArray.AtomicReleaseBit(blockIdx))
+		return false;
+
+	AtomicFetchAdd(&this->freeBlockNum, static_cast<size_t>(1));
+	return true;
+}
+
+
+size_t FixSizeAllocator::AllocBatch(size_t count, void** outPtrs)
+{
+	size_t allocNum = 0;
+	if (this->policy & FIX_SIZE_POLICY_FREE_LIST)
+	{
+		for (; allocNum < count; allocNum++)
+		{
+			outPtrs[allocNum] = this->Alloc();
+			if (outPtrs[allocNum] == nullptr)
+				break;
+		}
+		return allocNum;
+	}
+
+	size_t blockIdxs[BIT_ELEMENT_SIZE];
+	while (allocNum < count && this->freeBlockNum > 0)
+	{
+		size_t maxNum = count - allocNum < BIT_ELEMENT_SIZE ? count - allocNum : BIT_ELEMENT_SIZE;
+		size_t claimNum = this->bitArray.ClaimFreeBits(maxNum, blockIdxs);
+		if (claimNum == 0)
+			break;
+
+		for (size_t i = 0; i < claimNum; i++)
+			outPtrs[allocNum++] = PointerAdd(this->blockBaseAddr, this->blockSize * blockIdxs[i]);
+		this->freeBlockNum -= claimNum;
+	}
+	return allocNum;
+}
+
+
+size_t FixSizeAllocator::FreeBatch(void** ptrs, size_t count)
+{
+	size_t freeNum = 0;
+	if (this->policy & FIX_SIZE_POLICY_FREE_LIST)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			if (this->Free(ptrs[i]))
+				freeNum++;
+		}
+		return freeNum;
+	}
+
+	/* Collect the bits of consecutive memory blocks in the same element, and release them together */
+	size_t i = 0;
+	while (i < count)
+	{
+		size_t blockIdx;
+		if (!this->FindBlockIdx(ptrs[i++], blockIdx))
+			continue;
+
+		size_t idx = blockIdx / BIT_ELEMENT_SIZE;
+		BitElement bits = static_cast<BitElement>(1) << (blockIdx % BIT_ELEMENT_SIZE);
+		while (i < count && this->FindBlockIdx(ptrs[i], blockIdx) && blockIdx / BIT_ELEMENT_SIZE == idx)
+		{
+			bits |= static_cast<BitElement>(1) << (blockIdx % BIT_ELEMENT_SIZE);
+			i++;
+		}
+		freeNum += static_cast<size_t>(CountSetBits(this->bitArray.ReleaseBits(idx, bits)));
+	}
+
+	this->freeBlockNum += freeNum;
+	return freeNum;
+}
+
+
+size_t FixSizeAllocator::AtomicAllocBatch(size_t count, void** outPtrs)
+{
+	assert(this->policy == FIX_SIZE_POLICY_BIT_ARRAY);
+
+	size_t freeBlockNum = AtomicLoad(&this->freeBlockNum);
+	size_t reserveNum;
+	do
+	{
+		reserveNum = count < freeBlockNum ? count : freeBlockNum;
+		if (reserveNum == 0)
+			return 0;
+	} while (!AtomicCompareExchange(&this->freeBlockNum, freeBlockNum, freeBlockNum - reserveNum));
+
+	/* The blocks are reserved for this thread, claim them until all of them are found */
+	size_t allocNum = 0;
+	size_t blockIdxs[BIT_ELEMENT_SIZE];
+	uint32_t spinCount = 0;
+	while (allocNum < reserveNum)
+	{
+		size_t maxNum = reserveNum - allocNum < BIT_ELEMENT_SIZE ? reserveNum - allocNum : BIT_ELEMENT_SIZE;
+		size_t claimNum = this->bitArray.AtomicClaimFreeBits(maxNum, blockIdxs);
+		if (claimNum == 0)
+		{
+			SpinWait(spinCount);
+			continue;
+		}
+
+		for (size_t i = 0; i < claimNum; i++)
+			outPtrs[allocNum++] = PointerAdd(this->blockBaseAddr, this->blockSize * blockIdxs[i]);
+	}
+	return reserveNum;
+}
+
+
+size_t FixSizeAllocator::AtomicFreeBatch(void** ptrs, size_t count)
+{
+	assert(this->policy == FIX_SIZE_POLICY_BIT_ARRAY);
+
+	size_t freeNum = 0;
+	size_t i = 0;
+	while (i < count)
+	{
+		size_t blockIdx;
+		if (!this->FindBlockIdx(ptrs[i++], blockIdx))
+			continue;
+
+		size_t idx = blockIdx / BIT_ELEMENT_SIZE;
+		BitElement bits = static_cast<BitElement>(1) << (blockIdx % BIT_ELEMENT_SIZE);
+		while (i < count && this->FindBlockIdx(ptrs[i], blockIdx) && blockIdx / BIT_ELEMENT_SIZE == idx)
+		{
+			bits |= static_cast<BitElement>(1) << (blockIdx % BIT_ELEMENT_SIZE);
+			i++;
+		}
+		freeNum += static_cast<size_t>(CountSetBits(this->bitArray.AtomicReleaseBits(idx, bits)));
+	}
+
+	if (freeNum > 0)
+		AtomicFetchAdd(&this->freeBlockNum, freeNum);
+	return freeNum;
+}
+
+
+size_t FixSizeAllocator::Grow(size_t num)
+{
+	size_t blockNum = this->blockNum;
+	size_t newBlockNum = num < this->maxBlockNum - blockNum ? blockNum + num : this->maxBlockNum;
+	if (newBlockNum == blockNum)
+		return 0;
+
+	/* The blocks are accepted by Contains() before they can be claimed, and they are claimable
+	 * before they are counted, since a thread that reserves a block from "freeBlockNum" must find
+	 * it in the bit array. Blocks beyond "untouchedBlockIdx" are not in the free list yet */
+	AtomicStore(&this->blockNum, newBlockNum);
+	ReleaseBlockRange(this->bitArray, blockNum, newBlockNum);
+	if (this->policy & FIX_SIZE_POLICY_FREE_LIST)
+		this->freeBlockNum += newBlockNum - blockNum;
+	else
+		AtomicFetchAdd(&this->freeBlockNum, newBlockNum - blockNum);
+	return newBlockNum - blockNum;
+}
+
+
+void FixSizeAllocator::Destroy()
+{
+	if (this->policy == FIX_SIZE_POLICY_FREE_LIST)
+	{
+		if (this->freeBlockNum != this->blockNum)
+			printf("WARNING: FixAllocator.~FixAllocator(): Detect memory leak of %zu blocks \n", this->blockNum - this->freeBlockNum);
+		return;
+	}
+
+	/* Blocks beyond "blockNum" are not in use, they are marked as allocated */
+	size_t bitIdx;
+	if (!this->bitArray.AreAllBitsSet() && this->bitArray.FindFirstAllocateBit(bitIdx) && bitIdx < this->blockNum)
+	{
+		void* ptr = PointerAdd(this->blockBaseAddr, this->blockSize * bitIdx);
+		printf("WARNING: FixAllocator.~FixAllocator(): Detect memory leak at %p \n", ptr);
+	}
+}
@@ -1,87 +1,224 @@
-#pragma once
-#include "BirArray.h"
-#include "../Utility/Utility.h"
-
-
-using namespace Utility;
-
-
-/**
-* @brief FixSizeAllocator is a memory allocator that designed for small-size memory allocation. The 
-*		 size of each memory blocks in fix size allocator is defined by user and fixed during runtime.
-*		 Fix size allocator uses bit array to manage its memory blocks. A fix size allocator is make up
-*		 of two parts. The fist part is the memory space for storing datas (member variable, etc.) and 
-*		 the second part is the memory space for memory allocations. The structure of fix size allocator 
-*		 be like:
-*		 |  member variables  |  bit array  |  memory blocks... | ... | ... | ... | ...... |
-* 
-* @param blockNum -- The total number of memory blocks in fix size allocator;
-* @param freeBlockNum -- The number of free memory blocks at current stage;
-* @param blockSize - The size of memory block;
-* @param bitArraySize -- The total size of bit array;
-* @param blockBaseAddr -- A variable that stores the starting address of the first memory block;
-* @param bitArray -- BitArray instance. Note that "bitArray" must be the last member otherwise the
-*		 next member will have memory overlap with "bitArray". See the description of "BitArray"
-*		 class for more detail;
-*/
-class FixSizeAllocator
-{
-public:
-	size_t blockNum;
-	size_t freeBlockNum;
-	size_t blockSize;
-	size_t bitArraySize;
-	void* blockBaseAddr;
-	BitArray bitArray;
-
-
-	inline FixSizeAllocator(
-		BitArray bitArray, 
-		size_t blockNum = 0, size_t freeBlockNum = 0, 
-		size_t blockSize = 0, size_t bitArraySize = 0,
-		void* blockBaseAddr = nullptr);
-	inline ~FixSizeAllocator();
-
-
-	/**
-	* @brief Detect whether the given memory address is existed in current fix allocator
-	*		 Case 1: given memory address does not match to memory block offset.
-	*		 Case 2: given memory address does not within the range of the bit array.
-	*/
-	bool Contains(const void* ptr) const;
-
-	/**
-	* @brief Detect whether the provided memory address is already allocated. Noted that the method
-	*		 will return false if the memory address does not existed in fix allocator
-	* 
-	* @return If the given memory block does not exist in fix size allocator, return false as well.
-	*/
-	bool IsAllocated(const void* ptr) const;
-
-	/**
-	* @brief Need to check whether the given memory address is valid and whether the given memory address
-	*		 is already allocated before release the memory
-	* 
-	* @return If given memory block does not exist in fix size allocator or the given memory 
-	*		  block does not allocated, return false. Otherwise, release is success, return true.
-	*/
-	bool Free(void* ptr);
-
-	/**
-	* @brief Find first free block. Mark the block as "Allocated". Return the block address
-	*/
-	void* Alloc();
-
-	void Destroy();
-};
-
-
-/**
-* @brief Instantiate a FixSizeAllocator instance in the designated memory space. It is done by
-*		 manually assigning a block of unoccupied memory space to store the FixSizeAllocator
-*		 instance and telling the compiler to treat that memory space as a FixSizeAllocator.
-*/
-FixSizeAllocator* CreateFixSizeAllocator(void* baseAddr, size_t blockNum, size_t blockSize, size_t heapSize);
-
-#include "FixSizeAllocator.inl"
-
+#pragma once
+#include <stddef.h>
+#include "BirArray.h"
+#include "../Utility/Atomic.h"
+#include "../Utility/Utility.h"
+
+
+using namespace Utility;
+
+
+/* Policies of managing free memory blocks */
+const unsigned int FIX_SIZE_POLICY_BIT_ARRAY = 0x0;
+const unsigned int FIX_SIZE_POLICY_FREE_LIST = 0x1;
+const unsigned int FIX_SIZE_POLICY_CHECK_DOUBLE_FREE = 0x2;
+const unsigned int FIX_SIZE_POLICY_ISOLATE_HEADER = 0x4;
+
+/* The memory blocks of FIX_SIZE_POLICY_ISOLATE_HEADER start on a boundary of two cache lines, since
+ * the adjacent line prefetcher fetches cache lines in pairs */
+const size_t FIX_SIZE_ISOLATION_ALIGNMENT = 2 * CACHE_LINE_SIZE;
+
+
+/**
+* @brief The block size and the number of blocks of a fix size allocator.
+*
+* @param policy -- FIX_SIZE_POLICY_ISOLATE_HEADER or FIX_SIZE_POLICY_BIT_ARRAY. Arenas and memory systems
+*		 always manage free blocks with the bit array, so they only take this policy from a size
+*		 class. Together with a block size that is a multiple of CACHE_LINE_SIZE, it makes a size
+*		 class whose blocks share no cache line with anything else;
+*/
+struct FixSizeAllocatorArg
+{
+	size_t blockSize;
+	size_t blockNum;
+	unsigned int policy;
+};
+
+
+/**
+* @brief FixSizeAllocator is a memory allocator that designed for small-size memory allocation. The 
+*		 size of each memory blocks in fix size allocator is defined by user and fixed during runtime.
+*		 Fix size allocator uses bit array to manage its memory blocks. A fix size allocator is make up
+*		 of two parts. The fist part is the memory space for storing datas (member variable, etc.) and 
+*		 the second part is the memory space for memory allocations. The structure of fix size allocator 
+*		 be like:
+*		 |  member variables  |  bit array  |  memory blocks... | ... | ... | ... | ...... |
+*		 Free blocks are managed by one of the following policies:
+*		 FIX_SIZE_POLICY_BIT_ARRAY -- A set bit marks a free block. Allocation claims the first
+*							 free bit, and Free() checks the address and the bit before release;
+*		 FIX_SIZE_POLICY_FREE_LIST -- Every free block stores the address of the next free block
+*							 in itself, so Alloc() and Free() are a pop and a push of the list. The
+*							 most recently freed block is reused first, while it is still in cache.
+*							 Blocks that were never allocated are handed out in address order, so 
+*							 the list is built as the allocator is used. Free() only checks the
+*							 range of the address. Blocks must be large enough to hold a pointer;
+*		 FIX_SIZE_POLICY_CHECK_DOUBLE_FREE -- Can be combined with FIX_SIZE_POLICY_FREE_LIST. The 
+*							 bit array is kept in step with the free list, so Free() rejects 
+*							 invalid addresses and double frees, and IsAllocated() works. It is 
+*							 meant for debugging;
+*		 FIX_SIZE_POLICY_ISOLATE_HEADER -- Can be combined with any policy. The memory blocks 
+*							 start on the next boundary of FIX_SIZE_ISOLATION_ALIGNMENT after the 
+*							 bit array, so the member variables and the bit array, which threads
+*							 write on every allocation and free, never share a cache line with a
+*							 memory block. The allocator should start on such a boundary as well;
+*		 The space of the bit array is reserved under every policy, so the layout of the allocator 
+*		 does not depend on how free blocks are managed.
+* 
+* @param blockNum -- The total number of memory blocks in fix size allocator;
+* @param maxBlockNum -- The number of memory blocks that the allocator can grow to. The space of
+*		 the bit array and the blocks is laid out for this many blocks, but only the first 
+*		 "blockNum" blocks are in use, and the memory of the rest blocks may not be committed yet;
+* @param freeBlockNum -- The number of free memory blocks at current stage;
+* @param blockSize - The size of memory block;
+* @param bitArraySize -- The total size of bit array;
+* @param blockBaseAddr -- A variable that stores the starting address of the first memory block;
+* @param policy -- The policy of managing free blocks, without FIX_SIZE_POLICY_ISOLATE_HEADER;
+* @param freeList -- The first block of the free list (FIX_SIZE_POLICY_FREE_LIST);
+* @param untouchedBlockIdx -- The index of the first block that has never been allocated. Blocks from
+*		 it to the end are free but not in the free list (FIX_SIZE_POLICY_FREE_LIST);
+* @param bitArray -- BitArray instance. Note that "bitArray" must be the last member otherwise the
+*		 next member will have memory overlap with "bitArray". See the description of "BitArray"
+*		 class for more detail;
+*/
+class FixSizeAllocator
+{
+public:
+	size_t blockNum;
+	size_t maxBlockNum;
+	size_t freeBlockNum;
+	size_t blockSize;
+	size_t bitArraySize;
+	void* blockBaseAddr;
+	unsigned int policy;
+	void* freeList;
+	size_t untouchedBlockIdx;
+	BitArray bitArray;
+
+
+	inline FixSizeAllocator(
+		BitArray bitArray, 
+		size_t blockNum = 0, size_t freeBlockNum = 0, 
+		size_t blockSize = 0, size_t bitArraySize = 0,
+		void* blockBaseAddr = nullptr);
+	inline ~FixSizeAllocator();
+
+
+	/**
+	* @brief Detect whether the given memory address is existed in current fix allocator
+	*		 Case 1: given memory address does not match to memory block offset.
+	*		 Case 2: given memory address does not within the range of the bit array.
+	*/
+	bool Contains(const void* ptr) const;
+
+	/**
+	* @brief Detect whether the provided memory address is already allocated. Noted that the method
+	*		 will return false if the memory address does not existed in fix allocator
+	* 
+	* @return If the given memory block does not exist in fix size allocator, return false as well.
+	*		  Under FIX_SIZE_POLICY_FREE_LIST, it only works with FIX_SIZE_POLICY_CHECK_DOUBLE_FREE.
+	*/
+	bool IsAllocated(const void* ptr) const;
+
+	/**
+	* @brief Need to check whether the given memory address is valid and whether the given memory address
+	*		 is already allocated before release the memory
+	* 
+	* @return If given memory block does not exist in fix size allocator or the given memory 
+	*		  block does not allocated, return false. Otherwise, release is success, return true.
+	*/
+	bool Free(void* ptr);
+
+	/**
+	* @brief Find first free block. Mark the block as "Allocated". Return the block address
+	*/
+	void* Alloc();
+
+	/**
+	* @brief Thread-safe versions of Alloc() and Free(). Threads claim and release memory blocks with
+	*		 atomic operations on the bit array, so they can share the allocator without a lock. A 
+	*		 thread reserves a block by decreasing "freeBlockNum" before searching for it, so the 
+	*		 search always ends with a block once the reservation succeeds. A memory block is counted
+	*		 as free only after its bit is released. Do not call Alloc() or Free() while other 
+	*		 threads are using these methods on the same allocator. They are only supported by
+	*		 FIX_SIZE_POLICY_BIT_ARRAY.
+	*/
+	void* AtomicAlloc();
+	bool AtomicFree(void* ptr);
+
+	/**
+	* @brief The same as AtomicAlloc() and AtomicFree(), but memory blocks are identified by their
+	*		 index instead of their address. The caller converts between them, which is cheaper when
+	*		 the block size is known at compile time. AtomicFreeBlock() does not check the range of
+	*		 the index.
+	*/
+	bool AtomicAllocBlock(size_t& outBlockIdx);
+	bool AtomicFreeBlock(size_t blockIdx);
+
+	/**
+	* @brief Allocate (or free) many memory blocks at once. Free bits are claimed a whole element 
+	*		 at a time, and memory blocks whose bits share an element are released together, so the
+	*		 search and the update of summaries and counters are paid once per element instead of
+	*		 once per block. Memory blocks allocated together are next to each other, so freeing 
+	*		 them in the same order releases them element by element.
+	* 
+	* @return The number of memory blocks that are allocated (or freed). Invalid addresses and
+	*		  double frees are skipped.
+	*/
+	size_t AllocBatch(size_t count, void** outPtrs);
+	size_t FreeBatch(void** ptrs, size_t count);
+	size_t AtomicAllocBatch(size_t count, void** outPtrs);
+	size_t AtomicFreeBatch(void** ptrs, size_t count);
+
+	/**
+	* @brief Put up to "num" more memory blocks into use, without going beyond "maxBlockNum". The 
+	*		 memory of the new blocks must be committed before. It is safe to call while other 
+	*		 threads are allocating and freeing with the "Atomic" methods, but not while another 
+	*		 thread is growing the same allocator.
+	* 
+	* @return The number of memory blocks that are added.
+	*/
+	size_t Grow(size_t num);
+
+	void Destroy();
+
+	/**
+	* @brief Find the index of the memory block at the given address. Return false in the same cases
+	*		 as Contains().
+	*/
+	inline bool FindBlockIdx(const void* ptr, size_t& outBlockIdx) const;
+
+	inline void* AllocFromFreeList();
+	inline bool FreeToFreeList(void* ptr);
+};
+
+
+/**
+* @brief Instantiate a FixSizeAllocator instance in the designated memory space. It is done by
+*		 manually assigning a block of unoccupied memory space to store the FixSizeAllocator
+*		 instance and telling the compiler to treat that memory space as a FixSizeAllocator.
+* 
+* @param policy -- The policy of managing free blocks, FIX_SIZE_POLICY_BIT_ARRAY or 
+*		 FIX_SIZE_POLICY_FREE_LIST, optionally combined with FIX_SIZE_POLICY_CHECK_DOUBLE_FREE, and
+*		 with FIX_SIZE_POLICY_ISOLATE_HEADER.
+* @param maxBlockNum -- The number of memory blocks that the allocator can grow to with Grow(). The
+*		 memory space should be large enough for this many blocks, but only the memory of the 
+*		 first "blockNum" blocks is touched. A value not larger than "blockNum" means the 
+*		 allocator does not grow.
+* @return Return nullptr if the memory space is too small, or if the blocks can not hold a pointer
+*		  under FIX_SIZE_POLICY_FREE_LIST.
+*/
+FixSizeAllocator* CreateFixSizeAllocator(void* baseAddr, size_t blockNum, size_t blockSize, size_t heapSize, unsigned int policy = FIX_SIZE_POLICY_BIT_ARRAY, size_t maxBlockNum = 0);
+
+/**
+* @brief The offset from a fix size allocator to its first memory block, when it has room for 
+*		 "maxBlockNum" blocks under the given policy.
+*/
+constexpr size_t GetFixSizeBlockOffset(size_t maxBlockNum, unsigned int policy)
+{
+	return (policy & FIX_SIZE_POLICY_ISOLATE_HEADER) ? 
+		(offsetof(FixSizeAllocator, bitArray) + GetBitArraySize(maxBlockNum) + FIX_SIZE_ISOLATION_ALIGNMENT - 1) / FIX_SIZE_ISOLATION_ALIGNMENT * FIX_SIZE_ISOLATION_ALIGNMENT :
+		offsetof(FixSizeAllocator, bitArray) + GetBitArraySize(maxBlockNum);
+}
+
+#include "FixSizeAllocator.inl"
+
@@ -1,19 +1,55 @@
-#pragma once
-
-
-inline FixSizeAllocator::FixSizeAllocator(
-	BitArray bitArray,
-	size_t blockNum, size_t freeBlockNum,
-	size_t blockSize, size_t bitArraySize,
-	void* blockBaseAddr)
-{
-	this->blockNum = blockNum;
-	this->freeBlockNum = freeBlockNum;
-	this->blockSize = blockSize;
-	this->bitArraySize = bitArraySize;
-	this->blockBaseAddr = blockBaseAddr;
-	this->bitArray = bitArray;
-}
-
-
-inline FixSizeAllocator::~FixSizeAllocator() {}
\ No newline at end of file
+#pragma once
+
+
+inline FixSizeAllocator::FixSizeAllocator(
+	BitArray bitArray,
+	size_t blockNum, size_t freeBlockNum,
+	size_t blockSize, size_t bitArraySize,
+	void* blockBaseAddr)
+{
+	this->blockNum = blockNum;
+	this->maxBlockNum = blockNum;
+	this->freeBlockNum = freeBlockNum;
+	this->blockSize = blockSize;
+	this->bitArraySize = bitArraySize;
+	this->blockBaseAddr = blockBaseAddr;
+	this->bitArray = bitArray;
+}
+
+
+inline FixSizeAllocator::~FixSizeAllocator() {}
+
+
+inline bool FixSizeAllocator::FindBlockIdx(const void* ptr, size_t& outBlockIdx) const
+{
+	uintptr_t offset = reinterpret_cast<uintptr_t>(PointerSub(ptr, this->blockBaseAddr));
+	outBlockIdx = offset / this->blockSize;
+	return offset % this->blockSize == 0 && outBlockIdx < AtomicLoad(&this->blockNum);
+}
+
+
+inline void* FixSizeAllocator::AllocFromFreeList()
+{
+	void* ptr = this->freeList;
+	if (ptr != nullptr)
+		this->freeList = *static_cast<void**>(ptr);
+	else if (this->untouchedBlockIdx < this->blockNum)
+		ptr = PointerAdd(this->blockBaseAddr, this->blockSize * this->untouchedBlockIdx++);
+	else
+		return nullptr;
+
+	this->freeBlockNum--;
+	return ptr;
+}
+
+
+inline bool FixSizeAllocator::FreeToFreeList(void* ptr)
+{
+	if (ptr < this->blockBaseAddr || ptr >= PointerAdd(this->blockBaseAddr, this->blockSize * this->untouchedBlockIdx))
+		return false;
+
+	*static_cast<void**>(ptr) = this->freeList;
+	this->freeList = ptr;
+	this->freeBlockNum++;
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,271 @@
+#include "HeapProfiler.h"
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(__GLIBC__)
+#include <execinfo.h>
+#endif
+
+
+/* Seeds of the random number generators of threads. Each thread takes a different one */
+static uint64_t nextRandomSeed = 0x2545F4914F6CDD1Dull;
+
+
+void SampleCountdown::Reset(size_t interval)
+{
+	if (this->randomState == 0)
+		this->randomState = AtomicFetchAdd(&nextRandomSeed, static_cast<uint64_t>(0x9E3779B97F4A7C15ull)) ^ reinterpret_cast<uintptr_t>(this);
+	if (this->randomState == 0)
+		this->randomState = 1;
+
+	/* xorshift64*, the top 53 bits make a uniform number in (0, 1] */
+	uint64_t x = this->randomState;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	this->randomState = x;
+	double uniform = static_cast<double>(((x * 0x2545F4914F6CDD1Dull) >> 11) + 1) / 9007199254740992.0;
+
+	/* The distance to the next sample is exponential with a mean of "interval" bytes */
+	double distance = -log(uniform) * static_cast<double>(interval);
+	if (distance >= static_cast<double>(SIZE_MAX / 2))
+		this->bytesUntilSample = SIZE_MAX / 2;
+	else
+		this->bytesUntilSample = static_cast<size_t>(distance) + 1;
+}
+
+
+void HeapProfiler::RecordAlloc(void* ptr, size_t size, size_t skipNum)
+{
+	/* Walk the stack outside the lock, since it takes much longer than the rest */
+	void* frames[HEAP_PROFILER_MAX_DEPTH];
+	size_t depth = CaptureStackTrace(frames, HEAP_PROFILER_MAX_DEPTH, skipNum + 1);
+
+	this->lock.Lock();
+	size_t stackIdx = this->sampleNum < HEAP_PROFILER_MAX_SAMPLE_LOAD ? this->FindStackIdx(frames, depth) : HEAP_PROFILER_MAX_STACK_NUM;
+	if (stackIdx == HEAP_PROFILER_MAX_STACK_NUM || this->FindSampleIdx(ptr) != HEAP_PROFILER_MAX_SAMPLE_NUM)
+	{
+		this->droppedSampleNum++;
+		this->lock.Unlock();
+		return;
+	}
+
+	size_t idx = FindHeapSampleSlot(ptr);
+	while (this->samples[idx].addr != nullptr)
+		idx = (idx + 1) & (HEAP_PROFILER_MAX_SAMPLE_NUM - 1);
+	this->samples[idx].addr = ptr;
+	this->samples[idx].size = size;
+	this->samples[idx].stackIdx = stackIdx;
+
+	HeapStack& stack = this->stacks[stackIdx];
+	stack.liveCount++;
+	stack.liveSize += size;
+	stack.allocCount++;
+	stack.allocSize += size;
+
+	size_t filterIdx = FindHeapSampleFilterIdx(ptr);
+	AtomicStore(&this->sampleFilter[filterIdx], static_cast<uint16_t>(this->sampleFilter[filterIdx] + 1));
+	AtomicStore(&this->sampleNum, this->sampleNum + 1);
+	this->lock.Unlock();
+}
+
+
+bool HeapProfiler::RecordFree(const void* ptr)
+{
+	this->lock.Lock();
+	size_t sampleIdx = this->FindSampleIdx(ptr);
+	if (sampleIdx == HEAP_PROFILER_MAX_SAMPLE_NUM)
+	{
+		this->lock.Unlock();
+		return false;
+	}
+
+	HeapStack& stack = this->stacks[this->samples[sampleIdx].stackIdx];
+	stack.liveCount--;
+	stack.liveSize -= this->samples[sampleIdx].size;
+	this->RemoveSample(sampleIdx);
+
+	size_t filterIdx = FindHeapSampleFilterIdx(ptr);
+	AtomicStore(&this->sampleFilter[filterIdx], static_cast<uint16_t>(this->sampleFilter[filterIdx] - 1));
+	AtomicStore(&this->sampleNum, this->sampleNum - 1);
+	this->lock.Unlock();
+	return true;
+}
+
+
+bool HeapProfiler::RecordResize(const void* oldPtr, void* newPtr, size_t newSize)
+{
+	this->lock.Lock();
+	size_t sampleIdx = this->FindSampleIdx(oldPtr);
+	if (sampleIdx == HEAP_PROFILER_MAX_SAMPLE_NUM)
+	{
+		this->lock.Unlock();
+		return false;
+	}
+
+	HeapSample sample = this->samples[sampleIdx];
+	HeapStack& stack = this->stacks[sample.stackIdx];
+	stack.liveSize = stack.liveSize - sample.size + newSize;
+	if (newPtr == oldPtr)
+	{
+		this->samples[sampleIdx].size = newSize;
+		this->lock.Unlock();
+		return true;
+	}
+
+	/* The memory block moved, so the sample moves to the slot and the filter counter of its new address */
+	this->RemoveSample(sampleIdx);
+	size_t idx = FindHeapSampleSlot(newPtr);
+	while (this->samples[idx].addr != nullptr)
+		idx = (idx + 1) & (HEAP_PROFILER_MAX_SAMPLE_NUM - 1);
+	this->samples[idx].addr = newPtr;
+	this->samples[idx].size = newSize;
+	this->samples[idx].stackIdx = sample.stackIdx;
+
+	size_t oldFilterIdx = FindHeapSampleFilterIdx(oldPtr);
+	size_t newFilterIdx = FindHeapSampleFilterIdx(newPtr);
+	AtomicStore(&this->sampleFilter[newFilterIdx], static_cast<uint16_t>(this->sampleFilter[newFilterIdx] + 1));
+	AtomicStore(&this->sampleFilter[oldFilterIdx], static_cast<uint16_t>(this->sampleFilter[oldFilterIdx] - 1));
+	this->lock.Unlock();
+	return true;
+}
+
+
+bool HeapProfiler::Dump(FILE* file)
+{
+	if (file == nullptr)
+		return false;
+
+	this->lock.Lock();
+	size_t liveCount = 0, liveSize = 0, allocCount = 0, allocSize = 0;
+	for (size_t i = 0; i < HEAP_PROFILER_MAX_STACK_NUM; i++)
+	{
+		liveCount += this->stacks[i].liveCount;
+		liveSize += this->stacks[i].liveSize;
+		allocCount += this->stacks[i].allocCount;
+		allocSize += this->stacks[i].allocSize;
+	}
+
+	bool success = fprintf(file, "heap profile: %6zu: %8zu [%6zu: %8zu] @ heap_v2/%zu\n",
+		liveCount, liveSize, allocCount, allocSize, this->sampleInterval) > 0;
+	for (size_t i = 0; i < HEAP_PROFILER_MAX_STACK_NUM && success; i++)
+	{
+		const HeapStack& stack = this->stacks[i];
+		if (stack.allocCount == 0)
+			continue;
+
+		fprintf(file, "%6zu: %8zu [%6zu: %8zu] @", stack.liveCount, stack.liveSize, stack.allocCount, stack.allocSize);
+		for (size_t j = 0; j < stack.depth; j++)
+			fprintf(file, " 0x%016" PRIxPTR, reinterpret_cast<uintptr_t>(stack.frames[j]));
+		success = fprintf(file, "\n") > 0;
+	}
+	this->lock.Unlock();
+
+#if !defined(_WIN32)
+	/* pprof maps the addresses back to the binaries by the memory map */
+	FILE* mapFile = fopen("/proc/self/maps", "r");
+	if (mapFile != nullptr)
+	{
+		char buffer[4096];
+		size_t readSize;
+		fprintf(file, "\nMAPPED_LIBRARIES:\n");
+		while ((readSize = fread(buffer, 1, sizeof(buffer), mapFile)) > 0)
+			fwrite(buffer, 1, readSize, file);
+		fclose(mapFile);
+	}
+#endif
+	return success && fflush(file) == 0;
+}
+
+
+void HeapProfiler::Clear()
+{
+	this->lock.Lock();
+	memset(this->samples, 0, sizeof(this->samples));
+	memset(this->stacks, 0, sizeof(this->stacks));
+	for (size_t i = 0; i < HEAP_PROFILER_FILTER_SIZE; i++)
+		AtomicStore(&this->sampleFilter[i], static_cast<uint16_t>(0));
+	AtomicStore(&this->sampleNum, static_cast<size_t>(0));
+	this->stackNum = 0;
+	this->droppedSampleNum = 0;
+	this->lock.Unlock();
+}
+
+
+size_t HeapProfiler::FindStackIdx(void* const* frames, size_t depth)
+{
+	uint64_t hash = depth;
+	for (size_t i = 0; i < depth; i++)
+		hash = (hash ^ static_cast<uint64_t>(reinterpret_cast<uintptr_t>(frames[i]))) * 0x9E3779B97F4A7C15ull;
+
+	/* A stack trace that can not be taken still has a call site, with no frames */
+	size_t idx = static_cast<size_t>(hash >> 32) & (HEAP_PROFILER_MAX_STACK_NUM - 1);
+	for (size_t i = 0; i < HEAP_PROFILER_MAX_STACK_NUM; i++)
+	{
+		HeapStack& stack = this->stacks[idx];
+		if (stack.allocCount == 0)
+		{
+			if (this->stackNum >= HEAP_PROFILER_MAX_STACK_LOAD)
+				return HEAP_PROFILER_MAX_STACK_NUM;
+			stack.depth = depth;
+			memcpy(stack.frames, frames, depth * sizeof(void*));
+			this->stackNum++;
+			return idx;
+		}
+		if (stack.depth == depth && memcmp(stack.frames, frames, depth * sizeof(void*)) == 0)
+			return idx;
+		idx = (idx + 1) & (HEAP_PROFILER_MAX_STACK_NUM - 1);
+	}
+	return HEAP_PROFILER_MAX_STACK_NUM;
+}
+
+
+void HeapProfiler::RemoveSample(size_t sampleIdx)
+{
+	/* Move back every following entry whose probe starts at or before the hole, until an empty
+	 * entry ends the run */
+	size_t holeIdx = sampleIdx;
+	size_t idx = sampleIdx;
+	while (true)
+	{
+		idx = (idx + 1) & (HEAP_PROFILER_MAX_SAMPLE_NUM - 1);
+		if (this->samples[idx].addr == nullptr)
+			break;
+
+		size_t slotIdx = FindHeapSampleSlot(this->samples[idx].addr);
+		size_t distance = (idx - slotIdx) & (HEAP_PROFILER_MAX_SAMPLE_NUM - 1);
+		size_t holeDistance = (idx - holeIdx) & (HEAP_PROFILER_MAX_SAMPLE_NUM - 1);
+		if (distance >= holeDistance)
+		{
+			this->samples[holeIdx] = this->samples[idx];
+			holeIdx = idx;
+		}
+	}
+	this->samples[holeIdx].addr = nullptr;
+}
+
+
+size_t CaptureStackTrace(void** frames, size_t maxDepth, size_t skipNum)
+{
+#if defined(_WIN32)
+	return static_cast<size_t>(CaptureStackBackTrace(static_cast<DWORD>(skipNum + 1), static_cast<DWORD>(maxDepth), frames, nullptr));
+#elif defined(__GLIBC__)
+	void* buffer[HEAP_PROFILER_MAX_DEPTH + 16];
+	size_t bufferDepth = maxDepth + skipNum + 1;
+	if (bufferDepth > sizeof(buffer) / sizeof(void*))
+		bufferDepth = sizeof(buffer) / sizeof(void*);
+
+	int depth = backtrace(buffer, static_cast<int>(bufferDepth));
+	size_t frameNum = 0;
+	for (size_t i = skipNum + 1; i < static_cast<size_t>(depth) && frameNum < maxDepth; i++)
+		frames[frameNum++] = buffer[i];
+	return frameNum;
+#else
+	(void)frames;
+	(void)maxDepth;
+	(void)skipNum;
+	return 0;
+#endif
+}
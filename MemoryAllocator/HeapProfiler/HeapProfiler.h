@@ -0,0 +1,203 @@
+#pragma once
+#include <stdio.h>
+#include "../Utility/Atomic.h"
+#include "../Utility/Utility.h"
+
+
+using namespace Utility;
+
+
+/* The mean number of bytes allocated between two samples, unless another interval is set */
+const size_t HEAP_PROFILER_DEFAULT_INTERVAL = 512 * 1024;
+
+/* The number of return addresses recorded for a sampled allocation */
+const size_t HEAP_PROFILER_MAX_DEPTH = 32;
+
+/* The size of the lookup table of live samples, a power of 2. It is kept partly empty so that
+ * probes stay short, samples beyond the load are dropped */
+const size_t HEAP_PROFILER_MAX_SAMPLE_NUM = 4096;
+const size_t HEAP_PROFILER_MAX_SAMPLE_LOAD = HEAP_PROFILER_MAX_SAMPLE_NUM / 4 * 3;
+
+/* The size of the table of call sites, a power of 2, and the number of call sites it holds at most */
+const size_t HEAP_PROFILER_MAX_STACK_NUM = 1024;
+const size_t HEAP_PROFILER_MAX_STACK_LOAD = HEAP_PROFILER_MAX_STACK_NUM / 4 * 3;
+
+/* The number of counters of the sample filter, a power of 2 */
+const size_t HEAP_PROFILER_FILTER_SIZE = 64 * 1024;
+
+
+/**
+* @brief An entry of the lookup table of live samples.
+*
+* @param addr -- The address of the sampled memory block. nullptr if the entry is empty;
+* @param size -- The requested size of the memory block;
+* @param stackIdx -- The call site that allocated it, an index into the call site table;
+*/
+struct HeapSample
+{
+	void* addr;
+	size_t size;
+	size_t stackIdx;
+};
+
+
+/**
+* @brief A call site of sampled allocations, identified by its stack trace.
+*
+* @param depth -- The number of return addresses in "frames";
+* @param frames -- The stack trace, innermost call first;
+* @param liveCount, liveSize -- The samples of the call site that are not freed yet, and their size;
+* @param allocCount, allocSize -- All samples of the call site so far, and their size. "allocCount"
+*		 is 0 if the entry is empty;
+*/
+struct HeapStack
+{
+	size_t depth;
+	void* frames[HEAP_PROFILER_MAX_DEPTH];
+	size_t liveCount;
+	size_t liveSize;
+	size_t allocCount;
+	size_t allocSize;
+};
+
+
+/**
+* @brief The sampling state of a thread. The bytes allocated by the thread are counted down, and
+*		 the allocation that reaches zero is sampled. The distance to the next sample is drawn from
+*		 an exponential distribution, so every byte has the same chance to be sampled and the
+*		 samples do not lock onto a repeating pattern of allocations.
+*
+* @param bytesUntilSample -- The number of bytes left before the next sample;
+* @param randomState -- The state of the random number generator, 0 before the first sample;
+* @param busy -- Set while a sample is recorded, so that allocations made by the stack walk of the
+*		 OS are not sampled again;
+*/
+class SampleCountdown
+{
+public:
+	size_t bytesUntilSample;
+	uint64_t randomState;
+	bool busy;
+
+	/**
+	* @brief Count an allocation of "size" bytes. Return true if it should be sampled.
+	*/
+	inline bool Count(size_t size);
+
+	/**
+	* @brief Draw the distance to the next sample for a mean of "interval" bytes.
+	*/
+	void Reset(size_t interval);
+};
+
+
+/**
+* @brief HeapProfiler keeps a sampled record of the heap: which call sites allocated the memory
+*		 blocks that are still in use, and how much every call site has allocated so far. Only
+*		 about one allocation per "sampleInterval" bytes is recorded, each with its stack trace.
+*		 Live samples are kept in a lookup table keyed by address until they are freed. A counting
+*		 filter in front of it tells most frees that their memory block is not sampled without
+*		 taking the lock. The tables are protected by a lock. A heap profiler that is filled with
+*		 zero is disabled and empty, so it can be a global variable.
+*
+* @param lock -- The lock of the tables;
+* @param sampleInterval -- The mean number of bytes between samples. 0 disables sampling;
+* @param sampleNum -- The number of live samples;
+* @param stackNum -- The number of call sites;
+* @param droppedSampleNum -- The number of samples dropped because a table was full;
+* @param sampleFilter -- The number of live samples whose address hashes to each counter;
+* @param samples -- The lookup table of live samples;
+* @param stacks -- The table of call sites, keyed by the hash of the stack trace;
+*/
+class HeapProfiler
+{
+public:
+	SpinLock lock;
+	size_t sampleInterval;
+	size_t sampleNum;
+	size_t stackNum;
+	size_t droppedSampleNum;
+	volatile uint16_t sampleFilter[HEAP_PROFILER_FILTER_SIZE];
+	HeapSample samples[HEAP_PROFILER_MAX_SAMPLE_NUM];
+	HeapStack stacks[HEAP_PROFILER_MAX_STACK_NUM];
+
+
+	/**
+	* @brief Record a sampled memory block with the stack trace of the calling thread.
+	*
+	* @param skipNum -- The number of innermost frames to leave out of the stack trace, usually
+	*		 the frames of the memory allocator itself.
+	*/
+	void RecordAlloc(void* ptr, size_t size, size_t skipNum);
+
+	/**
+	* @brief Remove the sample of a memory block that is about to be freed. Return false if the
+	*		 memory block is not sampled. It should be called before the memory block is freed,
+	*		 otherwise another thread may allocate and sample the same address in between.
+	*/
+	bool RecordFree(const void* ptr);
+
+	/**
+	* @brief Update the sample of a memory block that is resized and may have moved. Return false if
+	*		 the memory block is not sampled.
+	*/
+	bool RecordResize(const void* oldPtr, void* newPtr, size_t newSize);
+
+	/**
+	* @brief Whether the memory block may be sampled. It is a hint read without the lock, false
+	*		 means the memory block is surely not sampled.
+	*/
+	inline bool MayBeSampled(const void* ptr) const;
+
+	/**
+	* @brief Write the profile in the legacy heap profile format of gperftools ("heap_v2"), which
+	*		 pprof reads. Each call site has a line of its live samples and their size, followed by
+	*		 all its samples and their size, and its stack trace. pprof scales the samples up by
+	*		 the sample interval. On Linux the memory map of the process follows, so that pprof can
+	*		 symbolize the addresses.
+	*
+	* @return Return false if the profile can not be written.
+	*/
+	bool Dump(FILE* file);
+
+	/**
+	* @brief Forget all samples and call sites. The sample interval is kept.
+	*/
+	void Clear();
+
+	/**
+	* @brief Return the index of the sample of the given memory block in the lookup table, or
+	*		 HEAP_PROFILER_MAX_SAMPLE_NUM if it is not sampled. The lock must be held.
+	*/
+	inline size_t FindSampleIdx(const void* ptr) const;
+
+	/**
+	* @brief Return the index of the call site with the given stack trace, and add it if it is new.
+	*		 Return HEAP_PROFILER_MAX_STACK_NUM if the table is full. The lock must be held.
+	*/
+	size_t FindStackIdx(void* const* frames, size_t depth);
+
+	/**
+	* @brief Remove the entry at the given index from the lookup table of live samples, and move
+	*		 the entries after it back so that no probe sequence is broken. The lock must be held.
+	*/
+	void RemoveSample(size_t sampleIdx);
+};
+
+
+/**
+* @brief Return the index in the lookup table of live samples where the probe for the given address
+*		 starts, and the counter of the sample filter of the address.
+*/
+inline size_t FindHeapSampleSlot(const void* ptr);
+inline size_t FindHeapSampleFilterIdx(const void* ptr);
+
+/**
+* @brief Fill "frames" with the return addresses of the calling thread, innermost first, leaving
+*		 out "skipNum" frames besides this function. Return the number of addresses. It is
+*		 backtrace() on Linux and CaptureStackBackTrace() on Windows.
+*/
+size_t CaptureStackTrace(void** frames, size_t maxDepth, size_t skipNum);
+
+
+#include "HeapProfiler.inl"
@@ -0,0 +1,53 @@
+#pragma once
+
+
+inline bool SampleCountdown::Count(size_t size)
+{
+	if (this->bytesUntilSample > size)
+	{
+		this->bytesUntilSample -= size;
+		return false;
+	}
+	return !this->busy;
+}
+
+
+inline size_t FindHeapSampleSlot(const void* ptr)
+{
+	/* Memory blocks are aligned, so the low bits are mostly zero. Multiply by a large odd constant
+	 * and keep the high bits, which depend on every bit of the address */
+	uint64_t key = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(ptr)) * 0x9E3779B97F4A7C15ull;
+	return static_cast<size_t>(key >> 32) & (HEAP_PROFILER_MAX_SAMPLE_NUM - 1);
+}
+
+
+inline size_t FindHeapSampleFilterIdx(const void* ptr)
+{
+	uint64_t key = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(ptr)) * 0x9E3779B97F4A7C15ull;
+	return static_cast<size_t>(key >> 40) & (HEAP_PROFILER_FILTER_SIZE - 1);
+}
+
+
+inline bool HeapProfiler::MayBeSampled(const void* ptr) const
+{
+	return AtomicLoad(&this->sampleNum) != 0 && AtomicLoad(&this->sampleFilter[FindHeapSampleFilterIdx(ptr)]) != 0;
+}
+
+
+inline size_t HeapProfiler::FindSampleIdx(const void* ptr) const
+{
+	if (ptr == nullptr)
+		return HEAP_PROFILER_MAX_SAMPLE_NUM;
+
+	size_t idx = FindHeapSampleSlot(ptr);
+	for (size_t i = 0; i < HEAP_PROFILER_MAX_SAMPLE_NUM; i++)
+	{
+		const HeapSample& sample = this->samples[idx];
+		if (sample.addr == ptr)
+			return idx;
+		if (sample.addr == nullptr)
+			break;
+		idx = (idx + 1) & (HEAP_PROFILER_MAX_SAMPLE_NUM - 1);
+	}
+	return HEAP_PROFILER_MAX_SAMPLE_NUM;
+}
@@ -0,0 +1,186 @@
+#include "LargeAllocator.h"
+#include <stdio.h>
+#include "../VirtualMemory/VirtualMemory.h"
+
+
+/**
+* @brief Round "size" up to the page size. Return 0 if it overflows.
+*/
+static size_t RoundUpToPageSize(size_t size)
+{
+	size_t pageSize = GetVirtualPageSize();
+	if (size > SIZE_MAX - pageSize + 1)
+		return 0;
+	return (size + pageSize - 1) / pageSize * pageSize;
+}
+
+
+void* LargeAllocator::Alloc(size_t size, size_t alignment)
+{
+	size_t mapSize = RoundUpToPageSize(size);
+	if (mapSize == 0 || (alignment & (alignment - 1)) != 0)
+		return nullptr;
+
+	/* Map the memory outside the lock, since it is a system call */
+	void* addr = ReserveVirtualMemory(mapSize, alignment);
+	if (addr == nullptr)
+		return nullptr;
+	if (!CommitVirtualMemory(addr, mapSize))
+	{
+		ReleaseVirtualMemory(addr, mapSize);
+		return nullptr;
+	}
+
+	this->lock.Lock();
+	bool full = this->blockNum >= LARGE_ALLOCATOR_MAX_LOAD;
+	if (!full)
+	{
+		this->InsertBlock(addr, mapSize, alignment);
+		this->blockNum++;
+		this->allocCount++;
+		this->mappedSize += mapSize;
+		if (this->mappedSize > this->maxMappedSize)
+			this->maxMappedSize = this->mappedSize;
+	}
+	this->lock.Unlock();
+
+	if (full)
+	{
+		ReleaseVirtualMemory(addr, mapSize);
+		return nullptr;
+	}
+	return addr;
+}
+
+
+bool LargeAllocator::Free(void* ptr)
+{
+	this->lock.Lock();
+	size_t blockIdx = this->FindBlockIdx(ptr);
+	if (blockIdx == LARGE_ALLOCATOR_MAX_BLOCK_NUM)
+	{
+		this->lock.Unlock();
+		return false;
+	}
+
+	LargeBlock block = this->blocks[blockIdx];
+	this->RemoveBlock(blockIdx);
+	this->blockNum--;
+	this->freeCount++;
+	this->mappedSize -= block.size;
+	this->lock.Unlock();
+
+	ReleaseVirtualMemory(block.addr, block.size);
+	return true;
+}
+
+
+size_t LargeAllocator::GetSize(const void* ptr)
+{
+	this->lock.Lock();
+	size_t blockIdx = this->FindBlockIdx(ptr);
+	size_t size = blockIdx != LARGE_ALLOCATOR_MAX_BLOCK_NUM ? this->blocks[blockIdx].size : 0;
+	this->lock.Unlock();
+	return size;
+}
+
+
+void* LargeAllocator::Resize(void* ptr, size_t newSize, bool mayMove)
+{
+	size_t newMapSize = RoundUpToPageSize(newSize);
+	if (newMapSize == 0)
+		return nullptr;
+
+	/* Take the memory block out of the lookup table while it is remapped, so that the lock is not
+	 * held during the system call. It still counts in "blockNum", so there is room to put it back */
+	this->lock.Lock();
+	size_t blockIdx = this->FindBlockIdx(ptr);
+	if (blockIdx == LARGE_ALLOCATOR_MAX_BLOCK_NUM)
+	{
+		this->lock.Unlock();
+		return nullptr;
+	}
+
+	LargeBlock block = this->blocks[blockIdx];
+	if (block.size == newMapSize)
+	{
+		this->lock.Unlock();
+		return ptr;
+	}
+	this->RemoveBlock(blockIdx);
+	this->lock.Unlock();
+
+	void* newAddr = RemapVirtualMemory(block.addr, block.size, newMapSize, mayMove && block.alignment <= GetVirtualPageSize());
+
+	this->lock.Lock();
+	if (newAddr != nullptr)
+	{
+		this->InsertBlock(newAddr, newMapSize, block.alignment);
+		this->mappedSize = this->mappedSize - block.size + newMapSize;
+		if (this->mappedSize > this->maxMappedSize)
+			this->maxMappedSize = this->mappedSize;
+	}
+	else
+		this->InsertBlock(block.addr, block.size, block.alignment);
+	this->lock.Unlock();
+	return newAddr;
+}
+
+
+void LargeAllocator::Destroy()
+{
+	this->lock.Lock();
+	for (size_t i = 0; i < LARGE_ALLOCATOR_MAX_BLOCK_NUM; i++)
+	{
+		LargeBlock& block = this->blocks[i];
+		if (block.addr == nullptr)
+			continue;
+
+		printf("WARNING: LargeAllocator.Destroy(): Detect memory leak at %p \n", block.addr);
+		ReleaseVirtualMemory(block.addr, block.size);
+		block.addr = nullptr;
+	}
+	this->blockNum = 0;
+	this->allocCount = 0;
+	this->freeCount = 0;
+	this->mappedSize = 0;
+	this->maxMappedSize = 0;
+	this->lock.Unlock();
+}
+
+
+void LargeAllocator::InsertBlock(void* addr, size_t size, size_t alignment)
+{
+	size_t idx = FindLargeBlockSlot(addr);
+	while (this->blocks[idx].addr != nullptr)
+		idx = (idx + 1) & (LARGE_ALLOCATOR_MAX_BLOCK_NUM - 1);
+
+	this->blocks[idx].addr = addr;
+	this->blocks[idx].size = size;
+	this->blocks[idx].alignment = alignment;
+}
+
+
+void LargeAllocator::RemoveBlock(size_t blockIdx)
+{
+	/* Move back every following entry whose probe starts at or before the hole, until an empty
+	 * entry ends the run */
+	size_t holeIdx = blockIdx;
+	size_t idx = blockIdx;
+	while (true)
+	{
+		idx = (idx + 1) & (LARGE_ALLOCATOR_MAX_BLOCK_NUM - 1);
+		if (this->blocks[idx].addr == nullptr)
+			break;
+
+		size_t slotIdx = FindLargeBlockSlot(this->blocks[idx].addr);
+		size_t distance = (idx - slotIdx) & (LARGE_ALLOCATOR_MAX_BLOCK_NUM - 1);
+		size_t holeDistance = (idx - holeIdx) & (LARGE_ALLOCATOR_MAX_BLOCK_NUM - 1);
+		if (distance >= holeDistance)
+		{
+			this->blocks[holeIdx] = this->blocks[idx];
+			holeIdx = idx;
+		}
+	}
+	this->blocks[holeIdx].addr = nullptr;
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include "../Utility/Atomic.h"
+#include "../Utility/Utility.h"
+
+
+using namespace Utility;
+
+
+/* The size of the lookup table of a large allocator, a power of 2 */
+const size_t LARGE_ALLOCATOR_MAX_BLOCK_NUM = 1024;
+
+/* The number of memory blocks that a large allocator tracks at most. The lookup table is kept 
+ * partly empty so that probes stay short. Requests beyond it are left to the other allocators */
+const size_t LARGE_ALLOCATOR_MAX_LOAD = LARGE_ALLOCATOR_MAX_BLOCK_NUM / 4 * 3;
+
+
+/**
+* @brief An entry of the lookup table of the large allocator.
+*
+* @param addr -- The starting address of the memory block, which is the starting address of its
+*		 mapping as well. nullptr if the entry is empty;
+* @param size -- The size of the mapping, a multiple of the page size;
+* @param alignment -- The alignment that the memory block was allocated with, 0 for the page size;
+*/
+struct LargeBlock
+{
+	void* addr;
+	size_t size;
+	size_t alignment;
+};
+
+
+/**
+* @brief LargeAllocator serves very large memory requests. Each memory block is a mapping of its own
+*		 from the OS, so it does not carve up the heap, and its memory goes back to the OS as soon as
+*		 it is freed. Blocks are tracked in a lookup table, an open addressing hash table keyed by
+*		 the address with linear probing, so Free() can tell a large block from any other address.
+*		 The table is protected by a lock. A large allocator that is filled with zero is empty, so
+*		 it can be a global variable that is ready before any constructor runs.
+*
+* @param lock -- The lock of the lookup table;
+* @param blockNum -- The number of memory blocks in the lookup table, including the ones that are
+*		 being resized and taken out of the table for the moment;
+* @param allocCount, freeCount -- The number of memory blocks allocated and freed so far;
+* @param mappedSize -- The total size of the memory blocks, and its highest value so far in 
+*		 "maxMappedSize";
+* @param blocks -- The lookup table;
+*/
+class LargeAllocator
+{
+public:
+	SpinLock lock;
+	size_t blockNum;
+	size_t allocCount;
+	size_t freeCount;
+	size_t mappedSize;
+	size_t maxMappedSize;
+	LargeBlock blocks[LARGE_ALLOCATOR_MAX_BLOCK_NUM];
+
+
+	/**
+	* @brief Map a memory block of at least "size" bytes. Its memory is filled with zero.
+	*
+	* @param alignment -- A power of 2. 0 or anything up to the page size costs nothing extra.
+	* @return Return nullptr if the OS has no memory, or the lookup table is full.
+	*/
+	void* Alloc(size_t size, size_t alignment = 0);
+
+	/**
+	* @brief Unmap a memory block. Return false if it is not allocated by the large allocator.
+	*/
+	bool Free(void* ptr);
+
+	/**
+	* @brief Return the usable size of a memory block, or 0 if it is not allocated by the large
+	*		 allocator.
+	*/
+	size_t GetSize(const void* ptr);
+
+	/**
+	* @brief Resize a memory block by remapping its pages, so its data is never copied. If "mayMove"
+	*		 is set, the pages can be moved to another address when there is no room after them.
+	*		 Remapping is only supported on Linux. Blocks with an alignment larger than the page size
+	*		 are not moved, since the new address may not be aligned.
+	*
+	* @return The new address of the memory block, or nullptr if it can not be resized this way, 
+	*		  in which case the memory block is left as it was.
+	*/
+	void* Resize(void* ptr, size_t newSize, bool mayMove);
+
+	/**
+	* @brief Unmap all memory blocks. The ones that are still in the lookup table are reported as
+	*		 leaks. The counters are reset.
+	*/
+	void Destroy();
+
+	/**
+	* @brief Return the index of the memory block that starts at the given address in the lookup
+	*		 table, or LARGE_ALLOCATOR_MAX_BLOCK_NUM if there is none. The lock must be held.
+	*/
+	inline size_t FindBlockIdx(const void* ptr) const;
+
+	/**
+	* @brief Put a memory block into the lookup table. The lock must be held, and the table must not
+	*		 be full. "blockNum" is left to the caller.
+	*/
+	void InsertBlock(void* addr, size_t size, size_t alignment);
+
+	/**
+	* @brief Remove the entry at the given index from the lookup table, and move the entries after it
+	*		 back so that no probe sequence is broken. The lock must be held. "blockNum" is left to
+	*		 the caller.
+	*/
+	void RemoveBlock(size_t blockIdx);
+};
+
+
+/**
+* @brief Return the index in the lookup table where the probe for the given address starts.
+*/
+inline size_t FindLargeBlockSlot(const void* ptr);
+
+
+#include "LargeAllocator.inl"
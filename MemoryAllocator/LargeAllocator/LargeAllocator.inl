@@ -0,0 +1,29 @@
+#pragma once
+
+
+inline size_t FindLargeBlockSlot(const void* ptr)
+{
+	/* Mappings start at page boundaries, so the low bits are always zero. Multiply by a large odd
+	 * constant and keep the high bits, which depend on every bit of the address */
+	uint64_t key = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(ptr)) * 0x9E3779B97F4A7C15ull;
+	return static_cast<size_t>(key >> 32) & (LARGE_ALLOCATOR_MAX_BLOCK_NUM - 1);
+}
+
+
+inline size_t LargeAllocator::FindBlockIdx(const void* ptr) const
+{
+	if (ptr == nullptr)
+		return LARGE_ALLOCATOR_MAX_BLOCK_NUM;
+
+	size_t idx = FindLargeBlockSlot(ptr);
+	for (size_t i = 0; i < LARGE_ALLOCATOR_MAX_BLOCK_NUM; i++)
+	{
+		const LargeBlock& block = this->blocks[idx];
+		if (block.addr == ptr)
+			return idx;
+		if (block.addr == nullptr)
+			break;
+		idx = (idx + 1) & (LARGE_ALLOCATOR_MAX_BLOCK_NUM - 1);
+	}
+	return LARGE_ALLOCATOR_MAX_BLOCK_NUM;
+}
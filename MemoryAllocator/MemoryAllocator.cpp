@@ -1,132 +1,1357 @@
-#include "MemoryAllocator.h"
-#include "Utility/Utility.h"
-
-using namespace Utility;
-
-const int fixSizeAllocatorNum = 3;
-const FixSizeAllocatorArg fixSizeAllocatorDatas[] = {
-	{16, 100},
-	{32, 200},
-	{96, 400},
-};
-FixSizeAllocator* fixSizeAllocatorPtrs[fixSizeAllocatorNum] = { nullptr };
-DynamicAllocator* dynamicAllocator;
-
-
-
-
-bool InitializeMemoryAllocator(void* i_pHeapMemory, size_t i_sizeHeapMemory)
-{
-	void* baseAddr = i_pHeapMemory;
-	for (int i = 0; i < fixSizeAllocatorNum; i++)
-	{
-		FixSizeAllocatorArg arg = fixSizeAllocatorDatas[i];
-		FixSizeAllocator* allocator = CreateFixSizeAllocator(baseAddr, arg.blockNum, arg.blockSize, i_sizeHeapMemory);
-		if (allocator != nullptr)
-		{
-			baseAddr = PointerAdd(allocator->blockBaseAddr, allocator->blockSize * allocator->blockNum);
-			fixSizeAllocatorPtrs[i] = allocator;
-		}
-	}
-
-	size_t fixAllocatorSize = reinterpret_cast<uintptr_t>(PointerSub(baseAddr, i_pHeapMemory));
-	dynamicAllocator = CreateDynamicAllocator(baseAddr, i_sizeHeapMemory - fixAllocatorSize);
-
-	/* Debug */
-	//assert(reinterpret_cast<uintptr_t>(FixAllocatorPtrs[1]) == reinterpret_cast<uintptr_t>(PointerAdd(i_pHeapMemory, 1672)));
-	//assert(reinterpret_cast<uintptr_t>(FixAllocatorPtrs[2]) == reinterpret_cast<uintptr_t>(PointerAdd(i_pHeapMemory, 1672 + 6484)));
-	//assert(reinterpret_cast<uintptr_t>(heapAllocator) == reinterpret_cast<uintptr_t>(PointerAdd(i_pHeapMemory, 1672 + 6484 + 38508)));
-	/**/
-
-
-	for (int i = 0; i < fixSizeAllocatorNum; i++)
-	{
-		if (fixSizeAllocatorPtrs[i] != nullptr)
-			return true;
-	}
-
-	return dynamicAllocator != nullptr ? true : false;
-}
-
-
-void Collect()
-{
-	dynamicAllocator->Collect();
-}
-
-
-void DestroyMemoryAllocator()
-{
-	for (int i = 0; i < fixSizeAllocatorNum; i++)
-	{
-		fixSizeAllocatorPtrs[i]->Destroy();
-	}
-	dynamicAllocator->Destroy();
-}
-
-
-void* Alloc(size_t size)
-{
-	void* ptr = nullptr;
-	for (int i = 0; i < fixSizeAllocatorNum; i++)
-	{
-		if (size <= fixSizeAllocatorDatas[i].blockSize && fixSizeAllocatorPtrs[i] != nullptr)
-		{
-			ptr = fixSizeAllocatorPtrs[i]->Alloc();
-
-			if (ptr != nullptr)
-				return ptr;
-		}
-	}
-
-	/* At this point, all fix allocator allocation attempts are fail. Otherwise, the function
-	 * is already returned. Heap allocator is the last attempt to allocate memory for the user */
-	if (dynamicAllocator != nullptr)
-		return dynamicAllocator->Alloc(size);
-	else
-		return nullptr;
-}
-
-
-void Free(void* ptr)
-{
-	bool success = false;
-	for (int i = 0; i < fixSizeAllocatorNum; i++)
-	{
-		if (!success && fixSizeAllocatorPtrs[i] != nullptr)
-			success = fixSizeAllocatorPtrs[i]->Free(ptr);
-
-		if (success)
-			return;
-	}
-
-	/* At this point, all fix allocator free attempts are fail. Otherwise, the function
-	 * is already returned. Heap allocator is the last attempt to free the memory. */
-	if (dynamicAllocator != nullptr)
-		success = dynamicAllocator->Free(ptr);
-	if (!success)
-		printf("Allocators.free(): Unable to free the given memory address. %p \n", ptr);
-}
-
-
-void* operator new(size_t size)
-{
-	return Alloc(size);
-}
-
-
-void* operator new[](size_t size)
-{
-	return Alloc(size);
-}
-
-
-void operator delete(void* ptr)
-{
-	return Free(ptr);
-}
-
-void operator delete[](void* ptr)
-{
-	return Free(ptr);
-}
\ No newline at end of file
+#include "MemoryAllocator.h"
+#include "Utility/Utility.h"
+#include "Utility/Atomic.h"
+#include "VirtualMemory/VirtualMemory.h"
+#include <string.h>
+
+using namespace Utility;
+
+/* Arenas share the size classes of the default compile time configuration */
+const int fixSizeAllocatorNum = MemorySystem<DefaultMemorySystemConfig>::sizeClassNum;
+const FixSizeAllocatorArg* const fixSizeAllocatorDatas = DefaultMemorySystemConfig::sizeClasses;
+Arena* arenaPtrs[ARENA_MAX_NUM] = { nullptr };
+unsigned int arenaNum = 0;
+unsigned int arenaPolicy = ARENA_ASSIGN_ROUND_ROBIN;
+size_t threadCacheDepth = THREAD_CACHE_DEFAULT_DEPTH;
+size_t trimThreshold = TRIM_DEFAULT_THRESHOLD;
+size_t directMapThreshold = 0;
+
+/* Memory blocks that are mapped from the OS one by one. It is empty when it is zero, so it is ready
+ * before any constructor runs */
+LargeAllocator largeAllocator;
+
+/* Sampled allocations and their call stacks. It is disabled when it is zero */
+HeapProfiler heapProfiler;
+AllocTrace allocTrace;
+
+/* Arenas are slices of equal size, so the arena of a memory address is found by a division */
+static void* heapBaseAddr = nullptr;
+static size_t arenaSize = 0;
+
+/* The address space reserved by InitializeGrowableMemoryAllocator(), released when the memory
+ * system is destroyed */
+static void* reservedHeapAddr = nullptr;
+static size_t reservedHeapSize = 0;
+
+/* The arena that the next thread is assigned to in ARENA_ASSIGN_ROUND_ROBIN mode */
+static unsigned int nextArenaIdx = 0;
+
+/* Increased whenever the memory system is initialized or destroyed, so that a thread cache can
+ * tell whether its blocks still belong to the live memory system */
+static size_t memorySystemGeneration = 0;
+
+/* The number of size class events a thread counts before it adds them to the shared counters */
+static const size_t STATS_PUBLISH_INTERVAL = 64;
+
+
+/**
+* @brief The counters of a size class shared by all threads, see SizeClassStats.
+*/
+class SizeClassCounters
+{
+public:
+	size_t allocCount;
+	size_t freeCount;
+	size_t maxLiveBlockNum;
+};
+static SizeClassCounters sizeClassCounters[ARENA_MAX_FIX_SIZE_ALLOCATOR_NUM];
+static size_t fallThroughCount = 0;
+
+
+/**
+* @brief Size class events that a thread has counted but not added to the shared counters yet. 
+*		 Adding them in batches keeps the shared cache lines off the allocation path. "peakCounts"
+*		 is the highest number of allocations over frees of each size class since the last batch,
+*		 so the high-water mark does not miss a peak in the middle of a batch.
+*/
+class PendingCounters
+{
+public:
+	size_t allocCounts[ARENA_MAX_FIX_SIZE_ALLOCATOR_NUM];
+	size_t freeCounts[ARENA_MAX_FIX_SIZE_ALLOCATOR_NUM];
+	size_t peakCounts[ARENA_MAX_FIX_SIZE_ALLOCATOR_NUM];
+	size_t fallThroughCount;
+	size_t eventNum;
+};
+
+
+/**
+* @brief A chain of memory blocks that a thread has freed for another arena, linked through their 
+*		 first bytes. It is handed over to the arena as a whole.
+*/
+class RemoteFreeBatch
+{
+public:
+	void* head;
+	void* tail;
+	size_t count;
+};
+
+
+/**
+* @brief Owner of the thread cache of each thread. Its destructor runs when the thread exits and
+*		 returns the cached memory blocks to the fix size allocators.
+* 
+* @param cache -- The thread cache, it only holds memory blocks of the arena of the thread;
+* @param arenaIdx -- The arena that the thread is assigned to. It is valid only if the generation
+*		 of the cache matches the memory system;
+* @param remoteFrees -- Memory blocks freed by the thread for each of the other arenas;
+* @param pendingCounters -- Size class events of the thread, valid under the same condition as
+*		 "arenaIdx";
+* @param sampleCountdown -- The bytes the thread allocates before its next heap profile sample;
+*/
+class ThreadCacheHolder
+{
+public:
+	ThreadCache cache;
+	unsigned int arenaIdx;
+	RemoteFreeBatch remoteFrees[ARENA_MAX_NUM];
+	PendingCounters pendingCounters;
+	SampleCountdown sampleCountdown;
+
+	~ThreadCacheHolder()
+	{
+		FlushThreadCache();
+	}
+};
+static thread_local ThreadCacheHolder threadCacheHolder;
+
+
+
+
+bool InitializeMemoryAllocator(void* i_pHeapMemory, size_t i_sizeHeapMemory)
+{
+	return InitializeMemoryAllocator(i_pHeapMemory, i_sizeHeapMemory, 1, ARENA_ASSIGN_ROUND_ROBIN);
+}
+
+
+/**
+* @brief Start a new memory system, and return the number of arenas clamped to [1, ARENA_MAX_NUM].
+*/
+static unsigned int ResetMemorySystem(unsigned int i_arenaNum, unsigned int i_arenaPolicy)
+{
+	memorySystemGeneration++;
+	threadCacheHolder.cache.Clear();
+	arenaPolicy = i_arenaPolicy;
+	nextArenaIdx = 0;
+	memset(sizeClassCounters, 0, sizeof(sizeClassCounters));
+	fallThroughCount = 0;
+	heapProfiler.Clear();
+
+	if (i_arenaNum == 0)
+		return 1;
+	else if (i_arenaNum > ARENA_MAX_NUM)
+		return ARENA_MAX_NUM;
+	return i_arenaNum;
+}
+
+
+bool InitializeMemoryAllocator(void* i_pHeapMemory, size_t i_sizeHeapMemory, unsigned int i_arenaNum, unsigned int i_arenaPolicy, bool i_heapZeroed)
+{
+	i_arenaNum = ResetMemorySystem(i_arenaNum, i_arenaPolicy);
+
+	/* Start every arena on its own cache line */
+	uintptr_t beginAddr = reinterpret_cast<uintptr_t>(i_pHeapMemory);
+	uintptr_t alignedBeginAddr = (beginAddr + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+	size_t alignedHeapSize = i_sizeHeapMemory > alignedBeginAddr - beginAddr ? i_sizeHeapMemory - (alignedBeginAddr - beginAddr) : 0;
+	heapBaseAddr = reinterpret_cast<void*>(alignedBeginAddr);
+	arenaSize = alignedHeapSize / i_arenaNum / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+
+	/* Arenas that do not fit are dropped, but they keep their slices so that lookups stay simple */
+	arenaNum = i_arenaNum;
+	bool success = false;
+	for (unsigned int i = 0; i < arenaNum; i++)
+	{
+		arenaPtrs[i] = CreateArena(PointerAdd(heapBaseAddr, arenaSize * i), arenaSize, fixSizeAllocatorDatas, fixSizeAllocatorNum, 
+			POLICY_SEGREGATED_FIT | POLICY_COALESCE_ON_FREE | (i_heapZeroed ? POLICY_ZEROED_MEMORY : 0));
+		if (arenaPtrs[i] != nullptr)
+			success = true;
+	}
+
+	/* Debug */
+	//assert(reinterpret_cast<uintptr_t>(FixAllocatorPtrs[1]) == reinterpret_cast<uintptr_t>(PointerAdd(i_pHeapMemory, 1672)));
+	//assert(reinterpret_cast<uintptr_t>(FixAllocatorPtrs[2]) == reinterpret_cast<uintptr_t>(PointerAdd(i_pHeapMemory, 1672 + 6484)));
+	//assert(reinterpret_cast<uintptr_t>(heapAllocator) == reinterpret_cast<uintptr_t>(PointerAdd(i_pHeapMemory, 1672 + 6484 + 38508)));
+	/**/
+
+	if (!success)
+		arenaNum = 0;
+	return success;
+}
+
+
+bool InitializeGrowableMemoryAllocator(size_t i_reserveSize, size_t i_initialSize, unsigned int i_arenaNum, unsigned int i_arenaPolicy, unsigned int i_pagePolicy)
+{
+	i_arenaNum = ResetMemorySystem(i_arenaNum, i_arenaPolicy);
+
+	/* Arenas are slices of whole pages, so each of them commits its own pages. With huge pages the
+	 * slices are whole huge pages, so that no huge page is shared by two arenas */
+	size_t pageSize = (i_pagePolicy & (ARENA_PAGE_HUGE | ARENA_PAGE_HUGETLB)) ? GetHugePageSize() : GetVirtualPageSize();
+	size_t sliceSize = i_reserveSize / i_arenaNum / pageSize * pageSize;
+	void* baseAddr = nullptr;
+	if (sliceSize > 0 && (i_pagePolicy & ARENA_PAGE_HUGETLB))
+		baseAddr = ReserveHugeVirtualMemory(sliceSize * i_arenaNum);
+
+	/* Fall back to transparent huge pages if the OS has no explicit huge pages to give */
+	if (sliceSize > 0 && baseAddr == nullptr)
+	{
+		if (i_pagePolicy & ARENA_PAGE_HUGETLB)
+			i_pagePolicy = (i_pagePolicy & ~ARENA_PAGE_HUGETLB) | ARENA_PAGE_HUGE;
+		baseAddr = ReserveVirtualMemory(sliceSize * i_arenaNum, (i_pagePolicy & ARENA_PAGE_HUGE) ? pageSize : 0);
+		if (baseAddr != nullptr && (i_pagePolicy & ARENA_PAGE_HUGE))
+			AdviseHugePages(baseAddr, sliceSize * i_arenaNum);
+	}
+	if (baseAddr == nullptr)
+	{
+		arenaNum = 0;
+		return false;
+	}
+
+	reservedHeapAddr = baseAddr;
+	reservedHeapSize = sliceSize * i_arenaNum;
+	heapBaseAddr = baseAddr;
+	arenaSize = sliceSize;
+
+	arenaNum = i_arenaNum;
+	bool success = false;
+	for (unsigned int i = 0; i < arenaNum; i++)
+	{
+		arenaPtrs[i] = CreateGrowableArena(PointerAdd(heapBaseAddr, arenaSize * i), arenaSize, i_initialSize / arenaNum, fixSizeAllocatorDatas, fixSizeAllocatorNum, 
+			POLICY_SEGREGATED_FIT | POLICY_COALESCE_ON_FREE, i_pagePolicy);
+		if (arenaPtrs[i] != nullptr)
+		{
+			arenaPtrs[i]->SetTrimThreshold(trimThreshold);
+			success = true;
+		}
+	}
+
+	if (!success)
+	{
+		arenaNum = 0;
+		ReleaseVirtualMemory(reservedHeapAddr, reservedHeapSize);
+		reservedHeapAddr = nullptr;
+	}
+	return success;
+}
+
+
+static void DrainRemoteFree(Arena* arena, ThreadCache* cache);
+
+
+void Collect()
+{
+	if (AtomicLoad(&allocTrace.enabled))
+		allocTrace.Record(TRACE_OP_COLLECT, nullptr, 0, 0);
+
+	for (unsigned int i = 0; i < arenaNum; i++)
+	{
+		if (arenaPtrs[i] != nullptr)
+		{
+			DrainRemoteFree(arenaPtrs[i], nullptr);
+			arenaPtrs[i]->Collect();
+		}
+	}
+}
+
+
+size_t Trim()
+{
+	size_t trimmedSize = 0;
+	for (unsigned int i = 0; i < arenaNum; i++)
+	{
+		if (arenaPtrs[i] != nullptr)
+		{
+			DrainRemoteFree(arenaPtrs[i], nullptr);
+			trimmedSize += arenaPtrs[i]->Trim();
+		}
+	}
+	return trimmedSize;
+}
+
+
+void SetTrimThreshold(size_t threshold)
+{
+	trimThreshold = threshold;
+	for (unsigned int i = 0; i < arenaNum; i++)
+	{
+		if (arenaPtrs[i] != nullptr)
+			arenaPtrs[i]->SetTrimThreshold(threshold);
+	}
+}
+
+
+void DestroyMemoryAllocator()
+{
+	/* Caches and remote frees of other threads are dropped the next time they are used */
+	FlushThreadCache();
+	for (unsigned int i = 0; i < arenaNum; i++)
+	{
+		if (arenaPtrs[i] != nullptr)
+			DrainRemoteFree(arenaPtrs[i], nullptr);
+	}
+	memorySystemGeneration++;
+
+	for (unsigned int i = 0; i < arenaNum; i++)
+	{
+		if (arenaPtrs[i] != nullptr)
+			arenaPtrs[i]->Destroy();
+		arenaPtrs[i] = nullptr;
+	}
+	arenaNum = 0;
+	largeAllocator.Destroy();
+
+	if (reservedHeapAddr != nullptr)
+	{
+		ReleaseVirtualMemory(reservedHeapAddr, reservedHeapSize);
+		reservedHeapAddr = nullptr;
+		reservedHeapSize = 0;
+		heapBaseAddr = nullptr;
+		arenaSize = 0;
+	}
+}
+
+
+/**
+* @brief Return the index of the arena that owns the given memory address, or -1 if the memory
+*		 address is not in any arena.
+*/
+static inline int FindArena(const void* ptr)
+{
+	if (arenaSize == 0 || ptr < heapBaseAddr)
+		return -1;
+
+	size_t arenaIdx = reinterpret_cast<uintptr_t>(PointerSub(ptr, heapBaseAddr)) / arenaSize;
+	if (arenaIdx >= arenaNum || arenaPtrs[arenaIdx] == nullptr)
+		return -1;
+	return static_cast<int>(arenaIdx);
+}
+
+
+/**
+* @brief Return the thread cache of the calling thread. If the cache was filled by a memory system
+*		 that no longer exists, its blocks are dropped first, and the thread is assigned to an arena
+*		 again.
+*/
+static inline ThreadCache& GetThreadCache()
+{
+	ThreadCache& cache = threadCacheHolder.cache;
+	if (cache.generation != memorySystemGeneration)
+	{
+		cache.Clear();
+		cache.generation = memorySystemGeneration;
+		for (unsigned int i = 0; i < ARENA_MAX_NUM; i++)
+			threadCacheHolder.remoteFrees[i].count = 0;
+		memset(&threadCacheHolder.pendingCounters, 0, sizeof(PendingCounters));
+
+		unsigned int arenaIdx;
+		if (arenaPolicy == ARENA_ASSIGN_BY_CPU)
+			arenaIdx = GetCurrentProcessorIdx() % arenaNum;
+		else
+			arenaIdx = AtomicFetchAdd(&nextArenaIdx, 1u) % arenaNum;
+
+		/* Skip the arenas that do not fit in the heap */
+		while (arenaPtrs[arenaIdx] == nullptr)
+			arenaIdx = (arenaIdx + 1) % arenaNum;
+		threadCacheHolder.arenaIdx = arenaIdx;
+	}
+	return cache;
+}
+
+
+/**
+* @brief Add the size class events of the calling thread to the shared counters, and raise the 
+*		 high-water marks of the size classes it touched. The thread cache must be valid.
+*/
+static void PublishPendingCounters()
+{
+	PendingCounters& pending = threadCacheHolder.pendingCounters;
+	for (int i = 0; i < fixSizeAllocatorNum; i++)
+	{
+		if (pending.allocCounts[i] == 0 && pending.freeCounts[i] == 0)
+			continue;
+
+		/* The peak of the batch is on top of the memory blocks in use before it. With other threads
+		 * adding their batches at the same time, it is an estimate */
+		SizeClassCounters& counters = sizeClassCounters[i];
+		size_t allocCount = AtomicFetchAdd(&counters.allocCount, pending.allocCounts[i]);
+		size_t freeCount = AtomicFetchAdd(&counters.freeCount, pending.freeCounts[i]);
+		size_t liveBlockNum = (allocCount > freeCount ? allocCount - freeCount : 0) + pending.peakCounts[i];
+		size_t maxLiveBlockNum = AtomicLoad(&counters.maxLiveBlockNum);
+		while (liveBlockNum > maxLiveBlockNum)
+		{
+			if (AtomicCompareExchange(&counters.maxLiveBlockNum, maxLiveBlockNum, liveBlockNum))
+				break;
+		}
+
+		pending.allocCounts[i] = 0;
+		pending.freeCounts[i] = 0;
+		pending.peakCounts[i] = 0;
+	}
+	if (pending.fallThroughCount != 0)
+		AtomicFetchAdd(&fallThroughCount, pending.fallThroughCount);
+	pending.fallThroughCount = 0;
+	pending.eventNum = 0;
+}
+
+
+/**
+* @brief Count memory blocks allocated from and freed to a size class by the calling thread. The 
+*		 thread cache must be valid.
+*/
+static inline void CountSizeClassEvent(int classIdx, size_t allocNum, size_t freeNum)
+{
+	PendingCounters& pending = threadCacheHolder.pendingCounters;
+	pending.allocCounts[classIdx] += allocNum;
+	pending.freeCounts[classIdx] += freeNum;
+	if (pending.allocCounts[classIdx] > pending.freeCounts[classIdx] + pending.peakCounts[classIdx])
+		pending.peakCounts[classIdx] = pending.allocCounts[classIdx] - pending.freeCounts[classIdx];
+	if (++pending.eventNum >= STATS_PUBLISH_INTERVAL)
+		PublishPendingCounters();
+}
+
+
+/**
+* @brief Allocate a memory block of the given fix size allocator through the thread cache. If the
+*		 magazine is empty, it is refilled with half of the cache depth in one batch.
+*/
+static void* AllocFromFixSizeAllocator(ThreadCache& cache, int classIdx, FixSizeAllocator* allocator)
+{
+	if (threadCacheDepth == 0 || classIdx >= static_cast<int>(THREAD_CACHE_MAX_CLASS_NUM))
+		return allocator->AtomicAlloc();
+
+	void* ptr = cache.Pop(classIdx);
+	if (ptr != nullptr)
+		return ptr;
+
+	cache.Refill(classIdx, allocator, (threadCacheDepth + 1) / 2);
+	return cache.Pop(classIdx);
+}
+
+
+/**
+* @brief Free a memory block of the given fix size allocator through the thread cache. If the 
+*		 magazine is full, the colder half of it is returned to the fix size allocator in one batch.
+*		 Noted that a memory block in the thread cache is still "allocated" from the view of the 
+*		 fix size allocator, so a double free of a cached memory block is not detected.
+*/
+static bool FreeToFixSizeAllocator(ThreadCache& cache, int classIdx, FixSizeAllocator* allocator, void* ptr)
+{
+	if (threadCacheDepth == 0 || classIdx >= static_cast<int>(THREAD_CACHE_MAX_CLASS_NUM) || !allocator->Contains(ptr))
+		return allocator->AtomicFree(ptr);
+
+	if (cache.Push(classIdx, ptr, threadCacheDepth))
+		return true;
+
+	cache.Flush(classIdx, allocator, cache.magazines[classIdx].count - threadCacheDepth / 2);
+	return cache.Push(classIdx, ptr, threadCacheDepth);
+}
+
+
+/**
+* @brief Push the memory blocks the thread collected for the given arena onto its remote free list.
+*/
+static inline void FlushRemoteFreeBatch(unsigned int arenaIdx)
+{
+	RemoteFreeBatch& batch = threadCacheHolder.remoteFrees[arenaIdx];
+	if (batch.count > 0)
+	{
+		arenaPtrs[arenaIdx]->PushRemoteFree(batch.head, batch.tail);
+		batch.count = 0;
+	}
+}
+
+
+/**
+* @brief Free a memory block of another arena. A block of a fix size allocator is kept by the thread
+*		 until a batch is collected, and the whole batch is pushed onto the remote free list of the
+*		 arena with one atomic operation. A block of the dynamic allocator can be large, so it is
+*		 pushed at once.
+*/
+static void FreeToRemoteArena(unsigned int arenaIdx, void* ptr)
+{
+	Arena* arena = arenaPtrs[arenaIdx];
+	if (arena->FindFixSizeAllocator(ptr) < 0)
+	{
+		arena->PushRemoteFree(ptr, ptr);
+		return;
+	}
+
+	RemoteFreeBatch& batch = threadCacheHolder.remoteFrees[arenaIdx];
+	*static_cast<uintptr_t*>(ptr) = reinterpret_cast<uintptr_t>(batch.head);
+	if (batch.count == 0)
+		batch.tail = ptr;
+	batch.head = ptr;
+	batch.count++;
+
+	if (batch.count >= ARENA_REMOTE_FREE_BATCH)
+		FlushRemoteFreeBatch(arenaIdx);
+}
+
+
+/**
+* @brief Free all memory blocks in the remote free list of the given arena. Memory blocks of fix 
+*		 size allocators go to the thread cache if it is given, and memory blocks of the dynamic 
+*		 allocator are freed under one lock.
+*/
+static void DrainRemoteFree(Arena* arena, ThreadCache* cache)
+{
+	void* ptr = arena->TakeRemoteFree();
+	bool locked = false;
+	while (ptr != nullptr)
+	{
+		void* nextPtr = reinterpret_cast<void*>(*static_cast<uintptr_t*>(ptr));
+
+		bool success;
+		int fixSizeAllocatorIdx = arena->FindFixSizeAllocator(ptr);
+		if (fixSizeAllocatorIdx >= 0)
+		{
+			FixSizeAllocator* allocator = arena->fixSizeAllocatorPtrs[fixSizeAllocatorIdx];
+			success = cache != nullptr ? FreeToFixSizeAllocator(*cache, fixSizeAllocatorIdx, allocator, ptr) : allocator->AtomicFree(ptr);
+
+			/* Without a thread cache the calling thread may not belong to the memory system */
+			if (success && cache != nullptr)
+				CountSizeClassEvent(fixSizeAllocatorIdx, 0, 1);
+			else if (success)
+				AtomicFetchAdd(&sizeClassCounters[fixSizeAllocatorIdx].freeCount, static_cast<size_t>(1));
+		}
+		else
+		{
+			if (!locked)
+			{
+				arena->dynamicAllocatorLock.Lock();
+				locked = true;
+			}
+			success = arena->dynamicAllocator != nullptr && arena->dynamicAllocator->Free(ptr);
+		}
+		if (!success)
+			printf("Allocators.free(): Unable to free the given memory address. %p \n", ptr);
+
+		ptr = nextPtr;
+	}
+
+	if (locked)
+		arena->dynamicAllocatorLock.Unlock();
+}
+
+
+void FlushThreadCache()
+{
+	ThreadCache& cache = threadCacheHolder.cache;
+	if (cache.generation != memorySystemGeneration)
+	{
+		cache.Clear();
+		return;
+	}
+
+	PublishPendingCounters();
+	for (unsigned int i = 0; i < arenaNum; i++)
+		FlushRemoteFreeBatch(i);
+
+	Arena* arena = arenaPtrs[threadCacheHolder.arenaIdx];
+	for (int i = 0; i < fixSizeAllocatorNum && i < static_cast<int>(THREAD_CACHE_MAX_CLASS_NUM); i++)
+	{
+		if (arena->fixSizeAllocatorPtrs[i] != nullptr)
+			cache.Flush(i, arena->fixSizeAllocatorPtrs[i], cache.magazines[i].count);
+	}
+}
+
+
+void SetThreadCacheDepth(size_t depth)
+{
+	threadCacheDepth = depth < THREAD_CACHE_MAX_DEPTH ? depth : THREAD_CACHE_MAX_DEPTH;
+}
+
+
+void LockMemorySystem()
+{
+	/* Fix size allocators and remote free lists are lock-free, and a fork copies them in a state
+	 * that some atomic operation left them in. Only the locks need to be held. A heap profile dump
+	 * allocates while it holds the lock of the profiler, so that lock is taken before the arenas */
+	allocTrace.lock.Lock();
+	heapProfiler.lock.Lock();
+	for (unsigned int i = 0; i < arenaNum; i++)
+	{
+		if (arenaPtrs[i] != nullptr)
+		{
+			arenaPtrs[i]->growLock.Lock();
+			arenaPtrs[i]->dynamicAllocatorLock.Lock();
+		}
+	}
+	largeAllocator.lock.Lock();
+}
+
+
+void UnlockMemorySystem()
+{
+	largeAllocator.lock.Unlock();
+	for (unsigned int i = arenaNum; i > 0; i--)
+	{
+		if (arenaPtrs[i - 1] != nullptr)
+		{
+			arenaPtrs[i - 1]->dynamicAllocatorLock.Unlock();
+			arenaPtrs[i - 1]->growLock.Unlock();
+		}
+	}
+	heapProfiler.lock.Unlock();
+	allocTrace.lock.Unlock();
+}
+
+
+void SetDirectMapThreshold(size_t threshold)
+{
+	directMapThreshold = threshold;
+}
+
+
+/**
+* @brief Record a heap profile sample of an allocation that used up the countdown of the thread, 
+*		 and draw the distance to the next one. Kept out of the inline path, which only counts bytes.
+*/
+static void SampleAllocation(void* ptr, size_t size)
+{
+	size_t interval = AtomicLoad(&heapProfiler.sampleInterval);
+	SampleCountdown& countdown = threadCacheHolder.sampleCountdown;
+	if (interval == 0)
+		return;
+
+	/* A thread starts from a random distance as well, rather than sampling its first allocation */
+	if (countdown.randomState == 0)
+	{
+		countdown.Reset(interval);
+		if (!countdown.Count(size))
+			return;
+	}
+
+	/* The stack walk may allocate, which must not be sampled again */
+	countdown.busy = true;
+	countdown.Reset(interval);
+	heapProfiler.RecordAlloc(ptr, size, 1);
+	countdown.busy = false;
+}
+
+
+/**
+* @brief Count an allocation towards the next heap profile sample, append it to the allocation trace,
+*		 and return the memory address.
+*/
+static inline void* ProfileAlloc(void* ptr, size_t size, size_t alignment = 0)
+{
+	if (heapProfiler.sampleInterval != 0 && ptr != nullptr && threadCacheHolder.sampleCountdown.Count(size))
+		SampleAllocation(ptr, size);
+	if (AtomicLoad(&allocTrace.enabled) && ptr != nullptr)
+		allocTrace.Record(TRACE_OP_ALLOC, ptr, size, alignment);
+	return ptr;
+}
+
+
+/**
+* @brief Remove the heap profile sample of a memory block before it is freed. Most memory blocks are
+*		 not sampled, which is told without taking the lock of the profiler. The free is traced 
+*		 before the memory block can be allocated again, so the records keep their order.
+*/
+static inline void ProfileFree(const void* ptr)
+{
+	if (heapProfiler.MayBeSampled(ptr))
+		heapProfiler.RecordFree(ptr);
+	if (AtomicLoad(&allocTrace.enabled))
+		allocTrace.Record(TRACE_OP_FREE, ptr, 0, 0);
+}
+
+
+/**
+* @brief Follow a memory block that is resized, and moved to "newPtr" if it is not the same address.
+*		 A move is traced as an allocation followed by a free, like the copy that Realloc() makes
+*		 otherwise.
+*/
+static inline void ProfileResize(void* oldPtr, void* newPtr, size_t newSize)
+{
+	if (heapProfiler.MayBeSampled(oldPtr))
+		heapProfiler.RecordResize(oldPtr, newPtr, newSize);
+	if (!AtomicLoad(&allocTrace.enabled))
+		return;
+
+	if (newPtr == oldPtr)
+		allocTrace.Record(TRACE_OP_RESIZE, newPtr, newSize, 0);
+	else
+	{
+		allocTrace.Record(TRACE_OP_ALLOC, newPtr, newSize, 0);
+		allocTrace.Record(TRACE_OP_FREE, oldPtr, 0, 0);
+	}
+}
+
+
+void SetHeapProfileInterval(size_t interval)
+{
+	AtomicStore(&heapProfiler.sampleInterval, interval);
+}
+
+
+bool DumpHeapProfile(const char* path)
+{
+	/* Writing the file may allocate, which must not be sampled while the profile is locked */
+	SampleCountdown& countdown = threadCacheHolder.sampleCountdown;
+	bool busy = countdown.busy;
+	countdown.busy = true;
+
+	FILE* file = nullptr;
+#if defined(_MSC_VER)
+	if (fopen_s(&file, path, "w") != 0)
+		file = nullptr;
+#else
+	file = fopen(path, "w");
+#endif
+	bool success = file != nullptr && heapProfiler.Dump(file);
+	if (file != nullptr && fclose(file) != 0)
+		success = false;
+
+	countdown.busy = busy;
+	return success;
+}
+
+
+bool StartAllocTrace(const char* path, size_t maxRecordNum)
+{
+	return allocTrace.Start(path, maxRecordNum);
+}
+
+
+bool StopAllocTrace()
+{
+	return allocTrace.Stop();
+}
+
+
+/**
+* @brief Map a memory block of its own for a request of at least "directMapThreshold" bytes. Return
+*		 nullptr if the request is smaller, or can not be mapped, so it is served by the arenas.
+*		 "fallBack" is cleared if the request is too large to be mapped at all, since the arenas can
+*		 not serve it either and the request fails.
+*/
+static inline void* AllocDirect(size_t size, size_t alignment, bool& fallBack)
+{
+	fallBack = true;
+	if (directMapThreshold == 0 || size < directMapThreshold || arenaNum == 0)
+		return nullptr;
+
+	/* The mapping is rounded up to whole pages, and an aligned one reserves the alignment on top */
+	size_t pageSize = GetVirtualPageSize();
+	size_t extraSize = alignment > pageSize ? pageSize + alignment : pageSize;
+	if (alignment > SIZE_MAX - pageSize || size > SIZE_MAX - extraSize)
+	{
+		fallBack = false;
+		return nullptr;
+	}
+	return largeAllocator.Alloc(size, alignment);
+}
+
+
+/**
+* @brief Whether every memory block of the given fix size allocator is aligned to "alignment". 
+*		 Alignment 0 means no requirement.
+*/
+static inline bool IsFixSizeAllocatorAligned(const FixSizeAllocator* allocator, size_t alignment)
+{
+	return alignment == 0 || (allocator->blockSize % alignment == 0 && reinterpret_cast<uintptr_t>(allocator->blockBaseAddr) % alignment == 0);
+}
+
+
+/**
+* @brief Allocate from the given arena. Only the arena of the calling thread goes through the thread
+*		 cache, since the cache only holds memory blocks of that arena. If "clear" is set, the memory
+*		 is filled with zero, except the memory of the dynamic allocator that is known to be zero.
+*/
+static void* AllocFromArena(Arena* arena, size_t size, size_t alignment, bool clear, ThreadCache* cache)
+{
+	void* ptr = nullptr;
+	for (int i = 0; i < fixSizeAllocatorNum; i++)
+	{
+		FixSizeAllocator* allocator = arena->fixSizeAllocatorPtrs[i];
+		if (size <= fixSizeAllocatorDatas[i].blockSize && allocator != nullptr && IsFixSizeAllocatorAligned(allocator, alignment))
+		{
+			/* A growable size class takes another slab when it is full, before larger classes are tried */
+			do
+			{
+				ptr = cache != nullptr ? AllocFromFixSizeAllocator(*cache, i, allocator) : allocator->AtomicAlloc();
+			} while (ptr == nullptr && arena->GrowFixSizeAllocator(i));
+
+			/* Blocks of fix size allocators are small, tracking whether they are zero costs more
+			 * than clearing them */
+			if (ptr != nullptr && clear)
+				memset(ptr, 0, size);
+			if (ptr != nullptr)
+			{
+				CountSizeClassEvent(i, 1, 0);
+				return ptr;
+			}
+		}
+	}
+
+	/* At this point, all fix allocator allocation attempts are fail. Otherwise, the function
+	 * is already returned. Heap allocator is the last attempt to allocate memory for the user */
+	if (clear)
+		ptr = arena->CallocFromDynamicAllocator(size);
+	else
+		ptr = arena->AllocFromDynamicAllocator(size, alignment);
+	if (ptr != nullptr && fixSizeAllocatorNum > 0 && size <= fixSizeAllocatorDatas[fixSizeAllocatorNum - 1].blockSize)
+		threadCacheHolder.pendingCounters.fallThroughCount++;
+	return ptr;
+}
+
+
+/**
+* @brief Allocate from the arena of the calling thread, and borrow from the other arenas if it runs
+*		 dry. See AllocFromArena() for the parameters.
+*/
+static void* AllocFromArenas(size_t size, size_t alignment, bool clear)
+{
+	if (arenaNum == 0 || (alignment & (alignment - 1)) != 0)
+		return nullptr;
+
+	ThreadCache& cache = GetThreadCache();
+	unsigned int homeArenaIdx = threadCacheHolder.arenaIdx;
+	Arena* homeArena = arenaPtrs[homeArenaIdx];
+	if (homeArena->HasRemoteFree())
+		DrainRemoteFree(homeArena, &cache);
+
+	void* ptr = AllocFromArena(homeArena, size, alignment, clear, &cache);
+	if (ptr != nullptr)
+		return ptr;
+
+	/* The arena of the thread runs dry, borrow memory from the other arenas */
+	for (unsigned int i = 1; i < arenaNum; i++)
+	{
+		unsigned int arenaIdx = (homeArenaIdx + i) % arenaNum;
+		Arena* arena = arenaPtrs[arenaIdx];
+		if (arena == nullptr)
+			continue;
+
+		ptr = AllocFromArena(arena, size, alignment, clear, nullptr);
+		if (ptr != nullptr)
+			return ptr;
+
+		/* The arena may only have memory in its remote free list, e.g. when its threads have exited,
+		 * so drain it, together with the blocks this thread still holds for it, and try again */
+		FlushRemoteFreeBatch(arenaIdx);
+		if (arena->HasRemoteFree())
+		{
+			DrainRemoteFree(arena, nullptr);
+			ptr = AllocFromArena(arena, size, alignment, clear, nullptr);
+			if (ptr != nullptr)
+				return ptr;
+		}
+	}
+	return nullptr;
+}
+
+
+void* Alloc(size_t size)
+{
+	bool fallBack;
+	void* ptr = AllocDirect(size, 0, fallBack);
+	if (ptr == nullptr && fallBack)
+		ptr = AllocFromArenas(size, 0, false);
+	return ProfileAlloc(ptr, size);
+}
+
+
+void* Alloc(size_t size, size_t alignment)
+{
+	bool fallBack;
+	void* ptr = AllocDirect(size, alignment, fallBack);
+	if (ptr == nullptr && fallBack)
+		ptr = AllocFromArenas(size, alignment, false);
+	return ProfileAlloc(ptr, size, alignment);
+}
+
+
+void* AllocIsolated(size_t size)
+{
+	if (size > SIZE_MAX - CACHE_LINE_SIZE)
+		return nullptr;
+
+	/* A block of whole cache lines that starts on a cache line ends on one, so the boundary tags of
+	 * the HeapManager around it stay off its cache lines */
+	size_t isolatedSize = size == 0 ? CACHE_LINE_SIZE : (size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+	return Alloc(isolatedSize, CACHE_LINE_SIZE);
+}
+
+
+void* Calloc(size_t num, size_t size)
+{
+	if (size != 0 && num > SIZE_MAX / size)
+		return nullptr;
+
+	/* Mapped memory is zero */
+	bool fallBack;
+	void* ptr = AllocDirect(num * size, 0, fallBack);
+	if (ptr == nullptr && fallBack)
+		ptr = AllocFromArenas(num * size, 0, true);
+	return ProfileAlloc(ptr, num * size);
+}
+
+
+void Free(void* ptr)
+{
+	if (ptr == nullptr)
+		return;
+	ProfileFree(ptr);
+
+	/* Memory addresses that are not owned by any fix size allocator are freed by heap allocator. 
+	 * Memory blocks of other arenas are handed over to them through their remote free lists */
+	bool success = false;
+	int arenaIdx = FindArena(ptr);
+	if (arenaIdx >= 0)
+	{
+		ThreadCache& cache = GetThreadCache();
+		Arena* arena = arenaPtrs[arenaIdx];
+		if (static_cast<unsigned int>(arenaIdx) != threadCacheHolder.arenaIdx)
+		{
+			FreeToRemoteArena(arenaIdx, ptr);
+			return;
+		}
+
+		int fixSizeAllocatorIdx = arena->FindFixSizeAllocator(ptr);
+		if (fixSizeAllocatorIdx < 0)
+			success = arena->FreeToDynamicAllocator(ptr);
+		else
+		{
+			success = FreeToFixSizeAllocator(cache, fixSizeAllocatorIdx, arena->fixSizeAllocatorPtrs[fixSizeAllocatorIdx], ptr);
+			if (success)
+				CountSizeClassEvent(fixSizeAllocatorIdx, 0, 1);
+		}
+	}
+	else
+		success = largeAllocator.Free(ptr);
+	if (!success)
+		printf("Allocators.free(): Unable to free the given memory address. %p \n", ptr);
+}
+
+
+size_t AllocBatch(size_t size, size_t count, void** outPtrs)
+{
+	if (arenaNum == 0)
+		return 0;
+
+	ThreadCache& cache = GetThreadCache();
+	Arena* homeArena = arenaPtrs[threadCacheHolder.arenaIdx];
+	if (homeArena->HasRemoteFree())
+		DrainRemoteFree(homeArena, &cache);
+
+	size_t allocNum = 0;
+	int classIdx = MemorySystem<DefaultMemorySystemConfig>::FindSizeClass(size);
+	FixSizeAllocator* allocator = classIdx >= 0 ? homeArena->fixSizeAllocatorPtrs[classIdx] : nullptr;
+	if (allocator != nullptr)
+	{
+		/* Cached blocks are the warmest, hand them out first */
+		if (classIdx < static_cast<int>(THREAD_CACHE_MAX_CLASS_NUM))
+		{
+			for (; allocNum < count; allocNum++)
+			{
+				outPtrs[allocNum] = cache.Pop(classIdx);
+				if (outPtrs[allocNum] == nullptr)
+					break;
+			}
+		}
+		allocNum += allocator->AtomicAllocBatch(count - allocNum, outPtrs + allocNum);
+		CountSizeClassEvent(classIdx, allocNum, 0);
+		for (size_t i = 0; i < allocNum; i++)
+			ProfileAlloc(outPtrs[i], size);
+	}
+
+	/* The size class runs dry, or the size is too large for any of them */
+	for (; allocNum < count; allocNum++)
+	{
+		outPtrs[allocNum] = Alloc(size);
+		if (outPtrs[allocNum] == nullptr)
+			break;
+	}
+	return allocNum;
+}
+
+
+void FreeBatch(void** ptrs, size_t count)
+{
+	if (arenaNum == 0)
+		return;
+
+	GetThreadCache();
+	size_t i = 0;
+	while (i < count)
+	{
+		/* Memory blocks of the dynamic allocator and of other arenas are freed one by one */
+		int arenaIdx = FindArena(ptrs[i]);
+		int fixSizeAllocatorIdx = arenaIdx >= 0 ? arenaPtrs[arenaIdx]->FindFixSizeAllocator(ptrs[i]) : -1;
+		if (fixSizeAllocatorIdx < 0 || static_cast<unsigned int>(arenaIdx) != threadCacheHolder.arenaIdx)
+		{
+			Free(ptrs[i++]);
+			continue;
+		}
+
+		FixSizeAllocator* allocator = arenaPtrs[arenaIdx]->fixSizeAllocatorPtrs[fixSizeAllocatorIdx];
+		size_t runEnd = i + 1;
+		while (runEnd < count && allocator->Contains(ptrs[runEnd]))
+			runEnd++;
+
+		for (size_t j = i; j < runEnd; j++)
+			ProfileFree(ptrs[j]);
+		size_t freeNum = allocator->AtomicFreeBatch(ptrs + i, runEnd - i);
+		CountSizeClassEvent(fixSizeAllocatorIdx, 0, freeNum);
+		if (freeNum != runEnd - i)
+			printf("Allocators.free(): Unable to free %zu of the given memory addresses. %p \n", runEnd - i - freeNum, ptrs[i]);
+		i = runEnd;
+	}
+}
+
+
+/**
+* @brief Resize a memory block in place. "outOldSize" is set to the usable size of the memory block
+*		 before it is resized, or 0 if the memory address is not allocated by the memory system.
+*/
+static bool ExpandInPlace(void* ptr, size_t newSize, size_t& outOldSize)
+{
+	outOldSize = 0;
+	int arenaIdx = FindArena(ptr);
+	if (arenaIdx < 0)
+	{
+		/* A mapped memory block is resized by remapping its pages where they are */
+		outOldSize = largeAllocator.GetSize(ptr);
+		return outOldSize != 0 && largeAllocator.Resize(ptr, newSize, false) != nullptr;
+	}
+
+	/* A block of a fix size allocator can not grow, but any size up to the block size fits */
+	Arena* arena = arenaPtrs[arenaIdx];
+	int fixSizeAllocatorIdx = arena->FindFixSizeAllocator(ptr);
+	if (fixSizeAllocatorIdx >= 0)
+	{
+		FixSizeAllocator* allocator = arena->fixSizeAllocatorPtrs[fixSizeAllocatorIdx];
+		if (!allocator->Contains(ptr))
+			return false;
+		outOldSize = allocator->blockSize;
+		return newSize <= outOldSize;
+	}
+
+	return arena->ExpandInDynamicAllocator(ptr, newSize, outOldSize);
+}
+
+
+size_t GetUsableSize(const void* ptr)
+{
+	if (ptr == nullptr)
+		return 0;
+
+	int arenaIdx = FindArena(ptr);
+	if (arenaIdx < 0)
+		return largeAllocator.GetSize(ptr);
+
+	Arena* arena = arenaPtrs[arenaIdx];
+	int fixSizeAllocatorIdx = arena->FindFixSizeAllocator(ptr);
+	if (fixSizeAllocatorIdx >= 0)
+	{
+		FixSizeAllocator* allocator = arena->fixSizeAllocatorPtrs[fixSizeAllocatorIdx];
+		return allocator->Contains(ptr) ? allocator->blockSize : 0;
+	}
+	return arena->GetDynamicAllocationSize(ptr);
+}
+
+
+bool Expand(void* ptr, size_t newSize)
+{
+	size_t oldSize;
+	if (ptr == nullptr || !ExpandInPlace(ptr, newSize, oldSize))
+		return false;
+	ProfileResize(ptr, ptr, newSize);
+	return true;
+}
+
+
+void* Realloc(void* ptr, size_t newSize)
+{
+	if (ptr == nullptr)
+		return Alloc(newSize);
+	if (newSize == 0)
+	{
+		Free(ptr);
+		return nullptr;
+	}
+
+	size_t oldSize;
+	if (ExpandInPlace(ptr, newSize, oldSize))
+	{
+		ProfileResize(ptr, ptr, newSize);
+		return ptr;
+	}
+	if (oldSize == 0)
+	{
+		printf("Allocators.realloc(): Unable to resize the given memory address. %p \n", ptr);
+		return nullptr;
+	}
+
+	/* A mapped memory block moves its pages to a new address instead of copying its data */
+	void* newPtr = FindArena(ptr) < 0 ? largeAllocator.Resize(ptr, newSize, true) : nullptr;
+	if (newPtr != nullptr)
+	{
+		ProfileResize(ptr, newPtr, newSize);
+		return newPtr;
+	}
+
+	newPtr = Alloc(newSize);
+	if (newPtr == nullptr)
+		return nullptr;
+
+	memcpy(newPtr, ptr, oldSize < newSize ? oldSize : newSize);
+	Free(ptr);
+	return newPtr;
+}
+
+
+void Free(void* ptr, size_t size)
+{
+	if (ptr == nullptr)
+		return;
+
+	/* A memory block is allocated from the first size class that fits its size, unless that class 
+	 * ran out of blocks or the request was aligned. Check that class of the arena of the thread, and
+	 * look the memory address up as usual if the block is not there */
+	int classIdx = MemorySystem<DefaultMemorySystemConfig>::FindSizeClass(size);
+	if (classIdx >= 0 && arenaNum != 0)
+	{
+		ThreadCache& cache = GetThreadCache();
+		FixSizeAllocator* allocator = arenaPtrs[threadCacheHolder.arenaIdx]->fixSizeAllocatorPtrs[classIdx];
+		if (allocator != nullptr && allocator->Contains(ptr))
+		{
+			ProfileFree(ptr);
+			if (FreeToFixSizeAllocator(cache, classIdx, allocator, ptr))
+				CountSizeClassEvent(classIdx, 0, 1);
+			else
+				printf("Allocators.free(): Unable to free the given memory address. %p \n", ptr);
+			return;
+		}
+	}
+	Free(ptr);
+}
+
+
+bool GetAllocatorStats(AllocatorStats& outStats)
+{
+	memset(&outStats, 0, sizeof(AllocatorStats));
+	if (arenaNum == 0)
+		return false;
+
+	/* The counts of the calling thread are up to date, the other threads add theirs in batches */
+	if (threadCacheHolder.cache.generation == memorySystemGeneration)
+		PublishPendingCounters();
+
+	outStats.sizeClassNum = static_cast<size_t>(fixSizeAllocatorNum);
+	for (int i = 0; i < fixSizeAllocatorNum; i++)
+	{
+		SizeClassStats& classStats = outStats.sizeClasses[i];
+		classStats.blockSize = fixSizeAllocatorDatas[i].blockSize;
+		classStats.allocCount = AtomicLoad(&sizeClassCounters[i].allocCount);
+		classStats.freeCount = AtomicLoad(&sizeClassCounters[i].freeCount);
+		classStats.liveBlockNum = classStats.allocCount > classStats.freeCount ? classStats.allocCount - classStats.freeCount : 0;
+		classStats.maxLiveBlockNum = AtomicLoad(&sizeClassCounters[i].maxLiveBlockNum);
+		outStats.liveSize += classStats.liveBlockNum * classStats.blockSize;
+	}
+	outStats.fallThroughCount = AtomicLoad(&fallThroughCount);
+
+	for (unsigned int i = 0; i < arenaNum; i++)
+	{
+		Arena* arena = arenaPtrs[i];
+		if (arena == nullptr)
+			continue;
+
+		for (int j = 0; j < fixSizeAllocatorNum; j++)
+		{
+			FixSizeAllocator* allocator = arena->fixSizeAllocatorPtrs[j];
+			if (allocator == nullptr)
+				continue;
+			outStats.sizeClasses[j].blockNum += AtomicLoad(&allocator->blockNum);
+			outStats.sizeClasses[j].freeBlockNum += AtomicLoad(&allocator->freeBlockNum);
+		}
+
+		arena->dynamicAllocatorLock.Lock();
+		DynamicAllocator* dynamicAllocator = arena->dynamicAllocator;
+		if (dynamicAllocator != nullptr)
+		{
+			outStats.dynamicAllocCount += dynamicAllocator->allocCount;
+			outStats.dynamicFreeCount += dynamicAllocator->freeCount;
+			outStats.dynamicLiveSize += dynamicAllocator->allocSize;
+			outStats.dynamicMaxLiveSize += dynamicAllocator->maxAllocSize;
+			outStats.dynamicFreeSize += dynamicAllocator->GetFreeSize();
+		}
+		arena->dynamicAllocatorLock.Unlock();
+	}
+	outStats.liveSize += outStats.dynamicLiveSize;
+
+	largeAllocator.lock.Lock();
+	outStats.largeAllocCount = largeAllocator.allocCount;
+	outStats.largeFreeCount = largeAllocator.freeCount;
+	outStats.largeLiveSize = largeAllocator.mappedSize;
+	outStats.largeMaxLiveSize = largeAllocator.maxMappedSize;
+	largeAllocator.lock.Unlock();
+	outStats.liveSize += outStats.largeLiveSize;
+
+	return true;
+}
+
+
+size_t GetLargestFreeBlock()
+{
+	size_t result = 0;
+	for (unsigned int i = 0; i < arenaNum; i++)
+	{
+		Arena* arena = arenaPtrs[i];
+		if (arena == nullptr)
+			continue;
+
+		arena->dynamicAllocatorLock.Lock();
+		size_t largestFreeBlock = arena->dynamicAllocator != nullptr ? arena->dynamicAllocator->GetLargestFreeBlock() : 0;
+		arena->dynamicAllocatorLock.Unlock();
+		if (largestFreeBlock > result)
+			result = largestFreeBlock;
+	}
+	return result;
+}
+
+
+#if MEMORY_ALLOCATOR_REPLACE_GLOBAL_NEW
+/**
+* @brief Allocate for a throwing operator new, which never returns nullptr. As the standard operator
+*		 new, call the new handler while the allocation fails, and throw std::bad_alloc if there is
+*		 no handler. Alignment 0 means the default alignment.
+*/
+static void* AllocOrThrow(size_t size, size_t alignment)
+{
+	while (true)
+	{
+		void* ptr = alignment != 0 ? Alloc(size, alignment) : Alloc(size);
+		if (ptr != nullptr)
+			return ptr;
+
+		std::new_handler handler = std::get_new_handler();
+		if (handler == nullptr)
+			throw std::bad_alloc();
+		handler();
+	}
+}
+
+
+void* operator new(size_t size)
+{
+	return AllocOrThrow(size, 0);
+}
+
+
+void* operator new[](size_t size)
+{
+	return AllocOrThrow(size, 0);
+}
+
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return Alloc(size);
+}
+
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return Alloc(size);
+}
+
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	return AllocOrThrow(size, static_cast<size_t>(alignment));
+}
+
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return AllocOrThrow(size, static_cast<size_t>(alignment));
+}
+
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return Alloc(size, static_cast<size_t>(alignment));
+}
+
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return Alloc(size, static_cast<size_t>(alignment));
+}
+
+
+void operator delete(void* ptr) noexcept
+{
+	Free(ptr);
+}
+
+
+void operator delete[](void* ptr) noexcept
+{
+	Free(ptr);
+}
+
+
+void operator delete(void* ptr, size_t size) noexcept
+{
+	Free(ptr, size);
+}
+
+
+void operator delete[](void* ptr, size_t size) noexcept
+{
+	Free(ptr, size);
+}
+
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+	Free(ptr);
+}
+
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+	Free(ptr);
+}
+
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+	Free(ptr);
+}
+
+
+void operator delete[](void* ptr, std::align_val_t) noexcept
+{
+	Free(ptr);
+}
+
+
+void operator delete(void* ptr, size_t size, std::align_val_t) noexcept
+{
+	Free(ptr, size);
+}
+
+
+void operator delete[](void* ptr, size_t size, std::align_val_t) noexcept
+{
+	Free(ptr, size);
+}
+
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	Free(ptr);
+}
+
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	Free(ptr);
+}
+#endif // MEMORY_ALLOCATOR_REPLACE_GLOBAL_NEW
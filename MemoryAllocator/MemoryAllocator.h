@@ -1,38 +1,207 @@
-#pragma once
-#include <assert.h>
-#include "DynamicAllocator/DynamicAllocator.h"
-#include "FixSizeAllocator/FixSizeAllocator.h"
-
-
-struct FixSizeAllocatorArg
-{
-	size_t blockSize;
-	size_t blockNum;
-};
-extern const int fixSizeAllocatorNum;
-extern const FixSizeAllocatorArg fixSizeAllocatorDatas[];
-extern FixSizeAllocator* fixSizeAllocatorPtrs[];
-extern DynamicAllocator* dynamicAllocator;
-
-
-
-// InitializeMemoryAllocator - initialize your memory system including your HeapManager and some FixedSizeAllocators
-bool InitializeMemoryAllocator(void * i_pHeapMemory, size_t i_sizeHeapMemory);
-
-// DestroyMemoryAllocator - destroy your memory systems
-void DestroyMemoryAllocator();
-
-void* Alloc(size_t size);
-
-void Free(void* ptr);
-
-// Collect - coalesce free blocks in attempt to create larger blocks
-void Collect();
-
-void* operator new(size_t size);
-
-void* operator new[](size_t size);
-
-void operator delete(void* ptr);
-
-void operator delete[](void* ptr);
+#pragma once
+#include <assert.h>
+#include <new>
+#include "AllocatorStats/AllocatorStats.h"
+#include "AllocTrace/AllocTrace.h"
+#include "Arena/Arena.h"
+#include "DynamicAllocator/DynamicAllocator.h"
+#include "FixSizeAllocator/FixSizeAllocator.h"
+#include "HeapProfiler/HeapProfiler.h"
+#include "LargeAllocator/LargeAllocator.h"
+#include "MemorySystem/MemorySystem.h"
+#include "PageMap/PageMap.h"
+#include "ThreadCache/ThreadCache.h"
+
+
+/* Replace the global operator new and delete with Alloc() and Free(). The preload library turns it
+ * off, so that the C++ runtime reaches the memory system through malloc() like every other caller */
+#ifndef MEMORY_ALLOCATOR_REPLACE_GLOBAL_NEW
+#define MEMORY_ALLOCATOR_REPLACE_GLOBAL_NEW 1
+#endif // MEMORY_ALLOCATOR_REPLACE_GLOBAL_NEW
+
+
+extern const int fixSizeAllocatorNum;
+extern const FixSizeAllocatorArg* const fixSizeAllocatorDatas;
+extern Arena* arenaPtrs[];
+extern unsigned int arenaNum;
+extern unsigned int arenaPolicy;
+extern size_t threadCacheDepth;
+extern size_t trimThreshold;
+extern size_t directMapThreshold;
+extern LargeAllocator largeAllocator;
+extern HeapProfiler heapProfiler;
+extern AllocTrace allocTrace;
+
+
+
+// InitializeMemoryAllocator - initialize your memory system including your HeapManager and some FixedSizeAllocators
+bool InitializeMemoryAllocator(void * i_pHeapMemory, size_t i_sizeHeapMemory);
+
+// InitializeMemoryAllocator - split the heap into i_arenaNum arenas of equal size, each with its own
+// FixedSizeAllocators and HeapManager. Threads are assigned to arenas by i_arenaPolicy
+// (ARENA_ASSIGN_ROUND_ROBIN or ARENA_ASSIGN_BY_CPU), and borrow from other arenas when theirs runs dry.
+// Set i_heapZeroed if the heap is filled with zero (e.g. fresh pages from the OS), so that Calloc
+// skips clearing memory that has never been handed out
+bool InitializeMemoryAllocator(void* i_pHeapMemory, size_t i_sizeHeapMemory, unsigned int i_arenaNum, unsigned int i_arenaPolicy = ARENA_ASSIGN_ROUND_ROBIN, bool i_heapZeroed = false);
+
+// InitializeGrowableMemoryAllocator - reserve i_reserveSize bytes of address space from the OS and split
+// it into arenas, but only commit about i_initialSize bytes at first. A FixedSizeAllocator commits another
+// slab when it is full, and a HeapManager commits the pages after its end when no free block fits, so the
+// memory in use follows the demand up to the reserved size. The address space is returned to the OS by
+// DestroyMemoryAllocator.
+// i_pagePolicy tells how the pages are backed (see ARENA_PAGE_HUGE etc): transparent or explicit huge
+// pages, which fall back to transparent ones if the OS has none set aside, and whether committed memory
+// is prefaulted or locked
+bool InitializeGrowableMemoryAllocator(size_t i_reserveSize, size_t i_initialSize, unsigned int i_arenaNum = 1, unsigned int i_arenaPolicy = ARENA_ASSIGN_ROUND_ROBIN, unsigned int i_pagePolicy = ARENA_PAGE_DEFAULT);
+
+// DestroyMemoryAllocator - destroy your memory systems
+void DestroyMemoryAllocator();
+
+void* Alloc(size_t size);
+
+// Alloc - allocate a memory block whose address is a multiple of alignment (a power of 2). It is
+// served by a fix size allocator whose blocks are all aligned, or by the aligned HeapManager allocation
+void* Alloc(size_t size, size_t alignment);
+
+// AllocIsolated - allocate a memory block that shares no cache line with other memory blocks, e.g. for
+// counters that each thread updates. It is aligned to CACHE_LINE_SIZE and its size is rounded up to a
+// multiple of it. It is served by a size class whose blocks are cache lines (see
+// FIX_SIZE_POLICY_ISOLATE_HEADER), or by the HeapManager. Free it with Free()
+void* AllocIsolated(size_t size);
+
+// Calloc - allocate a zero-filled array of num elements of size bytes. Returns nullptr if the total
+// size overflows
+void* Calloc(size_t num, size_t size);
+
+void Free(void* ptr);
+
+// AllocBatch - allocate count memory blocks of the same size into outPtrs, and return how many are
+// allocated. Small sizes take the blocks cached by the thread first, and then claim the rest from the
+// FixedSizeAllocator a whole bit array element at a time
+size_t AllocBatch(size_t size, size_t count, void** outPtrs);
+
+// FreeBatch - free count memory blocks. Consecutive blocks of the same FixedSizeAllocator are released
+// together, bypassing the thread cache
+void FreeBatch(void** ptrs, size_t count);
+
+// Realloc - resize a memory block. It is resized in place when the block has room for newSize or
+// can grow into the free block after it, otherwise the data is moved to a new block. Blocks of
+// FixedSizeAllocators move to a larger size class or to the HeapManager. Blocks mapped from the OS (see
+// SetDirectMapThreshold) are remapped instead of copied. Returns nullptr and keeps the old block if there
+// is no memory
+void* Realloc(void* ptr, size_t newSize);
+
+// Expand - resize a memory block in place. Returns false if it can not be done without moving the block
+bool Expand(void* ptr, size_t newSize);
+
+// GetUsableSize - the number of bytes that can be used at ptr, at least the requested size: the block
+// size of a FixedSizeAllocator, the size of a HeapManager block or of a mapping. Returns 0 if ptr is not
+// allocated by the memory system
+size_t GetUsableSize(const void* ptr);
+
+// Free - free a memory block whose requested size is known. The size names the FixedSizeAllocator the
+// block most likely came from, so the arena and page map lookups are skipped when it is there
+void Free(void* ptr, size_t size);
+
+// Collect - coalesce free blocks in attempt to create larger blocks
+void Collect();
+
+// Trim - give the pages of free HeapManager blocks back to the OS, and return the number of bytes. The
+// pages stay committed and read as zero when they are used again. Only the heap of
+// InitializeGrowableMemoryAllocator is trimmed
+size_t Trim();
+
+// SetTrimThreshold - free HeapManager blocks of at least threshold bytes are trimmed as soon as they are
+// freed. 0 disables automatic trimming, so only Trim() gives pages back
+void SetTrimThreshold(size_t threshold);
+
+// SetDirectMapThreshold - requests of at least threshold bytes get a mapping of their own from the OS
+// instead of a HeapManager block, so they do not fragment the heap, and their memory goes back to the OS
+// when they are freed. Realloc of such a block remaps its pages instead of copying them (Linux). 0
+// disables it, which is the default, so all memory comes from the heap
+void SetDirectMapThreshold(size_t threshold);
+
+// GetAllocatorStats - fill outStats with the counters of the memory system: allocations, frees and the
+// high-water mark of each size class, requests that fell through to the HeapManager, the memory in use and
+// the free memory of the HeapManagers, and the memory mapped from the OS. The counters are kept by the
+// allocations themselves, so it only sums them up per arena and never walks the free blocks. Returns false
+// if the memory system is not initialized
+bool GetAllocatorStats(AllocatorStats& outStats);
+
+// GetLargestFreeBlock - the largest free block of any HeapManager, e.g. to measure fragmentation as 1 -
+// largest free block / dynamicFreeSize of GetAllocatorStats. It is a slow query for diagnostics: it walks
+// the free blocks of each arena under the lock of its HeapManager, so allocations of the arena wait
+size_t GetLargestFreeBlock();
+
+// SetHeapProfileInterval - sample about one allocation per interval bytes allocated, recording its call stack
+// until it is freed. 0 disables sampling, which is the default. HEAP_PROFILER_DEFAULT_INTERVAL (512KB) costs
+// little enough to leave on. Samples taken so far are kept when sampling is disabled
+void SetHeapProfileInterval(size_t interval);
+
+// DumpHeapProfile - write the sampled memory in use and the memory allocated so far per call stack to the
+// file at path, in the legacy heap profile format that pprof reads. Returns false if the file can not be
+// written
+bool DumpHeapProfile(const char* path);
+
+// StartAllocTrace - record every allocation, free, resize and Collect of all threads to a trace file at path,
+// which is mapped into memory with room for maxRecordNum records of 32 bytes. Operations beyond it are
+// dropped and counted. The Replay tool runs a trace again on any configuration. Returns false if a trace
+// is already recording or the file can not be created
+bool StartAllocTrace(const char* path, size_t maxRecordNum);
+
+// StopAllocTrace - stop recording and cut the trace file to the records it holds. Returns false if no trace
+// is recording
+bool StopAllocTrace();
+
+// FlushThreadCache - return the memory blocks cached by the calling thread to the fix size allocators.
+// It is called automatically when a thread exits
+void FlushThreadCache();
+
+// SetThreadCacheDepth - set the number of memory blocks a thread can cache per fix size allocator.
+// 0 disables thread caches. The depth is clamped to THREAD_CACHE_MAX_DEPTH
+void SetThreadCacheDepth(size_t depth);
+
+// LockMemorySystem - take every lock of the memory system, so that fork() does not copy a lock that
+// another thread holds into the child. UnlockMemorySystem releases them, in the parent and in the child
+void LockMemorySystem();
+void UnlockMemorySystem();
+
+void* operator new(size_t size);
+
+void* operator new[](size_t size);
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept;
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept;
+
+void* operator new(size_t size, std::align_val_t alignment);
+
+void* operator new[](size_t size, std::align_val_t alignment);
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept;
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept;
+
+void operator delete(void* ptr) noexcept;
+
+void operator delete[](void* ptr) noexcept;
+
+void operator delete(void* ptr, size_t size) noexcept;
+
+void operator delete[](void* ptr, size_t size) noexcept;
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept;
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept;
+
+void operator delete(void* ptr, std::align_val_t alignment) noexcept;
+
+void operator delete[](void* ptr, std::align_val_t alignment) noexcept;
+
+void operator delete(void* ptr, size_t size, std::align_val_t alignment) noexcept;
+
+void operator delete[](void* ptr, size_t size, std::align_val_t alignment) noexcept;
+
+void operator delete(void* ptr, std::align_val_t alignment, const std::nothrow_t&) noexcept;
+
+void operator delete[](void* ptr, std::align_val_t alignment, const std::nothrow_t&) noexcept;
@@ -0,0 +1,126 @@
+#pragma once
+#include <stddef.h>
+#include "../DynamicAllocator/DynamicAllocator.h"
+#include "../FixSizeAllocator/FixSizeAllocator.h"
+#include "../Utility/Atomic.h"
+#include "../Utility/Utility.h"
+
+
+using namespace Utility;
+
+
+/* Every sub-allocator of a memory system starts at an address aligned to it */
+const size_t MEMORY_SYSTEM_ALIGNMENT = 16;
+
+
+/**
+* @brief The configuration of the memory system used by InitializeMemoryAllocator(). A configuration
+*		 of MemorySystem is a type with the following members:
+*		 sizeClasses -- A constexpr array of FixSizeAllocatorArg, sorted by block size;
+*		 dynamicAllocatorPolicy -- The policy of the dynamic allocator;
+*		 The bit arrays of the default size classes are written by every thread of an arena, so they
+*		 are kept off the cache lines of the memory blocks (FIX_SIZE_POLICY_ISOLATE_HEADER).
+*/
+struct DefaultMemorySystemConfig
+{
+	static constexpr FixSizeAllocatorArg sizeClasses[] = {
+		{16, 100, FIX_SIZE_POLICY_ISOLATE_HEADER},
+		{32, 200, FIX_SIZE_POLICY_ISOLATE_HEADER},
+		{96, 400, FIX_SIZE_POLICY_ISOLATE_HEADER},
+	};
+	static constexpr unsigned int dynamicAllocatorPolicy = POLICY_SEGREGATED_FIT | POLICY_COALESCE_ON_FREE;
+};
+
+
+/**
+* @brief MemorySystem is a memory system whose size classes are fixed at compile time by "Config". 
+*		 Since the block size, the block number and the place of every fix size allocator are 
+*		 constants, mapping a size to its class and finding the owner of an address are a few 
+*		 comparisons with constants, and the block index is a division by a constant. Instances
+*		 do not share any state, so several of them (e.g. one per subsystem) can live in one 
+*		 process, each in its own memory space. Fix size allocators are lock-free
+*		 and the dynamic allocator is protected by the lock of its instance. The structure of 
+*		 memory system be like:
+*		 |  member variables  |  fix size allocator 0  | ... |  fix size allocator N  |  dynamic allocator  |
+*
+* @param size -- The size of the memory space of the instance, including the instance itself;
+* @param fixSizeAllocatorPtrs -- The fix size allocators of the size classes;
+* @param dynamicAllocator -- The dynamic allocator that serves the rest memory requests. It is 
+*		 nullptr if there is no space left for it;
+* @param dynamicAllocatorLock -- The lock of the dynamic allocator;
+*/
+template <typename Config>
+class MemorySystem
+{
+public:
+	static constexpr int sizeClassNum = static_cast<int>(sizeof(Config::sizeClasses) / sizeof(FixSizeAllocatorArg));
+	static constexpr size_t maxFixSize = Config::sizeClasses[sizeClassNum - 1].blockSize;
+
+	size_t size;
+	FixSizeAllocator* fixSizeAllocatorPtrs[sizeClassNum];
+	DynamicAllocator* dynamicAllocator;
+	SpinLock dynamicAllocatorLock;
+
+
+	/**
+	* @brief Return the size class that serves the given size, or -1 if the size is larger than 
+	*		 every class.
+	*/
+	static constexpr int FindSizeClass(size_t size);
+
+	/**
+	* @brief The alignment of the offset of a size class. A class of FIX_SIZE_POLICY_ISOLATE_HEADER,
+	*		 and the class or the dynamic allocator after it, start on a boundary of 
+	*		 FIX_SIZE_ISOLATION_ALIGNMENT, so its blocks share no cache line with the others.
+	*/
+	static constexpr size_t GetClassAlignment(int classIdx);
+
+	/**
+	* @brief Offsets from the instance to the fix size allocator of a size class, to its first memory
+	*		 block, and to the end of its memory blocks.
+	*/
+	static constexpr size_t GetClassOffset(int classIdx);
+	static constexpr size_t GetBlockOffset(int classIdx);
+	static constexpr size_t GetClassEndOffset(int classIdx);
+
+	/**
+	* @brief The size of the memory space taken by the instance and all its fix size allocators. The
+	*		 dynamic allocator uses the rest of the memory space.
+	*/
+	static constexpr size_t GetFixSize();
+
+	inline void* Alloc(size_t size);
+
+	/**
+	* @return If the memory address does not belong to the memory system, or it is not allocated,
+	*		  return false.
+	*/
+	inline bool Free(void* ptr);
+
+	inline bool Contains(const void* ptr) const;
+
+	void Collect();
+
+	void Destroy();
+
+	template <int ClassIdx>
+	inline void* AllocFromClass(size_t size);
+
+	template <int ClassIdx>
+	inline bool FreeToClass(size_t offset);
+};
+
+
+/**
+* @brief Instantiate a MemorySystem instance in the designated memory space, and lay out its sub-
+*		 allocators right after it. "baseAddr" should be aligned to MEMORY_SYSTEM_ALIGNMENT, or to
+*		 FIX_SIZE_ISOLATION_ALIGNMENT if a size class is isolated (FIX_SIZE_POLICY_ISOLATE_HEADER).
+* 
+* @return The address of MemorySystem instance. Return nullptr if the memory space can not hold the
+*		  instance and its fix size allocators.
+*/
+template <typename Config>
+MemorySystem<Config>* CreateMemorySystem(void* baseAddr, size_t size);
+
+
+#include "MemorySystem.inl"
@@ -0,0 +1,225 @@
+#pragma once
+#include <assert.h>
+
+
+/**
+* @brief Round the given size up to a multiple of "alignment", MEMORY_SYSTEM_ALIGNMENT by default.
+*/
+constexpr size_t AlignMemorySystemSize(size_t size, size_t alignment = MEMORY_SYSTEM_ALIGNMENT)
+{
+	return (size + alignment - 1) / alignment * alignment;
+}
+
+
+template <typename Config>
+constexpr int MemorySystem<Config>::FindSizeClass(size_t size)
+{
+	for (int i = 0; i < sizeClassNum; i++)
+	{
+		if (size <= Config::sizeClasses[i].blockSize)
+			return i;
+	}
+	return -1;
+}
+
+
+template <typename Config>
+constexpr size_t MemorySystem<Config>::GetClassAlignment(int classIdx)
+{
+	bool isolated = (classIdx < sizeClassNum && (Config::sizeClasses[classIdx].policy & FIX_SIZE_POLICY_ISOLATE_HEADER)) ||
+		(classIdx > 0 && (Config::sizeClasses[classIdx - 1].policy & FIX_SIZE_POLICY_ISOLATE_HEADER));
+	return isolated ? FIX_SIZE_ISOLATION_ALIGNMENT : MEMORY_SYSTEM_ALIGNMENT;
+}
+
+
+template <typename Config>
+constexpr size_t MemorySystem<Config>::GetClassOffset(int classIdx)
+{
+	size_t offset = AlignMemorySystemSize(sizeof(MemorySystem<Config>), GetClassAlignment(0));
+	for (int i = 0; i < classIdx; i++)
+		offset = AlignMemorySystemSize(GetClassEndOffset(i), GetClassAlignment(i + 1));
+	return offset;
+}
+
+
+template <typename Config>
+constexpr size_t MemorySystem<Config>::GetBlockOffset(int classIdx)
+{
+	return GetClassOffset(classIdx) + GetFixSizeBlockOffset(Config::sizeClasses[classIdx].blockNum, Config::sizeClasses[classIdx].policy & FIX_SIZE_POLICY_ISOLATE_HEADER);
+}
+
+
+template <typename Config>
+constexpr size_t MemorySystem<Config>::GetClassEndOffset(int classIdx)
+{
+	return GetBlockOffset(classIdx) + Config::sizeClasses[classIdx].blockSize * Config::sizeClasses[classIdx].blockNum;
+}
+
+
+template <typename Config>
+constexpr size_t MemorySystem<Config>::GetFixSize()
+{
+	return GetClassOffset(sizeClassNum);
+}
+
+
+template <typename Config>
+inline void* MemorySystem<Config>::Alloc(size_t size)
+{
+	return this->AllocFromClass<0>(size);
+}
+
+
+template <typename Config>
+inline bool MemorySystem<Config>::Free(void* ptr)
+{
+	if (!this->Contains(ptr))
+		return false;
+
+	size_t offset = reinterpret_cast<uintptr_t>(PointerSub(ptr, this));
+	if (offset < GetFixSize())
+		return this->FreeToClass<0>(offset);
+
+	if (this->dynamicAllocator == nullptr)
+		return false;
+
+	this->dynamicAllocatorLock.Lock();
+	bool success = this->dynamicAllocator->Free(ptr);
+	this->dynamicAllocatorLock.Unlock();
+	return success;
+}
+
+
+template <typename Config>
+inline bool MemorySystem<Config>::Contains(const void* ptr) const
+{
+	return ptr >= this && reinterpret_cast<uintptr_t>(PointerSub(ptr, this)) < this->size;
+}
+
+
+/**
+* @brief Try the size classes from "ClassIdx" to the largest one, and fall back to the dynamic
+*		 allocator. Each class is a separate instantiation, so its block size and offset are 
+*		 constants in the generated code.
+*/
+template <typename Config>
+template <int ClassIdx>
+inline void* MemorySystem<Config>::AllocFromClass(size_t size)
+{
+	if constexpr (ClassIdx < sizeClassNum)
+	{
+		constexpr size_t blockSize = Config::sizeClasses[ClassIdx].blockSize;
+		size_t blockIdx;
+		if (size <= blockSize && this->fixSizeAllocatorPtrs[ClassIdx]->AtomicAllocBlock(blockIdx))
+			return PointerAdd(this, GetBlockOffset(ClassIdx) + blockIdx * blockSize);
+		return this->AllocFromClass<ClassIdx + 1>(size);
+	}
+	else
+	{
+		if (this->dynamicAllocator == nullptr)
+			return nullptr;
+
+		this->dynamicAllocatorLock.Lock();
+		void* ptr = this->dynamicAllocator->Alloc(size);
+		this->dynamicAllocatorLock.Unlock();
+		return ptr;
+	}
+}
+
+
+/**
+* @brief Find the size class of the given offset by comparing it with the constant end offset of
+*		 each class, and free the memory block by its index.
+*/
+template <typename Config>
+template <int ClassIdx>
+inline bool MemorySystem<Config>::FreeToClass(size_t offset)
+{
+	if constexpr (ClassIdx < sizeClassNum)
+	{
+		constexpr size_t blockSize = Config::sizeClasses[ClassIdx].blockSize;
+		if (offset >= GetClassEndOffset(ClassIdx))
+			return this->FreeToClass<ClassIdx + 1>(offset);
+		if (offset < GetBlockOffset(ClassIdx))
+			return false;
+
+		size_t blockOffset = offset - GetBlockOffset(ClassIdx);
+		if (blockOffset % blockSize != 0)
+			return false;
+		return this->fixSizeAllocatorPtrs[ClassIdx]->AtomicFreeBlock(blockOffset / blockSize);
+	}
+	else
+	{
+		/* The offset is in the padding between two fix size allocators */
+		return false;
+	}
+}
+
+
+template <typename Config>
+void MemorySystem<Config>::Collect()
+{
+	if (this->dynamicAllocator == nullptr)
+		return;
+
+	this->dynamicAllocatorLock.Lock();
+	this->dynamicAllocator->Collect();
+	this->dynamicAllocatorLock.Unlock();
+}
+
+
+template <typename Config>
+void MemorySystem<Config>::Destroy()
+{
+	for (int i = 0; i < sizeClassNum; i++)
+		this->fixSizeAllocatorPtrs[i]->Destroy();
+	if (this->dynamicAllocator != nullptr)
+		this->dynamicAllocator->Destroy();
+}
+
+
+/**
+* @brief Whether the size classes of the configuration are sorted by block size.
+*/
+template <typename Config>
+constexpr bool IsMemorySystemConfigValid()
+{
+	for (int i = 0; i < MemorySystem<Config>::sizeClassNum; i++)
+	{
+		if (Config::sizeClasses[i].blockSize < sizeof(void*) || Config::sizeClasses[i].blockNum == 0)
+			return false;
+		if (i > 0 && Config::sizeClasses[i].blockSize <= Config::sizeClasses[i - 1].blockSize)
+			return false;
+	}
+	return true;
+}
+
+
+template <typename Config>
+MemorySystem<Config>* CreateMemorySystem(void* baseAddr, size_t size)
+{
+	typedef MemorySystem<Config> System;
+	static_assert(IsMemorySystemConfigValid<Config>(), "Size classes must be sorted by block size, and hold at least a pointer");
+
+	if (System::GetFixSize() > size)
+		return nullptr;
+
+	System* system = static_cast<System*>(baseAddr);
+	system->size = size;
+	system->dynamicAllocatorLock.locked = 0;
+	for (int i = 0; i < System::sizeClassNum; i++)
+	{
+		FixSizeAllocatorArg arg = Config::sizeClasses[i];
+		size_t allocatorSize = System::GetClassEndOffset(i) - System::GetClassOffset(i);
+		system->fixSizeAllocatorPtrs[i] = CreateFixSizeAllocator(PointerAdd(baseAddr, System::GetClassOffset(i)), arg.blockNum, arg.blockSize, allocatorSize, 
+			FIX_SIZE_POLICY_BIT_ARRAY | (arg.policy & FIX_SIZE_POLICY_ISOLATE_HEADER));
+		assert(system->fixSizeAllocatorPtrs[i]->blockBaseAddr == PointerAdd(baseAddr, System::GetBlockOffset(i)));
+	}
+
+	size_t restSize = size - System::GetFixSize();
+	system->dynamicAllocator = nullptr;
+	if (restSize > MANAGER_SIZE + BLOCK_SIZE + TAG_SIZE)
+		system->dynamicAllocator = CreateDynamicAllocator(PointerAdd(baseAddr, System::GetFixSize()), restSize, Config::dynamicAllocatorPolicy);
+
+	return system;
+}
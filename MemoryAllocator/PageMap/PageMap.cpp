@@ -0,0 +1,57 @@
+#include "PageMap.h"
+
+
+PageMap* CreatePageMap(void* baseAddr, void* mapBeginAddr, void* mapEndAddr, size_t pageSize, size_t heapSize)
+{
+	if (GetPageMapSize(mapBeginAddr, mapEndAddr, pageSize) > heapSize)
+		return nullptr;
+
+	PageMap* pageMap = static_cast<PageMap*>(baseAddr);
+	pageMap->baseAddr = mapBeginAddr;
+	pageMap->endAddr = mapEndAddr;
+	pageMap->pageShift = 0;
+	while ((static_cast<size_t>(1) << (pageMap->pageShift + 1)) <= pageSize)
+		pageMap->pageShift++;
+
+	size_t mapSize = reinterpret_cast<uintptr_t>(PointerSub(mapEndAddr, mapBeginAddr));
+	pageMap->pageNum = (mapSize >> pageMap->pageShift) + ((mapSize & (pageSize - 1)) == 0 ? 0 : 1);
+
+	for (size_t i = 0; i < pageMap->pageNum; i++)
+		*pageMap->FindElementPtr(i) = PAGE_OWNER_NONE;
+
+	return pageMap;
+}
+
+
+size_t GetPageMapSize(const void* mapBeginAddr, const void* mapEndAddr, size_t pageSize)
+{
+	size_t mapSize = reinterpret_cast<uintptr_t>(PointerSub(mapEndAddr, mapBeginAddr));
+	size_t pageNum = mapSize / pageSize + (mapSize % pageSize == 0 ? 0 : 1);
+
+	/* "arr" already holds the owner of the first page */
+	return sizeof(PageMap) + (pageNum == 0 ? 0 : pageNum - 1);
+}
+
+
+void PageMap::SetOwner(const void* beginAddr, const void* endAddr, uint8_t owner)
+{
+	if (!this->Contains(beginAddr))
+		return;
+
+	/* The page that contains "beginAddr" belongs to the previous owner unless they start at the same byte */
+	size_t pageSize = static_cast<size_t>(1) << this->pageShift;
+	size_t beginIdx = this->FindPageIdx(beginAddr);
+	if (reinterpret_cast<uintptr_t>(PointerSub(beginAddr, this->baseAddr)) % pageSize != 0)
+		beginIdx++;
+
+	size_t endIdx = this->pageNum;
+	if (this->Contains(endAddr))
+	{
+		endIdx = this->FindPageIdx(endAddr);
+		if (reinterpret_cast<uintptr_t>(PointerSub(endAddr, this->baseAddr)) % pageSize != 0)
+			endIdx++;
+	}
+
+	for (size_t i = beginIdx; i < endIdx; i++)
+		*this->FindElementPtr(i) = owner;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <inttypes.h>
+#include "../Utility/Utility.h"
+
+
+using namespace Utility;
+
+
+/* The owner value of a page that does not belong to any sub-allocator */
+const uint8_t PAGE_OWNER_NONE = 0xFF;
+
+/* The upper limit of the page size. A smaller page is used if any sub-allocator is smaller */
+const size_t PAGE_MAP_MAX_PAGE_SIZE = 4096;
+
+
+/**
+* @brief PageMap is a lookup table that maps a memory address to the sub-allocator that owns it 
+*		 in constant time. The memory range covered by page map is divided into pages of equal 
+*		 size (a power of 2), and each element of the page map records the index of the 
+*		 sub-allocator that owns the first byte of that page. The page size is chosen to be no 
+*		 larger than the smallest sub-allocator, so a page is shared by at most two sub-allocators:
+*		 the owner of the page and the owner of the next page. The structure of page map be like:
+*		 |  member variables  |  owner of page 0  |  owner of page 1  | ... |  owner of page N  |
+*
+* @param baseAddr -- The starting address of the memory range covered by page map;
+* @param endAddr -- The address next to the last byte of the memory range covered by page map;
+* @param pageShift -- log2 of the page size;
+* @param pageNum -- The number of pages in page map;
+* @param arr -- Entry of the page map. arr is the owner of the first page, the owners of the rest
+*				pages are stored right after it. See the description of "BitArray" class for the
+*				same trick;
+*/
+class PageMap
+{
+public:
+	void* baseAddr;
+	void* endAddr;
+	size_t pageShift;
+	size_t pageNum;
+	uint8_t arr;
+
+
+	inline PageMap();
+	inline ~PageMap();
+
+	inline uint8_t* FindElementPtr(size_t idx) const;
+
+	inline bool Contains(const void* ptr) const;
+
+	/**
+	* @brief Return the index of the page that the given memory address is located in. Noted that
+	*		 the method does not check whether the memory address is within the page map.
+	*/
+	inline size_t FindPageIdx(const void* ptr) const;
+
+	/**
+	* @brief Return the owner of the given page. If the page index is out of range, return
+	*		 PAGE_OWNER_NONE.
+	*/
+	inline uint8_t GetOwner(size_t pageIdx) const;
+
+	/**
+	* @brief Mark all pages whose first byte is located in [beginAddr, endAddr) as owned by 
+	*		 the given owner.
+	*/
+	void SetOwner(const void* beginAddr, const void* endAddr, uint8_t owner);
+};
+
+
+/**
+* @brief Instantiate a PageMap instance in the designated memory space. 
+* 
+* @param baseAddr -- The starting address of the free memory space that is going to store the 
+*		 PageMap instance.
+* @param mapBeginAddr -- The starting address of the memory range that page map is going to cover.
+* @param mapEndAddr -- The ending address of the memory range that page map is going to cover.
+* @param pageSize -- The size of each page, must be a power of 2.
+* @param heapSize -- The size of the free memory space that can be used to store the PageMap.
+* 
+* @return The address of PageMap instance. Return nullptr if the free memory space is not large
+*		  enough to store the PageMap.
+*/
+PageMap* CreatePageMap(void* baseAddr, void* mapBeginAddr, void* mapEndAddr, size_t pageSize, size_t heapSize);
+
+/**
+* @brief Return the size of the PageMap instance that covers the given memory range.
+*/
+size_t GetPageMapSize(const void* mapBeginAddr, const void* mapEndAddr, size_t pageSize);
+
+
+#include "PageMap.inl"
@@ -0,0 +1,41 @@
+#pragma once
+
+
+inline PageMap::PageMap()
+{
+	this->baseAddr = nullptr;
+	this->endAddr = nullptr;
+	this->pageShift = 0;
+	this->pageNum = 0;
+	this->arr = PAGE_OWNER_NONE;
+}
+
+
+inline PageMap::~PageMap() {}
+
+
+inline uint8_t* PageMap::FindElementPtr(size_t idx) const
+{
+	return reinterpret_cast<uint8_t*>(PointerAdd(&this->arr, idx));
+}
+
+
+inline bool PageMap::Contains(const void* ptr) const
+{
+	return ptr >= this->baseAddr && ptr < this->endAddr;
+}
+
+
+inline size_t PageMap::FindPageIdx(const void* ptr) const
+{
+	return reinterpret_cast<uintptr_t>(PointerSub(ptr, this->baseAddr)) >> this->pageShift;
+}
+
+
+inline uint8_t PageMap::GetOwner(size_t pageIdx) const
+{
+	if (pageIdx >= this->pageNum)
+		return PAGE_OWNER_NONE;
+	else
+		return *this->FindElementPtr(pageIdx);
+}
@@ -0,0 +1,304 @@
+/* The preload library replaces malloc and its relatives with the memory allocator in programs that
+ * were not built against it, on Linux. It is not part of the Visual Studio project. Build it from the
+ * MemoryAllocator folder with
+ *
+ *	g++ -std=c++17 -O2 -pthread -fPIC -shared -DMEMORY_ALLOCATOR_REPLACE_GLOBAL_NEW=0 -o libmemoryallocator.so \
+ *		$(find . -name '*.cpp' ! -name UnitTest.cpp ! -name BenchmarkMain.cpp ! -name Replay.cpp ! -name PreloadTest.cpp)
+ *
+ * and run a program on it with "LD_PRELOAD=./libmemoryallocator.so program". The memory system is a
+ * growable heap reserved with mmap, initialized by the first call, which comes before main. It is
+ * configured by environment variables:
+ *
+ *	MEMORY_ALLOCATOR_RESERVE_MB -- The address space reserved for the heap, 64GB by default;
+ *	MEMORY_ALLOCATOR_ARENAS -- The number of arenas, the number of CPUs by default;
+ *	MEMORY_ALLOCATOR_DIRECT_MAP -- The direct map threshold in bytes, 1MB by default;
+ *
+ * The functions follow glibc, which lets every other function of the C library that allocates use
+ * them. */
+#include "../MemoryAllocator.h"
+#include "../VirtualMemory/VirtualMemory.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#define PRELOAD_EXPORT extern "C" __attribute__((visibility("default")))
+
+
+/* The defaults of the memory system, see the environment variables above */
+const size_t PRELOAD_DEFAULT_RESERVE_SIZE = 64ull * 1024 * 1024 * 1024;
+const size_t PRELOAD_INITIAL_SIZE = 4 * 1024 * 1024;
+const size_t PRELOAD_DEFAULT_DIRECT_MAP_THRESHOLD = 1024 * 1024;
+
+/* The largest request, as glibc. Pointer differences within a larger block would overflow */
+const size_t PRELOAD_MAX_SIZE = PTRDIFF_MAX;
+
+/* The states of the memory system */
+const int PRELOAD_UNINITIALIZED = 0;
+const int PRELOAD_INITIALIZING = 1;
+const int PRELOAD_READY = 2;
+const int PRELOAD_FAILED = 3;
+
+/* Memory for the calls made while the memory system initializes, e.g. by fopen() when the page
+ * sizes are read. It is never freed */
+const size_t PRELOAD_BOOTSTRAP_SIZE = 64 * 1024;
+
+
+static int preloadState = PRELOAD_UNINITIALIZED;
+alignas(64) static char bootstrapBuffer[PRELOAD_BOOTSTRAP_SIZE];
+static size_t bootstrapSize = 0;
+
+/* Set on the thread that initializes the memory system, so that its calls go to the bootstrap buffer */
+static __thread bool initializingThread __attribute__((tls_model("initial-exec"))) = false;
+
+
+/* Read a number from the environment. getenv() does not allocate */
+static size_t GetEnvironmentSize(const char* name, size_t defaultValue)
+{
+	const char* value = getenv(name);
+	if (value == nullptr || *value == '\0')
+		return defaultValue;
+	return static_cast<size_t>(strtoull(value, nullptr, 10));
+}
+
+
+static void PrepareFork()
+{
+	if (AtomicLoad(&preloadState) == PRELOAD_READY)
+		LockMemorySystem();
+}
+
+
+static void FinishFork()
+{
+	if (AtomicLoad(&preloadState) == PRELOAD_READY)
+		UnlockMemorySystem();
+}
+
+
+/**
+* @brief Initialize the memory system once. Other threads that call in the meantime wait, and the
+*		 initializing thread itself is served from the bootstrap buffer. Return false if the memory
+*		 system can not be used, in which case the bootstrap buffer serves the call.
+*/
+static bool InitializePreload()
+{
+	int state = AtomicLoad(&preloadState);
+	if (state == PRELOAD_READY)
+		return true;
+	if (initializingThread || state == PRELOAD_FAILED)
+		return false;
+
+	int expected = PRELOAD_UNINITIALIZED;
+	if (!AtomicCompareExchange(&preloadState, expected, PRELOAD_INITIALIZING))
+	{
+		uint32_t spinCount = 0;
+		while ((state = AtomicLoad(&preloadState)) == PRELOAD_INITIALIZING)
+			SpinWait(spinCount);
+		return state == PRELOAD_READY;
+	}
+
+	initializingThread = true;
+	long cpuNum = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t reserveSize = GetEnvironmentSize("MEMORY_ALLOCATOR_RESERVE_MB", PRELOAD_DEFAULT_RESERVE_SIZE / (1024 * 1024)) * 1024 * 1024;
+	size_t arenaNum = GetEnvironmentSize("MEMORY_ALLOCATOR_ARENAS", cpuNum > 0 ? static_cast<size_t>(cpuNum) : 1);
+	if (arenaNum > ARENA_MAX_NUM)
+		arenaNum = ARENA_MAX_NUM;
+
+	bool success = InitializeGrowableMemoryAllocator(reserveSize, PRELOAD_INITIAL_SIZE, static_cast<unsigned int>(arenaNum));
+	if (success)
+	{
+		SetDirectMapThreshold(GetEnvironmentSize("MEMORY_ALLOCATOR_DIRECT_MAP", PRELOAD_DEFAULT_DIRECT_MAP_THRESHOLD));
+		pthread_atfork(PrepareFork, FinishFork, FinishFork);
+	}
+	initializingThread = false;
+	AtomicStore(&preloadState, success ? PRELOAD_READY : PRELOAD_FAILED);
+	return success;
+}
+
+
+/* Take memory from the bootstrap buffer. Return nullptr once it is used up */
+static void* AllocBootstrap(size_t size, size_t alignment)
+{
+	if (alignment < 16)
+		alignment = 16;
+
+	size_t usedSize = AtomicLoad(&bootstrapSize);
+	while (true)
+	{
+		size_t offset = (usedSize + alignment - 1) & ~(alignment - 1);
+		if (offset > PRELOAD_BOOTSTRAP_SIZE || size > PRELOAD_BOOTSTRAP_SIZE - offset)
+			return nullptr;
+		if (AtomicCompareExchange(&bootstrapSize, usedSize, offset + size))
+			return bootstrapBuffer + offset;
+	}
+}
+
+
+static inline bool IsBootstrapMemory(const void* ptr)
+{
+	return ptr >= bootstrapBuffer && ptr < bootstrapBuffer + PRELOAD_BOOTSTRAP_SIZE;
+}
+
+
+/* Allocate "size" bytes aligned to "alignment", 0 for the default alignment, and set errno if it fails */
+static void* AllocPreload(size_t size, size_t alignment)
+{
+	if (size > PRELOAD_MAX_SIZE)
+	{
+		errno = ENOMEM;
+		return nullptr;
+	}
+
+	/* Every call returns a distinct memory block, even for 0 bytes */
+	if (size == 0)
+		size = 1;
+
+	void* ptr = InitializePreload() ? (alignment != 0 ? Alloc(size, alignment) : Alloc(size)) : AllocBootstrap(size, alignment);
+	if (ptr == nullptr)
+		errno = ENOMEM;
+	return ptr;
+}
+
+
+/* Run the memory system initialization before main, in case no constructor before it allocates */
+__attribute__((constructor)) static void InitializeBeforeMain()
+{
+	InitializePreload();
+}
+
+
+PRELOAD_EXPORT void* malloc(size_t size)
+{
+	return AllocPreload(size, 0);
+}
+
+
+PRELOAD_EXPORT void free(void* ptr)
+{
+	if (ptr == nullptr || IsBootstrapMemory(ptr))
+		return;
+	Free(ptr);
+}
+
+
+PRELOAD_EXPORT void* calloc(size_t num, size_t size)
+{
+	if (size != 0 && num > PRELOAD_MAX_SIZE / size)
+	{
+		errno = ENOMEM;
+		return nullptr;
+	}
+
+	/* The bootstrap buffer is zero, and it is never reused */
+	void* ptr = InitializePreload() ? Calloc(num * size != 0 ? num : 1, size != 0 ? size : 1) : AllocBootstrap(num * size, 0);
+	if (ptr == nullptr)
+		errno = ENOMEM;
+	return ptr;
+}
+
+
+PRELOAD_EXPORT void* realloc(void* ptr, size_t newSize)
+{
+	if (ptr == nullptr)
+		return AllocPreload(newSize, 0);
+	if (newSize == 0)
+	{
+		free(ptr);
+		return nullptr;
+	}
+	if (newSize > PRELOAD_MAX_SIZE)
+	{
+		errno = ENOMEM;
+		return nullptr;
+	}
+
+	/* A block of the bootstrap buffer moves to the memory system. Its size is not known, but the
+	 * buffer after it can be read up to its end */
+	if (IsBootstrapMemory(ptr))
+	{
+		void* newPtr = AllocPreload(newSize, 0);
+		size_t restSize = static_cast<size_t>(bootstrapBuffer + PRELOAD_BOOTSTRAP_SIZE - static_cast<char*>(ptr));
+		if (newPtr != nullptr)
+			memcpy(newPtr, ptr, newSize < restSize ? newSize : restSize);
+		return newPtr;
+	}
+
+	void* newPtr = Realloc(ptr, newSize);
+	if (newPtr == nullptr)
+		errno = ENOMEM;
+	return newPtr;
+}
+
+
+PRELOAD_EXPORT int posix_memalign(void** outPtr, size_t alignment, size_t size)
+{
+	if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0)
+		return EINVAL;
+
+	void* ptr = AllocPreload(size, alignment);
+	if (ptr == nullptr)
+		return ENOMEM;
+	*outPtr = ptr;
+	return 0;
+}
+
+
+PRELOAD_EXPORT void* aligned_alloc(size_t alignment, size_t size)
+{
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+	{
+		errno = EINVAL;
+		return nullptr;
+	}
+	return AllocPreload(size, alignment);
+}
+
+
+PRELOAD_EXPORT void* memalign(size_t alignment, size_t size)
+{
+	/* As glibc, an alignment that is not a power of two is rounded up to the next one */
+	if ((alignment & (alignment - 1)) != 0)
+	{
+		if (alignment > SIZE_MAX / 2 + 1)
+		{
+			errno = EINVAL;
+			return nullptr;
+		}
+		size_t powerOfTwo = 1;
+		while (powerOfTwo < alignment)
+			powerOfTwo <<= 1;
+		alignment = powerOfTwo;
+	}
+	return AllocPreload(size, alignment);
+}
+
+
+PRELOAD_EXPORT void* valloc(size_t size)
+{
+	return AllocPreload(size, GetVirtualPageSize());
+}
+
+
+PRELOAD_EXPORT void* pvalloc(size_t size)
+{
+	size_t pageSize = GetVirtualPageSize();
+	if (size > PRELOAD_MAX_SIZE - pageSize)
+	{
+		errno = ENOMEM;
+		return nullptr;
+	}
+	return AllocPreload((size + pageSize - 1) / pageSize * pageSize, pageSize);
+}
+
+
+PRELOAD_EXPORT size_t malloc_usable_size(void* ptr)
+{
+	if (ptr == nullptr || IsBootstrapMemory(ptr))
+		return 0;
+	return GetUsableSize(ptr);
+}
@@ -0,0 +1,404 @@
+/* The test of the preload library runs the functions it replaces at the edges glibc defines, through
+ * LD_PRELOAD. It does not link the memory allocator itself. Build the library as described in
+ * Preload.cpp, then build and run the test from the MemoryAllocator folder with
+ *
+ *	g++ -std=c++17 -O2 -pthread -o preloadtest Preload/PreloadTest.cpp -ldl
+ *	LD_PRELOAD=./libmemoryallocator.so ./preloadtest
+ *
+ * The bootstrap test runs the program again with a memory system that can not be initialized, so
+ * every call is served by the bootstrap buffer. */
+#include <assert.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+
+
+bool Preloaded_UnitTest();
+bool Bootstrap_UnitTest();
+bool BootstrapOnly_UnitTest();
+bool Calloc_UnitTest();
+bool ZeroSize_UnitTest();
+bool AlignedAlloc_UnitTest();
+bool Fork_UnitTest();
+bool OversizedAlloc_UnitTest();
+
+
+int main(int argc, char** argv)
+{
+	/* The child process of the bootstrap test */
+	if (argc > 1 && strcmp(argv[1], "bootstrap") == 0)
+		return BootstrapOnly_UnitTest() ? 0 : 1;
+
+	printf("Preloaded malloc unit test begin \n");
+	bool success = Preloaded_UnitTest();
+	if (success) { printf("Preloaded malloc unit test successful! \n"); }
+	assert(success);
+
+	printf("Bootstrap unit test begin \n");
+	success = Bootstrap_UnitTest();
+	if (success) { printf("Bootstrap unit test successful! \n"); }
+	assert(success);
+
+	printf("Calloc unit test begin \n");
+	success = Calloc_UnitTest();
+	if (success) { printf("Calloc unit test successful! \n"); }
+	assert(success);
+
+	printf("Zero size unit test begin \n");
+	success = ZeroSize_UnitTest();
+	if (success) { printf("Zero size unit test successful! \n"); }
+	assert(success);
+
+	printf("Aligned alloc unit test begin \n");
+	success = AlignedAlloc_UnitTest();
+	if (success) { printf("Aligned alloc unit test successful! \n"); }
+	assert(success);
+
+	printf("Fork unit test begin \n");
+	success = Fork_UnitTest();
+	if (success) { printf("Fork unit test successful! \n"); }
+	assert(success);
+
+	printf("Oversized alloc unit test begin \n");
+	success = OversizedAlloc_UnitTest();
+	if (success) { printf("Oversized alloc unit test successful! \n"); }
+	assert(success);
+
+	return 0;
+}
+
+
+/**
+* @brief Whether "ptr" is nullptr with errno set to ENOMEM. errno is cleared for the next call.
+*/
+static bool IsOutOfMemory(void* ptr)
+{
+	bool outOfMemory = ptr == nullptr && errno == ENOMEM;
+	errno = 0;
+	return outOfMemory;
+}
+
+
+static bool IsFilledWith(const void* ptr, size_t size, uint8_t value)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		if (static_cast<const uint8_t*>(ptr)[i] != value)
+			return false;
+	}
+	return true;
+}
+
+
+static inline bool IsAligned(const void* ptr, size_t alignment)
+{
+	return reinterpret_cast<uintptr_t>(ptr) % alignment == 0;
+}
+
+
+/**
+* @brief Wait for a child process, and return whether it exited with 0.
+*/
+static bool WaitForChild(pid_t pid)
+{
+	int status = 0;
+	if (pid < 0 || waitpid(pid, &status, 0) != pid)
+		return false;
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+
+bool Preloaded_UnitTest()
+{
+	/* malloc must come from the preload library, not from the C runtime */
+	Dl_info info;
+	if (dladdr(dlsym(RTLD_DEFAULT, "malloc"), &info) == 0 || info.dli_fname == nullptr || strstr(info.dli_fname, "libc.so") != nullptr)
+	{
+		printf("PreloadTest: malloc is not replaced, run the test with LD_PRELOAD \n");
+		return false;
+	}
+
+	char* ptr = static_cast<char*>(malloc(100));
+	if (ptr == nullptr)
+		return false;
+	memset(ptr, 0x5A, 100);
+	ptr = static_cast<char*>(realloc(ptr, 100000));
+	if (ptr == nullptr || malloc_usable_size(ptr) < 100000 || ptr[0] != 0x5A || ptr[99] != 0x5A)
+		return false;
+	free(ptr);
+	return true;
+}
+
+
+bool Bootstrap_UnitTest()
+{
+	/* A heap of 0 bytes can not be reserved, so the memory system fails to initialize */
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		setenv("MEMORY_ALLOCATOR_RESERVE_MB", "0", 1);
+		execl("/proc/self/exe", "preloadtest", "bootstrap", static_cast<char*>(nullptr));
+		_exit(2);
+	}
+	return WaitForChild(pid);
+}
+
+
+bool BootstrapOnly_UnitTest()
+{
+	/* Test 1: Memory of the bootstrap buffer has no usable size, and realloc() copies it to a new
+	 * block */
+	char* ptr = static_cast<char*>(malloc(100));
+	if (ptr == nullptr || malloc_usable_size(ptr) != 0)
+		return false;
+	memset(ptr, 0x5A, 100);
+	char* newPtr = static_cast<char*>(realloc(ptr, 200));
+	if (newPtr == nullptr || newPtr == ptr || !IsFilledWith(newPtr, 100, 0x5A))
+		return false;
+
+	/* free() leaves the buffer alone, so its memory is never handed out again */
+	uintptr_t freedAddr = reinterpret_cast<uintptr_t>(newPtr);
+	free(newPtr);
+	void* nextPtr = malloc(200);
+	if (nextPtr == nullptr || reinterpret_cast<uintptr_t>(nextPtr) == freedAddr)
+		return false;
+
+
+	/* Test 2: calloc() is zero, and alignments are honored */
+	void* zeroPtr = calloc(10, 10);
+	void* alignedPtr = aligned_alloc(256, 64);
+	if (zeroPtr == nullptr || !IsFilledWith(zeroPtr, 100, 0) || alignedPtr == nullptr || !IsAligned(alignedPtr, 256))
+		return false;
+
+
+	/* Test 3: The buffer runs out */
+	size_t allocNum = 0;
+	errno = 0;
+	while (malloc(1024) != nullptr)
+	{
+		if (++allocNum > 64)
+			return false;
+	}
+	return errno == ENOMEM;
+}
+
+
+bool Calloc_UnitTest()
+{
+	/* Memory that was used before is cleared, in size classes, in the dynamic allocator and for
+	 * blocks that are mapped directly */
+	const size_t sizes[] = { 1, 16, 90, 1000, 100000, 4 * 1024 * 1024 };
+	for (size_t size : sizes)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			void* dirtyPtr = malloc(size);
+			if (dirtyPtr == nullptr)
+				return false;
+			memset(dirtyPtr, 0xFF, size);
+			free(dirtyPtr);
+
+			void* zeroPtr = calloc(size, 1);
+			bool zeroed = zeroPtr != nullptr && IsFilledWith(zeroPtr, size, 0);
+			free(zeroPtr);
+			if (!zeroed)
+				return false;
+		}
+	}
+
+	void* arrayPtr = calloc(1000, 8);
+	bool zeroed = arrayPtr != nullptr && IsFilledWith(arrayPtr, 8000, 0);
+	free(arrayPtr);
+	return zeroed;
+}
+
+
+bool ZeroSize_UnitTest()
+{
+	/* Every call returns a distinct memory block that can be freed, even for 0 bytes */
+	void* ptrs[] = { malloc(0), malloc(0), calloc(0, 16), calloc(16, 0), calloc(0, 0), aligned_alloc(64, 0) };
+	const size_t ptrNum = sizeof(ptrs) / sizeof(ptrs[0]);
+	bool success = true;
+	for (size_t i = 0; i < ptrNum; i++)
+	{
+		if (ptrs[i] == nullptr)
+			success = false;
+		for (size_t j = 0; j < i; j++)
+		{
+			if (ptrs[i] == ptrs[j])
+				success = false;
+		}
+	}
+	for (size_t i = 0; i < ptrNum; i++)
+		free(ptrs[i]);
+	if (!success)
+		return false;
+
+	/* realloc() of nullptr allocates, and realloc() to 0 bytes frees */
+	void* ptr = realloc(nullptr, 32);
+	if (ptr == nullptr)
+		return false;
+	return realloc(ptr, 0) == nullptr;
+}
+
+
+bool AlignedAlloc_UnitTest()
+{
+	/* Test 1: Every power of two is honored, from the size classes up to the mapped blocks */
+	const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const size_t sizes[] = { 1, 100, 5000, 2 * 1024 * 1024 };
+	for (size_t alignment = sizeof(void*); alignment <= 64 * 1024; alignment *= 2)
+	{
+		for (size_t size : sizes)
+		{
+			void* ptrs[3] = { nullptr, aligned_alloc(alignment, size), memalign(alignment, size) };
+			if (posix_memalign(&ptrs[0], alignment, size) != 0)
+				return false;
+			for (void* ptr : ptrs)
+			{
+				if (ptr == nullptr || !IsAligned(ptr, alignment))
+					return false;
+				memset(ptr, 0x3C, size);
+				free(ptr);
+			}
+		}
+	}
+
+	void* pagePtr = valloc(100);
+	void* pagesPtr = pvalloc(pageSize + 1);
+	if (pagePtr == nullptr || !IsAligned(pagePtr, pageSize) || pagesPtr == nullptr || !IsAligned(pagesPtr, pageSize) || malloc_usable_size(pagesPtr) < 2 * pageSize)
+		return false;
+	free(pagePtr);
+	free(pagesPtr);
+
+
+	/* Test 2: posix_memalign() and aligned_alloc() reject alignments that are not a power of two,
+	 * and posix_memalign() those below the size of a pointer, without touching the result */
+	void* sentinel = &sentinel;
+	const size_t badAlignments[] = { 0, 3, 24, sizeof(void*) / 2, SIZE_MAX };
+	for (size_t alignment : badAlignments)
+	{
+		void* ptr = sentinel;
+		if (posix_memalign(&ptr, alignment, 64) != EINVAL || ptr != sentinel)
+			return false;
+		errno = 0;
+		if (alignment != sizeof(void*) / 2 && (aligned_alloc(alignment, 64) != nullptr || errno != EINVAL))
+			return false;
+	}
+
+
+	/* Test 3: memalign() rounds an alignment up to a power of two, as glibc */
+	void* ptr = memalign(24, 64);
+	if (ptr == nullptr || !IsAligned(ptr, 32))
+		return false;
+	free(ptr);
+	errno = 0;
+	return memalign(SIZE_MAX, 64) == nullptr && errno == EINVAL;
+}
+
+
+bool Fork_UnitTest()
+{
+	/* Threads allocate and free while the main thread forks, so the locks of the memory system are
+	 * taken at any point. The child must find them free, and its allocations must work */
+	const unsigned int threadNum = 4;
+	const unsigned int forkNum = 20;
+	std::atomic<bool> stop(false);
+	std::thread threads[threadNum];
+	for (unsigned int t = 0; t < threadNum; t++)
+	{
+		threads[t] = std::thread([&stop, t]()
+			{
+				void* ptrs[64] = {};
+				for (size_t i = 0; !stop.load(); i++)
+				{
+					size_t idx = (i * 7 + t) % 64;
+					free(ptrs[idx]);
+					ptrs[idx] = i % 3 == 0 ? memalign(64, 16 + i % 5000) : malloc(16 + (i * 13) % 300000);
+					ptrs[(idx + 1) % 64] = realloc(ptrs[(idx + 1) % 64], 16 + (i * 31) % 20000);
+				}
+				for (void* ptr : ptrs)
+					free(ptr);
+			});
+	}
+
+	bool success = true;
+	char* parentPtr = static_cast<char*>(malloc(1000));
+	memset(parentPtr, 0x7E, 1000);
+	for (unsigned int f = 0; f < forkNum && success; f++)
+	{
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			/* A lock that is never released ends the child by the alarm */
+			alarm(10);
+			char* ptr = static_cast<char*>(realloc(parentPtr, 200000));
+			bool childSuccess = ptr != nullptr && IsFilledWith(ptr, 1000, 0x7E);
+			free(ptr);
+			for (size_t i = 0; i < 1000; i++)
+			{
+				void* blockPtr = malloc(16 + i * 97);
+				childSuccess = childSuccess && blockPtr != nullptr;
+				free(blockPtr);
+			}
+			_exit(childSuccess ? 0 : 1);
+		}
+		success = WaitForChild(pid);
+		usleep(1000);
+	}
+	free(parentPtr);
+
+	stop.store(true);
+	for (unsigned int t = 0; t < threadNum; t++)
+		threads[t].join();
+	return success;
+}
+
+
+bool OversizedAlloc_UnitTest()
+{
+	/* Sizes beyond PTRDIFF_MAX can not be represented and fail with ENOMEM, whatever the function.
+	 * They are read at run time, so the compiler does not reject the calls */
+	volatile size_t maxSize = PTRDIFF_MAX;
+	volatile size_t allSize = SIZE_MAX;
+	errno = 0;
+	if (!IsOutOfMemory(malloc(allSize)) || !IsOutOfMemory(malloc(maxSize + 1)))
+		return false;
+	if (!IsOutOfMemory(calloc(1, allSize)) || !IsOutOfMemory(calloc(2, maxSize / 2 + 1)) || !IsOutOfMemory(calloc(allSize, 1)))
+		return false;
+	if (!IsOutOfMemory(aligned_alloc(64, allSize - 63)) || !IsOutOfMemory(memalign(4096, maxSize + 1)))
+		return false;
+	if (!IsOutOfMemory(valloc(allSize)) || !IsOutOfMemory(pvalloc(allSize)) || !IsOutOfMemory(pvalloc(maxSize)))
+		return false;
+
+	void* alignedPtr = nullptr;
+	if (posix_memalign(&alignedPtr, 64, allSize) != ENOMEM || alignedPtr != nullptr)
+		return false;
+	errno = 0;
+
+	/* A failed realloc leaves the memory block as it was */
+	char* ptr = static_cast<char*>(malloc(64));
+	if (ptr == nullptr)
+		return false;
+	memset(ptr, 0x3C, 64);
+	if (realloc(ptr, allSize - 1) != nullptr || errno != ENOMEM)
+		return false;
+	errno = 0;
+	if (realloc(ptr, maxSize + 1) != nullptr || errno != ENOMEM)
+		return false;
+	for (size_t i = 0; i < 64; i++)
+	{
+		if (ptr[i] != 0x3C)
+			return false;
+	}
+	free(ptr);
+	return true;
+}
@@ -0,0 +1,440 @@
+/* The replay tool runs an allocation trace recorded by StartAllocTrace() again, on a configuration of
+ * the memory allocator or on the malloc of the C runtime, and reports the throughput, the memory in
+ * use and the fragmentation as the trace goes on. The records are replayed one by one on a single
+ * thread in the order they were recorded, so a replay is deterministic. It is not part of the Visual
+ * Studio project, since it has a main of its own. Build it from the MemoryAllocator folder with
+ *
+ *	g++ -std=c++17 -O2 -pthread -o replay $(find . -name '*.cpp' ! -name UnitTest.cpp ! -name BenchmarkMain.cpp ! -name Preload.cpp ! -name PreloadTest.cpp)
+ *
+ * The tool itself only allocates with malloc, so the statistics of the memory allocator only show
+ * the memory blocks of the trace. */
+#include "../MemoryAllocator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+
+/* The address space reserved for a growable heap, and the memory committed at start */
+const size_t REPLAY_RESERVE_SIZE = 64ull * 1024 * 1024 * 1024;
+const size_t REPLAY_INITIAL_SIZE = 4 * 1024 * 1024;
+
+/* The number of reports over the trace, unless an interval is given */
+const size_t REPLAY_DEFAULT_REPORT_NUM = 20;
+
+
+/**
+* @brief The configuration of a replay, taken from the command line.
+*
+* @param useMalloc -- Replay on the malloc of the C runtime instead of the memory allocator;
+* @param heapSize -- The size of a fix heap. 0 replays on a growable heap;
+* @param arenaNum, threadCacheDepth, directMapThreshold, trimThreshold -- The configuration of the
+*		 memory allocator. A value of SIZE_MAX keeps the default;
+* @param reportInterval -- The number of records between reports;
+*/
+struct ReplayConfig
+{
+	bool useMalloc;
+	size_t heapSize;
+	unsigned int arenaNum;
+	size_t threadCacheDepth;
+	size_t directMapThreshold;
+	size_t trimThreshold;
+	size_t reportInterval;
+};
+
+
+/**
+* @brief A live memory block of the replay, keyed by its id in the trace.
+*/
+struct ReplayBlock
+{
+	uint64_t id;
+	void* ptr;
+	size_t size;
+};
+
+
+/**
+* @brief The memory blocks of the trace that are live in the replay, an open addressing table keyed
+*		 by id, kept at most half full. Ids are memory addresses of the recording, which are never
+*		 0, so an id of 0 marks an empty entry.
+*/
+class ReplayBlockTable
+{
+public:
+	ReplayBlock* blocks;
+	size_t capacity;
+	size_t blockNum;
+
+	bool Init(size_t capacity)
+	{
+		this->blocks = static_cast<ReplayBlock*>(calloc(capacity, sizeof(ReplayBlock)));
+		this->capacity = capacity;
+		this->blockNum = 0;
+		return this->blocks != nullptr;
+	}
+
+	inline size_t FindSlot(uint64_t id) const
+	{
+		size_t idx = static_cast<size_t>((id * 0x9E3779B97F4A7C15ull) >> 32) & (this->capacity - 1);
+		while (this->blocks[idx].id != 0 && this->blocks[idx].id != id)
+			idx = (idx + 1) & (this->capacity - 1);
+		return idx;
+	}
+
+	inline ReplayBlock* Find(uint64_t id)
+	{
+		ReplayBlock* block = &this->blocks[this->FindSlot(id)];
+		return block->id == id ? block : nullptr;
+	}
+
+	bool Insert(uint64_t id, void* ptr, size_t size)
+	{
+		if ((this->blockNum + 1) * 2 > this->capacity && !this->Resize(this->capacity * 2))
+			return false;
+
+		ReplayBlock* block = &this->blocks[this->FindSlot(id)];
+		if (block->id == 0)
+			this->blockNum++;
+		block->id = id;
+		block->ptr = ptr;
+		block->size = size;
+		return true;
+	}
+
+	void Remove(ReplayBlock* block)
+	{
+		/* Move back the entries after the hole whose probe starts at or before it */
+		size_t holeIdx = static_cast<size_t>(block - this->blocks);
+		size_t idx = holeIdx;
+		while (true)
+		{
+			idx = (idx + 1) & (this->capacity - 1);
+			if (this->blocks[idx].id == 0)
+				break;
+
+			size_t slotIdx = static_cast<size_t>((this->blocks[idx].id * 0x9E3779B97F4A7C15ull) >> 32) & (this->capacity - 1);
+			if (((idx - slotIdx) & (this->capacity - 1)) >= ((idx - holeIdx) & (this->capacity - 1)))
+			{
+				this->blocks[holeIdx] = this->blocks[idx];
+				holeIdx = idx;
+			}
+		}
+		this->blocks[holeIdx].id = 0;
+		this->blockNum--;
+	}
+
+	bool Resize(size_t capacity)
+	{
+		ReplayBlock* oldBlocks = this->blocks;
+		size_t oldCapacity = this->capacity;
+		if (!this->Init(capacity))
+		{
+			this->blocks = oldBlocks;
+			this->capacity = oldCapacity;
+			return false;
+		}
+
+		for (size_t i = 0; i < oldCapacity; i++)
+		{
+			if (oldBlocks[i].id != 0)
+			{
+				this->blocks[this->FindSlot(oldBlocks[i].id)] = oldBlocks[i];
+				this->blockNum++;
+			}
+		}
+		free(oldBlocks);
+		return true;
+	}
+};
+
+
+/* Read a whole trace file into memory from malloc. Return nullptr if it is not a valid trace */
+static TraceRecord* LoadTrace(const char* path, TraceHeader& outHeader)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == nullptr)
+	{
+		printf("Can not open %s \n", path);
+		return nullptr;
+	}
+
+	TraceRecord* records = nullptr;
+	if (fread(&outHeader, sizeof(TraceHeader), 1, file) != 1 || outHeader.magic != TRACE_FILE_MAGIC ||
+		outHeader.version != TRACE_FILE_VERSION || outHeader.recordSize != sizeof(TraceRecord))
+		printf("%s is not a trace file of this version \n", path);
+	else
+	{
+		records = static_cast<TraceRecord*>(malloc(static_cast<size_t>(outHeader.recordNum) * sizeof(TraceRecord) + 1));
+		if (records != nullptr && fread(records, sizeof(TraceRecord), static_cast<size_t>(outHeader.recordNum), file) != outHeader.recordNum)
+		{
+			printf("%s is cut short \n", path);
+			free(records);
+			records = nullptr;
+		}
+	}
+	fclose(file);
+	return records;
+}
+
+
+/* The peak resident memory of the process in MB, or 0 where it is not known */
+static double GetPeakResidentSize()
+{
+#if defined(_WIN32)
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+	return static_cast<double>(usage.ru_maxrss) / 1024.0;
+#endif
+}
+
+
+static void* AllocBlock(const ReplayConfig& config, size_t size, size_t alignment)
+{
+	if (!config.useMalloc)
+		return alignment != 0 ? Alloc(size, alignment) : Alloc(size);
+	if (alignment <= sizeof(void*))
+		return malloc(size);
+
+#if defined(_WIN32)
+	return nullptr;
+#else
+	void* ptr = nullptr;
+	return posix_memalign(&ptr, alignment, size) == 0 ? ptr : nullptr;
+#endif
+}
+
+
+static void FreeBlock(const ReplayConfig& config, void* ptr)
+{
+	if (config.useMalloc)
+		free(ptr);
+	else
+		Free(ptr);
+}
+
+
+static void* ResizeBlock(const ReplayConfig& config, void* ptr, size_t size)
+{
+	return config.useMalloc ? realloc(ptr, size) : Realloc(ptr, size);
+}
+
+
+static void CollectBlocks(const ReplayConfig& config)
+{
+	if (!config.useMalloc)
+		Collect();
+#if defined(__GLIBC__)
+	else
+		malloc_trim(0);
+#endif
+}
+
+
+/* Print a line of the memory in use at a point of the replay */
+static void Report(const ReplayConfig& config, size_t recordIdx, const TraceRecord* records, size_t liveSize)
+{
+	double traceTime = recordIdx > 0 ? static_cast<double>(records[recordIdx - 1].time) / 1e6 : 0;
+	AllocatorStats stats;
+	if (!config.useMalloc && GetAllocatorStats(stats))
+	{
+		size_t largestFreeBlock = GetLargestFreeBlock();
+		double fragmentation = stats.dynamicFreeSize > 0 ? 1.0 - static_cast<double>(largestFreeBlock) / static_cast<double>(stats.dynamicFreeSize) : 0.0;
+		printf("%12zu %12.1f %12.2f %12.2f %12.2f %8.3f %10.1f \n", recordIdx, traceTime, static_cast<double>(liveSize) / 1048576.0,
+			static_cast<double>(stats.liveSize) / 1048576.0, static_cast<double>(stats.dynamicFreeSize) / 1048576.0, fragmentation,
+			GetPeakResidentSize());
+	}
+	else
+	{
+		printf("%12zu %12.1f %12.2f %12s %12s %8s %10.1f \n", recordIdx, traceTime, static_cast<double>(liveSize) / 1048576.0,
+			"-", "-", "-", GetPeakResidentSize());
+	}
+}
+
+
+static void PrintUsage()
+{
+	printf("Usage: replay <trace file> [options] \n"
+		"  --malloc             replay on the malloc of the C runtime \n"
+		"  --heap <MB>          a fix heap of the given size instead of a growable one \n"
+		"  --arenas <n>         the number of arenas \n"
+		"  --cache-depth <n>    SetThreadCacheDepth() \n"
+		"  --direct-map <bytes> SetDirectMapThreshold() \n"
+		"  --trim <bytes>       SetTrimThreshold() \n"
+		"  --interval <n>       the number of records between reports \n");
+}
+
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	ReplayConfig config = { false, 0, 1, SIZE_MAX, SIZE_MAX, SIZE_MAX, 0 };
+	for (int i = 2; i < argc; i++)
+	{
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (strcmp(argv[i], "--malloc") == 0)
+			config.useMalloc = true;
+		else if (value != nullptr && strcmp(argv[i], "--heap") == 0)
+			config.heapSize = strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+		else if (value != nullptr && strcmp(argv[i], "--arenas") == 0)
+			config.arenaNum = static_cast<unsigned int>(strtoul(argv[++i], nullptr, 10));
+		else if (value != nullptr && strcmp(argv[i], "--cache-depth") == 0)
+			config.threadCacheDepth = strtoull(argv[++i], nullptr, 10);
+		else if (value != nullptr && strcmp(argv[i], "--direct-map") == 0)
+			config.directMapThreshold = strtoull(argv[++i], nullptr, 10);
+		else if (value != nullptr && strcmp(argv[i], "--trim") == 0)
+			config.trimThreshold = strtoull(argv[++i], nullptr, 10);
+		else if (value != nullptr && strcmp(argv[i], "--interval") == 0)
+			config.reportInterval = strtoull(argv[++i], nullptr, 10);
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	TraceHeader header;
+	TraceRecord* records = LoadTrace(argv[1], header);
+	if (records == nullptr)
+		return 1;
+	size_t recordNum = static_cast<size_t>(header.recordNum);
+	if (config.reportInterval == 0)
+		config.reportInterval = recordNum / REPLAY_DEFAULT_REPORT_NUM > 0 ? recordNum / REPLAY_DEFAULT_REPORT_NUM : 1;
+
+	void* heapMemory = nullptr;
+	if (!config.useMalloc)
+	{
+		bool success;
+		if (config.heapSize != 0)
+		{
+			heapMemory = malloc(config.heapSize);
+			success = heapMemory != nullptr && InitializeMemoryAllocator(heapMemory, config.heapSize, config.arenaNum);
+		}
+		else
+			success = InitializeGrowableMemoryAllocator(REPLAY_RESERVE_SIZE, REPLAY_INITIAL_SIZE, config.arenaNum);
+		if (!success)
+		{
+			printf("Can not initialize the memory allocator \n");
+			return 1;
+		}
+
+		if (config.threadCacheDepth != SIZE_MAX)
+			SetThreadCacheDepth(config.threadCacheDepth);
+		if (config.directMapThreshold != SIZE_MAX)
+			SetDirectMapThreshold(config.directMapThreshold);
+		if (config.trimThreshold != SIZE_MAX)
+			SetTrimThreshold(config.trimThreshold);
+	}
+
+	ReplayBlockTable table;
+	if (!table.Init(1024))
+		return 1;
+
+	printf("Replay of %s: %zu records, %llu dropped when recorded, on %s \n", argv[1], recordNum,
+		static_cast<unsigned long long>(header.droppedRecordNum), config.useMalloc ? "malloc" : "MemoryAllocator");
+	printf("%12s %12s %12s %12s %12s %8s %10s \n", "records", "trace ms", "requested MB", "in use MB", "free MB", "frag", "peak RSS MB");
+
+	/* Only the replay of the records is timed, not the reports */
+	size_t liveSize = 0, maxLiveSize = 0, unmatchedNum = 0, failNum = 0;
+	uint64_t replayTime = 0;
+	for (size_t begin = 0; begin < recordNum; begin += config.reportInterval)
+	{
+		size_t end = begin + config.reportInterval < recordNum ? begin + config.reportInterval : recordNum;
+		uint64_t beginTime = GetTraceTime();
+		for (size_t i = begin; i < end; i++)
+		{
+			const TraceRecord& record = records[i];
+			if (record.op == TRACE_OP_ALLOC)
+			{
+				void* ptr = AllocBlock(config, static_cast<size_t>(record.size), record.alignment);
+				if (ptr == nullptr)
+				{
+					failNum++;
+					continue;
+				}
+
+				/* Touch the memory block as its user would. An id that is still live lost its free */
+				static_cast<volatile char*>(ptr)[0] = 0;
+				ReplayBlock* oldBlock = table.Find(record.id);
+				if (oldBlock != nullptr)
+				{
+					FreeBlock(config, oldBlock->ptr);
+					liveSize -= oldBlock->size;
+					table.Remove(oldBlock);
+					unmatchedNum++;
+				}
+				if (!table.Insert(record.id, ptr, static_cast<size_t>(record.size)))
+					return 1;
+				liveSize += static_cast<size_t>(record.size);
+				if (liveSize > maxLiveSize)
+					maxLiveSize = liveSize;
+			}
+			else if (record.op == TRACE_OP_FREE || record.op == TRACE_OP_RESIZE)
+			{
+				/* Memory blocks allocated before the trace started are not known */
+				ReplayBlock* block = record.id != 0 ? table.Find(record.id) : nullptr;
+				if (block == nullptr)
+				{
+					unmatchedNum++;
+					continue;
+				}
+
+				if (record.op == TRACE_OP_FREE)
+				{
+					FreeBlock(config, block->ptr);
+					liveSize -= block->size;
+					table.Remove(block);
+					continue;
+				}
+
+				void* ptr = ResizeBlock(config, block->ptr, static_cast<size_t>(record.size));
+				if (ptr == nullptr)
+				{
+					failNum++;
+					continue;
+				}
+				liveSize = liveSize - block->size + static_cast<size_t>(record.size);
+				if (liveSize > maxLiveSize)
+					maxLiveSize = liveSize;
+				block->ptr = ptr;
+				block->size = static_cast<size_t>(record.size);
+			}
+			else if (record.op == TRACE_OP_COLLECT)
+				CollectBlocks(config);
+		}
+		replayTime += GetTraceTime() - beginTime;
+		Report(config, end, records, liveSize);
+	}
+
+	double seconds = static_cast<double>(replayTime) / 1e9;
+	printf("%zu records in %.3f s, %.2f Mops/s, peak requested %.2f MB, peak RSS %.1f MB \n", recordNum, seconds,
+		seconds > 0 ? static_cast<double>(recordNum) / seconds / 1e6 : 0, static_cast<double>(maxLiveSize) / 1048576.0, GetPeakResidentSize());
+	printf("%zu frees and resizes of unknown memory blocks, %zu failed allocations, %zu memory blocks left \n", unmatchedNum, failNum, table.blockNum);
+
+	for (size_t i = 0; i < table.capacity; i++)
+	{
+		if (table.blocks[i].id != 0)
+			FreeBlock(config, table.blocks[i].ptr);
+	}
+	free(table.blocks);
+	free(records);
+	if (!config.useMalloc)
+		DestroyMemoryAllocator();
+	free(heapMemory);
+	return 0;
+}
@@ -0,0 +1,47 @@
+#include "ThreadCache.h"
+#include <string.h>
+
+
+size_t ThreadCache::Refill(size_t classIdx, FixSizeAllocator* allocator, size_t count)
+{
+	ThreadCacheMagazine& magazine = this->magazines[classIdx];
+	if (count > THREAD_CACHE_MAX_DEPTH - magazine.count)
+		count = THREAD_CACHE_MAX_DEPTH - magazine.count;
+
+	size_t refillNum = 0;
+	while (refillNum < count)
+	{
+		void* ptr = allocator->AtomicAlloc();
+		if (ptr == nullptr)
+			break;
+
+		magazine.blocks[magazine.count++] = ptr;
+		refillNum++;
+	}
+	return refillNum;
+}
+
+
+void ThreadCache::Flush(size_t classIdx, FixSizeAllocator* allocator, size_t count)
+{
+	ThreadCacheMagazine& magazine = this->magazines[classIdx];
+	if (count > magazine.count)
+		count = magazine.count;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!allocator->AtomicFree(magazine.blocks[i]))
+			printf("ThreadCache.Flush(): Unable to return the memory block to fix size allocator. %p \n", magazine.blocks[i]);
+	}
+
+	/* Keep the hot blocks on the top of the stack */
+	magazine.count -= count;
+	memmove(magazine.blocks, magazine.blocks + count, magazine.count * sizeof(void*));
+}
+
+
+void ThreadCache::Clear()
+{
+	for (size_t i = 0; i < THREAD_CACHE_MAX_CLASS_NUM; i++)
+		this->magazines[i].count = 0;
+}
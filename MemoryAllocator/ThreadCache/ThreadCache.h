@@ -0,0 +1,91 @@
+#pragma once
+#include "../FixSizeAllocator/FixSizeAllocator.h"
+#include "../Utility/Utility.h"
+
+
+using namespace Utility;
+
+
+/* The maximum number of fix size allocators that a thread cache can serve */
+const size_t THREAD_CACHE_MAX_CLASS_NUM = 8;
+
+/* The capacity of each magazine. The depth that is actually used is configured at runtime */
+const size_t THREAD_CACHE_MAX_DEPTH = 64;
+
+/* The default number of memory blocks a magazine can hold before it is flushed */
+const size_t THREAD_CACHE_DEFAULT_DEPTH = 32;
+
+
+/**
+* @brief ThreadCacheMagazine is a stack of free memory blocks of one fix size allocator. The most
+*		 recently freed block is on the top of the stack, so it is the first one to be reused while
+*		 it is still hot in the CPU cache.
+* 
+* @param count -- The number of memory blocks in the magazine;
+* @param blocks -- The memory blocks in the magazine, blocks[count - 1] is the top of the stack;
+*/
+class ThreadCacheMagazine
+{
+public:
+	size_t count;
+	void* blocks[THREAD_CACHE_MAX_DEPTH];
+};
+
+
+/**
+* @brief ThreadCache sits in front of the fix size allocators and holds a magazine of free memory
+*		 blocks for each of them. A thread allocates from and frees to its own magazines without
+*		 any synchronization. Only when a magazine is empty (or full) does the thread go to the 
+*		 shared fix size allocator, and then it moves a batch of memory blocks at once, so the 
+*		 atomic operations on the shared bit array are not paid for every allocation. 
+*		 ThreadCache does not own any memory. The blocks in magazines are still marked as allocated
+*		 in their fix size allocators until they are flushed.
+* 
+* @param generation -- The generation of the memory system that the cached blocks belong to. If the
+*		 memory system is destroyed or re-initialized, the cached blocks are stale and dropped;
+* @param magazines -- One magazine per fix size allocator;
+*/
+class ThreadCache
+{
+public:
+	size_t generation;
+	ThreadCacheMagazine magazines[THREAD_CACHE_MAX_CLASS_NUM];
+
+
+	/**
+	* @brief Pop a memory block from the magazine of the given fix size allocator.
+	* 
+	* @return Return nullptr if the magazine is empty.
+	*/
+	inline void* Pop(size_t classIdx);
+
+	/**
+	* @brief Push a memory block into the magazine of the given fix size allocator.
+	* 
+	* @return Return false if the magazine already holds "depth" memory blocks.
+	*/
+	inline bool Push(size_t classIdx, void* ptr, size_t depth);
+
+	/**
+	* @brief Allocate up to "count" memory blocks from the fix size allocator and push them into its
+	*		 magazine.
+	* 
+	* @return The number of memory blocks that are moved into the magazine.
+	*/
+	size_t Refill(size_t classIdx, FixSizeAllocator* allocator, size_t count);
+
+	/**
+	* @brief Return up to "count" memory blocks at the bottom of the magazine (the coldest ones) to
+	*		 the fix size allocator.
+	*/
+	void Flush(size_t classIdx, FixSizeAllocator* allocator, size_t count);
+
+	/**
+	* @brief Drop all memory blocks without returning them. Used when the memory system that owns
+	*		 them is gone.
+	*/
+	void Clear();
+};
+
+
+#include "ThreadCache.inl"
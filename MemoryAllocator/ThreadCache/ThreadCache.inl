@@ -0,0 +1,20 @@
+#pragma once
+
+
+inline void* ThreadCache::Pop(size_t classIdx)
+{
+	ThreadCacheMagazine& magazine = this->magazines[classIdx];
+	if (magazine.count == 0)
+		return nullptr;
+	return magazine.blocks[--magazine.count];
+}
+
+
+inline bool ThreadCache::Push(size_t classIdx, void* ptr, size_t depth)
+{
+	ThreadCacheMagazine& magazine = this->magazines[classIdx];
+	if (magazine.count >= depth)
+		return false;
+	magazine.blocks[magazine.count++] = ptr;
+	return true;
+}
@@ -1,272 +1,2511 @@
-#include "MemoryAllocator.h"
-
-#include <Windows.h>
-#include <assert.h>
-#include <algorithm>
-#include <vector>
-
-#ifdef _DEBUG
-#define _CRTDBG_MAP_ALLOC
-#include <stdlib.h>
-#include <crtdbg.h>
-#endif // _DEBUG
-
-
-bool MemorySystem_UnitTest();
-bool BitArray_UnitTest();
-bool FixSizeAllocator_UnitTest();
-
-
-int main(int i_arg, char**)
-{
-
-	/* BitArray Test */
-	printf("Bit Array unit test begin \n");
-	if (BitArray_UnitTest())
-		printf("Bit Array unit test success! \n");
-
-
-
-	/* Fix Allocator Test */
-	printf("Fix Allocator unit test begin \n");
-	if (FixSizeAllocator_UnitTest())
-		printf("Fix Allocator unit test success! \n");
-
-
-
-	/* Memory Allocator Test */
-	const size_t 		sizeHeap = 1024 * 1024;
-	const unsigned int 	numDescriptors = 2048;
-
-	// Allocate memory for my test heap.
-	void* pHeapMemory = HeapAlloc(GetProcessHeap(), 0, sizeHeap);
-	assert(pHeapMemory);
-
-	// Create your HeapManager and FixedSizeAllocators.
-	InitializeMemoryAllocator(pHeapMemory, sizeHeap);
-
-	printf("Memory system unit test begin \n");
-	bool success = MemorySystem_UnitTest();
-	if (success) { printf("Memory system unit test successful! \n"); }
-	assert(success);
-
-	// Clean up your Memory Allocator (DynamicAllocator and FixedSizeAllocators)
-	DestroyMemoryAllocator();
-
-	HeapFree(GetProcessHeap(), 0, pHeapMemory);
-
-	// in a Debug build make sure we didn't leak any memory.
-#if defined(_DEBUG)
-	_CrtDumpMemoryLeaks();
-#endif // _DEBUG
-
-	return 0;
-}
-
-
-
-bool MemorySystem_UnitTest()
-{
-	const size_t maxAllocations = 10 * 1024;
-	std::vector<void*> AllocatedAddresses;
-
-	long	numAllocs = 0;
-	long	numFrees = 0;
-	long	numCollects = 0;
-
-	size_t totalAllocated = 0;
-
-	// reserve space in AllocatedAddresses for the maximum number of allocation attempts
-	// prevents new returning null when std::vector expands the underlying array
-	AllocatedAddresses.reserve(10 * 1024);
-
-	// allocate memory of random sizes up to 1024 bytes from the heap manager
-	// until it runs out of memory
-	do
-	{
-		const size_t maxTestAllocationSize = 1024;
-		size_t sizeAlloc = 1 + (rand() & (maxTestAllocationSize - 1));
-		void* pPtr = Alloc(sizeAlloc);
-
-		// if allocation failed see if garbage collecting will create a large enough block
-		if (pPtr == nullptr)
-		{
-			Collect();
-			pPtr = Alloc(sizeAlloc);
-
-			// if not we're done. go on to cleanup phase of test
-			if (pPtr == nullptr)
-				break;
-		}
-
-		AllocatedAddresses.push_back(pPtr);
-		numAllocs++;
-
-		totalAllocated += sizeAlloc;
-
-		// randomly free and/or garbage collect during allocation phase
-		const unsigned int freeAboutEvery = 0x07;
-		const unsigned int garbageCollectAboutEvery = 0x07;
-
-		if (!AllocatedAddresses.empty() && ((rand() % freeAboutEvery) == 0))
-		{
-			void* pPtrToFree = AllocatedAddresses.back();
-			AllocatedAddresses.pop_back();
-
-			Free(pPtrToFree);
-			numFrees++;
-		}
-		else if ((rand() % garbageCollectAboutEvery) == 0)
-		{
-			Collect();
-			numCollects++;
-		}
-
-	} while (numAllocs < maxAllocations);
-
-	// now free those blocks in a random order
-	if (!AllocatedAddresses.empty())
-	{
-		// randomize the addresses
-		std::random_shuffle(AllocatedAddresses.begin(), AllocatedAddresses.end());
-
-		// return them back to the heap manager
-		while (!AllocatedAddresses.empty())
-		{
-			void* pPtrToFree = AllocatedAddresses.back();
-			AllocatedAddresses.pop_back();
-
-			delete[] pPtrToFree;
-		}
-
-		// do garbage collection
-		Collect();
-		// our heap should be one single block, all the memory it started with
-
-		// do a large test allocation to see if garbage collection worked
-		void* pPtr = Alloc(totalAllocated / 2);
-
-		if (pPtr)
-			Free(pPtr);
-		else
-			return false;
-	}
-	else
-		return false;
-
-	// this new [] / delete [] pair should run through your allocator
-	char* pNewTest1 = new char[1024];
-	delete[] pNewTest1;
-
-	int* pNewTest2 = new int[1024];
-	delete[] pNewTest2;
-
-	long long* pNewTest3 = new long long;
-	delete pNewTest3;
-
-	// we succeeded
-	return true;
-}
-
-
-bool BitArray_UnitTest()
-{
-	const size_t 		sizeHeap = 1024 * 1024;
-	const unsigned int 	numDescriptors = 2048;
-
-	void* pHeapMemory = HeapAlloc(GetProcessHeap(), 0, sizeHeap);
-	assert(pHeapMemory);
-
-	const size_t blockNum = 128;
-	const size_t blockSize = 16;
-	BitArray* bitArray = CreateBitArray(pHeapMemory, blockNum, true);
-
-	printf("List address: %p \n", &bitArray->arr);
-
-	*bitArray->FindElementPtr(0) = 0xFFFFFFFF;
-	*bitArray->FindElementPtr(1) = 0x7FFFFFFF;
-	*bitArray->FindElementPtr(2) = 0x0;
-
-	printf("\nTest 1\n");
-	printf("arr[%u]: %x\n", 0, *bitArray->FindElementPtr(0));
-	printf("arr[%u]: %x\n", 1, *bitArray->FindElementPtr(1));
-	printf("arr[%u]: %x\n", 2, *bitArray->FindElementPtr(2));
-	size_t temp1, temp2;
-	bool temp3;
-	temp3 = bitArray->FindFirstAllocateBit(temp1);
-	temp3 = bitArray->FindFirstFreeBit(temp2);
-	assert(temp1 == 63);
-	assert(temp2 == 0);
-
-	printf("\nTest 2\n");
-	assert(bitArray->IsBitSet(63) == false);
-	assert(bitArray->IsBitSet(62) == true);
-	assert(bitArray->IsBitClear(63) == true);
-	assert(bitArray->IsBitClear(62) == false);
-	assert(bitArray->AreAllBitsSet() == false);
-	assert(bitArray->AreAllBitsClear() == false);
-	bitArray->SetBit(63);
-	printf("arr[%u]: %x\n", 0, *bitArray->FindElementPtr(0));
-	printf("arr[%u]: %x\n", 1, *bitArray->FindElementPtr(1));
-	printf("arr[%u]: %x\n", 2, *bitArray->FindElementPtr(2));
-	assert(bitArray->IsBitSet(63) == true);
-	assert(bitArray->IsBitSet(62) == true);
-	assert(bitArray->IsBitClear(63) == false);
-	assert(bitArray->IsBitClear(62) == false);
-	bitArray->ClearBit(63);
-	printf("arr[%u]: %x\n", 0, *bitArray->FindElementPtr(0));
-	printf("arr[%u]: %x\n", 1, *bitArray->FindElementPtr(1));
-	printf("arr[%u]: %x\n", 2, *bitArray->FindElementPtr(2));
-
-	printf("\nTest 3\n");
-	bitArray->SetAllBits();
-	assert(bitArray->AreAllBitsSet() == true);
-	assert(bitArray->AreAllBitsClear() == false);
-	printf("arr[%u]: %x\n", 1, *bitArray->FindElementPtr(1));
-	printf("arr[%u]: %x\n", 2, *bitArray->FindElementPtr(2));
-	bitArray->ClearAllBits();
-	assert(bitArray->AreAllBitsSet() == false);
-	assert(bitArray->AreAllBitsClear() == true);
-	printf("arr[%u]: %x\n", 1, *bitArray->FindElementPtr(1));
-	printf("arr[%u]: %x\n", 2, *bitArray->FindElementPtr(2));
-
-	return true;
-}
-
-
-
-bool FixSizeAllocator_UnitTest()
-{
-	const size_t 		sizeHeap = 1024 * 1024;
-	const unsigned int 	numDescriptors = 2048;
-
-	void* pHeapMemory = HeapAlloc(GetProcessHeap(), 0, sizeHeap);
-	assert(pHeapMemory);
-
-	const uint32_t blockNum = 128;
-	const size_t blockSize = 16;
-	FixSizeAllocator* allocator = CreateFixSizeAllocator(pHeapMemory, blockNum, blockSize, sizeHeap);
-
-	printf("arr[%u]: %x\n", 0, *allocator->bitArray.FindElementPtr(0));
-	void* ptr1 = allocator->Alloc();
-	void* ptr2 = allocator->Alloc();
-	void* ptr3 = allocator->Alloc();
-	void* ptr4 = allocator->Alloc();
-	printf("arr[%u]: %x\n", 0, *allocator->bitArray.FindElementPtr(0));
-	assert(*allocator->bitArray.FindElementPtr(0) == 0xFFFFFFF0);
-
-	allocator->Free(ptr3);
-	printf("arr[%u]: %x\n", 0, *allocator->bitArray.FindElementPtr(0));
-	assert(*allocator->bitArray.FindElementPtr(0) == 0xFFFFFFF4);
-	allocator->Free(ptr2);
-	printf("arr[%u]: %x\n", 0, *allocator->bitArray.FindElementPtr(0));
-	assert(*allocator->bitArray.FindElementPtr(0) == 0xFFFFFFF6);
-	allocator->Free(ptr4);
-	printf("arr[%u]: %x\n", 0, *allocator->bitArray.FindElementPtr(0));
-	assert(*allocator->bitArray.FindElementPtr(0) == 0xFFFFFFFE);
-	allocator->Free(ptr1);
-	printf("arr[%u]: %x\n", 0, *allocator->bitArray.FindElementPtr(0));
-	assert(*allocator->bitArray.FindElementPtr(0) == 0xFFFFFFFF);
-
-	return true;
+#include "MemoryAllocator.h"
+#include "Benchmark/Benchmark.h"
+#include "VirtualMemory/VirtualMemory.h"
+
+#include <Windows.h>
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _DEBUG
+#define _CRTDBG_MAP_ALLOC
+#include <stdlib.h>
+#include <crtdbg.h>
+#endif // _DEBUG
+
+
+bool MemorySystem_UnitTest();
+bool ThreadCache_UnitTest();
+bool OperatorNew_UnitTest();
+bool Realloc_UnitTest();
+bool Calloc_UnitTest();
+bool BatchAlloc_UnitTest();
+bool ConcurrentFixSizeAllocator_UnitTest();
+bool Arena_UnitTest();
+bool GrowableHeap_UnitTest();
+bool Trim_UnitTest();
+bool HugePage_UnitTest();
+bool DirectMap_UnitTest();
+bool Stats_UnitTest();
+bool HeapProfile_UnitTest();
+bool AllocTrace_UnitTest();
+bool UsableSize_UnitTest();
+bool CacheLine_UnitTest();
+bool MemorySystemTemplate_UnitTest();
+bool BitArray_UnitTest();
+bool FixSizeAllocator_UnitTest();
+bool FreeListFixSizeAllocator_UnitTest();
+bool PageMap_UnitTest();
+bool DynamicAllocator_UnitTest();
+
+
+int main(int i_arg, char**)
+{
+
+	/* BitArray Test */
+	printf("Bit Array unit test begin \n");
+	if (BitArray_UnitTest())
+		printf("Bit Array unit test success! \n");
+
+
+
+	/* Fix Allocator Test */
+	printf("Fix Allocator unit test begin \n");
+	if (FixSizeAllocator_UnitTest())
+		printf("Fix Allocator unit test success! \n");
+
+	printf("Free list fix allocator unit test begin \n");
+	if (FreeListFixSizeAllocator_UnitTest())
+		printf("Free list fix allocator unit test success! \n");
+
+
+
+	/* Dynamic Allocator Test */
+	printf("Dynamic Allocator unit test begin \n");
+	if (DynamicAllocator_UnitTest())
+		printf("Dynamic Allocator unit test success! \n");
+
+
+
+	/* Page Map Test */
+	printf("Page Map unit test begin \n");
+	if (PageMap_UnitTest())
+		printf("Page Map unit test success! \n");
+
+
+
+	/* Memory Allocator Test */
+	const size_t 		sizeHeap = 1024 * 1024;
+	const unsigned int 	numDescriptors = 2048;
+
+	// Allocate memory for my test heap.
+	void* pHeapMemory = HeapAlloc(GetProcessHeap(), 0, sizeHeap);
+	assert(pHeapMemory);
+
+	// Create your HeapManager and FixedSizeAllocators.
+	InitializeMemoryAllocator(pHeapMemory, sizeHeap);
+
+	printf("Memory system unit test begin \n");
+	bool success = MemorySystem_UnitTest();
+	if (success) { printf("Memory system unit test successful! \n"); }
+	assert(success);
+
+	printf("Operator new unit test begin \n");
+	success = OperatorNew_UnitTest();
+	if (success) { printf("Operator new unit test successful! \n"); }
+	assert(success);
+
+	printf("Realloc unit test begin \n");
+	success = Realloc_UnitTest();
+	if (success) { printf("Realloc unit test successful! \n"); }
+	assert(success);
+
+	printf("Calloc unit test begin \n");
+	success = Calloc_UnitTest();
+	if (success) { printf("Calloc unit test successful! \n"); }
+	assert(success);
+
+	printf("Batch alloc unit test begin \n");
+	success = BatchAlloc_UnitTest();
+	if (success) { printf("Batch alloc unit test successful! \n"); }
+	assert(success);
+
+	/* Tests below start threads, which need the memory system to be initialized */
+	printf("Concurrent fix allocator unit test begin \n");
+	success = ConcurrentFixSizeAllocator_UnitTest();
+	if (success) { printf("Concurrent fix allocator unit test successful! \n"); }
+	assert(success);
+
+	printf("Thread cache unit test begin \n");
+	success = ThreadCache_UnitTest();
+	if (success) { printf("Thread cache unit test successful! \n"); }
+	assert(success);
+
+	/* Benchmarks. They run before the memory system is destroyed, since threads allocate through it */
+	DynamicAllocator_Benchmark();
+	BitArray_Benchmark();
+	FixSizeAllocator_Benchmark();
+	FixSizeAllocator_BatchBenchmark();
+	FixSizeAllocator_ConcurrentBenchmark();
+
+	// Clean up your Memory Allocator (DynamicAllocator and FixedSizeAllocators)
+	DestroyMemoryAllocator();
+
+	HeapFree(GetProcessHeap(), 0, pHeapMemory);
+
+	/* Arena Test. It initializes the memory system again with several arenas */
+	printf("Arena unit test begin \n");
+	success = Arena_UnitTest();
+	if (success) { printf("Arena unit test successful! \n"); }
+	assert(success);
+
+	printf("Growable heap unit test begin \n");
+	success = GrowableHeap_UnitTest();
+	if (success) { printf("Growable heap unit test successful! \n"); }
+	assert(success);
+
+	printf("Trim unit test begin \n");
+	success = Trim_UnitTest();
+	if (success) { printf("Trim unit test successful! \n"); }
+	assert(success);
+
+	printf("Huge page unit test begin \n");
+	success = HugePage_UnitTest();
+	if (success) { printf("Huge page unit test successful! \n"); }
+	assert(success);
+
+	printf("Direct map unit test begin \n");
+	success = DirectMap_UnitTest();
+	if (success) { printf("Direct map unit test successful! \n"); }
+	assert(success);
+
+	printf("Allocator stats unit test begin \n");
+	success = Stats_UnitTest();
+	if (success) { printf("Allocator stats unit test successful! \n"); }
+	assert(success);
+
+	printf("Heap profile unit test begin \n");
+	success = HeapProfile_UnitTest();
+	if (success) { printf("Heap profile unit test successful! \n"); }
+	assert(success);
+
+	printf("Allocation trace unit test begin \n");
+	success = AllocTrace_UnitTest();
+	if (success) { printf("Allocation trace unit test successful! \n"); }
+	assert(success);
+
+	printf("Usable size unit test begin \n");
+	success = UsableSize_UnitTest();
+	if (success) { printf("Usable size unit test successful! \n"); }
+	assert(success);
+
+	printf("Cache line isolation unit test begin \n");
+	success = CacheLine_UnitTest();
+	if (success) { printf("Cache line isolation unit test successful! \n"); }
+	assert(success);
+
+	printf("Memory system template unit test begin \n");
+	success = MemorySystemTemplate_UnitTest();
+	if (success) { printf("Memory system template unit test successful! \n"); }
+	assert(success);
+
+	// in a Debug build make sure we didn't leak any memory.
+#if defined(_DEBUG)
+	_CrtDumpMemoryLeaks();
+#endif // _DEBUG
+
+	return 0;
+}
+
+
+
+bool MemorySystem_UnitTest()
+{
+	const size_t maxAllocations = 10 * 1024;
+	std::vector<void*> AllocatedAddresses;
+
+	long	numAllocs = 0;
+	long	numFrees = 0;
+	long	numCollects = 0;
+
+	size_t totalAllocated = 0;
+
+	// reserve space in AllocatedAddresses for the maximum number of allocation attempts
+	// prevents new returning null when std::vector expands the underlying array
+	AllocatedAddresses.reserve(10 * 1024);
+
+	// allocate memory of random sizes up to 1024 bytes from the heap manager
+	// until it runs out of memory
+	do
+	{
+		const size_t maxTestAllocationSize = 1024;
+		size_t sizeAlloc = 1 + (rand() & (maxTestAllocationSize - 1));
+		void* pPtr = Alloc(sizeAlloc);
+
+		// if allocation failed see if garbage collecting will create a large enough block
+		if (pPtr == nullptr)
+		{
+			Collect();
+			pPtr = Alloc(sizeAlloc);
+
+			// if not we're done. go on to cleanup phase of test
+			if (pPtr == nullptr)
+				break;
+		}
+
+		AllocatedAddresses.push_back(pPtr);
+		numAllocs++;
+
+		totalAllocated += sizeAlloc;
+
+		// randomly free and/or garbage collect during allocation phase
+		const unsigned int freeAboutEvery = 0x07;
+		const unsigned int garbageCollectAboutEvery = 0x07;
+
+		if (!AllocatedAddresses.empty() && ((rand() % freeAboutEvery) == 0))
+		{
+			void* pPtrToFree = AllocatedAddresses.back();
+			AllocatedAddresses.pop_back();
+
+			Free(pPtrToFree);
+			numFrees++;
+		}
+		else if ((rand() % garbageCollectAboutEvery) == 0)
+		{
+			Collect();
+			numCollects++;
+		}
+
+	} while (numAllocs < maxAllocations);
+
+	// now free those blocks in a random order
+	if (!AllocatedAddresses.empty())
+	{
+		// randomize the addresses
+		std::random_shuffle(AllocatedAddresses.begin(), AllocatedAddresses.end());
+
+		// return them back to the heap manager
+		while (!AllocatedAddresses.empty())
+		{
+			void* pPtrToFree = AllocatedAddresses.back();
+			AllocatedAddresses.pop_back();
+
+			delete[] pPtrToFree;
+		}
+
+		// do garbage collection
+		Collect();
+		// our heap should be one single block, all the memory it started with
+
+		// do a large test allocation to see if garbage collection worked
+		void* pPtr = Alloc(totalAllocated / 2);
+
+		if (pPtr)
+			Free(pPtr);
+		else
+			return false;
+	}
+	else
+		return false;
+
+	// this new [] / delete [] pair should run through your allocator
+	char* pNewTest1 = new char[1024];
+	delete[] pNewTest1;
+
+	int* pNewTest2 = new int[1024];
+	delete[] pNewTest2;
+
+	long long* pNewTest3 = new long long;
+	delete pNewTest3;
+
+	// we succeeded
+	return true;
+}
+
+
+struct alignas(64) OperatorNewTestObject
+{
+	char data[48];
+};
+
+
+bool OperatorNew_UnitTest()
+{
+	/* Test 1: Aligned allocations, from fix size allocators and from the dynamic allocator */
+	const size_t sizes[] = { 1, 16, 32, 90, 200, 3000 };
+	const size_t alignments[] = { 8, 16, 32, 64, 256 };
+	for (size_t size : sizes)
+	{
+		for (size_t alignment : alignments)
+		{
+			void* ptr = Alloc(size, alignment);
+			if (ptr == nullptr || reinterpret_cast<uintptr_t>(ptr) % alignment != 0)
+			{
+				printf("OperatorNew: Allocation of %zu bytes is not aligned to %zu. %p \n", size, alignment, ptr);
+				return false;
+			}
+			memset(ptr, 0, size);
+			Free(ptr, size);
+		}
+	}
+	if (Alloc(16, 24) != nullptr)
+		return false;
+
+	/* An alignment beyond 32 bits is never truncated, the heap is too small to honor it */
+	const size_t hugeAlignment = static_cast<size_t>(1) << (sizeof(size_t) * 8 - 1);
+	if (Alloc(16, hugeAlignment) != nullptr || (sizeof(size_t) > 4 && Alloc(16, static_cast<size_t>(1) << (sizeof(size_t) * 4)) != nullptr))
+		return false;
+
+
+	/* Test 2: Sized free returns a block to the class of its size, so the next allocation of the 
+	 * same size reuses it */
+	void* smallPtr = Alloc(20);
+	Free(smallPtr, 20);
+	if (Alloc(20) != smallPtr)
+		return false;
+	Free(smallPtr, 20);
+
+	/* A wrong size only costs the usual lookup */
+	void* largePtr = Alloc(500);
+	Free(largePtr, 8);
+	if (Alloc(500) != largePtr)
+		return false;
+	Free(largePtr, 500);
+
+
+	/* Test 3: C++17 operators */
+	OperatorNewTestObject* object = new OperatorNewTestObject;
+	OperatorNewTestObject* objects = new OperatorNewTestObject[3];
+	if (reinterpret_cast<uintptr_t>(object) % 64 != 0 || reinterpret_cast<uintptr_t>(objects) % 64 != 0)
+		return false;
+	delete object;
+	delete[] objects;
+
+	int* value = new (std::nothrow) int(7);
+	if (value == nullptr || *value != 7)
+		return false;
+	delete value;
+
+	void* rawPtr = ::operator new(24);
+	::operator delete(rawPtr, 24);
+	rawPtr = ::operator new(24, std::align_val_t(32), std::nothrow);
+	if (reinterpret_cast<uintptr_t>(rawPtr) % 32 != 0)
+		return false;
+	::operator delete(rawPtr, 24, std::align_val_t(32));
+
+	/* A request the heap can not hold makes the throwing operators throw, and the nothrow ones
+	 * return nullptr */
+	const size_t hugeSize = 64 * 1024 * 1024;
+	size_t thrownNum = 0;
+	try { rawPtr = ::operator new(hugeSize); } catch (const std::bad_alloc&) { thrownNum++; }
+	try { rawPtr = ::operator new[](hugeSize); } catch (const std::bad_alloc&) { thrownNum++; }
+	try { rawPtr = ::operator new(hugeSize, std::align_val_t(64)); } catch (const std::bad_alloc&) { thrownNum++; }
+	try { rawPtr = ::operator new[](hugeSize, std::align_val_t(64)); } catch (const std::bad_alloc&) { thrownNum++; }
+	if (thrownNum != 4 || ::operator new(hugeSize, std::nothrow) != nullptr || ::operator new(hugeSize, std::align_val_t(64), std::nothrow) != nullptr)
+		return false;
+
+	return true;
+}
+
+
+static void FillPattern(void* ptr, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		static_cast<uint8_t*>(ptr)[i] = static_cast<uint8_t>(i * 7 + 3);
+}
+
+
+static bool CheckPattern(const void* ptr, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		if (static_cast<const uint8_t*>(ptr)[i] != static_cast<uint8_t>(i * 7 + 3))
+			return false;
+	}
+	return true;
+}
+
+
+bool Realloc_UnitTest()
+{
+	/* Test 1: Dynamic allocator grows into the next free block and gives the tail back in place */
+	const size_t sizeHeap = 64 * 1024;
+	void* pHeapMemory = HeapAlloc(GetProcessHeap(), 0, sizeHeap);
+	assert(pHeapMemory);
+
+	const unsigned int policies[] = { POLICY_FIRST_FIT, POLICY_SEGREGATED_FIT | POLICY_COALESCE_ON_FREE };
+	for (unsigned int policy : policies)
+	{
+		DynamicAllocator* allocator = CreateDynamicAllocator(pHeapMemory, sizeHeap, policy);
+		void* ptr1 = allocator->Alloc(100);
+		void* ptr2 = allocator->Alloc(100);
+		void* ptr3 = allocator->Alloc(100);
+		FillPattern(ptr1, 100);
+
+		allocator->Free(ptr2);
+		if (!allocator->Expand(ptr1, 200) || allocator->GetAllocationSize(ptr1) < 200 || !CheckPattern(ptr1, 100))
+			return false;
+		if (allocator->Expand(ptr1, 1000) || allocator->GetAllocationSize(ptr1) >= 1000)
+			return false;
+
+		size_t freeMemory = allocator->GetTotalFreeMemory();
+		if (!allocator->Expand(ptr1, 32) || allocator->GetAllocationSize(ptr1) != 32 || allocator->GetTotalFreeMemory() <= freeMemory)
+			return false;
+
+		/* The block can not grow in place, so it is moved */
+		void* ptr4 = allocator->Realloc(ptr1, 2000);
+		if (ptr4 == nullptr || ptr4 == ptr1 || !CheckPattern(ptr4, 32) || allocator->IsAllocated(ptr1))
+			return false;
+		if (allocator->Realloc(ptr4, sizeHeap) != nullptr || !allocator->IsAllocated(ptr4))
+			return false;
+
+		/* Sizes that overflow when they are aligned are never reached in place */
+		size_t oldSize = allocator->GetAllocationSize(ptr4);
+		if (allocator->Expand(ptr4, SIZE_MAX) || allocator->Realloc(ptr4, SIZE_MAX - 8) != nullptr || allocator->GetAllocationSize(ptr4) != oldSize)
+			return false;
+
+		allocator->Free(ptr3);
+		allocator->Free(ptr4);
+		allocator->Collect();
+		if (allocator->GetTotalFreeMemory() != allocator->GetLargestFreeBlock())
+			return false;
+	}
+	HeapFree(GetProcessHeap(), 0, pHeapMemory);
+
+
+	/* Test 2: Blocks move across size classes and into the dynamic allocator with their data */
+	void* ptr = Realloc(nullptr, 10);
+	FillPattern(ptr, 10);
+	if (Realloc(ptr, 16) != ptr || !Expand(ptr, 16) || Expand(ptr, 17))
+		return false;
+
+	void* largerPtr = Realloc(ptr, 80);
+	if (largerPtr == ptr || !CheckPattern(largerPtr, 10))
+		return false;
+	FillPattern(largerPtr, 80);
+
+	void* dynamicPtr = Realloc(largerPtr, 500);
+	if (dynamicPtr == largerPtr || !CheckPattern(dynamicPtr, 80) || !arenaPtrs[0]->dynamicAllocator->IsAllocated(dynamicPtr))
+		return false;
+	FillPattern(dynamicPtr, 500);
+
+	/* Growing a vector-like buffer repeatedly mostly stays in place */
+	size_t moveNum = 0;
+	for (size_t size = 600; size <= 6000; size += 100)
+	{
+		void* grownPtr = Realloc(dynamicPtr, size);
+		if (grownPtr == nullptr || !CheckPattern(grownPtr, 500))
+			return false;
+		if (grownPtr != dynamicPtr)
+			moveNum++;
+		dynamicPtr = grownPtr;
+	}
+	if (moveNum > 1)
+	{
+		printf("Realloc: Buffer is moved %zu times. \n", moveNum);
+		return false;
+	}
+
+	if (Realloc(dynamicPtr, 0) != nullptr || arenaPtrs[0]->dynamicAllocator->IsAllocated(dynamicPtr))
+		return false;
+	return true;
+}
+
+
+static bool IsFilledWith(const void* ptr, size_t size, uint8_t value)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		if (static_cast<const uint8_t*>(ptr)[i] != value)
+			return false;
+	}
+	return true;
+}
+
+
+/**
+* @brief Calloc() of the dynamic allocator, in the given memory space. The caller owns the memory.
+*/
+static bool DynamicCalloc_UnitTest(void* pHeapMemory, size_t sizeHeap)
+{
+	/* Test 1: Without POLICY_ZEROED_MEMORY, Calloc() always clears the memory */
+	memset(pHeapMemory, 0xAA, sizeHeap);
+	DynamicAllocator* allocator = CreateDynamicAllocator(pHeapMemory, sizeHeap, POLICY_SEGREGATED_FIT);
+	void* ptr = allocator->Calloc(100, 10);
+	if (ptr == nullptr || !IsFilledWith(ptr, 1000, 0) || allocator->zeroBeginAddr != allocator->blockEndAddr)
+		return false;
+	if (allocator->Calloc(SIZE_MAX / 2, 4) != nullptr)
+		return false;
+	allocator->Free(ptr);
+
+
+	/* Test 2: Memory that has never been handed out is not cleared. The memory space is not really
+	 * zero here, which shows that Calloc() trusts the policy and skips memset() */
+	const unsigned int policies[] = { POLICY_FIRST_FIT | POLICY_ZEROED_MEMORY, POLICY_SEGREGATED_FIT | POLICY_COALESCE_ON_FREE | POLICY_ZEROED_MEMORY };
+	for (unsigned int policy : policies)
+	{
+		memset(pHeapMemory, 0xAA, sizeHeap);
+		allocator = CreateDynamicAllocator(pHeapMemory, sizeHeap, policy);
+		void* ptr1 = allocator->Calloc(1, 1000);
+		void* ptr2 = allocator->Calloc(1, 1000);
+		if (!IsFilledWith(ptr1, 1000, 0xAA) || !IsFilledWith(ptr2, 1000, 0xAA))
+			return false;
+		if (allocator->zeroBeginAddr <= PointerAdd(ptr2, 1000))
+			return false;
+
+		/* A block that reuses memory is only cleared below "zeroBeginAddr". After the blocks are
+		 * freed and merged, there is only one free block, so the next block starts at "ptr1" */
+		allocator->Free(ptr1);
+		allocator->Free(ptr2);
+		allocator->Collect();
+		void* zeroBeginAddr = allocator->zeroBeginAddr;
+		void* ptr3 = allocator->Calloc(1, 3000);
+		if (ptr3 != ptr1 || PointerAdd(ptr3, 3000) <= zeroBeginAddr)
+			return false;
+		size_t dirtySize = reinterpret_cast<uintptr_t>(PointerSub(zeroBeginAddr, ptr3));
+		if (!IsFilledWith(ptr3, dirtySize, 0) || !IsFilledWith(zeroBeginAddr, 3000 - dirtySize, 0xAA))
+			return false;
+		allocator->Free(ptr3);
+	}
+	return true;
+}
+
+
+bool Calloc_UnitTest()
+{
+	const size_t sizeHeap = 64 * 1024;
+	void* pHeapMemory = HeapAlloc(GetProcessHeap(), 0, sizeHeap);
+	assert(pHeapMemory);
+	bool success = DynamicCalloc_UnitTest(pHeapMemory, sizeHeap);
+	HeapFree(GetProcessHeap(), 0, pHeapMemory);
+	if (!success)
+		return false;
+
+
+	/* Test 3: Global Calloc() clears blocks of fix size allocators and the dynamic allocator. Every
+	 * block is freed before the test returns, so the memory system reports no leak */
+	const size_t sizes[] = { 1, 16, 90, 500, 5000 };
+	for (size_t size : sizes)
+	{
+		void* dirtyPtr = Alloc(size);
+		memset(dirtyPtr, 0xFF, size);
+		Free(dirtyPtr);
+
+		void* zeroPtr = Calloc(size, 1);
+		bool zeroed = zeroPtr != nullptr && IsFilledWith(zeroPtr, size, 0);
+		Free(zeroPtr);
+		if (!zeroed)
+			return false;
+	}
+
+	void* overflowPtr = Calloc(SIZE_MAX / 8, 16);
+	void* emptyPtr = Calloc(0, 16);
+	Free(overflowPtr);
+	Free(emptyPtr);
+	return overflowPtr == nullptr && emptyPtr != nullptr;
+}
+
+
+bool BatchAlloc_UnitTest()
+{
+	const size_t sizeHeap = 256 * 1024;
+	const size_t blockNum = 1000;
+	const size_t blockSize = 16;
+	void* pHeapMemory = HeapAlloc(GetProcessHeap(), 0, sizeHeap);
+	assert(pHeapMemory);
+
+
+	/* Test 1: Batches of fix size allocator, with and without atomic operations */
+	for (int atomic = 0; atomic < 2; atomic++)
+	{
+		FixSizeAllocator* allocator = CreateFixSizeAllocator(pHeapMemory, blockNum, blockSize, sizeHeap);
+		void* singlePtr = allocator->Alloc();
+
+		void* ptrs[blockNum];
+		size_t allocNum = atomic ? allocator->AtomicAllocBatch(300, ptrs) : allocator->AllocBatch(300, ptrs);
+		if (allocNum != 300 || allocator->freeBlockNum != blockNum - 301)
+			return false;
+		for (size_t i = 0; i < allocNum; i++)
+		{
+			if (!allocator->IsAllocated(ptrs[i]) || ptrs[i] == singlePtr)
+				return false;
+			for (size_t j = 0; j < i; j++)
+			{
+				if (ptrs[i] == ptrs[j])
+					return false;
+			}
+		}
+
+		/* The rest of the allocator, then nothing */
+		size_t restNum = atomic ? allocator->AtomicAllocBatch(blockNum, ptrs + allocNum) : allocator->AllocBatch(blockNum, ptrs + allocNum);
+		if (restNum != blockNum - 301 || allocator->Alloc() != nullptr || allocator->AllocBatch(1, ptrs) != 0)
+			return false;
+		allocNum += restNum;
+
+		/* Invalid addresses and double frees are skipped */
+		void* invalidPtrs[] = { ptrs[5], PointerAdd(ptrs[6], 1), ptrs[5], pHeapMemory };
+		if (allocator->FreeBatch(invalidPtrs, 4) != 1)
+			return false;
+		ptrs[5] = allocator->Alloc();
+
+		size_t freeNum = atomic ? allocator->AtomicFreeBatch(ptrs, allocNum) : allocator->FreeBatch(ptrs, allocNum);
+		if (freeNum != allocNum || !allocator->Free(singlePtr) || !allocator->bitArray.AreAllBitsSet() || allocator->freeBlockNum != blockNum)
+			return false;
+
+		/* Summaries are still right for single allocations */
+		if (allocator->Alloc() != allocator->blockBaseAddr)
+			return false;
+	}
+
+
+	/* Test 2: Free list policy */
+	FixSizeAllocator* listAllocator = CreateFixSizeAllocator(pHeapMemory, blockNum, blockSize, sizeHeap, FIX_SIZE_POLICY_FREE_LIST);
+	void* listPtrs[100];
+	if (listAllocator->AllocBatch(100, listPtrs) != 100 || listAllocator->FreeBatch(listPtrs, 100) != 100 || listAllocator->freeBlockNum != blockNum)
+		return false;
+	HeapFree(GetProcessHeap(), 0, pHeapMemory);
+
+
+	/* Test 3: Global batches of small and large sizes */
+	FlushThreadCache();
+	size_t initFreeBlockNums[ARENA_MAX_FIX_SIZE_ALLOCATOR_NUM];
+	for (int i = 0; i < fixSizeAllocatorNum; i++)
+		initFreeBlockNums[i] = arenaPtrs[0]->fixSizeAllocatorPtrs[i]->freeBlockNum;
+
+	const size_t sizes[] = { 24, 2000 };
+	for (size_t size : sizes)
+	{
+		void* ptrs[64];
+		if (AllocBatch(size, 64, ptrs) != 64)
+			return false;
+		for (size_t i = 0; i < 64; i++)
+			memset(ptrs[i], static_cast<int>(i), size);
+		for (size_t i = 0; i < 64; i++)
+		{
+			if (!IsFilledWith(ptrs[i], size, static_cast<uint8_t>(i)))
+				return false;
+		}
+		FreeBatch(ptrs, 64);
+	}
+
+	FlushThreadCache();
+	for (int i = 0; i < fixSizeAllocatorNum; i++)
+	{
+		if (arenaPtrs[0]->fixSizeAllocatorPtrs[i]->freeBlockNum != initFreeBlockNums[i])
+			return false;
+	}
+	return true;
+}
+
+
+bool ThreadCache_UnitTest()
+{
+	FixSizeAllocator* allocator = arenaPtrs[0]->fixSizeAllocatorPtrs[0];
+	const size_t blockSize = fixSizeAllocatorDatas[0].blockSize;
+	FlushThreadCache();
+	const size_t initFreeBlockNum = allocator->freeBlockNum;
+
+
+	/* Test 1: A freed block is reused by the next allocation of the same thread */
+	void* ptr1 = Alloc(blockSize);
+	Free(ptr1);
+	void* ptr2 = Alloc(blockSize);
+	if (ptr1 != ptr2)
+	{
+		printf("ThreadCache: Freed block is not reused. %p %p \n", ptr1, ptr2);
+		return false;
+	}
+	Free(ptr2);
+
+
+	/* Test 2: Refill and flush in batches, every block is returned after FlushThreadCache() */
+	const size_t allocNum = 80;
+	void* ptrs[allocNum];
+	for (size_t i = 0; i < allocNum; i++)
+	{
+		ptrs[i] = Alloc(blockSize);
+		if (!allocator->Contains(ptrs[i]) || !allocator->IsAllocated(ptrs[i]))
+		{
+			printf("ThreadCache: Block %zu is not allocated from fix size allocator. \n", i);
+			return false;
+		}
+		for (size_t j = 0; j < i; j++)
+		{
+			if (ptrs[j] == ptrs[i])
+			{
+				printf("ThreadCache: Block %p is allocated twice. \n", ptrs[i]);
+				return false;
+			}
+		}
+	}
+	for (size_t i = 0; i < allocNum; i++)
+		Free(ptrs[i]);
+
+	FlushThreadCache();
+	if (allocator->freeBlockNum != initFreeBlockNum)
+	{
+		printf("ThreadCache: %zu blocks are not returned after flush. \n", initFreeBlockNum - allocator->freeBlockNum);
+		return false;
+	}
+
+
+	/* Test 3: Thread caches are disabled when the depth is 0 */
+	const size_t depth = threadCacheDepth;
+	SetThreadCacheDepth(0);
+	ptr1 = Alloc(blockSize);
+	Free(ptr1);
+	if (allocator->freeBlockNum != initFreeBlockNum)
+	{
+		printf("ThreadCache: Block is cached when thread cache is disabled. \n");
+		return false;
+	}
+	SetThreadCacheDepth(depth);
+
+
+	/* Test 4: Threads allocate and free concurrently, their caches are flushed when they exit */
+	const int threadNum = 4;
+	bool threadSuccess[threadNum];
+	std::vector<std::thread> threads;
+	threads.reserve(threadNum);
+	for (int t = 0; t < threadNum; t++)
+	{
+		threadSuccess[t] = true;
+		threads.emplace_back([t, blockSize, &threadSuccess]()
+			{
+				const size_t slotNum = 32;
+				unsigned char* slots[slotNum] = { nullptr };
+				for (size_t i = 0; i < 20000; i++)
+				{
+					size_t slot = (i * 7 + t) % slotNum;
+					if (slots[slot] != nullptr)
+					{
+						for (size_t j = 0; j < blockSize; j++)
+						{
+							if (slots[slot][j] != static_cast<unsigned char>(t + slot))
+								threadSuccess[t] = false;
+						}
+						Free(slots[slot]);
+						slots[slot] = nullptr;
+					}
+					else
+					{
+						slots[slot] = static_cast<unsigned char*>(Alloc(1 + (i % blockSize)));
+						if (slots[slot] != nullptr)
+							memset(slots[slot], static_cast<int>(t + slot), blockSize);
+					}
+				}
+				for (size_t i = 0; i < slotNum; i++)
+					Free(slots[i]);
+			});
+	}
+	for (int t = 0; t < threadNum; t++)
+	{
+		threads[t].join();
+		if (!threadSuccess[t])
+		{
+			printf("ThreadCache: Block of thread %d is overwritten by another thread. \n", t);
+			return false;
+		}
+	}
+	if (allocator->freeBlockNum != initFreeBlockNum)
+	{
+		printf("ThreadCache: %zu blocks are not returned after threads exit. \n", initFreeBlockNum - allocator->freeBlockNum);
+		return false;
+	}
+
+	return true;
+}
+
+
+bool Arena_UnitTest()
+{
+	const size_t 		sizeHeap = 4 * 1024 * 1024;
+	const unsigned int 	testArenaNum = 4;
+
+	void* pHeapMemory = HeapAlloc(GetProcessHeap(), 0, sizeHeap);
+	assert(pHeapMemory);
+	if (!InitializeMemoryAllocator(pHeapMemory, sizeHeap, testArenaNum, ARENA_ASSIGN_ROUND_ROBIN))
+		return false;
+
+
+	/* Test 1: Arenas are independent slices of the heap, each starts on its own cache line */
+	if (arenaNum != testArenaNum)
+		return false;
+	size_t largestFreeBlocks[testArenaNum];
+	for (unsigned int i = 0; i < arenaNum; i++)
+	{
+		Arena* arena = arenaPtrs[i];
+		if (arena == nullptr || reinterpret_cast<uintptr_t>(arena) % ARENA_ALIGNMENT != 0 || arena->dynamicAllocator == nullptr)
+			return false;
+		if (i > 0 && arena->baseAddr != arenaPtrs[i - 1]->endAddr)
+			return false;
+		largestFreeBlocks[i] = arena->dynamicAllocator->GetLargestFreeBlock();
+	}
+
+
+	/* Containers of the tests below are allocated from the memory system, release them before it
+	 * is destroyed */
+	{
+		/* Test 2: Threads are assigned to arenas round-robin, and allocate from their own arenas */
+		unsigned int threadArenas[testArenaNum];
+		bool threadSuccess[testArenaNum];
+		std::vector<std::thread> threads;
+		threads.reserve(testArenaNum);
+		for (unsigned int t = 0; t < testArenaNum; t++)
+		{
+			threadSuccess[t] = true;
+			threads.emplace_back([t, &threadArenas, &threadSuccess]()
+				{
+					void* smallPtr = Alloc(16);
+					void* largePtr = Alloc(1000);
+					threadArenas[t] = testArenaNum;
+					for (unsigned int i = 0; i < arenaNum; i++)
+					{
+						if (arenaPtrs[i]->Contains(smallPtr))
+							threadArenas[t] = i;
+					}
+					if (threadArenas[t] == testArenaNum || !arenaPtrs[threadArenas[t]]->Contains(largePtr))
+						threadSuccess[t] = false;
+					Free(smallPtr);
+					Free(largePtr);
+				});
+		}
+		for (unsigned int t = 0; t < testArenaNum; t++)
+		{
+			threads[t].join();
+			if (!threadSuccess[t])
+				return false;
+			for (unsigned int i = 0; i < t; i++)
+			{
+				if (threadArenas[i] == threadArenas[t])
+				{
+					printf("Arena: Thread %u and thread %u share arena %u. \n", i, t, threadArenas[t]);
+					return false;
+				}
+			}
+		}
+
+
+		/* Test 3: When the arena of a thread runs dry, memory is borrowed from the other arenas */
+		const size_t allocSize = 4000;
+		const size_t maxAllocNum = sizeHeap / allocSize;
+		std::vector<void*> ptrs;
+		ptrs.reserve(maxAllocNum);
+		bool usedArenas[testArenaNum] = { false };
+		for (size_t i = 0; i < maxAllocNum; i++)
+		{
+			void* ptr = Alloc(allocSize);
+			if (ptr == nullptr)
+				break;
+			ptrs.push_back(ptr);
+			for (unsigned int j = 0; j < arenaNum; j++)
+			{
+				if (arenaPtrs[j]->Contains(ptr))
+					usedArenas[j] = true;
+			}
+		}
+		for (unsigned int j = 0; j < arenaNum; j++)
+		{
+			if (!usedArenas[j])
+			{
+				printf("Arena: Nothing is borrowed from arena %u. \n", j);
+				return false;
+			}
+		}
+		for (void* ptr : ptrs)
+			Free(ptr);
+
+
+		/* Test 4: Memory blocks freed by a thread of another arena go back through the remote free
+		 * list of their arena, and are drained by the next allocation of the arena */
+		const size_t remoteNum = ARENA_REMOTE_FREE_BATCH * 2;
+		void* remotePtrs[remoteNum];
+		for (size_t i = 0; i < remoteNum; i++)
+			remotePtrs[i] = Alloc(i % 2 == 0 ? 16 : 2000);
+
+		unsigned int homeArenaIdx = 0;
+		for (unsigned int i = 0; i < arenaNum; i++)
+		{
+			if (arenaPtrs[i]->Contains(remotePtrs[0]))
+				homeArenaIdx = i;
+		}
+		for (size_t i = 0; i < remoteNum; i++)
+		{
+			if (!arenaPtrs[homeArenaIdx]->Contains(remotePtrs[i]))
+				return false;
+		}
+
+		bool consumerIsRemote = false;
+		std::thread consumer([&remotePtrs, &consumerIsRemote, homeArenaIdx]()
+			{
+				void* ptr = Alloc(16);
+				consumerIsRemote = !arenaPtrs[homeArenaIdx]->Contains(ptr);
+				Free(ptr);
+				for (size_t i = 0; i < remoteNum; i++)
+					Free(remotePtrs[i]);
+			});
+		consumer.join();
+		if (consumerIsRemote && !arenaPtrs[homeArenaIdx]->HasRemoteFree())
+		{
+			printf("Arena: Blocks freed by another thread are not in the remote free list. \n");
+			return false;
+		}
+
+		Free(Alloc(16));
+		if (arenaPtrs[homeArenaIdx]->HasRemoteFree())
+		{
+			printf("Arena: Remote free list is not drained by the owner. \n");
+			return false;
+		}
+
+
+		/* Test 5: A thread fills its arena and exits. Once its blocks are freed by this thread, they
+		 * can be borrowed again, although no thread of that arena drains its remote free list */
+		const size_t fillSize = 1000;
+		unsigned int fillArenaIdx = homeArenaIdx;
+		std::vector<void*> fillPtrs;
+		fillPtrs.reserve(sizeHeap / fillSize);
+		for (unsigned int t = 0; t < testArenaNum && fillArenaIdx == homeArenaIdx; t++)
+		{
+			std::thread filler([&fillPtrs, &fillArenaIdx, homeArenaIdx, fillSize]()
+				{
+					void* ptr = Alloc(fillSize);
+					for (unsigned int i = 0; i < arenaNum; i++)
+					{
+						if (arenaPtrs[i]->Contains(ptr))
+							fillArenaIdx = i;
+					}
+					if (fillArenaIdx == homeArenaIdx)
+					{
+						Free(ptr);
+						return;
+					}
+					while (ptr != nullptr && arenaPtrs[fillArenaIdx]->Contains(ptr))
+					{
+						fillPtrs.push_back(ptr);
+						ptr = Alloc(fillSize);
+					}
+					Free(ptr);
+				});
+			filler.join();
+		}
+		if (fillArenaIdx == homeArenaIdx || fillPtrs.empty())
+			return false;
+
+		/* The vector is reserved before the arenas are full, so it does not take their memory */
+		ptrs.clear();
+		ptrs.reserve(sizeHeap / fillSize);
+		for (void* ptr : fillPtrs)
+			Free(ptr);
+		size_t borrowedNum = 0;
+		for (void* ptr = Alloc(fillSize); ptr != nullptr; ptr = Alloc(fillSize))
+		{
+			ptrs.push_back(ptr);
+			if (arenaPtrs[fillArenaIdx]->Contains(ptr))
+				borrowedNum++;
+		}
+		for (void* ptr : ptrs)
+			Free(ptr);
+		if (borrowedNum < fillPtrs.size())
+		{
+			printf("Arena: Only %zu of %zu blocks freed into arena %u are borrowed again. \n", borrowedNum, fillPtrs.size(), fillArenaIdx);
+			return false;
+		}
+	}
+
+
+	/* Test 6: Every block is returned to the arena it came from */
+	FlushThreadCache();
+	Collect();
+	for (unsigned int i = 0; i < arenaNum; i++)
+	{
+		if (arenaPtrs[i]->dynamicAllocator->GetLargestFreeBlock() != largestFreeBlocks[i])
+		{
+			printf("Arena: Memory of arena %u is not returned. \n", i);
+			return false;
+		}
+	}
+
+	DestroyMemoryAllocator();
+	HeapFree(GetProcessHeap(), 0, pHeapMemory);
+	return true;
+}
+
+
+bool GrowableHeap_UnitTest()
+{
+	const size_t		reserveSize = 16 * 1024 * 1024;
+	const size_t		initialSize = 128 * 1024;
+	const unsigned int	testArenaNum = 2;
+
+	if (!InitializeGrowableMemoryAllocator(reserveSize, initialSize, testArenaNum))
+		return false;
+
+
+	/* Test 1: Only the first slab of each size class and a part of the dynamic allocator are in use */
+	if (arenaNum != testArenaNum)
+		return false;
+	for (unsigned int i = 0; i < arenaNum; i++)
+	{
+		Arena* arena = arenaPtrs[i];
+		if (arena == nullptr || arena->dynamicAllocator == nullptr || arena->dynamicAllocator->heapSize > initialSize / testArenaNum)
+			return false;
+		for (int j = 0; j < fixSizeAllocatorNum; j++)
+		{
+			FixSizeAllocator* allocator = arena->fixSizeAllocatorPtrs[j];
+			if (allocator == nullptr || allocator->blockNum != fixSizeAllocatorDatas[j].blockNum || 
+				allocator->maxBlockNum != fixSizeAllocatorDatas[j].blockNum * ARENA_MAX_SLAB_NUM)
+				return false;
+		}
+	}
+
+
+	/* Test 2: A full size class takes another slab instead of moving on to the larger classes */
+	const size_t smallNum = DefaultMemorySystemConfig::sizeClasses[0].blockNum * 3 + 1;
+	void* smallPtrs[smallNum];
+	for (size_t i = 0; i < smallNum; i++)
+	{
+		void* ptr = Alloc(fixSizeAllocatorDatas[0].blockSize);
+		if (ptr == nullptr)
+			return false;
+
+		int arenaIdx = static_cast<int>(reinterpret_cast<uintptr_t>(PointerSub(ptr, arenaPtrs[0])) / reinterpret_cast<uintptr_t>(PointerSub(arenaPtrs[0]->endAddr, arenaPtrs[0])));
+		if (arenaIdx >= static_cast<int>(arenaNum) || arenaPtrs[arenaIdx]->FindFixSizeAllocator(ptr) != 0)
+		{
+			printf("GrowableHeap: Block %zu is not served by the smallest size class. \n", i);
+			return false;
+		}
+		memset(ptr, 0xAB, fixSizeAllocatorDatas[0].blockSize);
+		smallPtrs[i] = ptr;
+	}
+	size_t smallBlockNum = 0;
+	for (unsigned int i = 0; i < arenaNum; i++)
+		smallBlockNum += arenaPtrs[i]->fixSizeAllocatorPtrs[0]->blockNum;
+	if (smallBlockNum <= fixSizeAllocatorDatas[0].blockNum * arenaNum)
+		return false;
+
+
+	/* Test 3: The dynamic allocator grows for requests that do not fit, and the new memory is zero */
+	const size_t largeSize = 2 * 1024 * 1024;
+	void* largePtr = Alloc(largeSize);
+	void* zeroPtr = Calloc(1024, 1024);
+	if (largePtr == nullptr || zeroPtr == nullptr || !IsFilledWith(zeroPtr, 1024 * 1024, 0))
+		return false;
+	memset(largePtr, 0xCD, largeSize);
+	memset(zeroPtr, 0xEF, 1024 * 1024);
+
+	/* The segregated fit rounds a request up to the next list, and the heap grows for that too */
+	const size_t growSizes[] = { 300000, 500000, 700000 };
+	void* growPtrs[sizeof(growSizes) / sizeof(size_t)];
+	for (size_t i = 0; i < sizeof(growSizes) / sizeof(size_t); i++)
+	{
+		growPtrs[i] = Alloc(growSizes[i]);
+		if (growPtrs[i] == nullptr)
+		{
+			printf("GrowableHeap: The heap does not grow for %zu bytes. \n", growSizes[i]);
+			return false;
+		}
+	}
+	for (size_t i = 0; i < sizeof(growSizes) / sizeof(size_t); i++)
+		Free(growPtrs[i]);
+
+
+	/* Test 4: The heap does not grow beyond the reserved address space */
+	if (Alloc(reserveSize / testArenaNum) != nullptr)
+		return false;
+
+
+	/* Test 5: Threads that fill a size class at the same time grow it once per slab they need */
+	const unsigned int threadNum = 4;
+	const size_t threadBlockNum = 500;
+	std::thread threads[threadNum];
+	bool threadSuccess[threadNum];
+	for (unsigned int t = 0; t < threadNum; t++)
+	{
+		threads[t] = std::thread([&threadSuccess, t, threadBlockNum]()
+		{
+			void* ptrs[threadBlockNum];
+			threadSuccess[t] = true;
+			for (size_t i = 0; i < threadBlockNum; i++)
+			{
+				ptrs[i] = Alloc(fixSizeAllocatorDatas[0].blockSize);
+				if (ptrs[i] == nullptr)
+					threadSuccess[t] = false;
+				else
+					memset(ptrs[i], static_cast<int>(t), fixSizeAllocatorDatas[0].blockSize);
+			}
+			for (size_t i = 0; i < threadBlockNum; i++)
+			{
+				if (ptrs[i] != nullptr && !IsFilledWith(ptrs[i], fixSizeAllocatorDatas[0].blockSize, static_cast<uint8_t>(t)))
+					threadSuccess[t] = false;
+				Free(ptrs[i]);
+			}
+		});
+	}
+	for (unsigned int t = 0; t < threadNum; t++)
+	{
+		threads[t].join();
+		if (!threadSuccess[t])
+			return false;
+	}
+
+	for (size_t i = 0; i < smallNum; i++)
+		Free(smallPtrs[i]);
+	Free(largePtr);
+	Free(zeroPtr);
+	FlushThreadCache();
+	Collect();
+	for (unsigned int i = 0; i < arenaNum; i++)
+	{
+		if (arenaPtrs[i]->fixSizeAllocatorPtrs[0]->freeBlockNum != arenaPtrs[i]->fixSizeAllocatorPtrs[0]->blockNum)
+			return false;
+	}
+
+	DestroyMemoryAllocator();
+	return true;
+}
+
+
+bool Trim_UnitTest()
+{
+	const size_t smallSize = 64 * 1024;
+	const size_t largeSize = 2 * 1024 * 1024;
+
+	SetTrimThreshold(0);
+	if (!InitializeGrowableMemoryAllocator(16 * 1024 * 1024, 128 * 1024))
+		return false;
+
+	DynamicAllocator* allocator = arenaPtrs[0]->dynamicAllocator;
+	if (allocator == nullptr || !(allocator->policy & POLICY_TRIMMABLE) || allocator->trimThreshold != 0)
+		return false;
+
+
+	/* Test 1: The pages of a free block are given back once, and the blocks around it keep their data */
+	void* ptrA = Alloc(smallSize);
+	void* ptrB = Alloc(largeSize);
+	void* ptrC = Alloc(smallSize);
+	if (ptrA == nullptr || ptrB == nullptr || ptrC == nullptr)
+		return false;
+	memset(ptrA, 0x11, smallSize);
+	memset(ptrB, 0x22, largeSize);
+	memset(ptrC, 0x33, smallSize);
+
+	Free(ptrB);
+	size_t trimmedSize = Trim();
+	if (trimmedSize < largeSize - 2 * GetVirtualPageSize() || trimmedSize > largeSize)
+	{
+		printf("Trim: %zu bytes are trimmed from a free block of %zu bytes. \n", trimmedSize, largeSize);
+		return false;
+	}
+	if (Trim() != 0)
+		return false;
+	if (!IsFilledWith(ptrA, smallSize, 0x11) || !IsFilledWith(ptrC, smallSize, 0x33))
+		return false;
+
+
+	/* Test 2: Large blocks are trimmed as soon as they are freed once the threshold is set, and trimmed 
+	 * pages can be allocated again */
+	SetTrimThreshold(1024 * 1024);
+	if (allocator->trimThreshold != 1024 * 1024)
+		return false;
+	ptrB = Alloc(largeSize);
+	if (ptrB == nullptr)
+		return false;
+	memset(ptrB, 0x44, largeSize);
+	Free(ptrB);
+	if (Trim() != 0)
+		return false;
+	if (!IsFilledWith(ptrA, smallSize, 0x11) || !IsFilledWith(ptrC, smallSize, 0x33))
+		return false;
+
+
+	/* Test 3: Trimming the last block lowers the memory known to be zero, so Calloc of the trimmed
+	 * pages is not cleared again but still reads as zero */
+	Free(ptrA);
+	Free(ptrC);
+	Trim();
+	if (allocator->zeroBeginAddr >= ptrC)
+		return false;
+	void* zeroPtr = Calloc(1024, 1024);
+	if (zeroPtr == nullptr || !IsFilledWith(zeroPtr, 1024 * 1024, 0))
+		return false;
+	Free(zeroPtr);
+
+	DestroyMemoryAllocator();
+	SetTrimThreshold(TRIM_DEFAULT_THRESHOLD);
+	return true;
+}
+
+
+bool HugePage_UnitTest()
+{
+	const size_t hugePageSize = GetHugePageSize();
+	const unsigned int testArenaNum = 2;
+	const unsigned int pagePolicies[] = {
+		ARENA_PAGE_HUGE | ARENA_PAGE_PREFAULT,
+		ARENA_PAGE_HUGETLB | ARENA_PAGE_HUGE | ARENA_PAGE_LOCK,
+		ARENA_PAGE_PREFAULT | ARENA_PAGE_LOCK,
+	};
+
+	if (hugePageSize == 0 || (hugePageSize & (hugePageSize - 1)) != 0 || hugePageSize % GetVirtualPageSize() != 0)
+		return false;
+
+	for (unsigned int pagePolicy : pagePolicies)
+	{
+		if (!InitializeGrowableMemoryAllocator(16 * hugePageSize, 256 * 1024, testArenaNum, ARENA_ASSIGN_ROUND_ROBIN, pagePolicy))
+			return false;
+
+		/* Test 1: Arenas are whole huge pages, and the first slab of each class is in one huge page.
+		 * Explicit huge pages fall back to transparent ones when the OS has none */
+		for (unsigned int i = 0; i < arenaNum; i++)
+		{
+			Arena* arena = arenaPtrs[i];
+			if (arena == nullptr || arena->dynamicAllocator == nullptr)
+				return false;
+			if ((pagePolicy & ARENA_PAGE_HUGETLB) && arena->pagePolicy != pagePolicy && arena->pagePolicy != (pagePolicy & ~ARENA_PAGE_HUGETLB))
+				return false;
+			if (!(pagePolicy & ARENA_PAGE_HUGETLB) && arena->pagePolicy != pagePolicy)
+				return false;
+			if (!(arena->pagePolicy & ARENA_PAGE_HUGE))
+				continue;
+
+			if (reinterpret_cast<uintptr_t>(arena->baseAddr) % hugePageSize != 0 || reinterpret_cast<uintptr_t>(PointerSub(arena->endAddr, arena->baseAddr)) % hugePageSize != 0)
+				return false;
+			for (int j = 0; j < arena->fixSizeAllocatorNum; j++)
+			{
+				FixSizeAllocator* allocator = arena->fixSizeAllocatorPtrs[j];
+				uintptr_t slabBeginAddr = reinterpret_cast<uintptr_t>(allocator->blockBaseAddr);
+				uintptr_t slabEndAddr = slabBeginAddr + allocator->blockSize * fixSizeAllocatorDatas[j].blockNum - 1;
+				if (slabBeginAddr / hugePageSize != slabEndAddr / hugePageSize)
+				{
+					printf("HugePage: The first slab of class %d crosses a huge page. \n", j);
+					return false;
+				}
+			}
+		}
+
+		/* Test 2: Locked memory and explicit huge pages are never trimmed */
+		bool trimmable = !(arenaPtrs[0]->pagePolicy & (ARENA_PAGE_LOCK | ARENA_PAGE_HUGETLB));
+		if (((arenaPtrs[0]->dynamicAllocator->policy & POLICY_TRIMMABLE) != 0) != trimmable)
+			return false;
+
+		/* Test 3: Fix size classes and the dynamic allocator grow by huge pages, and keep their data */
+		const size_t smallNum = DefaultMemorySystemConfig::sizeClasses[0].blockNum * 3;
+		void* smallPtrs[smallNum];
+		for (size_t i = 0; i < smallNum; i++)
+		{
+			smallPtrs[i] = Alloc(fixSizeAllocatorDatas[0].blockSize);
+			if (smallPtrs[i] == nullptr)
+				return false;
+			memset(smallPtrs[i], 0x5A, fixSizeAllocatorDatas[0].blockSize);
+		}
+		void* largePtr = Alloc(3 * hugePageSize);
+		void* zeroPtr = Calloc(hugePageSize, 1);
+		if (largePtr == nullptr || zeroPtr == nullptr || !IsFilledWith(zeroPtr, hugePageSize, 0))
+			return false;
+		memset(largePtr, 0xA5, 3 * hugePageSize);
+		for (size_t i = 0; i < smallNum; i++)
+		{
+			if (!IsFilledWith(smallPtrs[i], fixSizeAllocatorDatas[0].blockSize, 0x5A))
+				return false;
+			Free(smallPtrs[i]);
+		}
+		if (!IsFilledWith(largePtr, 3 * hugePageSize, 0xA5))
+			return false;
+		Free(largePtr);
+		Free(zeroPtr);
+		if (!trimmable && Trim() != 0)
+			return false;
+
+		DestroyMemoryAllocator();
+	}
+	return true;
+}
+
+
+/**
+* @brief Whether the given memory address is in any arena of the memory system.
+*/
+static bool IsInArenas(const void* ptr)
+{
+	for (unsigned int i = 0; i < arenaNum; i++)
+	{
+		if (arenaPtrs[i] != nullptr && ptr >= arenaPtrs[i]->baseAddr && ptr < arenaPtrs[i]->endAddr)
+			return true;
+	}
+	return false;
+}
+
+
+bool DirectMap_UnitTest()
+{
+	const size_t threshold = 1024 * 1024;
+	const size_t pageSize = GetVirtualPageSize();
+
+	SetDirectMapThreshold(threshold);
+	if (!InitializeGrowableMemoryAllocator(16 * 1024 * 1024, 256 * 1024))
+		return false;
+
+
+	/* Test 1: Large requests are mapped outside the heap, small ones still come from the arenas */
+	void* largePtr = Alloc(4 * threshold);
+	void* zeroPtr = Calloc(2 * threshold, 1);
+	void* alignedPtr = Alloc(3 * threshold, 64 * 1024);
+	void* smallPtr = Alloc(1000);
+	if (largePtr == nullptr || zeroPtr == nullptr || alignedPtr == nullptr || smallPtr == nullptr)
+		return false;
+	if (IsInArenas(largePtr) || IsInArenas(zeroPtr) || IsInArenas(alignedPtr) || !IsInArenas(smallPtr) || largeAllocator.blockNum != 3)
+		return false;
+	if (largeAllocator.GetSize(largePtr) != 4 * threshold || reinterpret_cast<uintptr_t>(largePtr) % pageSize != 0 || 
+		reinterpret_cast<uintptr_t>(alignedPtr) % (64 * 1024) != 0 || !IsFilledWith(zeroPtr, 2 * threshold, 0))
+		return false;
+	memset(largePtr, 0x3C, 4 * threshold);
+
+
+	/* Test 2: Realloc moves the pages of a mapped block and keeps its data, in both directions */
+	largePtr = Realloc(largePtr, 16 * threshold);
+	if (largePtr == nullptr || IsInArenas(largePtr) || largeAllocator.GetSize(largePtr) != 16 * threshold ||
+		!IsFilledWith(largePtr, 4 * threshold, 0x3C))
+		return false;
+	memset(largePtr, 0x3C, 16 * threshold);
+	largePtr = Realloc(largePtr, 2 * threshold + 1);
+	if (largePtr == nullptr || largeAllocator.GetSize(largePtr) != 2 * threshold + pageSize || !IsFilledWith(largePtr, 2 * threshold, 0x3C))
+		return false;
+	if (!Expand(largePtr, threshold) || largeAllocator.GetSize(largePtr) != threshold || !IsFilledWith(largePtr, threshold, 0x3C))
+		return false;
+
+	/* Requests too large to be mapped fail, instead of being tried again in the arenas */
+	if (Alloc(SIZE_MAX) != nullptr || Alloc(SIZE_MAX - pageSize, 64 * 1024) != nullptr || Calloc(1, SIZE_MAX - 1) != nullptr ||
+		Realloc(largePtr, SIZE_MAX) != nullptr || largeAllocator.GetSize(largePtr) != threshold || largeAllocator.blockNum != 3)
+		return false;
+
+	Free(largePtr);
+	Free(zeroPtr);
+	Free(alignedPtr);
+	Free(smallPtr);
+	if (largeAllocator.blockNum != 0)
+		return false;
+
+
+	/* Test 3: Requests beyond the capacity of the lookup table fall back to the heap, and every block
+	 * can still be found and freed */
+	const size_t blockNum = LARGE_ALLOCATOR_MAX_LOAD + 8;
+	const size_t blockSize = 64 * 1024;
+	static void* ptrs[blockNum];
+	SetDirectMapThreshold(blockSize);
+	for (size_t i = 0; i < blockNum; i++)
+	{
+		ptrs[i] = Alloc(blockSize);
+		if (ptrs[i] == nullptr || IsInArenas(ptrs[i]) != (i >= LARGE_ALLOCATOR_MAX_LOAD))
+			return false;
+		*static_cast<size_t*>(ptrs[i]) = i;
+	}
+	for (size_t i = 0; i < blockNum; i += 2)
+		Free(ptrs[i]);
+	for (size_t i = 1; i < blockNum; i += 2)
+	{
+		if (*static_cast<size_t*>(ptrs[i]) != i)
+			return false;
+		Free(ptrs[i]);
+	}
+	if (largeAllocator.blockNum != 0)
+		return false;
+
+
+	/* Test 4: Threads map and unmap blocks at the same time */
+	const unsigned int threadNum = 4;
+	std::thread threads[threadNum];
+	bool threadSuccess[threadNum];
+	for (unsigned int t = 0; t < threadNum; t++)
+	{
+		threads[t] = std::thread([&threadSuccess, t, blockSize, pageSize]()
+		{
+			threadSuccess[t] = true;
+			for (size_t i = 0; i < 100; i++)
+			{
+				void* ptr = Alloc(blockSize + i * pageSize);
+				if (ptr == nullptr || IsInArenas(ptr))
+				{
+					threadSuccess[t] = false;
+					break;
+				}
+				memset(ptr, static_cast<int>(t), blockSize);
+				ptr = Realloc(ptr, 2 * blockSize);
+				if (ptr == nullptr || !IsFilledWith(ptr, blockSize, static_cast<uint8_t>(t)))
+					threadSuccess[t] = false;
+				Free(ptr);
+			}
+		});
+	}
+	for (unsigned int t = 0; t < threadNum; t++)
+	{
+		threads[t].join();
+		if (!threadSuccess[t])
+			return false;
+	}
+
+
+	/* Test 5: Without a threshold, large requests come from the heap again */
+	SetDirectMapThreshold(0);
+	largePtr = Alloc(4 * threshold);
+	if (largePtr == nullptr || !IsInArenas(largePtr) || largeAllocator.blockNum != 0)
+		return false;
+	Free(largePtr);
+
+	DestroyMemoryAllocator();
+	return true;
+}
+
+
+bool Stats_UnitTest()
+{
+	if (!InitializeGrowableMemoryAllocator(16 * 1024 * 1024, 256 * 1024))
+		return false;
+
+	AllocatorStats stats;
+	if (!GetAllocatorStats(stats) || stats.sizeClassNum != static_cast<size_t>(fixSizeAllocatorNum) || stats.liveSize != 0 || 
+		stats.sizeClasses[0].allocCount != 0 || stats.dynamicAllocCount != 0 || stats.fallThroughCount != 0)
+		return false;
+
+
+	/* Test 1: Allocations and frees are counted per size class, along with the high-water mark */
+	void* smallPtrs[10];
+	void* mediumPtrs[5];
+	for (size_t i = 0; i < 10; i++)
+		smallPtrs[i] = Alloc(16);
+	for (size_t i = 0; i < 5; i++)
+		mediumPtrs[i] = Alloc(80);
+	for (size_t i = 0; i < 4; i++)
+		Free(smallPtrs[i]);
+
+	const SizeClassStats& smallStats = stats.sizeClasses[0];
+	const SizeClassStats& mediumStats = stats.sizeClasses[2];
+	if (!GetAllocatorStats(stats) || smallStats.blockSize != 16 || smallStats.allocCount != 10 || smallStats.freeCount != 4 ||
+		smallStats.liveBlockNum != 6 || smallStats.maxLiveBlockNum != 10 || mediumStats.liveBlockNum != 5 || 
+		smallStats.blockNum < smallStats.freeBlockNum + smallStats.liveBlockNum)
+		return false;
+	if (stats.liveSize != 6 * 16 + 5 * mediumStats.blockSize)
+		return false;
+
+
+	/* Test 2: Requests a size class fits but can not serve fall through to the dynamic allocator */
+	void* dynamicPtr = Alloc(5000);
+	void* alignedPtr = Alloc(24, 64);
+	if (!GetAllocatorStats(stats) || stats.fallThroughCount != 1 || stats.dynamicAllocCount != 2 || 
+		stats.dynamicLiveSize < 5000 + 24 || stats.liveSize != 6 * 16 + 5 * mediumStats.blockSize + stats.dynamicLiveSize)
+		return false;
+	Free(alignedPtr);
+	size_t maxLiveSize = stats.dynamicLiveSize;
+	if (!GetAllocatorStats(stats) || stats.dynamicFreeCount != 1 || stats.dynamicMaxLiveSize != maxLiveSize || stats.dynamicLiveSize >= maxLiveSize)
+		return false;
+
+
+	/* Test 3: Free memory and the largest free block match a walk of the free blocks, and scattered
+	 * free blocks raise the fragmentation, 1 - largest free block / free memory */
+	void* blockPtrs[16];
+	for (size_t i = 0; i < 16; i++)
+		blockPtrs[i] = Alloc(2000);
+	for (size_t i = 0; i < 16; i += 2)
+		Free(blockPtrs[i]);
+
+	DynamicAllocator* dynamicAllocator = arenaPtrs[0]->dynamicAllocator;
+	size_t freeBlockNum = 0;
+	for (MemoryBlock* block = dynamicAllocator->GetFirstFreeBlock(); block != nullptr; block = dynamicAllocator->GetNextFreeBlock(block))
+		freeBlockNum++;
+	if (!GetAllocatorStats(stats) || stats.dynamicFreeSize != dynamicAllocator->GetTotalFreeMemory() + freeBlockNum * (BLOCK_SIZE + TAG_SIZE))
+		return false;
+	size_t largestFreeBlock = 0;
+	for (MemoryBlock* block = dynamicAllocator->GetFirstFreeBlock(); block != nullptr; block = dynamicAllocator->GetNextFreeBlock(block))
+		largestFreeBlock = block->blockSize > largestFreeBlock ? block->blockSize : largestFreeBlock;
+	double fragmentation = 1.0 - static_cast<double>(GetLargestFreeBlock()) / static_cast<double>(stats.dynamicFreeSize);
+	if (GetLargestFreeBlock() != largestFreeBlock || fragmentation <= 0.0 || fragmentation >= 1.0)
+		return false;
+
+	for (size_t i = 1; i < 16; i += 2)
+		Free(blockPtrs[i]);
+	if (!GetAllocatorStats(stats) || 1.0 - static_cast<double>(GetLargestFreeBlock()) / static_cast<double>(stats.dynamicFreeSize) >= fragmentation)
+		return false;
+
+
+	/* Test 4: Mapped blocks are counted by the large allocator */
+	SetDirectMapThreshold(1024 * 1024);
+	void* largePtr = Alloc(2 * 1024 * 1024);
+	if (!GetAllocatorStats(stats) || stats.largeAllocCount != 1 || stats.largeLiveSize != 2 * 1024 * 1024)
+		return false;
+	Free(largePtr);
+	SetDirectMapThreshold(0);
+	if (!GetAllocatorStats(stats) || stats.largeFreeCount != 1 || stats.largeLiveSize != 0 || stats.largeMaxLiveSize != 2 * 1024 * 1024)
+		return false;
+
+
+	/* Test 5: Counts of other threads are added when they exit. Starting a thread allocates as well */
+	size_t allocCount = smallStats.allocCount;
+	const unsigned int threadNum = 4;
+	std::thread threads[threadNum];
+	for (unsigned int t = 0; t < threadNum; t++)
+	{
+		threads[t] = std::thread([]()
+		{
+			void* ptrs[100];
+			for (size_t i = 0; i < 100; i++)
+				ptrs[i] = Alloc(16);
+			for (size_t i = 0; i < 100; i++)
+				Free(ptrs[i]);
+		});
+	}
+	for (unsigned int t = 0; t < threadNum; t++)
+		threads[t].join();
+	if (!GetAllocatorStats(stats) || smallStats.allocCount < allocCount + 100 * threadNum || smallStats.liveBlockNum != 6)
+		return false;
+
+	for (size_t i = 4; i < 10; i++)
+		Free(smallPtrs[i]);
+	for (size_t i = 0; i < 5; i++)
+		Free(mediumPtrs[i]);
+	Free(dynamicPtr);
+	if (!GetAllocatorStats(stats) || stats.liveSize != 0)
+		return false;
+
+	DestroyMemoryAllocator();
+	return !GetAllocatorStats(stats);
+}
+
+
+/**
+* @brief Sum the live samples and all samples of every call site of the heap profiler.
+*/
+static void CountHeapSamples(size_t& outLiveCount, size_t& outAllocCount)
+{
+	outLiveCount = 0;
+	outAllocCount = 0;
+	for (size_t i = 0; i < HEAP_PROFILER_MAX_STACK_NUM; i++)
+	{
+		outLiveCount += heapProfiler.stacks[i].liveCount;
+		outAllocCount += heapProfiler.stacks[i].allocCount;
+	}
+}
+
+
+bool HeapProfile_UnitTest()
+{
+	if (!InitializeGrowableMemoryAllocator(64 * 1024 * 1024, 256 * 1024))
+		return false;
+
+	/* Test 1: With an interval of one byte every allocation is sampled, and frees remove the samples */
+	SetHeapProfileInterval(1);
+	void* ptrs[10];
+	for (size_t i = 0; i < 10; i++)
+		ptrs[i] = Alloc(200);
+	for (size_t i = 0; i < 4; i++)
+		Free(ptrs[i]);
+
+	size_t liveCount, allocCount;
+	CountHeapSamples(liveCount, allocCount);
+	if (heapProfiler.sampleNum != 6 || liveCount != 6 || allocCount != 10 || heapProfiler.droppedSampleNum != 0)
+		return false;
+
+	/* Samples of the same call site share its entry, which has a stack trace */
+	size_t stackIdx = heapProfiler.samples[heapProfiler.FindSampleIdx(ptrs[4])].stackIdx;
+	if (heapProfiler.FindSampleIdx(ptrs[0]) != HEAP_PROFILER_MAX_SAMPLE_NUM || heapProfiler.stacks[stackIdx].allocCount != 10 ||
+		heapProfiler.stacks[stackIdx].liveSize != 6 * 200 || heapProfiler.stacks[stackIdx].depth == 0)
+		return false;
+
+
+	/* Test 2: The sample follows a memory block that is resized or remapped */
+	ptrs[4] = Realloc(ptrs[4], 100);
+	if (ptrs[4] == nullptr || heapProfiler.stacks[stackIdx].liveSize != 5 * 200 + 100)
+		return false;
+	SetDirectMapThreshold(1024 * 1024);
+	void* largePtr = Alloc(2 * 1024 * 1024);
+	largePtr = Realloc(largePtr, 16 * 1024 * 1024);
+	if (largePtr == nullptr || heapProfiler.FindSampleIdx(largePtr) == HEAP_PROFILER_MAX_SAMPLE_NUM || 
+		heapProfiler.samples[heapProfiler.FindSampleIdx(largePtr)].size != 16 * 1024 * 1024)
+		return false;
+	Free(largePtr);
+	SetDirectMapThreshold(0);
+	for (size_t i = 4; i < 10; i++)
+		Free(ptrs[i]);
+	if (heapProfiler.sampleNum != 0)
+		return false;
+
+
+	/* Test 3: The dump is a heap profile that pprof reads */
+	FILE* file = tmpfile();
+	if (file == nullptr || !heapProfiler.Dump(file))
+		return false;
+	rewind(file);
+	char line[256];
+	bool hasHeader = fgets(line, sizeof(line), file) != nullptr && strncmp(line, "heap profile:", 13) == 0 && strstr(line, "@ heap_v2/1") != nullptr;
+	bool hasStack = fgets(line, sizeof(line), file) != nullptr && strstr(line, "] @ 0x") != nullptr;
+	fclose(file);
+	if (!hasHeader || !hasStack)
+		return false;
+
+
+	/* Test 4: With a larger interval, about one allocation per interval bytes is sampled */
+	heapProfiler.Clear();
+	const size_t interval = 4096;
+	const size_t blockNum = 10000;
+	static void* blocks[blockNum];
+	SetHeapProfileInterval(interval);
+	for (size_t i = 0; i < blockNum; i++)
+		blocks[i] = Alloc(64);
+	CountHeapSamples(liveCount, allocCount);
+	if (allocCount < blockNum * 64 / interval / 2 || allocCount > blockNum * 64 / interval * 2)
+		return false;
+	for (size_t i = 0; i < blockNum; i++)
+		Free(blocks[i]);
+	if (heapProfiler.sampleNum != 0)
+		return false;
+
+
+	/* Test 5: Threads sample and free at the same time */
+	const unsigned int threadNum = 4;
+	std::thread threads[threadNum];
+	for (unsigned int t = 0; t < threadNum; t++)
+	{
+		threads[t] = std::thread([]()
+		{
+			void* threadPtrs[1000];
+			for (size_t i = 0; i < 1000; i++)
+				threadPtrs[i] = Alloc(64 + i % 128);
+			for (size_t i = 0; i < 1000; i++)
+				Free(threadPtrs[i]);
+		});
+	}
+	for (unsigned int t = 0; t < threadNum; t++)
+		threads[t].join();
+	CountHeapSamples(liveCount, allocCount);
+	if (heapProfiler.sampleNum != 0 || liveCount != 0 || allocCount == 0)
+		return false;
+
+
+	/* Test 6: Nothing is sampled once sampling is disabled */
+	SetHeapProfileInterval(0);
+	heapProfiler.Clear();
+	for (size_t i = 0; i < 100; i++)
+		Free(Alloc(1000));
+	CountHeapSamples(liveCount, allocCount);
+	if (allocCount != 0)
+		return false;
+
+	DestroyMemoryAllocator();
+	return true;
+}
+
+
+/* Read the header and the records of a trace file */
+static bool ReadAllocTrace(const char* path, TraceHeader& outHeader, std::vector<TraceRecord>& outRecords)
+{
+	FILE* file = nullptr;
+#if defined(_MSC_VER)
+	if (fopen_s(&file, path, "rb") != 0)
+		file = nullptr;
+#else
+	file = fopen(path, "rb");
+#endif
+	if (file == nullptr)
+		return false;
+
+	bool success = fread(&outHeader, sizeof(TraceHeader), 1, file) == 1;
+	if (success)
+	{
+		outRecords.resize(static_cast<size_t>(outHeader.recordNum));
+		success = outRecords.empty() || fread(outRecords.data(), sizeof(TraceRecord), outRecords.size(), file) == outRecords.size();
+	}
+	success = success && fgetc(file) == EOF;
+	fclose(file);
+	return success;
+}
+
+
+bool AllocTrace_UnitTest()
+{
+	const char* path = "AllocTrace_UnitTest.trace";
+	if (!InitializeGrowableMemoryAllocator(64 * 1024 * 1024, 256 * 1024))
+		return false;
+
+	/* Test 1: Each operation is a record, in the order of the calls */
+	if (!StartAllocTrace(path, 100) || StartAllocTrace(path, 100))
+		return false;
+	void* ptr = Alloc(100);
+	void* alignedPtr = Alloc(64, 64);
+	if (Realloc(ptr, 50) != ptr)
+		return false;
+	Free(alignedPtr);
+	Collect();
+	Free(ptr);
+	if (!StopAllocTrace() || StopAllocTrace())
+		return false;
+
+	TraceHeader header;
+	std::vector<TraceRecord> records;
+	if (!ReadAllocTrace(path, header, records))
+		return false;
+	if (header.magic != TRACE_FILE_MAGIC || header.version != TRACE_FILE_VERSION || header.recordSize != sizeof(TraceRecord) ||
+		header.recordNum != 6 || header.droppedRecordNum != 0)
+		return false;
+
+	const uint32_t ops[] = { TRACE_OP_ALLOC, TRACE_OP_ALLOC, TRACE_OP_RESIZE, TRACE_OP_FREE, TRACE_OP_COLLECT, TRACE_OP_FREE };
+	const void* ids[] = { ptr, alignedPtr, ptr, alignedPtr, nullptr, ptr };
+	const uint64_t sizes[] = { 100, 64, 50, 0, 0, 0 };
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		if (records[i].op != ops[i] || records[i].id != reinterpret_cast<uintptr_t>(ids[i]) || records[i].size != sizes[i] ||
+			(i > 0 && records[i].time < records[i - 1].time))
+		{
+			printf("AllocTrace: Record %zu is wrong. \n", i);
+			return false;
+		}
+	}
+	if (records[0].alignment != 0 || records[1].alignment != 64)
+		return false;
+
+
+	/* Test 2: Operations beyond the capacity are dropped and counted */
+	if (!StartAllocTrace(path, 4))
+		return false;
+	for (size_t i = 0; i < 10; i++)
+		Free(Alloc(16));
+	if (!StopAllocTrace() || !ReadAllocTrace(path, header, records) || header.recordNum != 4 || header.droppedRecordNum != 16)
+		return false;
+
+
+	/* Test 3: Records of threads keep the order of the operations, so every free follows the
+	 * allocation of its memory block, even when addresses are reused */
+	const unsigned int threadNum = 4;
+	if (!StartAllocTrace(path, 100000))
+		return false;
+	std::thread threads[threadNum];
+	for (unsigned int t = 0; t < threadNum; t++)
+	{
+		threads[t] = std::thread([]()
+		{
+			void* threadPtrs[100];
+			for (size_t round = 0; round < 10; round++)
+			{
+				for (size_t i = 0; i < 100; i++)
+					threadPtrs[i] = Alloc(16 + i * 8);
+				for (size_t i = 0; i < 100; i++)
+					Free(threadPtrs[i]);
+			}
+		});
+	}
+	for (unsigned int t = 0; t < threadNum; t++)
+		threads[t].join();
+	if (!StopAllocTrace() || !ReadAllocTrace(path, header, records) || header.recordNum < threadNum * 2000 || header.droppedRecordNum != 0)
+		return false;
+
+	std::unordered_set<uint64_t> liveIds;
+	for (const TraceRecord& record : records)
+	{
+		bool success = record.op == TRACE_OP_ALLOC ? liveIds.insert(record.id).second : record.op == TRACE_OP_FREE && liveIds.erase(record.id) == 1;
+		if (!success)
+		{
+			printf("AllocTrace: A record of %p is out of order. \n", reinterpret_cast<void*>(static_cast<uintptr_t>(record.id)));
+			return false;
+		}
+	}
+	if (!liveIds.empty())
+		return false;
+
+	/* The containers live in the memory system, release them before it is destroyed */
+	std::unordered_set<uint64_t>().swap(liveIds);
+	std::vector<TraceRecord>().swap(records);
+	remove(path);
+	DestroyMemoryAllocator();
+	return true;
+}
+
+
+/* Size classes of the memory system template test. They differ from the default ones, so the test
+ * also shows that instances of different configurations live side by side */
+struct TestMemorySystemConfig
+{
+	static constexpr FixSizeAllocatorArg sizeClasses[] = {
+		{8, 64, FIX_SIZE_POLICY_BIT_ARRAY},
+		{24, 100, FIX_SIZE_POLICY_BIT_ARRAY},
+		{48, 100, FIX_SIZE_POLICY_BIT_ARRAY},
+		{128, 30, FIX_SIZE_POLICY_BIT_ARRAY},
+	};
+	static constexpr unsigned int dynamicAllocatorPolicy = POLICY_FIRST_FIT | POLICY_COALESCE_ON_FREE;
+};
+
+
+bool UsableSize_UnitTest()
+{
+	const size_t threshold = 1024 * 1024;
+	SetDirectMapThreshold(threshold);
+	if (!InitializeGrowableMemoryAllocator(16 * 1024 * 1024, 256 * 1024, 2))
+		return false;
+
+
+	/* Test 1: Blocks of size classes, of the heap and of mappings have room for at least the request,
+	 * all of which can be written and kept by Realloc in place */
+	const size_t sizes[] = { 1, 8, 100, 1000, 5000, 100000, 2 * threshold };
+	for (size_t size : sizes)
+	{
+		void* ptr = Alloc(size);
+		size_t usableSize = GetUsableSize(ptr);
+		if (ptr == nullptr || usableSize < size)
+			return false;
+		memset(ptr, 0x5A, usableSize);
+		if (Realloc(ptr, usableSize) != ptr || GetUsableSize(ptr) < usableSize || !IsFilledWith(ptr, usableSize, 0x5A))
+			return false;
+		Free(ptr);
+	}
+	int stackValue = 0;
+	if (GetUsableSize(nullptr) != 0 || GetUsableSize(&stackValue) != 0)
+		return false;
+
+
+	/* Test 2: LockMemorySystem holds back allocations that need a lock until UnlockMemorySystem, as
+	 * before a fork */
+	volatile bool allocated = false;
+	void* heapPtr = nullptr;
+	LockMemorySystem();
+	std::thread thread([&allocated, &heapPtr]()
+	{
+		heapPtr = Alloc(100000);
+		allocated = true;
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	bool blocked = !allocated;
+	UnlockMemorySystem();
+	thread.join();
+	if (!blocked || !allocated || heapPtr == nullptr)
+		return false;
+	Free(heapPtr);
+
+	SetDirectMapThreshold(0);
+	DestroyMemoryAllocator();
+	return true;
+}
+
+
+/* Size classes with a class of whole cache lines in the middle, whose neighbours are packed */
+struct IsolatedMemorySystemConfig
+{
+	static constexpr FixSizeAllocatorArg sizeClasses[] = {
+		{16, 64, FIX_SIZE_POLICY_BIT_ARRAY},
+		{64, 32, FIX_SIZE_POLICY_ISOLATE_HEADER},
+		{96, 16, FIX_SIZE_POLICY_BIT_ARRAY},
+	};
+	static constexpr unsigned int dynamicAllocatorPolicy = POLICY_SEGREGATED_FIT | POLICY_COALESCE_ON_FREE;
+};
+
+
+/**
+* @brief Whether two memory ranges share a cache line.
+*/
+static bool ShareCacheLine(const void* beginAddr1, const void* endAddr1, const void* beginAddr2, const void* endAddr2)
+{
+	uintptr_t firstLine1 = reinterpret_cast<uintptr_t>(beginAddr1) / CACHE_LINE_SIZE;
+	uintptr_t lastLine1 = (reinterpret_cast<uintptr_t>(endAddr1) - 1) / CACHE_LINE_SIZE;
+	uintptr_t firstLine2 = reinterpret_cast<uintptr_t>(beginAddr2) / CACHE_LINE_SIZE;
+	uintptr_t lastLine2 = (reinterpret_cast<uintptr_t>(endAddr2) - 1) / CACHE_LINE_SIZE;
+	return firstLine1 <= lastLine2 && firstLine2 <= lastLine1;
+}
+
+
+bool CacheLine_UnitTest()
+{
+	/* Test 1: The blocks of an isolated fix size allocator start on a boundary of two cache lines
+	 * after its bit array, and it works like any other */
+	const size_t heapSize = 64 * 1024;
+	void* pHeapMemory = HeapAlloc(GetProcessHeap(), 0, heapSize + FIX_SIZE_ISOLATION_ALIGNMENT);
+	assert(pHeapMemory);
+	void* baseAddr = PointerAdd(pHeapMemory, FIX_SIZE_ISOLATION_ALIGNMENT - reinterpret_cast<uintptr_t>(pHeapMemory) % FIX_SIZE_ISOLATION_ALIGNMENT);
+
+	FixSizeAllocator* allocator = CreateFixSizeAllocator(baseAddr, 50, 24, heapSize, FIX_SIZE_POLICY_BIT_ARRAY | FIX_SIZE_POLICY_ISOLATE_HEADER);
+	if (allocator == nullptr || allocator->policy != FIX_SIZE_POLICY_BIT_ARRAY ||
+		reinterpret_cast<uintptr_t>(allocator->blockBaseAddr) % FIX_SIZE_ISOLATION_ALIGNMENT != 0 ||
+		ShareCacheLine(allocator, PointerAdd(&allocator->bitArray, allocator->bitArraySize), allocator->blockBaseAddr, PointerAdd(allocator->blockBaseAddr, 24)))
+		return false;
+	void* ptrs[50];
+	for (size_t i = 0; i < 50; i++)
+	{
+		ptrs[i] = allocator->AtomicAlloc();
+		if (ptrs[i] == nullptr || !allocator->Contains(ptrs[i]))
+			return false;
+	}
+	for (size_t i = 0; i < 50; i++)
+	{
+		if (!allocator->AtomicFree(ptrs[i]))
+			return false;
+	}
+	allocator->Destroy();
+
+
+	/* Test 2: A memory system keeps an isolated class apart from its neighbours, and serves whole
+	 * cache lines from it */
+	typedef MemorySystem<IsolatedMemorySystemConfig> IsolatedSystem;
+	static_assert(IsolatedSystem::GetClassOffset(1) % FIX_SIZE_ISOLATION_ALIGNMENT == 0 && IsolatedSystem::GetBlockOffset(1) % FIX_SIZE_ISOLATION_ALIGNMENT == 0,
+		"Isolated class is not aligned");
+	static_assert(IsolatedSystem::GetClassOffset(2) % FIX_SIZE_ISOLATION_ALIGNMENT == 0, "Class after an isolated class is not aligned");
+	static_assert(IsolatedSystem::GetClassAlignment(0) == MEMORY_SYSTEM_ALIGNMENT, "Packed class is aligned");
+
+	IsolatedSystem* system = CreateMemorySystem<IsolatedMemorySystemConfig>(baseAddr, heapSize);
+	if (system == nullptr)
+		return false;
+	for (size_t i = 0; i < 32; i++)
+	{
+		ptrs[i] = system->Alloc(40);
+		if (ptrs[i] == nullptr || reinterpret_cast<uintptr_t>(ptrs[i]) % CACHE_LINE_SIZE != 0 || 
+			ptrs[i] < PointerAdd(system, IsolatedSystem::GetBlockOffset(1)) || ptrs[i] >= PointerAdd(system, IsolatedSystem::GetClassEndOffset(1)))
+			return false;
+	}
+	for (size_t i = 0; i < 32; i++)
+	{
+		if (!system->Free(ptrs[i]))
+			return false;
+	}
+	if (system->Free(PointerAdd(system, IsolatedSystem::GetBlockOffset(1) - CACHE_LINE_SIZE)))
+		return false;
+	system->Destroy();
+	HeapFree(GetProcessHeap(), 0, pHeapMemory);
+
+
+	/* Test 3: The headers of the default size classes do not share a cache line with any memory
+	 * block of an arena */
+	if (!InitializeGrowableMemoryAllocator(16 * 1024 * 1024, 256 * 1024, 2))
+		return false;
+	for (unsigned int i = 0; i < arenaNum; i++)
+	{
+		for (int j = 0; j < arenaPtrs[i]->fixSizeAllocatorNum; j++)
+		{
+			FixSizeAllocator* classAllocator = arenaPtrs[i]->fixSizeAllocatorPtrs[j];
+			void* headerEndAddr = PointerAdd(&classAllocator->bitArray, classAllocator->bitArraySize);
+			void* blockEndAddr = PointerAdd(classAllocator->blockBaseAddr, classAllocator->blockSize * classAllocator->maxBlockNum);
+			if (ShareCacheLine(classAllocator, headerEndAddr, classAllocator->blockBaseAddr, blockEndAddr))
+				return false;
+			if (j > 0)
+			{
+				FixSizeAllocator* prevAllocator = arenaPtrs[i]->fixSizeAllocatorPtrs[j - 1];
+				void* prevBlockEndAddr = PointerAdd(prevAllocator->blockBaseAddr, prevAllocator->blockSize * prevAllocator->maxBlockNum);
+				if (ShareCacheLine(prevAllocator->blockBaseAddr, prevBlockEndAddr, classAllocator, headerEndAddr))
+					return false;
+			}
+		}
+	}
+
+
+	/* Test 4: Isolated allocations are whole cache lines, and threads update them side by side */
+	const unsigned int threadNum = 4;
+	const size_t incrementNum = 100000;
+	size_t* counters[threadNum];
+	for (unsigned int t = 0; t < threadNum; t++)
+	{
+		counters[t] = static_cast<size_t*>(AllocIsolated(sizeof(size_t)));
+		if (counters[t] == nullptr || reinterpret_cast<uintptr_t>(counters[t]) % CACHE_LINE_SIZE != 0 || 
+			GetUsableSize(counters[t]) < CACHE_LINE_SIZE || GetUsableSize(counters[t]) % CACHE_LINE_SIZE != 0)
+			return false;
+		*counters[t] = 0;
+	}
+	void* smallPtr = Alloc(8);
+	void* largePtr = AllocIsolated(1000);
+	if (smallPtr == nullptr || largePtr == nullptr || reinterpret_cast<uintptr_t>(largePtr) % CACHE_LINE_SIZE != 0 ||
+		GetUsableSize(largePtr) < 1024 || ShareCacheLine(smallPtr, PointerAdd(smallPtr, 8), counters[0], PointerAdd(counters[0], CACHE_LINE_SIZE)))
+		return false;
+
+	std::thread threads[threadNum];
+	for (unsigned int t = 0; t < threadNum; t++)
+	{
+		threads[t] = std::thread([&counters, t, incrementNum]()
+		{
+			volatile size_t* counter = counters[t];
+			for (size_t i = 0; i < incrementNum; i++)
+				*counter = *counter + 1;
+		});
+	}
+	for (unsigned int t = 0; t < threadNum; t++)
+		threads[t].join();
+	for (unsigned int t = 0; t < threadNum; t++)
+	{
+		if (*counters[t] != incrementNum)
+			return false;
+		Free(counters[t]);
+	}
+	Free(smallPtr);
+	Free(largePtr);
+
+	DestroyMemoryAllocator();
+	return true;
+}
+
+
+bool MemorySystemTemplate_UnitTest()
+{
+	typedef MemorySystem<TestMemorySystemConfig> TestSystem;
+	typedef MemorySystem<DefaultMemorySystemConfig> DefaultSystem;
+
+	/* Size classes and layout are resolved at compile time */
+	static_assert(TestSystem::sizeClassNum == 4, "Wrong size class number");
+	static_assert(TestSystem::FindSizeClass(1) == 0 && TestSystem::FindSizeClass(8) == 0, "Wrong size class");
+	static_assert(TestSystem::FindSizeClass(9) == 1 && TestSystem::FindSizeClass(48) == 2, "Wrong size class");
+	static_assert(TestSystem::FindSizeClass(128) == 3 && TestSystem::FindSizeClass(129) == -1, "Wrong size class");
+	static_assert(TestSystem::GetClassOffset(1) % MEMORY_SYSTEM_ALIGNMENT == 0, "Fix size allocator is not aligned");
+	static_assert(TestSystem::GetBlockOffset(3) < TestSystem::GetClassEndOffset(3), "Wrong layout");
+	static_assert(DefaultSystem::maxFixSize == 96, "Wrong largest block size");
+
+	const size_t sizeHeap = 256 * 1024;
+	void* pTestMemory = HeapAlloc(GetProcessHeap(), 0, sizeHeap);
+	void* pDefaultMemory = HeapAlloc(GetProcessHeap(), 0, sizeHeap);
+	assert(pTestMemory && pDefaultMemory);
+
+	TestSystem* testSystem = CreateMemorySystem<TestMemorySystemConfig>(pTestMemory, sizeHeap);
+	DefaultSystem* defaultSystem = CreateMemorySystem<DefaultMemorySystemConfig>(pDefaultMemory, sizeHeap);
+	if (testSystem == nullptr || defaultSystem == nullptr || testSystem->dynamicAllocator == nullptr)
+		return false;
+	if (CreateMemorySystem<TestMemorySystemConfig>(pTestMemory, TestSystem::GetFixSize() - 1) != nullptr)
+		return false;
+	testSystem = CreateMemorySystem<TestMemorySystemConfig>(pTestMemory, sizeHeap);
+
+
+	/* Test 1: Every size is served by the smallest class that fits it, and the rest by the dynamic 
+	 * allocator */
+	const size_t sizes[] = { 1, 8, 9, 24, 25, 48, 100, 128, 129, 5000 };
+	for (size_t size : sizes)
+	{
+		void* ptr = testSystem->Alloc(size);
+		if (ptr == nullptr || !testSystem->Contains(ptr) || defaultSystem->Contains(ptr))
+			return false;
+
+		int classIdx = TestSystem::FindSizeClass(size);
+		bool inDynamic = testSystem->dynamicAllocator->Contains(ptr);
+		if (classIdx == -1 ? !inDynamic : !testSystem->fixSizeAllocatorPtrs[classIdx]->Contains(ptr))
+		{
+			printf("MemorySystem: Size %zu is not served by class %d. \n", size, classIdx);
+			return false;
+		}
+		memset(ptr, 0xAB, size);
+
+		/* Double free and foreign pointers are rejected */
+		if (defaultSystem->Free(ptr) || !testSystem->Free(ptr) || testSystem->Free(ptr))
+			return false;
+	}
+	if (testSystem->Free(PointerAdd(testSystem, TestSystem::GetBlockOffset(1) + 1)))
+		return false;
+
+
+	/* Test 2: When a class runs out of blocks, requests move on to the larger classes */
+	const size_t smallNum = TestMemorySystemConfig::sizeClasses[0].blockNum + 10;
+	void* smallPtrs[smallNum];
+	for (size_t i = 0; i < smallNum; i++)
+	{
+		smallPtrs[i] = testSystem->Alloc(8);
+		if (smallPtrs[i] == nullptr)
+			return false;
+	}
+	if (testSystem->fixSizeAllocatorPtrs[0]->freeBlockNum != 0 || !testSystem->fixSizeAllocatorPtrs[1]->Contains(smallPtrs[smallNum - 1]))
+		return false;
+
+
+	/* Test 3: Instances do not share state */
+	void* defaultPtr = defaultSystem->Alloc(8);
+	if (defaultPtr == nullptr || !defaultSystem->fixSizeAllocatorPtrs[0]->Contains(defaultPtr))
+		return false;
+	defaultSystem->Free(defaultPtr);
+
+	for (size_t i = 0; i < smallNum; i++)
+	{
+		if (!testSystem->Free(smallPtrs[i]))
+			return false;
+	}
+
+	testSystem->Collect();
+	defaultSystem->Collect();
+	testSystem->Destroy();
+	defaultSystem->Destroy();
+	HeapFree(GetProcessHeap(), 0, pTestMemory);
+	HeapFree(GetProcessHeap(), 0, pDefaultMemory);
+	return true;
+}
+
+
+bool BitArray_UnitTest()
+{
+	const size_t 		sizeHeap = 1024 * 1024;
+	const unsigned int 	numDescriptors = 2048;
+
+	void* pHeapMemory = HeapAlloc(GetProcessHeap(), 0, sizeHeap);
+	assert(pHeapMemory);
+
+	const size_t blockNum = 128;
+	const size_t blockSize = 16;
+	BitArray* bitArray = CreateBitArray(pHeapMemory, blockNum, true);
+
+	printf("List address: %p \n", &bitArray->arr);
+
+	*bitArray->FindElementPtr(0) = 0xFFFFFFFF;
+	*bitArray->FindElementPtr(1) = 0x7FFFFFFF;
+	*bitArray->FindElementPtr(2) = 0x0;
+	bitArray->UpdateSummary();			// Elements are modified directly, so the summaries need to be rebuilt
+
+	printf("\nTest 1\n");
+	printf("arr[%u]: %x\n", 0, *bitArray->FindElementPtr(0));
+	printf("arr[%u]: %x\n", 1, *bitArray->FindElementPtr(1));
+	printf("arr[%u]: %x\n", 2, *bitArray->FindElementPtr(2));
+	size_t temp1, temp2;
+	bool temp3;
+	temp3 = bitArray->FindFirstAllocateBit(temp1);
+	temp3 = bitArray->FindFirstFreeBit(temp2);
+	assert(temp1 == 63);
+	assert(temp2 == 0);
+
+	printf("\nTest 2\n");
+	assert(bitArray->IsBitSet(63) == false);
+	assert(bitArray->IsBitSet(62) == true);
+	assert(bitArray->IsBitClear(63) == true);
+	assert(bitArray->IsBitClear(62) == false);
+	assert(bitArray->AreAllBitsSet() == false);
+	assert(bitArray->AreAllBitsClear() == false);
+	bitArray->SetBit(63);
+	printf("arr[%u]: %x\n", 0, *bitArray->FindElementPtr(0));
+	printf("arr[%u]: %x\n", 1, *bitArray->FindElementPtr(1));
+	printf("arr[%u]: %x\n", 2, *bitArray->FindElementPtr(2));
+	assert(bitArray->IsBitSet(63) == true);
+	assert(bitArray->IsBitSet(62) == true);
+	assert(bitArray->IsBitClear(63) == false);
+	assert(bitArray->IsBitClear(62) == false);
+	bitArray->ClearBit(63);
+	printf("arr[%u]: %x\n", 0, *bitArray->FindElementPtr(0));
+	printf("arr[%u]: %x\n", 1, *bitArray->FindElementPtr(1));
+	printf("arr[%u]: %x\n", 2, *bitArray->FindElementPtr(2));
+
+	printf("\nTest 3\n");
+	bitArray->SetAllBits();
+	assert(bitArray->AreAllBitsSet() == true);
+	assert(bitArray->AreAllBitsClear() == false);
+	printf("arr[%u]: %x\n", 1, *bitArray->FindElementPtr(1));
+	printf("arr[%u]: %x\n", 2, *bitArray->FindElementPtr(2));
+	bitArray->ClearAllBits();
+	assert(bitArray->AreAllBitsSet() == false);
+	assert(bitArray->AreAllBitsClear() == true);
+	printf("arr[%u]: %x\n", 1, *bitArray->FindElementPtr(1));
+	printf("arr[%u]: %x\n", 2, *bitArray->FindElementPtr(2));
+
+	printf("\nTest 4\n");
+	const size_t largeBlockNum = 100000;
+	bitArray = CreateBitArray(pHeapMemory, largeBlockNum, false);
+	assert(bitArray->summaryLevelNum > 1);
+	assert(bitArray->FindFirstFreeBit(temp1) == false);
+	bitArray->SetBit(77777);
+	bitArray->SetBit(99999);
+	assert(bitArray->FindFirstFreeBit(temp1) == true && temp1 == 77777);
+	bitArray->ClearBit(77777);
+	assert(bitArray->FindFirstFreeBit(temp1) == true && temp1 == 99999);
+	bitArray->SetAllBits();
+	assert(bitArray->FindFirstAllocateBit(temp1) == false);
+	bitArray->ClearBit(65536);
+	assert(bitArray->FindFirstAllocateBit(temp1) == true && temp1 == 65536);
+
+	/* Summaries should agree with a linear scan after random modifications */
+	const size_t randomBlockNum = 5000;
+	bitArray = CreateBitArray(pHeapMemory, randomBlockNum, true);
+	for (int i = 0; i < 500; i++)
+	{
+		size_t blockIdx = rand() % randomBlockNum;
+		if (rand() % 4 == 0)
+			bitArray->SetBit(blockIdx);
+		else
+			bitArray->ClearBit(blockIdx);
+
+		size_t expectIdx = 0;
+		while (expectIdx < randomBlockNum && bitArray->IsBitClear(expectIdx))
+			expectIdx++;
+		temp3 = bitArray->FindFirstFreeBit(temp1);
+		assert(temp3 == (expectIdx < randomBlockNum) && (!temp3 || temp1 == expectIdx));
+	}
+
+	HeapFree(GetProcessHeap(), 0, pHeapMemory);
+	return true;
+}
+
+
+
+bool FixSizeAllocator_UnitTest()
+{
+	const size_t 		sizeHeap = 1024 * 1024;
+	const unsigned int 	numDescriptors = 2048;
+
+	void* pHeapMemory = HeapAlloc(GetProcessHeap(), 0, sizeHeap);
+	assert(pHeapMemory);
+
+	const uint32_t blockNum = 128;
+	const size_t blockSize = 16;
+	FixSizeAllocator* allocator = CreateFixSizeAllocator(pHeapMemory, blockNum, blockSize, sizeHeap);
+
+	printf("arr[%u]: %x\n", 0, *allocator->bitArray.FindElementPtr(0));
+	void* ptr1 = allocator->Alloc();
+	void* ptr2 = allocator->Alloc();
+	void* ptr3 = allocator->Alloc();
+	void* ptr4 = allocator->Alloc();
+	printf("arr[%u]: %x\n", 0, *allocator->bitArray.FindElementPtr(0));
+	assert(*allocator->bitArray.FindElementPtr(0) == 0xFFFFFFF0);
+
+	allocator->Free(ptr3);
+	printf("arr[%u]: %x\n", 0, *allocator->bitArray.FindElementPtr(0));
+	assert(*allocator->bitArray.FindElementPtr(0) == 0xFFFFFFF4);
+	allocator->Free(ptr2);
+	printf("arr[%u]: %x\n", 0, *allocator->bitArray.FindElementPtr(0));
+	assert(*allocator->bitArray.FindElementPtr(0) == 0xFFFFFFF6);
+	allocator->Free(ptr4);
+	printf("arr[%u]: %x\n", 0, *allocator->bitArray.FindElementPtr(0));
+	assert(*allocator->bitArray.FindElementPtr(0) == 0xFFFFFFFE);
+	allocator->Free(ptr1);
+	printf("arr[%u]: %x\n", 0, *allocator->bitArray.FindElementPtr(0));
+	assert(*allocator->bitArray.FindElementPtr(0) == 0xFFFFFFFF);
+
+	return true;
+}
+
+
+bool FreeListFixSizeAllocator_UnitTest()
+{
+	const size_t 		sizeHeap = 64 * 1024;
+	const size_t 		blockNum = 100;
+	const size_t 		blockSize = 16;
+
+	void* pHeapMemory = HeapAlloc(GetProcessHeap(), 0, sizeHeap);
+	assert(pHeapMemory);
+
+	/* Blocks must be able to hold the link of the free list */
+	if (CreateFixSizeAllocator(pHeapMemory, blockNum, sizeof(void*) / 2, sizeHeap, FIX_SIZE_POLICY_FREE_LIST) != nullptr)
+		return false;
+
+	const unsigned int policies[] = { FIX_SIZE_POLICY_FREE_LIST, FIX_SIZE_POLICY_FREE_LIST | FIX_SIZE_POLICY_CHECK_DOUBLE_FREE };
+	for (unsigned int policy : policies)
+	{
+		FixSizeAllocator* allocator = CreateFixSizeAllocator(pHeapMemory, blockNum, blockSize, sizeHeap, policy);
+		if (allocator == nullptr)
+			return false;
+
+		/* Test 1: Untouched blocks are handed out in address order, until the allocator runs dry */
+		void* ptrs[blockNum];
+		for (size_t i = 0; i < blockNum; i++)
+		{
+			ptrs[i] = allocator->Alloc();
+			if (ptrs[i] != PointerAdd(allocator->blockBaseAddr, blockSize * i))
+				return false;
+			memset(ptrs[i], 0xCD, blockSize);
+		}
+		if (allocator->Alloc() != nullptr || allocator->freeBlockNum != 0)
+			return false;
+
+		/* Test 2: The most recently freed block is reused first */
+		if (!allocator->Free(ptrs[10]) || !allocator->Free(ptrs[20]))
+			return false;
+		if (allocator->Alloc() != ptrs[20] || allocator->Alloc() != ptrs[10])
+			return false;
+
+		/* Test 3: Addresses out of the blocks are rejected. Double frees and misaligned addresses 
+		 * are only rejected by the checker */
+		if (allocator->Free(PointerAdd(allocator->blockBaseAddr, blockSize * blockNum)) || allocator->Free(pHeapMemory))
+			return false;
+		if (policy & FIX_SIZE_POLICY_CHECK_DOUBLE_FREE)
+		{
+			if (!allocator->Free(ptrs[5]) || allocator->Free(ptrs[5]) || allocator->Free(PointerAdd(ptrs[6], 1)))
+				return false;
+			if (allocator->IsAllocated(ptrs[5]) || !allocator->IsAllocated(ptrs[6]))
+				return false;
+			ptrs[5] = allocator->Alloc();
+		}
+
+		for (size_t i = 0; i < blockNum; i++)
+		{
+			if (!allocator->Free(ptrs[i]))
+				return false;
+		}
+		if (allocator->freeBlockNum != blockNum)
+			return false;
+		allocator->Destroy();
+	}
+
+	HeapFree(GetProcessHeap(), 0, pHeapMemory);
+	return true;
+}
+
+
+bool ConcurrentFixSizeAllocator_UnitTest()
+{
+	const size_t 		sizeHeap = 1024 * 1024;
+
+	void* pHeapMemory = HeapAlloc(GetProcessHeap(), 0, sizeHeap);
+	assert(pHeapMemory);
+
+	/* Threads allocate and free from the same allocator with the atomic methods. The number of
+	 * blocks is not a multiple of the element size, so padding bits must never be handed out */
+	const size_t concurrentBlockNum = 1000;
+	const size_t concurrentBlockSize = sizeof(size_t) * 2;
+	FixSizeAllocator* concurrentAllocator = CreateFixSizeAllocator(pHeapMemory, concurrentBlockNum, concurrentBlockSize, sizeHeap);
+	assert(concurrentAllocator != nullptr);
+
+	const int threadNum = 4;
+	bool threadSuccess[threadNum];
+	std::vector<std::thread> threads;
+	threads.reserve(threadNum);
+	for (int t = 0; t < threadNum; t++)
+	{
+		threadSuccess[t] = true;
+		threads.emplace_back([t, concurrentAllocator, &threadSuccess]()
+			{
+				const size_t slotNum = 300;
+				size_t* slots[slotNum] = { nullptr };
+				for (size_t i = 0; i < 50000; i++)
+				{
+					size_t slot = (i * 13 + t * 7) % slotNum;
+					if (slots[slot] != nullptr)
+					{
+						if (slots[slot][0] != static_cast<size_t>(t) || slots[slot][1] != slot)
+							threadSuccess[t] = false;
+						if (!concurrentAllocator->AtomicFree(slots[slot]))
+							threadSuccess[t] = false;
+						slots[slot] = nullptr;
+					}
+					else
+					{
+						slots[slot] = static_cast<size_t*>(concurrentAllocator->AtomicAlloc());
+						if (slots[slot] != nullptr)
+						{
+							if (!concurrentAllocator->Contains(slots[slot]))
+								threadSuccess[t] = false;
+							slots[slot][0] = static_cast<size_t>(t);
+							slots[slot][1] = slot;
+						}
+					}
+				}
+				for (size_t i = 0; i < slotNum; i++)
+				{
+					if (slots[i] != nullptr && !concurrentAllocator->AtomicFree(slots[i]))
+						threadSuccess[t] = false;
+				}
+			});
+	}
+	for (int t = 0; t < threadNum; t++)
+	{
+		threads[t].join();
+		assert(threadSuccess[t]);
+	}
+	assert(concurrentAllocator->freeBlockNum == concurrentBlockNum);
+	assert(concurrentAllocator->bitArray.AreAllBitsSet());
+
+	/* Every block can still be found through the summaries after the concurrent churn */
+	for (size_t i = 0; i < concurrentBlockNum; i++)
+		assert(concurrentAllocator->AtomicAlloc() != nullptr);
+	assert(concurrentAllocator->AtomicAlloc() == nullptr);
+	assert(concurrentAllocator->bitArray.AreAllBitsClear());
+	assert(concurrentAllocator->AtomicFree(concurrentAllocator->blockBaseAddr) == true);
+	assert(concurrentAllocator->AtomicFree(concurrentAllocator->blockBaseAddr) == false);
+	assert(concurrentAllocator->AtomicFree(PointerAdd(concurrentAllocator->blockBaseAddr, concurrentBlockSize * concurrentBlockNum)) == false);
+
+	HeapFree(GetProcessHeap(), 0, pHeapMemory);
+	return true;
+}
+
+
+
+bool PageMap_UnitTest()
+{
+	const size_t 		sizeHeap = 1024 * 1024;
+
+	void* pHeapMemory = HeapAlloc(GetProcessHeap(), 0, sizeHeap);
+	assert(pHeapMemory);
+
+	/* Cover 8 pages of 1KB, owner 0 takes [0, 1.5KB), owner 1 takes [1.5KB, 8KB) */
+	const size_t pageSize = 1024;
+	void* mapBeginAddr = PointerAdd(pHeapMemory, sizeHeap / 2);
+	void* mapEndAddr = PointerAdd(mapBeginAddr, pageSize * 8);
+	PageMap* pageMap = CreatePageMap(pHeapMemory, mapBeginAddr, mapEndAddr, pageSize, sizeHeap / 2);
+	assert(pageMap != nullptr);
+	assert(pageMap->pageNum == 8);
+	assert(pageMap->GetOwner(0) == PAGE_OWNER_NONE);
+
+	void* splitAddr = PointerAdd(mapBeginAddr, pageSize + pageSize / 2);
+	pageMap->SetOwner(mapBeginAddr, splitAddr, 0);
+	pageMap->SetOwner(splitAddr, mapEndAddr, 1);
+
+	assert(pageMap->Contains(mapBeginAddr) == true);
+	assert(pageMap->Contains(mapEndAddr) == false);
+	assert(pageMap->FindPageIdx(splitAddr) == 1);
+	assert(pageMap->GetOwner(0) == 0);
+	assert(pageMap->GetOwner(1) == 0);
+	assert(pageMap->GetOwner(2) == 1);
+	assert(pageMap->GetOwner(7) == 1);
+	assert(pageMap->GetOwner(8) == PAGE_OWNER_NONE);
+
+	/* The page map should not be created if there is no enough space */
+	assert(CreatePageMap(pHeapMemory, mapBeginAddr, mapEndAddr, pageSize, sizeof(PageMap)) == nullptr);
+
+	HeapFree(GetProcessHeap(), 0, pHeapMemory);
+	return true;
+}
+
+
+
+bool DynamicAllocator_UnitTest()
+{
+	const size_t 		sizeHeap = 1024 * 1024;
+
+	void* pHeapMemory = HeapAlloc(GetProcessHeap(), 0, sizeHeap);
+	assert(pHeapMemory);
+
+	const unsigned int policies[] = { 
+		POLICY_FIRST_FIT, POLICY_SEGREGATED_FIT, 
+		POLICY_FIRST_FIT | POLICY_COALESCE_ON_FREE, POLICY_SEGREGATED_FIT | POLICY_COALESCE_ON_FREE 
+	};
+	for (unsigned int policy : policies)
+	{
+		DynamicAllocator* allocator = CreateDynamicAllocator(pHeapMemory, sizeHeap, policy);
+		assert(allocator != nullptr);
+		size_t totalFreeMemory = allocator->GetTotalFreeMemory();
+
+		/* Headers are at a fixed negative offset, and physical neighbours are found by boundary tags */
+		void* ptr1 = allocator->Alloc(10);
+		void* ptr2 = allocator->Alloc(100);
+		void* ptr3 = allocator->Alloc(1000, 64);
+		assert(reinterpret_cast<uintptr_t>(ptr1) % BLOCK_ALIGNMENT == 0);
+		assert(reinterpret_cast<uintptr_t>(ptr3) % 64 == 0);
+
+		MemoryBlock* block1 = allocator->FindMemoryBlock(ptr1);
+		MemoryBlock* block2 = allocator->FindMemoryBlock(ptr2);
+		assert(block1 == PointerSub(ptr1, BLOCK_SIZE));
+		assert(block1->blockSize == BLOCK_ALIGNMENT);
+		assert(allocator->GetPrevPhysicalBlock(block1) == nullptr);
+		assert(allocator->GetNextPhysicalBlock(block1) == block2);
+		assert(allocator->GetPrevPhysicalBlock(block2) == block1);
+
+		assert(allocator->Contains(ptr2) == true);
+		assert(allocator->IsAllocated(ptr2) == true);
+		assert(allocator->Contains(PointerAdd(ptr2, BLOCK_ALIGNMENT)) == false);
+
+		/* Invalid addresses and double free should be rejected */
+		assert(allocator->Free(PointerAdd(ptr2, BLOCK_ALIGNMENT)) == false);
+		assert(allocator->Free(ptr2) == true);
+		assert(allocator->IsAllocated(ptr2) == false);
+		assert(allocator->Contains(ptr2) == true);
+		assert(allocator->Free(ptr2) == false);
+
+		/* Sizes that overflow when they are aligned, or together with the alignment, never fit */
+		assert(allocator->Alloc(SIZE_MAX) == nullptr);
+		assert(allocator->Alloc(SIZE_MAX - 8) == nullptr);
+		assert(allocator->Alloc(SIZE_MAX - 64, 64) == nullptr);
+		assert(allocator->Alloc(SIZE_MAX - 16, 4096) == nullptr);
+
+		/* A freed block of the same size is reused */
+		assert(allocator->Alloc(100) == ptr2);
+		assert(allocator->Free(ptr2) == true);
+
+		assert(allocator->Free(ptr1) == true);
+		assert(allocator->Free(ptr3) == true);
+		allocator->Collect();
+		assert(allocator->GetTotalFreeMemory() == totalFreeMemory);
+		assert(allocator->GetLargestFreeBlock() == totalFreeMemory);
+
+		/* Fill the allocator up and make sure every byte comes back after collecting */
+		void* ptrs[1024];
+		size_t ptrNum = 0;
+		while (ptrNum < 1024)
+		{
+			ptrs[ptrNum] = allocator->Alloc(16 + (ptrNum * 37) % 2000);
+			if (ptrs[ptrNum] == nullptr)
+				break;
+			ptrNum++;
+		}
+		for (size_t i = 0; i < ptrNum; i += 2)
+			assert(allocator->Free(ptrs[i]) == true);
+		for (size_t i = 1; i < ptrNum; i += 2)
+			assert(allocator->Free(ptrs[i]) == true);
+		if (policy & POLICY_COALESCE_ON_FREE)
+			assert(allocator->GetLargestFreeBlock() == totalFreeMemory);
+		allocator->Collect();
+		assert(allocator->GetLargestFreeBlock() == totalFreeMemory);
+	}
+
+	HeapFree(GetProcessHeap(), 0, pHeapMemory);
+	return true;
 }
\ No newline at end of file
@@ -0,0 +1,221 @@
+#pragma once
+#include <stdint.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+extern "C" __declspec(dllimport) int __stdcall SwitchToThread();
+#else
+#include <sched.h>
+#endif
+
+
+namespace Utility
+{
+
+/**
+* @brief Atomic operations on 32-bit and 64-bit integers. They are thin wrappers of compiler
+*		 intrinsics, so that memory allocator does not depend on the C++ standard library. All
+*		 operations are sequentially consistent.
+*/
+
+template <typename T>
+inline T AtomicLoad(const volatile T* ptr)
+{
+#if defined(_MSC_VER)
+	T value = *ptr;
+	_ReadWriteBarrier();
+	return value;
+#else
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+#endif
+}
+
+
+/**
+* @brief Replace the value at "ptr" with "desired" if it equals to "expected". 
+* 
+* @return If the value is replaced, return true. Otherwise, return false and the current value 
+*		  is assigned to parameter "expected".
+*/
+template <typename T>
+inline bool AtomicCompareExchange(volatile T* ptr, T& expected, T desired)
+{
+#if defined(_MSC_VER)
+	T prev;
+	if (sizeof(T) == 4)
+		prev = static_cast<T>(_InterlockedCompareExchange(reinterpret_cast<volatile long*>(ptr), static_cast<long>(desired), static_cast<long>(expected)));
+	else
+		prev = static_cast<T>(_InterlockedCompareExchange64(reinterpret_cast<volatile __int64*>(ptr), static_cast<__int64>(desired), static_cast<__int64>(expected)));
+
+	if (prev == expected)
+		return true;
+	expected = prev;
+	return false;
+#else
+	return __atomic_compare_exchange_n(ptr, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+
+template <typename T>
+inline T AtomicExchange(volatile T* ptr, T value)
+{
+#if defined(_MSC_VER)
+	if (sizeof(T) == 4)
+		return static_cast<T>(_InterlockedExchange(reinterpret_cast<volatile long*>(ptr), static_cast<long>(value)));
+	else
+		return static_cast<T>(_InterlockedExchange64(reinterpret_cast<volatile __int64*>(ptr), static_cast<__int64>(value)));
+#else
+	return __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+
+template <typename T>
+inline void AtomicStore(volatile T* ptr, T value)
+{
+#if defined(_MSC_VER)
+	AtomicExchange(ptr, value);
+#else
+	__atomic_store_n(ptr, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+
+/**
+* @brief Add "value" to the value at "ptr".
+* 
+* @return The value before the addition.
+*/
+template <typename T>
+inline T AtomicFetchAdd(volatile T* ptr, T value)
+{
+#if defined(_MSC_VER)
+	if (sizeof(T) == 4)
+		return static_cast<T>(_InterlockedExchangeAdd(reinterpret_cast<volatile long*>(ptr), static_cast<long>(value)));
+	else
+		return static_cast<T>(_InterlockedExchangeAdd64(reinterpret_cast<volatile __int64*>(ptr), static_cast<__int64>(value)));
+#else
+	return __atomic_fetch_add(ptr, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+
+/**
+* @brief Bitwise OR (or AND) "value" into the value at "ptr".
+* 
+* @return The value before the operation.
+*/
+template <typename T>
+inline T AtomicFetchOr(volatile T* ptr, T value)
+{
+#if defined(_MSC_VER)
+	if (sizeof(T) == 4)
+		return static_cast<T>(_InterlockedOr(reinterpret_cast<volatile long*>(ptr), static_cast<long>(value)));
+	else
+		return static_cast<T>(_InterlockedOr64(reinterpret_cast<volatile __int64*>(ptr), static_cast<__int64>(value)));
+#else
+	return __atomic_fetch_or(ptr, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+
+template <typename T>
+inline T AtomicFetchAnd(volatile T* ptr, T value)
+{
+#if defined(_MSC_VER)
+	if (sizeof(T) == 4)
+		return static_cast<T>(_InterlockedAnd(reinterpret_cast<volatile long*>(ptr), static_cast<long>(value)));
+	else
+		return static_cast<T>(_InterlockedAnd64(reinterpret_cast<volatile __int64*>(ptr), static_cast<__int64>(value)));
+#else
+	return __atomic_fetch_and(ptr, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+
+/**
+* @brief Hint the processor that the current thread is spinning.
+*/
+inline void CpuRelax()
+{
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+	_mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#endif
+}
+
+
+/* The number of times a waiting thread spins before it gives its time slice away */
+const uint32_t SPIN_COUNT_BEFORE_YIELD = 64;
+
+
+/**
+* @brief Give the rest of the time slice of the current thread to another thread that is ready.
+*/
+inline void YieldThread()
+{
+#if defined(_MSC_VER)
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+
+/**
+* @brief Wait once more in a spin loop. The first waits spin on the processor, and the later ones
+*		 yield, since the thread that is waited for may be preempted and can not run while the
+*		 waiting threads take its processor.
+*
+* @param spinCount -- The number of waits so far, 0 when the loop starts;
+*/
+inline void SpinWait(uint32_t& spinCount)
+{
+	if (spinCount < SPIN_COUNT_BEFORE_YIELD)
+	{
+		spinCount++;
+		CpuRelax();
+	}
+	else
+		YieldThread();
+}
+
+
+/**
+* @brief SpinLock is a minimal lock for the short critical sections of memory allocator. It
+*		 does not allocate memory, so it can be used inside the allocator itself. A thread that
+*		 waits for the lock long yields its processor, see SpinWait().
+*
+* @param locked -- 1 if the lock is held by a thread, otherwise 0;
+*/
+class SpinLock
+{
+public:
+	volatile uint32_t locked;
+
+	inline SpinLock() : locked(0) {}
+
+	inline bool TryLock()
+	{
+		uint32_t expected = 0;
+		return AtomicCompareExchange(&this->locked, expected, static_cast<uint32_t>(1));
+	}
+
+	inline void Lock()
+	{
+		uint32_t spinCount = 0;
+		while (!this->TryLock())
+		{
+			while (AtomicLoad(&this->locked) != 0)
+				SpinWait(spinCount);
+		}
+	}
+
+	inline void Unlock()
+	{
+		AtomicStore(&this->locked, static_cast<uint32_t>(0));
+	}
+};
+
+}
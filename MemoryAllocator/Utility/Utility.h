@@ -1,28 +1,96 @@
-#pragma once
-#include <stdlib.h>
-#include <stdio.h>
-
-namespace Utility
-{
-
-inline void* PointerAdd(const void* ptr, size_t size)
-{
-	return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(ptr) + size);
-}
-
-inline void* PointerAdd(const void* ptr1, const void* ptr2)
-{
-	return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(ptr1) + reinterpret_cast<uintptr_t>(ptr2));
-}
-
-inline void* PointerSub(const void* ptr, size_t size)
-{
-	return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(ptr) - size);
-}
-
-inline void* PointerSub(const void* ptr1, const void* ptr2)
-{
-	return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(ptr1) - reinterpret_cast<uintptr_t>(ptr2));
-}
-
-}
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace Utility
+{
+
+/* The size of a cache line on the CPUs that the memory allocator runs on */
+const size_t CACHE_LINE_SIZE = 64;
+
+
+inline void* PointerAdd(const void* ptr, size_t size)
+{
+	return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(ptr) + size);
+}
+
+inline void* PointerAdd(const void* ptr1, const void* ptr2)
+{
+	return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(ptr1) + reinterpret_cast<uintptr_t>(ptr2));
+}
+
+inline void* PointerSub(const void* ptr, size_t size)
+{
+	return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(ptr) - size);
+}
+
+inline void* PointerSub(const void* ptr1, const void* ptr2)
+{
+	return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(ptr1) - reinterpret_cast<uintptr_t>(ptr2));
+}
+
+
+/**
+* @brief Find the index of the least significant set bit of the given value. Return -1 if 
+*		 the value is zero.
+*/
+inline int FindFirstSetBit(size_t value)
+{
+	if (value == 0)
+		return -1;
+
+#if defined(_MSC_VER) && defined(_WIN64)
+	unsigned long idx;
+	_BitScanForward64(&idx, value);
+	return static_cast<int>(idx);
+#elif defined(_MSC_VER)
+	unsigned long idx;
+	_BitScanForward(&idx, value);
+	return static_cast<int>(idx);
+#else
+	return __builtin_ctzll(static_cast<unsigned long long>(value));
+#endif
+}
+
+/**
+* @brief Find the index of the most significant set bit of the given value. Return -1 if 
+*		 the value is zero.
+*/
+inline int FindLastSetBit(size_t value)
+{
+	if (value == 0)
+		return -1;
+
+#if defined(_MSC_VER) && defined(_WIN64)
+	unsigned long idx;
+	_BitScanReverse64(&idx, value);
+	return static_cast<int>(idx);
+#elif defined(_MSC_VER)
+	unsigned long idx;
+	_BitScanReverse(&idx, value);
+	return static_cast<int>(idx);
+#else
+	return 63 - __builtin_clzll(static_cast<unsigned long long>(value));
+#endif
+}
+
+/**
+* @brief Count the set bits of the given value.
+*/
+inline int CountSetBits(size_t value)
+{
+#if defined(_MSC_VER)
+	int count = 0;
+	for (; value != 0; value &= value - 1)
+		count++;
+	return count;
+#else
+	return __builtin_popcountll(static_cast<unsigned long long>(value));
+#endif
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,278 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE	/* mremap */
+#endif
+#include "VirtualMemory.h"
+#include "../Utility/Atomic.h"
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace Utility;
+
+
+/* The page sizes never change, so they are only asked from the OS once */
+static size_t virtualPageSize = 0;
+static size_t hugePageSize = 0;
+
+/* Used when the OS does not report its huge page size */
+static const size_t DEFAULT_HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+
+size_t GetVirtualPageSize()
+{
+	size_t pageSize = AtomicLoad(&virtualPageSize);
+	if (pageSize != 0)
+		return pageSize;
+
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	pageSize = static_cast<size_t>(info.dwPageSize);
+#else
+	long osPageSize = sysconf(_SC_PAGESIZE);
+	pageSize = osPageSize > 0 ? static_cast<size_t>(osPageSize) : 4096;
+#endif
+	AtomicStore(&virtualPageSize, pageSize);
+	return pageSize;
+}
+
+
+size_t GetHugePageSize()
+{
+	size_t pageSize = AtomicLoad(&hugePageSize);
+	if (pageSize != 0)
+		return pageSize;
+
+#if defined(_WIN32)
+	pageSize = static_cast<size_t>(GetLargePageMinimum());
+#else
+	FILE* file = fopen("/proc/meminfo", "r");
+	if (file != nullptr)
+	{
+		char line[128];
+		size_t sizeKB;
+		while (fgets(line, sizeof(line), file) != nullptr)
+		{
+			if (sscanf(line, "Hugepagesize: %zu kB", &sizeKB) == 1)
+			{
+				pageSize = sizeKB * 1024;
+				break;
+			}
+		}
+		fclose(file);
+	}
+#endif
+	if (pageSize == 0 || (pageSize & (pageSize - 1)) != 0)
+		pageSize = DEFAULT_HUGE_PAGE_SIZE;
+	AtomicStore(&hugePageSize, pageSize);
+	return pageSize;
+}
+
+
+void* ReserveVirtualMemory(size_t size, size_t alignment)
+{
+	if (alignment <= GetVirtualPageSize())
+	{
+#if defined(_WIN32)
+		return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+		/* Reserved pages are not accessible and not counted as committed until they are committed */
+		void* addr = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		return addr != MAP_FAILED ? addr : nullptr;
+#endif
+	}
+
+	/* Reserve more than needed and keep the aligned part */
+	if (size + alignment < size)
+		return nullptr;
+	uint8_t* addr = static_cast<uint8_t*>(ReserveVirtualMemory(size + alignment));
+	if (addr == nullptr)
+		return nullptr;
+	uint8_t* alignedAddr = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(addr) + alignment - 1) & ~(alignment - 1));
+#if defined(_WIN32)
+	/* A reservation can only be released as a whole, so release it and reserve the aligned part
+	 * again. Another thread may take the range in between, so try a few times */
+	for (int i = 0; i < 8 && addr != nullptr; i++)
+	{
+		VirtualFree(addr, 0, MEM_RELEASE);
+		if (VirtualAlloc(alignedAddr, size, MEM_RESERVE, PAGE_NOACCESS) != nullptr)
+			return alignedAddr;
+		addr = static_cast<uint8_t*>(ReserveVirtualMemory(size + alignment));
+		if (addr != nullptr)
+			alignedAddr = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(addr) + alignment - 1) & ~(alignment - 1));
+	}
+	if (addr != nullptr)
+		VirtualFree(addr, 0, MEM_RELEASE);
+	return nullptr;
+#else
+	if (alignedAddr > addr)
+		munmap(addr, alignedAddr - addr);
+	if (alignedAddr + size < addr + size + alignment)
+		munmap(alignedAddr + size, addr + size + alignment - alignedAddr - size);
+	return alignedAddr;
+#endif
+}
+
+
+void* ReserveHugeVirtualMemory(size_t size)
+{
+#if defined(_WIN32)
+	return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+#elif defined(MAP_HUGETLB)
+	/* Huge pages are reserved from the pool when the range is mapped, so touching them later does 
+	 * not fail */
+	void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	return addr != MAP_FAILED ? addr : nullptr;
+#else
+	(void)size;
+	return nullptr;
+#endif
+}
+
+
+bool CommitVirtualMemory(void* addr, size_t size)
+{
+#if defined(_WIN32)
+	return VirtualAlloc(addr, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+	/* Pages are backed by physical memory on the first touch, so only the access is changed */
+	return mprotect(addr, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+
+void* RemapVirtualMemory(void* addr, size_t oldSize, size_t newSize, bool mayMove)
+{
+#if defined(_WIN32)
+	(void)mayMove;
+	if (newSize > oldSize)
+		return nullptr;
+	if (newSize < oldSize && VirtualFree(static_cast<uint8_t*>(addr) + newSize, oldSize - newSize, MEM_DECOMMIT) == 0)
+		return nullptr;
+	return addr;
+#elif defined(__linux__)
+	void* newAddr = mremap(addr, oldSize, newSize, mayMove ? MREMAP_MAYMOVE : 0);
+	return newAddr != MAP_FAILED ? newAddr : nullptr;
+#else
+	(void)addr;
+	(void)oldSize;
+	(void)newSize;
+	(void)mayMove;
+	return nullptr;
+#endif
+}
+
+
+bool ResetVirtualMemory(void* addr, size_t size)
+{
+#if defined(_WIN32)
+	/* Committed pages that have not been touched do not take physical memory */
+	return VirtualFree(addr, size, MEM_DECOMMIT) != 0 && VirtualAlloc(addr, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+	return madvise(addr, size, MADV_DONTNEED) == 0;
+#endif
+}
+
+
+bool AdviseHugePages(void* addr, size_t size)
+{
+#if !defined(_WIN32) && defined(MADV_HUGEPAGE)
+	return madvise(addr, size, MADV_HUGEPAGE) == 0;
+#else
+	(void)addr;
+	(void)size;
+	return false;
+#endif
+}
+
+
+bool PrefaultVirtualMemory(void* addr, size_t size)
+{
+#if !defined(_WIN32) && defined(MADV_POPULATE_WRITE)
+	if (madvise(addr, size, MADV_POPULATE_WRITE) == 0)
+		return true;
+#endif
+	/* Write each page with its own contents. Reading alone would map the shared zero page */
+	size_t pageSize = GetVirtualPageSize();
+	volatile uint8_t* bytes = static_cast<volatile uint8_t*>(addr);
+	for (size_t offset = 0; offset < size; offset += pageSize)
+		bytes[offset] = bytes[offset];
+	return true;
+}
+
+
+bool LockVirtualMemory(void* addr, size_t size)
+{
+#if defined(_WIN32)
+	return VirtualLock(addr, size) != 0;
+#else
+	return mlock(addr, size) == 0;
+#endif
+}
+
+
+bool ReleaseVirtualMemory(void* addr, size_t size)
+{
+#if defined(_WIN32)
+	(void)size;
+	return VirtualFree(addr, 0, MEM_RELEASE) != 0;
+#else
+	return munmap(addr, size) == 0;
+#endif
+}
+
+
+void* MapFile(const char* path, size_t size)
+{
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return nullptr;
+
+	/* The mapping sets the size of the file, and the view keeps the mapping and the file open */
+	uint64_t fileSize = static_cast<uint64_t>(size);
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(fileSize >> 32), static_cast<DWORD>(fileSize), nullptr);
+	void* addr = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size) : nullptr;
+	if (mapping != nullptr)
+		CloseHandle(mapping);
+	CloseHandle(file);
+	return addr;
+#else
+	int file = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file < 0)
+		return nullptr;
+
+	void* addr = ftruncate(file, static_cast<off_t>(size)) == 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0) : MAP_FAILED;
+	close(file);
+	return addr != MAP_FAILED ? addr : nullptr;
+#endif
+}
+
+
+bool UnmapFile(void* addr, size_t size, const char* path, size_t fileSize)
+{
+#if defined(_WIN32)
+	(void)size;
+	bool success = FlushViewOfFile(addr, 0) != 0;
+	success = UnmapViewOfFile(addr) != 0 && success;
+
+	HANDLE file = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER offset;
+	offset.QuadPart = static_cast<LONGLONG>(fileSize);
+	success = SetFilePointerEx(file, offset, nullptr, FILE_BEGIN) != 0 && SetEndOfFile(file) != 0 && success;
+	CloseHandle(file);
+	return success;
+#else
+	/* The pages stay in the page cache after they are unmapped, and are written back by the OS */
+	bool success = munmap(addr, size) == 0;
+	return truncate(path, static_cast<off_t>(fileSize)) == 0 && success;
+#endif
+}
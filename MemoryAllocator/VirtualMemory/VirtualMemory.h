@@ -0,0 +1,107 @@
+#pragma once
+#include <stddef.h>
+
+
+/**
+* @brief Thin wrappers of the virtual memory API of the OS (VirtualAlloc on Windows, mmap on Linux).
+*		 Address space is reserved first and backed by memory only when it is committed, so a
+*		 large range can be set aside for the heap while the memory in use follows the demand.
+*		 Reserved memory that is not committed can not be accessed. Committed memory is filled
+*		 with zero the first time it is touched. All addresses and sizes passed to these functions
+*		 should be multiples of the page size.
+*/
+
+/**
+* @brief The size of a page of virtual memory, usually 4KB.
+*/
+size_t GetVirtualPageSize();
+
+/**
+* @brief The size of a huge page, usually 2MB. It is the default huge page size of the kernel on
+*		 Linux, and the large page minimum on Windows.
+*/
+size_t GetHugePageSize();
+
+/**
+* @brief Reserve a range of address space without committing any memory.
+*
+* @param alignment -- The alignment of the starting address, a power of 2. 0 aligns it to the 
+*		 page size.
+* @return The starting address of the range. Return nullptr if the address space can not be 
+*		  reserved.
+*/
+void* ReserveVirtualMemory(size_t size, size_t alignment = 0);
+
+/**
+* @brief Reserve and commit a range backed by explicit huge pages (MAP_HUGETLB on Linux, 
+*		 MEM_LARGE_PAGES on Windows). The whole range can be accessed at once, and its pages are
+*		 never swapped out. "size" should be a multiple of GetHugePageSize(). It fails unless the
+*		 OS has enough huge pages set aside (vm.nr_hugepages on Linux), or the process holds the
+*		 lock pages privilege on Windows. Release it by ReleaseVirtualMemory().
+*/
+void* ReserveHugeVirtualMemory(size_t size);
+
+/**
+* @brief Back a part of a reserved range with memory, so that it can be read and written.
+*		 Committing memory that is already committed does nothing.
+*/
+bool CommitVirtualMemory(void* addr, size_t size);
+
+/**
+* @brief Resize a committed range that was reserved and committed as a whole, keeping its contents.
+*		 The pages are moved to another address if there is no room after them and "mayMove" is 
+*		 set, without copying the data (mremap on Linux). Memory added to the range is zero. On
+*		 Windows, a range can only shrink in place, and the pages after the new end are 
+*		 decommitted.
+*
+* @return The new starting address of the range, or nullptr if it can not be resized, in which 
+*		  case the range is left as it was.
+*/
+void* RemapVirtualMemory(void* addr, size_t oldSize, size_t newSize, bool mayMove);
+
+/**
+* @brief Give the physical memory behind committed pages back to the OS, while the pages stay 
+*		 committed and can still be accessed. They read as zero the next time they are touched, 
+*		 so their contents are lost. It is MADV_DONTNEED on Linux, and a decommit followed by a
+*		 commit on Windows.
+*/
+bool ResetVirtualMemory(void* addr, size_t size);
+
+/**
+* @brief Ask the OS to back a range with transparent huge pages (MADV_HUGEPAGE on Linux), so that
+*		 each aligned huge page that is committed as a whole takes a single TLB entry. Return false
+*		 if the OS does not support it, which is always the case on Windows.
+*/
+bool AdviseHugePages(void* addr, size_t size);
+
+/**
+* @brief Touch every page of committed memory for writing, so that later accesses do not take page
+*		 faults. The contents are not changed. Pages that may be written by other threads should 
+*		 not be passed.
+*/
+bool PrefaultVirtualMemory(void* addr, size_t size);
+
+/**
+* @brief Lock committed memory into physical memory, so that it is never paged out. The pages are
+*		 faulted in as well. It is limited by RLIMIT_MEMLOCK on Linux and by the working set size 
+*		 on Windows. The pages are unlocked when they are released.
+*/
+bool LockVirtualMemory(void* addr, size_t size);
+
+/**
+* @brief Return a whole range reserved by ReserveVirtualMemory() to the OS, including the memory
+*		 committed in it.
+*/
+bool ReleaseVirtualMemory(void* addr, size_t size);
+
+/**
+* @brief Create a file of "size" bytes, or empty it if it exists, and map it into memory for reading
+*		 and writing. The memory is zero at first, and what is written to it goes to the file. 
+*		 Return nullptr if the file can not be created or mapped.
+*/
+void* MapFile(const char* path, size_t size);
+
+/**
+* @brief Unmap a file mapped by MapFile(), and cut it to its first "fileSize" bytes.
+*/
+bool UnmapFile(void* addr, size_t size, const char* path, size_t fileSize);